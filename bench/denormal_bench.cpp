@@ -0,0 +1,172 @@
+// Standalone benchmark of what denormals cost while a reverb tail decays,
+// with and without `AnaglyphFloatMode` flushing them.
+// Anaglyph itself is a closed dll, so this runs a stand-in plugin instead:
+// a small Freeverb-style reverb (damped combs into allpasses), which decays
+// the same way any recursive filter does once its input goes silent.
+// This is not part of the extension. Build and run with e.g.
+//   g++ -O2 -Isrc bench/denormal_bench.cpp -o denormal_bench && ./denormal_bench
+//   cl /O2 /EHsc /Isrc bench\denormal_bench.cpp
+// (Not with -ffast-math, which flushes denormals for the whole program and
+// so hides the difference.)
+// Optionally pass the block size (default 512) and the seconds of tail to
+// run (default 20). With the default settings, the stand-in reaches
+// denormals after about 10 seconds.
+
+#include "anaglyph_float_mode.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace godot;
+
+static const int mix_rate = 48000;
+
+// The stand-in plugin. Mono in, stereo out, just like a reverb send.
+class StandInReverb {
+	struct Comb {
+		std::vector<float> buffer;
+		int index = 0;
+		float damped = 0;
+	};
+	struct Allpass {
+		std::vector<float> buffer;
+		int index = 0;
+	};
+
+	Comb combs[2][8];
+	Allpass allpasses[2][4];
+	float feedback = 0.84f;
+	float damping = 0.2f;
+
+	float run_comb(Comb& comb, float in) {
+		float out = comb.buffer[comb.index];
+		comb.damped = out * (1 - damping) + comb.damped * damping;
+		comb.buffer[comb.index] = in + comb.damped * feedback;
+		comb.index = (comb.index + 1) % (int)comb.buffer.size();
+		return out;
+	}
+
+	static float run_allpass(Allpass& allpass, float in) {
+		float delayed = allpass.buffer[allpass.index];
+		float out = delayed - in;
+		allpass.buffer[allpass.index] = in + delayed * 0.5f;
+		allpass.index = (allpass.index + 1) % (int)allpass.buffer.size();
+		return out;
+	}
+
+public:
+	StandInReverb() {
+		// Freeverb's tunings (at 44.1kHz), with the usual stereo spread.
+		const int comb_lengths[8] = { 1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617 };
+		const int allpass_lengths[4] = { 556, 441, 341, 225 };
+		for (int c = 0; c < 2; c++) {
+			for (int i = 0; i < 8; i++) {
+				combs[c][i].buffer.assign(comb_lengths[i] + 23 * c, 0.0f);
+			}
+			for (int i = 0; i < 4; i++) {
+				allpasses[c][i].buffer.assign(allpass_lengths[i] + 23 * c, 0.0f);
+			}
+		}
+	}
+
+	void process(const float* in, float* out, int count) {
+		for (int f = 0; f < count; f++) {
+			for (int c = 0; c < 2; c++) {
+				float sum = 0;
+				for (int i = 0; i < 8; i++) {
+					sum += run_comb(combs[c][i], in[f] * 0.015f);
+				}
+				for (int i = 0; i < 4; i++) {
+					sum = run_allpass(allpasses[c][i], sum);
+				}
+				out[2 * f + c] = sum;
+			}
+		}
+	}
+};
+
+// Half a second of noise, then silence for `tail_seconds`. Returns the
+// nanoseconds every block of the tail took.
+static std::vector<double> run(bool flush, int block, int tail_seconds) {
+	AnaglyphFloatMode::set_enabled(flush);
+	StandInReverb reverb;
+	std::vector<float> in(block), out(2 * block);
+
+	srand(1234);
+	int burst_blocks = mix_rate / 2 / block;
+	for (int b = 0; b < burst_blocks; b++) {
+		for (int i = 0; i < block; i++) {
+			in[i] = rand() / (float)RAND_MAX * 2 - 1;
+		}
+		AnaglyphFloatMode::Scope scope;
+		reverb.process(in.data(), out.data(), block);
+	}
+
+	for (int i = 0; i < block; i++) {
+		in[i] = 0;
+	}
+	int tail_blocks = tail_seconds * mix_rate / block;
+	std::vector<double> times(tail_blocks);
+	for (int b = 0; b < tail_blocks; b++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		{
+			// The same thing the bridge does around every process call.
+			AnaglyphFloatMode::Scope scope;
+			reverb.process(in.data(), out.data(), block);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		times[b] = std::chrono::duration<double, std::nano>(end - start).count();
+	}
+	return times;
+}
+
+int main(int argc, char** argv) {
+	int block = argc > 1 ? atoi(argv[1]) : 512;
+	int tail_seconds = argc > 2 ? atoi(argv[2]) : 20;
+	if (block <= 0 || tail_seconds <= 0) {
+		printf("usage: denormal_bench [block size] [tail seconds]\n");
+		return 1;
+	}
+
+#if defined(GDANAGLYPH_FLOAT_MODE_SSE)
+	const char* mode = "FTZ+DAZ (MXCSR)";
+#elif defined(GDANAGLYPH_FLOAT_MODE_ARM64)
+	const char* mode = "FZ (FPCR)";
+#else
+	const char* mode = "nothing (unsupported platform)";
+#endif
+	printf("%d frame blocks at %d Hz, flushing sets %s\n", block, mix_rate, mode);
+
+	std::vector<double> off = run(false, block, tail_seconds);
+	std::vector<double> on = run(true, block, tail_seconds);
+
+	// A realtime budget to compare against.
+	double budget_ns = block * 1e9 / mix_rate;
+	printf("per-block cost during the tail (budget %.0f us per block):\n", budget_ns / 1000);
+	printf("  tail    flush off (avg/max)    flush on (avg/max)\n");
+	int blocks_per_second = mix_rate / block;
+	double off_total = 0, on_total = 0, off_peak = 0, on_peak = 0;
+	for (int s = 0; s < tail_seconds; s++) {
+		double off_sum = 0, on_sum = 0, off_max = 0, on_max = 0;
+		for (int b = s * blocks_per_second; b < (s + 1) * blocks_per_second; b++) {
+			off_sum += off[b];
+			on_sum += on[b];
+			off_max = fmax(off_max, off[b]);
+			on_max = fmax(on_max, on[b]);
+		}
+		off_total += off_sum;
+		on_total += on_sum;
+		off_peak = fmax(off_peak, off_max);
+		on_peak = fmax(on_peak, on_max);
+		printf("  %2d-%2ds  %8.1f / %8.1f us    %8.1f / %8.1f us\n", s, s + 1,
+			off_sum / blocks_per_second / 1000, off_max / 1000,
+			on_sum / blocks_per_second / 1000, on_max / 1000);
+	}
+	int counted = tail_seconds * blocks_per_second;
+	printf("overall: %.1f us/block off, %.1f us/block on (%.1fx), worst block %.1f us off, %.1f us on\n",
+		off_total / counted / 1000, on_total / counted / 1000, off_total / on_total, off_peak / 1000, on_peak / 1000);
+	return 0;
+}
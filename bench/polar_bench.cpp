@@ -0,0 +1,138 @@
+// Standalone microbenchmark of the batched polar position kernel against a
+// scalar copy of `AnaglyphHelpers::calculate_polar_position`.
+// This is not part of the extension. Build and run with e.g.
+//   g++ -O2 -Isrc bench/polar_bench.cpp -o polar_bench && ./polar_bench
+//   cl /O2 /EHsc /Isrc bench\polar_bench.cpp
+// and optionally pass the amount of sources (default 500).
+
+#include "anaglyph_simd.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace godot;
+
+struct Quat {
+	float x, y, z, w;
+};
+
+// Same math as the scalar helper (Quaternion::xform_inv, atan2f, asinf),
+// without the godot types.
+static void scalar_polar(const float* listener, Quat q, float sx, float sy, float sz, float* out) {
+	float vx = sx - listener[0];
+	float vy = sy - listener[1];
+	float vz = sz - listener[2];
+	// xform_inv = rotate by the conjugate.
+	float ux = -q.x, uy = -q.y, uz = -q.z;
+	float cx = uy * vz - uz * vy;
+	float cy = uz * vx - ux * vz;
+	float cz = ux * vy - uy * vx;
+	float ccx = uy * cz - uz * cy;
+	float ccy = uz * cx - ux * cz;
+	float ccz = ux * cy - uy * cx;
+	float rx = vx + 2 * (q.w * cx + ccx);
+	float ry = vy + 2 * (q.w * cy + ccy);
+	float rz = -(vz + 2 * (q.w * cz + ccz));
+
+	float dist = sqrtf(rx * rx + ry * ry + rz * rz);
+	if (dist < 0.001f) {
+		dist = 0.001f;
+	}
+	float azim = (rx == 0 && rz == 0) ? 0 : atan2f(rx, rz);
+	float elev = asinf(ry / dist);
+	const float rad2deg = 57.2957805f;
+	out[0] = azim * rad2deg;
+	out[1] = elev * rad2deg;
+	out[2] = dist;
+}
+
+static float frand(float lo, float hi) {
+	return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+int main(int argc, char** argv) {
+	int count = argc > 1 ? atoi(argv[1]) : 500;
+	const int iterations = 20000;
+	srand(1234);
+
+	std::vector<float> px(count), py(count), pz(count);
+	for (int i = 0; i < count; i++) {
+		px[i] = frand(-20, 20);
+		py[i] = frand(-5, 5);
+		pz[i] = frand(-20, 20);
+	}
+	float listener[3] = { 1.5f, 1.7f, -3.0f };
+	// Some arbitrary normalized rotation.
+	Quat q = { 0.1f, 0.7f, -0.2f, 0.5f };
+	float len = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+	q.x /= len; q.y /= len; q.z /= len; q.w /= len;
+
+	AnaglyphSIMD::ListenerFrame frame;
+	frame.position[0] = listener[0];
+	frame.position[1] = listener[1];
+	frame.position[2] = listener[2];
+	AnaglyphSIMD::set_rotation(frame, -q.x, -q.y, -q.z, q.w);
+
+	std::vector<float> ref(count * 3);
+	std::vector<float> az(count), el(count), di(count);
+
+	// Keep the compiler from optimizing things away.
+	volatile float sink = 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; it++) {
+		for (int i = 0; i < count; i++) {
+			scalar_polar(listener, q, px[i], py[i], pz[i], &ref[i * 3]);
+		}
+		sink = sink + ref[(it % count) * 3];
+	}
+	auto mid = std::chrono::high_resolution_clock::now();
+	for (int it = 0; it < iterations; it++) {
+		AnaglyphSIMD::cartesian_to_polar(frame, px.data(), py.data(), pz.data(), az.data(), el.data(), di.data(), count);
+		sink = sink + az[it % count];
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	double scalar_ns = std::chrono::duration<double, std::nano>(mid - start).count() / ((double)iterations * count);
+	double batch_ns = std::chrono::duration<double, std::nano>(end - mid).count() / ((double)iterations * count);
+
+	float max_angle_error = 0;
+	float max_distance_error = 0;
+	for (int i = 0; i < count; i++) {
+		float da = fabsf(az[i] - ref[i * 3]);
+		// Don't count +180 vs -180 as an error.
+		if (da > 180) {
+			da = 360 - da;
+		}
+		float de = fabsf(el[i] - ref[i * 3 + 1]);
+		float dd = fabsf(di[i] - ref[i * 3 + 2]) / ref[i * 3 + 2];
+		max_angle_error = fmaxf(max_angle_error, fmaxf(da, de));
+		max_distance_error = fmaxf(max_distance_error, dd);
+	}
+
+	// And the atan2 approximation by itself, over the whole circle.
+	float max_atan_error = 0;
+	for (int i = 0; i < 1000000; i++) {
+		float angle = -3.14159265f + 6.2831853f * (i / 1000000.0f);
+		float y = sinf(angle) * 3.0f;
+		float x = cosf(angle) * 3.0f;
+		max_atan_error = fmaxf(max_atan_error, fabsf(AnaglyphSIMD::atan2_approx(y, x) - atan2f(y, x)));
+	}
+
+#if defined(GDANAGLYPH_SIMD_SSE2)
+	const char* path = "SSE2";
+#elif defined(GDANAGLYPH_SIMD_NEON)
+	const char* path = "NEON";
+#else
+	const char* path = "scalar";
+#endif
+	printf("%d sources, %s kernel\n", count, path);
+	printf("scalar helper: %8.2f ns/source\n", scalar_ns);
+	printf("batched:       %8.2f ns/source (%.1fx)\n", batch_ns, scalar_ns / batch_ns);
+	printf("max angle error: %g deg, max relative distance error: %g\n", max_angle_error, max_distance_error);
+	printf("max atan2 error: %g rad\n", max_atan_error);
+	return sink == 12345.0f ? 1 : 0;
+}
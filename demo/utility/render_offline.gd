@@ -0,0 +1,50 @@
+## Renders a sound binaurally to a .wav file from the command line, without an audio device.
+##
+## Usage:
+## [codeblock]
+## godot --headless --path demo -s res://utility/render_offline.gd -- \
+##     --stream=res://some_sound.wav --out=user://render.wav \
+##     [--settings=res://some_settings.tres] [--from=x,y,z] [--to=x,y,z] [--tail=1.0]
+## [/codeblock]
+## The sound moves in a straight line from [code]--from[/code] to [code]--to[/code] over its
+## length. Positions are relative to the listener, who looks towards -Z.
+extends SceneTree
+
+func _init() -> void:
+	var args := {}
+	for arg in OS.get_cmdline_user_args():
+		var parts := arg.trim_prefix("--").split("=", true, 1)
+		args[parts[0]] = parts[1] if len(parts) > 1 else ""
+
+	if not args.has("stream") or not args.has("out"):
+		printerr("Usage: -- --stream=<res path> --out=<path> [--settings=<res path>] [--from=x,y,z] [--to=x,y,z] [--tail=seconds]")
+		quit(1)
+		return
+
+	var stream : AudioStream = load(args["stream"])
+	var settings : AnaglyphEffectData = load(args["settings"]) if args.has("settings") else null
+	var from := _parse_vector(args.get("from", "0,0,-1"))
+	var to := _parse_vector(args.get("to", args.get("from", "0,0,-1")))
+	var length := stream.get_length() if stream != null else 0.0
+
+	var result := AnaglyphOfflineRenderer.render(
+		stream,
+		settings,
+		PackedFloat32Array([0, length]),
+		PackedVector3Array([from, to]),
+		args["out"],
+		float(args.get("tail", "1.0"))
+	)
+	if result.is_empty():
+		quit(1)
+		return
+	print("Rendered %.2fs in %.2fs (%.1fx realtime) to %s" % [
+		result["duration"], result["elapsed"], result["realtime_factor"], args["out"]
+	])
+	quit(0)
+
+func _parse_vector(text : String) -> Vector3:
+	var parts := text.split(",")
+	if len(parts) != 3:
+		return Vector3(0, 0, -1)
+	return Vector3(float(parts[0]), float(parts[1]), float(parts[2]))
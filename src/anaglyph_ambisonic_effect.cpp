@@ -0,0 +1,277 @@
+#include "anaglyph_ambisonic_effect.h"
+#include "anaglyph_dll_bridge.h"
+#include "anaglyph_float_mode.h"
+#include "anaglyph_simd.h"
+#include "helpers.h"
+
+#include <godot_cpp/classes/audio_server.hpp>
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/core/math.hpp>
+#include <string.h>
+
+using namespace godot;
+
+float AnaglyphAmbisonicField::buffer[AnaglyphAmbisonics::max_channels * AnaglyphAmbisonicField::max_frames] = {};
+int AnaglyphAmbisonicField::order = 2;
+bool AnaglyphAmbisonicField::written = false;
+uint64_t AnaglyphAmbisonicField::consumed_usec = 0;
+
+// If the decoder hasn't consumed the field for this long, it's not coming.
+static const uint64_t stale_usec = 100000;
+
+void AnaglyphAmbisonicField::set_order(int p_order) {
+	p_order = CLAMP(p_order, 1, AnaglyphAmbisonics::max_order);
+	if (p_order == order) {
+		return;
+	}
+	// (So that encoders and decoder agree within a mix step.)
+	AudioServer::get_singleton()->lock();
+	order = p_order;
+	AudioServer::get_singleton()->unlock();
+}
+
+int AnaglyphAmbisonicField::get_order() {
+	return order;
+}
+
+int AnaglyphAmbisonicField::get_channel_count() {
+	return AnaglyphAmbisonics::channel_count(order);
+}
+
+void AnaglyphAmbisonicField::begin_write() {
+	uint64_t now = Time::get_singleton()->get_ticks_usec();
+	if (now - consumed_usec > stale_usec) {
+		// Whatever's in here was never heard, and never will be.
+		clear(max_frames);
+		consumed_usec = now;
+	}
+	written = true;
+}
+
+bool AnaglyphAmbisonicField::consume() {
+	consumed_usec = Time::get_singleton()->get_ticks_usec();
+	bool was_written = written;
+	written = false;
+	return was_written;
+}
+
+float* AnaglyphAmbisonicField::get_channel(int channel) {
+	return buffer + channel * max_frames;
+}
+
+void AnaglyphAmbisonicField::clear(int frames) {
+	frames = MIN(frames, max_frames);
+	// All of them, as the order may have changed halfway.
+	for (int c = 0; c < AnaglyphAmbisonics::max_channels; c++) {
+		memset(buffer + c * max_frames, 0, frames * sizeof(float));
+	}
+}
+
+AnaglyphAmbisonicEncoderEffectInstance::AnaglyphAmbisonicEncoderEffectInstance() { }
+
+AnaglyphAmbisonicEncoderEffectInstance::~AnaglyphAmbisonicEncoderEffectInstance() { }
+
+void AnaglyphAmbisonicEncoderEffectInstance::_bind_methods() { }
+
+void AnaglyphAmbisonicEncoderEffectInstance::_process(const void* p_src_frames, AudioFrame* p_dst_frames, int32_t p_frame_count) {
+	AnaglyphFloatMode::Scope flush;
+	base->process((const AudioFrame*)p_src_frames, p_dst_frames, p_frame_count);
+}
+
+AnaglyphAmbisonicEncoderEffect::AnaglyphAmbisonicEncoderEffect() {
+	azimuth = 0;
+	elevation = 0;
+	reset_requested = false;
+	for (int c = 0; c < AnaglyphAmbisonics::max_channels; c++) {
+		gains[c] = 0;
+	}
+	gains_order = 0;
+}
+
+AnaglyphAmbisonicEncoderEffect::~AnaglyphAmbisonicEncoderEffect() { }
+
+Ref<AudioEffectInstance> AnaglyphAmbisonicEncoderEffect::_instantiate() {
+	Ref<AnaglyphAmbisonicEncoderEffectInstance> ins;
+	ins.instantiate();
+	ins->base = Ref<AnaglyphAmbisonicEncoderEffect>(this);
+
+	return ins;
+}
+
+void AnaglyphAmbisonicEncoderEffect::process(const AudioFrame* src, AudioFrame* dst, int count) {
+	if (reset_requested) {
+		reset_requested = false;
+		// Ramping up from nothing is the fade-in.
+		for (int c = 0; c < AnaglyphAmbisonics::max_channels; c++) {
+			gains[c] = 0;
+		}
+		gains_order = AnaglyphAmbisonicField::get_order();
+	}
+
+	int order = AnaglyphAmbisonicField::get_order();
+	int channels = AnaglyphAmbisonics::channel_count(order);
+	float target[AnaglyphAmbisonics::max_channels];
+	AnaglyphAmbisonics::encode(order, azimuth, elevation, target);
+	if (order != gains_order) {
+		// Nothing sensible to ramp from. This only happens when the order
+		// changes, which drops a block anyway.
+		for (int c = 0; c < channels; c++) {
+			gains[c] = target[c];
+		}
+		gains_order = order;
+	}
+
+	int frames = MIN(count, (int)AnaglyphAmbisonicField::max_frames);
+	for (int i = 0; i < frames; i++) {
+		mono[i] = (src[i].left + src[i].right) * 0.5f;
+	}
+	AnaglyphAmbisonicField::begin_write();
+	for (int c = 0; c < channels; c++) {
+		float* field = AnaglyphAmbisonicField::get_channel(c);
+		AnaglyphSIMD::scale_accumulate(mono, gains[c], target[c], field, frames);
+		gains[c] = target[c];
+	}
+
+	// All sound comes out of the decode bus.
+	for (int i = 0; i < count; i++) {
+		dst[i].left = 0;
+		dst[i].right = 0;
+	}
+}
+
+void AnaglyphAmbisonicEncoderEffect::set_azimuth(const float degrees) {
+	azimuth = CLAMP(degrees, -180, 180);
+}
+
+float AnaglyphAmbisonicEncoderEffect::get_azimuth() const {
+	return azimuth;
+}
+
+void AnaglyphAmbisonicEncoderEffect::set_elevation(const float degrees) {
+	elevation = CLAMP(degrees, -90, 90);
+}
+
+float AnaglyphAmbisonicEncoderEffect::get_elevation() const {
+	return elevation;
+}
+
+void AnaglyphAmbisonicEncoderEffect::reset_state() {
+	// Same as the panner, let the audio thread do this itself.
+	reset_requested = true;
+}
+
+void AnaglyphAmbisonicEncoderEffect::_bind_methods() {
+	REGISTER(FLOAT, azimuth, AnaglyphAmbisonicEncoderEffect, "angle", PROPERTY_HINT_RANGE, "-180,180,0.1,degrees");
+	REGISTER(FLOAT, elevation, AnaglyphAmbisonicEncoderEffect, "angle", PROPERTY_HINT_RANGE, "-90,90,0.1,degrees");
+
+	ClassDB::bind_method(D_METHOD("reset_state"), &AnaglyphAmbisonicEncoderEffect::reset_state);
+}
+
+AnaglyphAmbisonicDecoderEffectInstance::AnaglyphAmbisonicDecoderEffectInstance() { }
+
+AnaglyphAmbisonicDecoderEffectInstance::~AnaglyphAmbisonicDecoderEffectInstance() { }
+
+void AnaglyphAmbisonicDecoderEffectInstance::_bind_methods() { }
+
+void AnaglyphAmbisonicDecoderEffectInstance::_process(const void* p_src_frames, AudioFrame* p_dst_frames, int32_t p_frame_count) {
+	// The decoder's partitions keep convolving the decaying tail.
+	AnaglyphFloatMode::Scope flush;
+	base->process((const AudioFrame*)p_src_frames, p_dst_frames, p_frame_count);
+}
+
+bool AnaglyphAmbisonicDecoderEffectInstance::_process_silence() const {
+	// While encoders are playing, their (silent) output already keeps this
+	// bus going. Afterwards, the decoder still needs to get its last
+	// partitions out.
+	return base->silent_blocks < AnaglyphAmbisonicDecoderEffect::tail_blocks;
+}
+
+AnaglyphAmbisonicDecoderEffect::AnaglyphAmbisonicDecoderEffect() {
+	hrtf_id = 0;
+	silent_blocks = tail_blocks;
+	input.resize(AnaglyphAmbisonics::max_channels * AnaglyphAmbisonicField::max_frames);
+	output.resize(2 * AnaglyphAmbisonicField::max_frames);
+
+	UnityAudioEffectState st{};
+	state = st;
+	created = AnaglyphBridge::CreateAmbisonicDecoder(&state, &ambisonic_data) == UNITY_AUDIODSP_OK;
+	if (!created) {
+		AnaglyphHelpers::print_warning("The ambisonic decoder failed to initialize. Ambisonic sources won't be heard.");
+	}
+}
+
+AnaglyphAmbisonicDecoderEffect::~AnaglyphAmbisonicDecoderEffect() {
+	if (created) {
+		AnaglyphBridge::ReleaseAmbisonicDecoder(&state);
+	}
+}
+
+Ref<AudioEffectInstance> AnaglyphAmbisonicDecoderEffect::_instantiate() {
+	Ref<AnaglyphAmbisonicDecoderEffectInstance> ins;
+	ins.instantiate();
+	ins->base = Ref<AnaglyphAmbisonicDecoderEffect>(this);
+
+	return ins;
+}
+
+void AnaglyphAmbisonicDecoderEffect::process(const AudioFrame* src, AudioFrame* dst, int count) {
+	if (AnaglyphAmbisonicField::consume()) {
+		silent_blocks = 0;
+	}
+	else if (silent_blocks < tail_blocks) {
+		silent_blocks++;
+	}
+	int frames = MIN(count, (int)AnaglyphAmbisonicField::max_frames);
+	if (!created) {
+		for (int i = 0; i < count; i++) {
+			dst[i] = src[i];
+		}
+		AnaglyphAmbisonicField::clear(frames);
+		return;
+	}
+
+	int channels = AnaglyphAmbisonicField::get_channel_count();
+	float* in = input.ptrw();
+	for (int c = 0; c < channels; c++) {
+		const float* field = AnaglyphAmbisonicField::get_channel(c);
+		for (int i = 0; i < frames; i++) {
+			in[i * channels + c] = field[i];
+		}
+	}
+	AnaglyphAmbisonicField::clear(frames);
+
+	float* out = output.ptrw();
+	UNITY_AUDIODSP_RESULT res = AnaglyphBridge::ProcessAmbisonicDecoder(&state, in, out, frames, channels);
+	if (res != UNITY_AUDIODSP_OK) {
+		for (int i = 0; i < 2 * frames; i++) {
+			out[i] = 0;
+		}
+	}
+	for (int i = 0; i < frames; i++) {
+		dst[i].left = src[i].left + out[2 * i];
+		dst[i].right = src[i].right + out[2 * i + 1];
+	}
+	for (int i = frames; i < count; i++) {
+		dst[i] = src[i];
+	}
+}
+
+void AnaglyphAmbisonicDecoderEffect::set_hrtf_id(const float value) {
+	hrtf_id = CLAMP(value, 0, 1);
+	// (A dll's decoder has parameters of its own.)
+	if (!created || AnaglyphBridge::GetAmbisonicDecoder() != AnaglyphAmbisonics::get_decoder_definition()) {
+		return;
+	}
+	// Rebuilding the filters races with processing, so hold the mix.
+	AudioServer::get_singleton()->lock();
+	AnaglyphBridge::GetAmbisonicDecoder()->setfloatparameter(&state, AnaglyphAmbisonics::PARAM_HRTF_ID, hrtf_id);
+	AudioServer::get_singleton()->unlock();
+}
+
+float AnaglyphAmbisonicDecoderEffect::get_hrtf_id() const {
+	return hrtf_id;
+}
+
+void AnaglyphAmbisonicDecoderEffect::_bind_methods() {
+	REGISTER(FLOAT, hrtf_id, AnaglyphAmbisonicDecoderEffect, "id", PROPERTY_HINT_RANGE, "0,1");
+}
\ No newline at end of file
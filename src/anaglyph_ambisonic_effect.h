@@ -0,0 +1,175 @@
+#ifndef GDANAGLYPH_AMBISONIC_EFFECT
+#define GDANAGLYPH_AMBISONIC_EFFECT
+
+#include "AudioPluginInterface.h"
+#include "anaglyph_ambisonics.h"
+#include "register_macro.h"
+
+#include <godot_cpp/classes/audio_effect.hpp>
+#include <godot_cpp/classes/audio_effect_instance.hpp>
+#include <godot_cpp/classes/audio_frame.hpp>
+#include <godot_cpp/templates/vector.hpp>
+
+namespace godot {
+	// The shared B-format signal that all encoders add into, and that the
+	// decoder consumes once per mix step.
+	// This only works because AudioServer mixes all buses on one thread,
+	// from the last index to the first. So as long as the decode bus comes
+	// before all encoder buses, every encoder has written its block by the
+	// time the decoder reads it.
+	class AnaglyphAmbisonicField {
+	public:
+		// More than AudioServer ever mixes at once.
+		static const int max_frames = 4096;
+
+	private:
+		// [channel][frame]
+		static float buffer[AnaglyphAmbisonics::max_channels * max_frames];
+		static int order;
+		// Whether anything was written since the last `consume()`.
+		static bool written;
+		// When the decoder last consumed the field. If it stops doing that
+		// (say, its bus got removed), encoders would otherwise keep adding
+		// to the same buffer forever.
+		static uint64_t consumed_usec;
+
+	public:
+		// The ambisonic order, 1 through 3. Changing it mid-mix drops a
+		// block at most.
+		static void set_order(int order);
+		static int get_order();
+		static int get_channel_count();
+
+		// For encoders, before adding to any channel: makes sure the field
+		// hasn't gone stale.
+		static void begin_write();
+		// For the decoder: whether anything was written this mix step.
+		static bool consume();
+		// [frame], `max_frames` long.
+		static float* get_channel(int channel);
+		// For the decoder: clears all channels for the next mix step.
+		static void clear(int frames);
+	};
+
+	class AnaglyphAmbisonicEncoderEffect;
+
+	class AnaglyphAmbisonicEncoderEffectInstance : public AudioEffectInstance {
+		GDCLASS(AnaglyphAmbisonicEncoderEffectInstance, AudioEffectInstance);
+		friend class AnaglyphAmbisonicEncoderEffect;
+
+		Ref<AnaglyphAmbisonicEncoderEffect> base;
+
+	protected:
+		static void _bind_methods();
+
+	public:
+		AnaglyphAmbisonicEncoderEffectInstance();
+		~AnaglyphAmbisonicEncoderEffectInstance();
+
+		void _process(const void* p_src_frames, AudioFrame* p_dst_frames, int32_t p_frame_count) override;
+	};
+
+	// Encodes the mono sum of whatever comes in into the shared ambisonic
+	// field, and outputs silence. The actual sound comes out of the
+	// `AnaglyphAmbisonicDecoderEffect`, together with every other encoded
+	// source.
+	// Per sample, this is only a multiply-add per ambisonic channel, so
+	// it's about as cheap as it gets.
+	// Just like the panner, attenuation over distance is not done here.
+	class AnaglyphAmbisonicEncoderEffect : public AudioEffect {
+		GDCLASS(AnaglyphAmbisonicEncoderEffect, AudioEffect);
+		friend class AnaglyphAmbisonicEncoderEffectInstance;
+
+		float azimuth;
+		float elevation;
+
+		// Everything below is audio thread only, except `reset_requested`.
+		bool reset_requested;
+		// The gains of the previous block, which this block ramps from.
+		float gains[AnaglyphAmbisonics::max_channels];
+		int gains_order;
+		float mono[AnaglyphAmbisonicField::max_frames];
+
+		void process(const AudioFrame* src, AudioFrame* dst, int count);
+
+	protected:
+		static void _bind_methods();
+
+	public:
+		AnaglyphAmbisonicEncoderEffect();
+		~AnaglyphAmbisonicEncoderEffect();
+
+		Ref<AudioEffectInstance> _instantiate() override;
+
+		void set_azimuth(const float degrees);
+		float get_azimuth() const;
+
+		void set_elevation(const float degrees);
+		float get_elevation() const;
+
+		// Forgets the previous direction, and fades in over the next block.
+		void reset_state();
+	};
+
+	class AnaglyphAmbisonicDecoderEffect;
+
+	class AnaglyphAmbisonicDecoderEffectInstance : public AudioEffectInstance {
+		GDCLASS(AnaglyphAmbisonicDecoderEffectInstance, AudioEffectInstance);
+		friend class AnaglyphAmbisonicDecoderEffect;
+
+		Ref<AnaglyphAmbisonicDecoderEffect> base;
+
+	protected:
+		static void _bind_methods();
+
+	public:
+		AnaglyphAmbisonicDecoderEffectInstance();
+		~AnaglyphAmbisonicDecoderEffectInstance();
+
+		void _process(const void* p_src_frames, AudioFrame* p_dst_frames, int32_t p_frame_count) override;
+		// Only for as long as the decoder still has a tail to play.
+		bool _process_silence() const override;
+	};
+
+	// Decodes the shared ambisonic field to binaural, and adds that to
+	// whatever else comes into its bus.
+	// This uses the Anaglyph dll's ambisonic decoder if it has one (it
+	// doesn't as of writing), and `AnaglyphAmbisonics`' own otherwise.
+	// There should only ever be one of these, on the bus all ambisonic
+	// encoder buses send to.
+	class AnaglyphAmbisonicDecoderEffect : public AudioEffect {
+		GDCLASS(AnaglyphAmbisonicDecoderEffect, AudioEffect);
+		friend class AnaglyphAmbisonicDecoderEffectInstance;
+
+		UnityAudioEffectState state;
+		UnityAudioAmbisonicData ambisonic_data;
+		bool created;
+		float hrtf_id;
+
+		// Interleaved, as the decoder wants it.
+		Vector<float> input;
+		Vector<float> output;
+		// Mix steps since any encoder wrote anything.
+		int silent_blocks;
+		// After this many silent blocks, the decoder's tail is surely done.
+		static const int tail_blocks = 16;
+
+		void process(const AudioFrame* src, AudioFrame* dst, int count);
+
+	protected:
+		static void _bind_methods();
+
+	public:
+		AnaglyphAmbisonicDecoderEffect();
+		~AnaglyphAmbisonicDecoderEffect();
+
+		Ref<AudioEffectInstance> _instantiate() override;
+
+		// As in `AnaglyphEffect::set_hrtf_id()`. This rebuilds the
+		// decoder's filters, so don't animate it.
+		void set_hrtf_id(const float value);
+		float get_hrtf_id() const;
+	};
+}
+
+#endif // GDANAGLYPH_AMBISONIC_EFFECT
\ No newline at end of file
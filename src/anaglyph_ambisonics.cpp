@@ -0,0 +1,362 @@
+#include "anaglyph_ambisonics.h"
+#include "anaglyph_native_backend.h"
+#include "anaglyph_simd.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+using namespace godot;
+
+static const float PI_F = 3.14159265f;
+static const float DEG2RAD = PI_F / 180.0f;
+static const float speed_of_sound = 343.0f;
+// Same as the native backend's default, the decoder doesn't know anyone's
+// head circumference.
+static const float head_radius = 0.0875f;
+
+int AnaglyphAmbisonics::channel_count(int order) {
+	return (order + 1) * (order + 1);
+}
+
+// The real spherical harmonics, SN3D, in ACN order, for the unit vector
+// (x front, y left, z up) that ambisonics uses.
+static void spherical_harmonics(int order, float x, float y, float z, float* out) {
+	out[0] = 1;
+	if (order < 1) {
+		return;
+	}
+	out[1] = y;
+	out[2] = z;
+	out[3] = x;
+	if (order < 2) {
+		return;
+	}
+	const float sqrt3 = 1.7320508f;
+	out[4] = sqrt3 * x * y;
+	out[5] = sqrt3 * y * z;
+	out[6] = 0.5f * (3 * z * z - 1);
+	out[7] = sqrt3 * x * z;
+	out[8] = 0.5f * sqrt3 * (x * x - y * y);
+	if (order < 3) {
+		return;
+	}
+	const float sqrt5_8 = 0.7905694f;
+	const float sqrt15 = 3.8729833f;
+	const float sqrt3_8 = 0.6123724f;
+	out[9] = sqrt5_8 * y * (3 * x * x - y * y);
+	out[10] = sqrt15 * x * y * z;
+	out[11] = sqrt3_8 * y * (5 * z * z - 1);
+	out[12] = 0.5f * z * (5 * z * z - 3);
+	out[13] = sqrt3_8 * x * (5 * z * z - 1);
+	out[14] = 0.5f * sqrt15 * z * (x * x - y * y);
+	out[15] = sqrt5_8 * x * (x * x - 3 * y * y);
+}
+
+void AnaglyphAmbisonics::encode(int order, float azimuth, float elevation, float* out_gains) {
+	order = order < 1 ? 1 : (order > max_order ? max_order : order);
+	float az = azimuth * DEG2RAD;
+	float el = elevation * DEG2RAD;
+	// Azimuth 90 is right, which is -y.
+	float x = cosf(az) * cosf(el);
+	float y = -sinf(az) * cosf(el);
+	float z = sinf(el);
+	spherical_harmonics(order, x, y, z, out_gains);
+}
+
+UnityAudioEffectDefinition* AnaglyphAmbisonics::get_decoder_definition() {
+	static UnityAudioEffectDefinition definition;
+	static bool initialized = false;
+	if (!initialized) {
+		memset(&definition, 0, sizeof(definition));
+		definition.structsize = sizeof(UnityAudioEffectDefinition);
+		definition.paramstructsize = sizeof(UnityAudioParameterDefinition);
+		definition.apiversion = UNITY_AUDIO_PLUGIN_API_VERSION;
+		definition.pluginversion = 1;
+		definition.flags = UnityAudioEffectDefinitionFlags_IsAmbisonicDecoder;
+		definition.numparameters = PARAM_COUNT;
+		definition.paramdefs = nullptr;
+		strncpy(definition.name, "GDAnaglyph ambisonic", sizeof(definition.name) - 1);
+		definition.create = &create;
+		definition.release = &release;
+		definition.reset = &reset;
+		definition.process = &process;
+		definition.setfloatparameter = &set_float_parameter;
+		definition.getfloatparameter = &get_float_parameter;
+		initialized = true;
+	}
+	return &definition;
+}
+
+void AnaglyphAmbisonics::build_filters(Instance* instance, int model) {
+	const AnaglyphHRIRSet* set = instance->models[model];
+	instance->model = model;
+	int size = instance->partition_size;
+	int bins = 2 * size;
+	float rate = instance->sample_rate;
+	int ir_length = set->get_ir_length();
+	// The largest ITD Woodworth gives, plus room for interpolation.
+	int max_delay = (int)ceilf(head_radius / speed_of_sound * (PI_F / 2 + 1) * rate) + 2;
+	int length = ir_length + max_delay;
+
+	for (int order = 1; order <= max_order; order++) {
+		Filters& filters = instance->filters[order - 1];
+		int channels = channel_count(order);
+		filters.channels = channels;
+		filters.partitions = (length + size - 1) / size;
+		size_t total = (size_t)channels * filters.partitions * bins;
+		filters.re.assign(total, 0);
+		filters.im.assign(total, 0);
+
+		// Enough speakers for this order, evenly spread with a Fibonacci
+		// spiral.
+		int speakers = 2 * channels;
+		float weights[max_order + 1];
+		// max-rE: Legendre polynomials at cos(137.9 deg / (order + 1.51)).
+		float c = cosf(137.9f * DEG2RAD / (order + 1.51f));
+		weights[0] = 1;
+		weights[1] = c;
+		weights[2] = 0.5f * (3 * c * c - 1);
+		weights[3] = 0.5f * (5 * c * c * c - 3 * c);
+
+		// Time domain first, [channel][ear][sample].
+		std::vector<float> irs((size_t)channels * 2 * length, 0.0f);
+		float harmonics[max_channels];
+		const float golden_angle = PI_F * (3 - sqrtf(5.0f));
+		for (int s = 0; s < speakers; s++) {
+			float z = 1 - 2 * (s + 0.5f) / speakers;
+			float r = sqrtf(fmaxf(0.0f, 1 - z * z));
+			float phi = s * golden_angle;
+			float x = r * cosf(phi);
+			float y = r * sinf(phi);
+			float azimuth = atan2f(-y, x) / DEG2RAD;
+			float elevation = asinf(z) / DEG2RAD;
+			spherical_harmonics(order, x, y, z, harmonics);
+
+			int direction = set->find_nearest(azimuth, elevation);
+			const float* ears[2] = { set->get_left(direction), set->get_right(direction) };
+			// Woodworth, just like the native backend. Speakers on the right
+			// (-y) reach the left ear last.
+			float lateral = asinf(fminf(1.0f, fmaxf(-1.0f, -y)));
+			float itd = head_radius / speed_of_sound * (fabsf(lateral) + sinf(fabsf(lateral))) * rate;
+			float delays[2] = { lateral > 0 ? itd : 0, lateral > 0 ? 0 : itd };
+
+			for (int ch = 0; ch < channels; ch++) {
+				int l = (int)sqrtf((float)ch);
+				// Projection onto the speakers. Summed over all speakers, a
+				// source at gain 1 comes out at gain 1.
+				float gain = (2 * l + 1) * weights[l] * harmonics[ch] / speakers;
+				for (int e = 0; e < 2; e++) {
+					float* out = irs.data() + ((size_t)ch * 2 + e) * length;
+					int whole = (int)delays[e];
+					float frac = delays[e] - whole;
+					for (int i = 0; i < ir_length; i++) {
+						float v = ears[e][i] * gain;
+						out[whole + i] += v * (1 - frac);
+						out[whole + i + 1] += v * frac;
+					}
+				}
+			}
+		}
+
+		for (int ch = 0; ch < channels; ch++) {
+			const float* left = irs.data() + (size_t)ch * 2 * length;
+			const float* right = left + length;
+			for (int p = 0; p < filters.partitions; p++) {
+				size_t offset = ((size_t)ch * filters.partitions + p) * bins;
+				float* re = filters.re.data() + offset;
+				float* im = filters.im.data() + offset;
+				for (int i = 0; i < size; i++) {
+					int sample = p * size + i;
+					if (sample < length) {
+						re[i] = left[sample];
+						im[i] = right[sample];
+					}
+				}
+				instance->fft.forward(re, im);
+			}
+		}
+	}
+
+	int fdl_partitions = 1;
+	for (int i = 0; i < max_order; i++) {
+		fdl_partitions = std::max(fdl_partitions, instance->filters[i].partitions);
+	}
+	instance->fdl_partitions = fdl_partitions;
+	instance->fdl_re.assign((size_t)fdl_partitions * max_channels * bins, 0);
+	instance->fdl_im.assign((size_t)fdl_partitions * max_channels * bins, 0);
+}
+
+void AnaglyphAmbisonics::reset_buffers(Instance* instance) {
+	std::fill(instance->input_block.begin(), instance->input_block.end(), 0.0f);
+	std::fill(instance->output_block.begin(), instance->output_block.end(), 0.0f);
+	std::fill(instance->history.begin(), instance->history.end(), 0.0f);
+	std::fill(instance->fdl_re.begin(), instance->fdl_re.end(), 0.0f);
+	std::fill(instance->fdl_im.begin(), instance->fdl_im.end(), 0.0f);
+	instance->block_fill = 0;
+	instance->fdl_position = 0;
+}
+
+UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK AnaglyphAmbisonics::create(UnityAudioEffectState* state) {
+	Instance* instance = new Instance();
+	instance->sample_rate = state->samplerate;
+	// Same partition sizes as the native backend.
+	int partition_size = AnaglyphNativeBackend::max_partition_size;
+	while (partition_size > 16 && partition_size > (int)state->dspbuffersize) {
+		partition_size /= 2;
+	}
+	instance->partition_size = partition_size;
+	instance->fft.init(2 * partition_size);
+	AnaglyphNativeBackend::find_models(instance->sample_rate, instance->models);
+	instance->params[PARAM_HRTF_ID] = 0;
+
+	int bins = 2 * partition_size;
+	instance->input_block.resize((size_t)max_channels * partition_size);
+	instance->output_block.resize(2 * partition_size);
+	instance->history.resize((size_t)max_channels * bins);
+	instance->acc_re.resize(bins);
+	instance->acc_im.resize(bins);
+	build_filters(instance, 0);
+	instance->channels = 0;
+
+	reset_buffers(instance);
+	state->effectdata = instance;
+	return UNITY_AUDIODSP_OK;
+}
+
+UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK AnaglyphAmbisonics::release(UnityAudioEffectState* state) {
+	Instance* instance = (Instance*)state->effectdata;
+	delete instance;
+	state->effectdata = nullptr;
+	return UNITY_AUDIODSP_OK;
+}
+
+UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK AnaglyphAmbisonics::reset(UnityAudioEffectState* state) {
+	Instance* instance = (Instance*)state->effectdata;
+	if (instance == nullptr) {
+		return UNITY_AUDIODSP_ERR_UNSUPPORTED;
+	}
+	reset_buffers(instance);
+	return UNITY_AUDIODSP_OK;
+}
+
+UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK AnaglyphAmbisonics::set_float_parameter(UnityAudioEffectState* state, int index, float value) {
+	Instance* instance = (Instance*)state->effectdata;
+	if (instance == nullptr || index < 0 || index >= PARAM_COUNT) {
+		return UNITY_AUDIODSP_ERR_UNSUPPORTED;
+	}
+	instance->params[index] = value;
+	if (index == PARAM_HRTF_ID) {
+		// Same mapping as Anaglyph: n models get the ids 0/(n-1), 1/(n-1), ...
+		int model_count = (int)instance->models.size();
+		int model = (int)lroundf(value * (model_count - 1));
+		model = model < 0 ? 0 : (model >= model_count ? model_count - 1 : model);
+		if (model != instance->model) {
+			build_filters(instance, model);
+			reset_buffers(instance);
+		}
+	}
+	return UNITY_AUDIODSP_OK;
+}
+
+UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK AnaglyphAmbisonics::get_float_parameter(UnityAudioEffectState* state, int index, float* value, char* valuestr) {
+	Instance* instance = (Instance*)state->effectdata;
+	if (instance == nullptr || index < 0 || index >= PARAM_COUNT) {
+		return UNITY_AUDIODSP_ERR_UNSUPPORTED;
+	}
+	if (value != nullptr) {
+		*value = instance->params[index];
+	}
+	if (valuestr != nullptr) {
+		valuestr[0] = 0;
+	}
+	return UNITY_AUDIODSP_OK;
+}
+
+void AnaglyphAmbisonics::process_block(Instance* instance) {
+	int size = instance->partition_size;
+	int bins = 2 * size;
+	int channels = instance->channels;
+	const Filters& filters = instance->filters[(int)sqrtf((float)channels) - 2];
+	const float* input = instance->input_block.data();
+	float* output = instance->output_block.data();
+
+	// Overlap-save per channel, into this block's FDL slot.
+	instance->fdl_position = (instance->fdl_position + 1) % instance->fdl_partitions;
+	size_t slot_offset = (size_t)instance->fdl_position * max_channels * bins;
+	for (int ch = 0; ch < channels; ch++) {
+		float* history = instance->history.data() + (size_t)ch * bins;
+		for (int i = 0; i < size; i++) {
+			history[i] = history[size + i];
+			history[size + i] = input[i * max_channels + ch];
+		}
+		float* slot_re = instance->fdl_re.data() + slot_offset + (size_t)ch * bins;
+		float* slot_im = instance->fdl_im.data() + slot_offset + (size_t)ch * bins;
+		memcpy(slot_re, history, bins * sizeof(float));
+		std::fill(slot_im, slot_im + bins, 0.0f);
+		instance->fft.forward(slot_re, slot_im);
+	}
+
+	// All channels go into the same accumulator, so there's only a single
+	// inverse FFT.
+	float* re = instance->acc_re.data();
+	float* im = instance->acc_im.data();
+	std::fill(re, re + bins, 0.0f);
+	std::fill(im, im + bins, 0.0f);
+	for (int p = 0; p < filters.partitions; p++) {
+		int slot = (instance->fdl_position - p + instance->fdl_partitions) % instance->fdl_partitions;
+		size_t fdl_offset = (size_t)slot * max_channels * bins;
+		for (int ch = 0; ch < channels; ch++) {
+			size_t filter_offset = ((size_t)ch * filters.partitions + p) * bins;
+			AnaglyphSIMD::complex_multiply_accumulate(
+				instance->fdl_re.data() + fdl_offset + (size_t)ch * bins, instance->fdl_im.data() + fdl_offset + (size_t)ch * bins,
+				filters.re.data() + filter_offset, filters.im.data() + filter_offset,
+				re, im,
+				bins
+			);
+		}
+	}
+	instance->fft.inverse(re, im);
+	for (int i = 0; i < size; i++) {
+		output[2 * i] = re[size + i];
+		output[2 * i + 1] = im[size + i];
+	}
+}
+
+UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK AnaglyphAmbisonics::process(UnityAudioEffectState* state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int outchannels) {
+	Instance* instance = (Instance*)state->effectdata;
+	if (instance == nullptr || outchannels != 2 || (inchannels != 4 && inchannels != 9 && inchannels != 16)) {
+		return UNITY_AUDIODSP_ERR_UNSUPPORTED;
+	}
+	if (inchannels != instance->channels) {
+		// The old history has nothing to do with the new channels.
+		reset_buffers(instance);
+		instance->channels = inchannels;
+	}
+	int size = instance->partition_size;
+	float* input = instance->input_block.data();
+	float* output = instance->output_block.data();
+	unsigned int done = 0;
+	while (done < length) {
+		int fill = instance->block_fill;
+		int count = size - fill;
+		if ((unsigned int)count > length - done) {
+			count = length - done;
+		}
+		for (int i = 0; i < count; i++) {
+			const float* frame = inbuffer + (size_t)(done + i) * inchannels;
+			for (int ch = 0; ch < inchannels; ch++) {
+				input[(fill + i) * max_channels + ch] = frame[ch];
+			}
+			outbuffer[2 * (done + i)] = output[2 * (fill + i)];
+			outbuffer[2 * (done + i) + 1] = output[2 * (fill + i) + 1];
+		}
+		done += count;
+		instance->block_fill += count;
+		if (instance->block_fill == size) {
+			process_block(instance);
+			instance->block_fill = 0;
+		}
+	}
+	return UNITY_AUDIODSP_OK;
+}
\ No newline at end of file
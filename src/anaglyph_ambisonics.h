@@ -0,0 +1,116 @@
+#ifndef GDANAGLYPH_AMBISONICS
+#define GDANAGLYPH_AMBISONICS
+
+// Godot-free, just like the native backend it borrows its heads from.
+
+#include "AudioPluginInterface.h"
+#include "anaglyph_fft.h"
+#include "anaglyph_hrir.h"
+
+#include <vector>
+
+namespace godot {
+	// Ambisonics, for when there are too many sources to give each their
+	// own HRTF instance. Every source gets encoded into one shared B-format
+	// signal with nothing but a gain per channel, and that sum is decoded
+	// to binaural once, no matter how many sources went in.
+	//
+	// Conventions are AmbiX: ACN channel order, SN3D normalization. Orders
+	// 1 through 3 are supported, which is 4, 9, or 16 channels. Higher
+	// orders are sharper, but the encoding cost grows with the channels.
+	class AnaglyphAmbisonics {
+	public:
+		static const int max_order = 3;
+		static const int max_channels = (max_order + 1) * (max_order + 1);
+
+		// (order + 1)^2.
+		static int channel_count(int order);
+		// The encoding gains of a source in this direction, for all
+		// `channel_count(order)` channels. Azimuth and elevation are in
+		// degrees, with the same conventions as Anaglyph (azimuth 90 is
+		// right, elevation 90 is up).
+		static void encode(int order, float azimuth, float elevation, float* out_gains);
+
+		// The parameters the native decoder understands.
+		enum Param {
+			// Selects the head in the same way as the native backend's
+			// hrtf_id. Changing it rebuilds the decoder's filters, which
+			// allocates, so don't do it from the audio thread.
+			PARAM_HRTF_ID = 0,
+			PARAM_COUNT = 1
+		};
+
+		// A binaural decoder of our own, as a Unity plugin flagged
+		// `UnityAudioEffectDefinitionFlags_IsAmbisonicDecoder`, so that
+		// the bridge can swap it for a dll's decoder.
+		// It takes `channel_count(order)` interleaved input channels, and
+		// gives two.
+		//
+		// It's a virtual speaker decode: a few speakers spread evenly over
+		// the sphere, each with the HRIR (and ITD) of the nearest measured
+		// direction, and max-rE weighting to keep the sources tight. But as
+		// everything is linear, the speakers are folded into one pair of
+		// filters per ambisonic channel when the decoder is created. Each
+		// block then costs one FFT per channel, the multiply-accumulate
+		// over all channels' partitions, and one inverse FFT.
+		static UnityAudioEffectDefinition* get_decoder_definition();
+
+	private:
+		struct Filters {
+			int channels;
+			int partitions;
+			// [channel][partition][bin], packed as FFT(left + i * right),
+			// just like `AnaglyphHRIRSet::Spectra`.
+			std::vector<float> re;
+			std::vector<float> im;
+		};
+
+		// What lives in `state->effectdata`.
+		struct Instance {
+			float params[PARAM_COUNT];
+
+			float sample_rate;
+			int partition_size;
+			AnaglyphFFT fft;
+			std::vector<AnaglyphHRIRSet*> models;
+			// The model the filters were built from.
+			int model;
+			// Per order (index order - 1), so that the order can change
+			// without rebuilding anything.
+			Filters filters[max_order];
+
+			// Input is collected until there's a partition's worth, with
+			// `max_channels` per frame. Output (stereo) lags one partition.
+			std::vector<float> input_block;
+			std::vector<float> output_block;
+			int block_fill;
+			// The channel count of the last process call. When it changes,
+			// all history is thrown away.
+			int channels;
+
+			// The last two partitions of every channel.
+			std::vector<float> history;
+			// [slot][channel][bin]
+			std::vector<float> fdl_re;
+			std::vector<float> fdl_im;
+			int fdl_partitions;
+			int fdl_position;
+			std::vector<float> acc_re;
+			std::vector<float> acc_im;
+		};
+
+		// Builds `filters` from this model.
+		static void build_filters(Instance* instance, int model);
+		static void reset_buffers(Instance* instance);
+		static void process_block(Instance* instance);
+
+		static UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK create(UnityAudioEffectState* state);
+		static UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK release(UnityAudioEffectState* state);
+		static UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK reset(UnityAudioEffectState* state);
+		static UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK process(UnityAudioEffectState* state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int outchannels);
+		static UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK set_float_parameter(UnityAudioEffectState* state, int index, float value);
+		static UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK get_float_parameter(UnityAudioEffectState* state, int index, float* value, char* valuestr);
+	};
+}
+
+#endif // GDANAGLYPH_AMBISONICS
\ No newline at end of file
@@ -1,17 +1,71 @@
 #include "anaglyph_bus_manager.h"
+#include "anaglyph_dll_bridge.h"
 #include "helpers.h"
 
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/core/math.hpp>
+#include <godot_cpp/core/mutex_lock.hpp>
+#include <godot_cpp/variant/callable_method_pointer.hpp>
+
 using namespace godot;
 
 AnaglyphBusManager* AnaglyphBusManager::singleton = nullptr;
 char* AnaglyphBusManager::a_bus_name = "[Anaglyph_Bus]";
 char* AnaglyphBusManager::s_bus_name = "[Silent_Bus]";
+char* AnaglyphBusManager::light_bus_names[AnaglyphBusManager::LIGHT_KIND_COUNT] = { "[Anaglyph_Panner]", "[Anaglyph_Ambisonic]" };
+char* AnaglyphBusManager::d_bus_name = "[Anaglyph_Ambisonic_Decode]";
+char* AnaglyphBusManager::r_bus_name = "[Anaglyph_Room]";
+
+// For messages, by LightKind.
+static const char* light_descriptions[] = { "panner", "ambisonic" };
+static const char* light_effect_names[] = { "AnaglyphPannerEffect", "AnaglyphAmbisonicEncoderEffect" };
+
+const float AnaglyphBusManager::drain_threshold_db = -70;
+// Anaglyph's own latency can be up to a second, and during that time the
+// meters may still read silence. So don't trust them before that.
+const uint64_t AnaglyphBusManager::min_drain_msec = 1000;
+const uint64_t AnaglyphBusManager::max_drain_msec = 10000;
+const uint64_t AnaglyphBusManager::poll_interval_msec = 500;
+// A couple of the players' borrow attempts.
+const uint64_t AnaglyphBusManager::deferred_borrow_msec = 1000;
+const float AnaglyphBusManager::cluster_hysteresis = 1.5f;
+const float AnaglyphBusManager::cluster_distance_ratio = 2.0f;
 
 int AnaglyphBusManager::total_bus_count() const {
-	return anaglyph_buses.size() + used_anaglyph_buses;
+	return anaglyph_buses.size() + draining_buses.size() + used_anaglyph_buses;
 }
 
-StringName AnaglyphBusManager::add_bus(StringName base_name) {
+void AnaglyphBusManager::update_draining_buses() {
+	if (draining_buses.size() == 0) {
+		return;
+	}
+	uint64_t now = Time::get_singleton()->get_ticks_msec();
+	// Backwards as we're removing stuff.
+	for (int i = draining_buses.size() - 1; i >= 0; i--) {
+		const DrainingBus& draining = draining_buses[i];
+		int index = get_bus_index(draining.name);
+		if (index == -1) {
+			// AudioServer::set_bus_layout happened, this one's gone.
+			draining_buses.remove_at(i);
+			continue;
+		}
+		uint64_t elapsed = now - draining.returned_msec;
+		if (elapsed < min_drain_msec) {
+			continue;
+		}
+		float peak = MAX(
+			audio->get_bus_peak_volume_left_db(index, 0),
+			audio->get_bus_peak_volume_right_db(index, 0)
+		);
+		if (peak < drain_threshold_db || elapsed >= max_drain_msec) {
+			AnaglyphHelpers::print("Anaglyph audio bus ", draining.name, " drained after ", elapsed, "ms");
+			anaglyph_buses.push_back(draining.name);
+			draining_buses.remove_at(i);
+		}
+	}
+}
+
+StringName AnaglyphBusManager::add_bus(StringName base_name, int at_position) {
 	String name = base_name;
 	int attempts = 1;
 	int num_buses = audio->get_bus_count();
@@ -35,10 +89,11 @@ StringName AnaglyphBusManager::add_bus(StringName base_name) {
 	// This method neither returns the index nor the name.
 	// On top of that, it emits a "stuff changed" signal.
 	// I don't know if the layout can change under my nose, but just create a
-	// new bus, and assume it's at the end.
-	int insert_index = num_buses;
-	audio->add_bus(-1);
+	// new bus, and assume it's where I asked for it.
+	int insert_index = at_position < 0 ? num_buses : MIN(at_position, num_buses);
+	audio->add_bus(at_position < 0 ? -1 : insert_index);
 	audio->set_bus_name(insert_index, name);
+	created_buses.insert(name);
 	AnaglyphHelpers::print("Added Anaglyph audio bus ", name);
 	return name;
 }
@@ -64,7 +119,503 @@ int AnaglyphBusManager::get_bus_index(StringName name) {
 	return -1;
 }
 
+void AnaglyphBusManager::sweep_borrowers() {
+	sweep_deferred_borrows();
+	// Can't return while iterating, so collect first.
+	Vector<StringName> orphaned;
+	Vector<ObjectID> orphaned_by;
+	for (const KeyValue<StringName, ObjectID>& kv : borrowers) {
+		if (kv.value.is_null()) {
+			continue;
+		}
+		if (ObjectDB::get_instance(kv.value) == nullptr) {
+			orphaned.push_back(kv.key);
+			orphaned_by.push_back(kv.value);
+		}
+	}
+	for (int i = 0; i < orphaned.size(); i++) {
+		// (If it's clustered, this hands it to someone else in there.)
+		AnaglyphHelpers::print("Reclaimed Anaglyph audio bus ", orphaned[i], " from a freed player");
+		return_anaglyph_bus(orphaned[i], true, orphaned_by[i]);
+	}
+	sweep_cluster_members();
+
+	for (int kind = 0; kind < LIGHT_KIND_COUNT; kind++) {
+		orphaned.clear();
+		for (const KeyValue<StringName, ObjectID>& kv : light_pools[kind].borrowers) {
+			if (!kv.value.is_null() && ObjectDB::get_instance(kv.value) == nullptr) {
+				orphaned.push_back(kv.key);
+			}
+		}
+		for (int i = 0; i < orphaned.size(); i++) {
+			AnaglyphHelpers::print("Reclaimed ", light_descriptions[kind], " audio bus ", orphaned[i], " from a freed player");
+			return_light_bus((LightKind)kind, orphaned[i]);
+		}
+	}
+}
+
+void AnaglyphBusManager::poll() {
+	MutexLock lock(*mutex.ptr());
+	uint64_t now = Time::get_singleton()->get_ticks_msec();
+	if (now - last_poll_msec < poll_interval_msec) {
+		return;
+	}
+	last_poll_msec = now;
+	sweep_borrowers();
+	if (is_main_thread()) {
+		update_draining_buses();
+		refresh_bus_gains();
+		return;
+	}
+	if (draining_buses.size() > 0) {
+		pending_drain_check = true;
+		schedule_flush();
+	}
+	if (bus_gains.size() > 0) {
+		pending_gain_refresh = true;
+		schedule_flush();
+	}
+}
+
+void AnaglyphBusManager::refresh_bus_gains() {
+	for (KeyValue<StringName, BusGain>& kv : bus_gains) {
+		int index = get_bus_index(kv.key);
+		if (index == -1) {
+			// Playing on a bus that doesn't exist goes to Master, which we
+			// don't count either.
+			kv.value.volume_db = 0;
+			kv.value.mute = false;
+			continue;
+		}
+		kv.value.volume_db = audio->get_bus_volume_db(index);
+		kv.value.mute = audio->is_bus_mute(index);
+	}
+}
+
+float AnaglyphBusManager::get_bus_gain_db(const StringName& bus) {
+	MutexLock lock(*mutex.ptr());
+	if (!bus_gains.has(bus)) {
+		BusGain gain;
+		gain.volume_db = 0;
+		gain.mute = false;
+		bus_gains.insert(bus, gain);
+		if (is_main_thread()) {
+			refresh_bus_gains();
+		}
+		else {
+			pending_gain_refresh = true;
+			schedule_flush();
+		}
+	}
+	const BusGain& gain = bus_gains[bus];
+	return gain.mute ? -INFINITY : gain.volume_db;
+}
+
+void AnaglyphBusManager::adopt_layout_buses() {
+	layout_adopted = true;
+	String base_name = String(a_bus_name);
+	String decode_name = String(d_bus_name);
+	// The first time we see a layout, whoever declared buses in it wants to
+	// use all of them, even if that's more than the maximum.
+	// After that (e.g. after `set_max_anaglyph_buses()`), respect the maximum.
+	bool raise_max = !layout_declares_buses;
+	int num_buses = audio->get_bus_count();
+	for (int i = 0; i < num_buses; i++) {
+		StringName name = audio->get_bus_name(i);
+		if (String(name) == decode_name) {
+			if (created_buses.has(name)) {
+				// We added it ourselves, so it says nothing about the layout.
+				continue;
+			}
+			// Gets its decoder when first needed, see `guarantee_decode_bus()`.
+			layout_declares_buses = true;
+			continue;
+		}
+		if (String(name).begins_with(String(r_bus_name))) {
+			if (created_buses.has(name)) {
+				// Already in `rooms`.
+				continue;
+			}
+			layout_declares_buses = true;
+			if (adopted_buses.has(name)) {
+				continue;
+			}
+			if (audio->get_bus_effect_count(i) > 0) {
+				if (Object::cast_to<AnaglyphRoomEffect>(audio->get_bus_effect(i, 0).ptr()) == nullptr) {
+					AnaglyphHelpers::print_warning("Bus ", name, " looks like a room bus, but its first effect is not an AnaglyphRoomEffect. Not using it.");
+					continue;
+				}
+			}
+			else {
+				audio->add_bus_effect(i, memnew(AnaglyphRoomEffect));
+			}
+			adopted_buses.insert(name);
+			Room room;
+			room.bus = name;
+			room.users = 0;
+			rooms.push_back(room);
+			AnaglyphHelpers::print("Adopted room audio bus ", name, " from the bus layout");
+			continue;
+		}
+		int light_kind = -1;
+		for (int kind = 0; kind < LIGHT_KIND_COUNT; kind++) {
+			if (String(name).begins_with(String(light_bus_names[kind]))) {
+				light_kind = kind;
+			}
+		}
+		if (light_kind != -1 && created_buses.has(name)) {
+			// Already in the pool, or borrowed from it.
+			continue;
+		}
+		if (light_kind != -1) {
+			LightPool& pool = light_pools[light_kind];
+			layout_declares_buses = true;
+			if (adopted_buses.has(name) || pool.borrowers.has(name)) {
+				continue;
+			}
+			if (audio->get_bus_effect_count(i) > 0) {
+				if (!is_light_effect((LightKind)light_kind, audio->get_bus_effect(i, 0))) {
+					AnaglyphHelpers::print_warning("Bus ", name, " looks like a ", light_descriptions[light_kind], " bus, but its first effect is not an ", light_effect_names[light_kind], ". Not using it.");
+					continue;
+				}
+			}
+			else {
+				audio->add_bus_effect(i, create_light_effect((LightKind)light_kind));
+			}
+			adopted_buses.insert(name);
+			pool.idle.push_back(name);
+			AnaglyphHelpers::print("Adopted ", light_descriptions[light_kind], " audio bus ", name, " from the bus layout");
+			continue;
+		}
+		if (!String(name).begins_with(base_name) || created_buses.has(name)) {
+			continue;
+		}
+		layout_declares_buses = true;
+		if (adopted_buses.has(name) || borrowers.has(name)) {
+			continue;
+		}
+		if (!raise_max && total_bus_count() >= max_anaglyph_buses) {
+			break;
+		}
+
+		// Either it has our effect first, or no effects whatsoever.
+		int effect_count = audio->get_bus_effect_count(i);
+		if (effect_count > 0) {
+			Ref<AnaglyphEffect> effect = audio->get_bus_effect(i, 0);
+			if (effect == nullptr) {
+				AnaglyphHelpers::print_warning("Bus ", name, " looks like an Anaglyph bus, but its first effect is not an AnaglyphEffect. Not using it.");
+				continue;
+			}
+		}
+		else {
+			Ref<AnaglyphEffect> effect = memnew(AnaglyphEffect);
+			audio->add_bus_effect(i, effect);
+		}
+
+		adopted_buses.insert(name);
+		anaglyph_buses.push_back(name);
+		AnaglyphHelpers::print("Adopted Anaglyph audio bus ", name, " from the bus layout");
+	}
+
+	if (raise_max && total_bus_count() > max_anaglyph_buses) {
+		max_anaglyph_buses = total_bus_count();
+	}
+	// Same for rooms, as they're what make Anaglyph buses cheaper.
+	if (rooms.size() > max_room_buses) {
+		max_room_buses = rooms.size();
+	}
+	// Light buses are cheap, so whatever's declared is always used.
+	for (int kind = 0; kind < LIGHT_KIND_COUNT; kind++) {
+		LightPool& pool = light_pools[kind];
+		if (pool.total_bus_count() > pool.max_buses) {
+			pool.max_buses = pool.total_bus_count();
+		}
+	}
+	// Sends to later buses go to Master instead, so these would play
+	// nothing at all.
+	const Vector<StringName>& ambisonic_buses = light_pools[LIGHT_AMBISONIC].idle;
+	int decode_index = get_bus_index(StringName(d_bus_name));
+	for (int i = 0; i < ambisonic_buses.size(); i++) {
+		if (get_bus_index(ambisonic_buses[i]) < decode_index || decode_index == -1) {
+			AnaglyphHelpers::print_warning("Ambisonic bus ", ambisonic_buses[i], " needs a ", d_bus_name, " bus before it in the bus layout, or it won't be heard.");
+		}
+	}
+}
+
+bool AnaglyphBusManager::is_layout_fixed() const {
+	return layout_declares_buses;
+}
+
+void AnaglyphBusManager::invalidate_layout() {
+	// Our own buses that are still around are still ours, and stay in their
+	// pool. Anything else is either gone, or was declared by the new layout
+	// (and gets adopted by the next scan).
+	Vector<StringName> gone;
+	for (const StringName& name : created_buses) {
+		if (get_bus_index(name) == -1) {
+			gone.push_back(name);
+		}
+	}
+	for (int i = 0; i < gone.size(); i++) {
+		created_buses.erase(gone[i]);
+	}
+	for (int i = anaglyph_buses.size() - 1; i >= 0; i--) {
+		if (!created_buses.has(anaglyph_buses[i])) {
+			anaglyph_buses.remove_at(i);
+		}
+	}
+	for (int kind = 0; kind < LIGHT_KIND_COUNT; kind++) {
+		Vector<StringName>& idle = light_pools[kind].idle;
+		for (int i = idle.size() - 1; i >= 0; i--) {
+			if (!created_buses.has(idle[i])) {
+				idle.remove_at(i);
+			}
+		}
+	}
+	// (Keeping the rooms' users, who return them as usual.)
+	for (int i = rooms.size() - 1; i >= 0; i--) {
+		if (!created_buses.has(rooms[i].bus)) {
+			rooms.remove_at(i);
+		}
+	}
+	Vector<StringName> lost_rooms;
+	for (const KeyValue<StringName, StringName>& kv : room_of) {
+		if (!created_buses.has(kv.value)) {
+			lost_rooms.push_back(kv.key);
+		}
+	}
+	for (int i = 0; i < lost_rooms.size(); i++) {
+		room_of.erase(lost_rooms[i]);
+	}
+	clusters.clear();
+	adopted_buses.clear();
+	layout_adopted = false;
+	layout_declares_buses = false;
+	silent_bus_ready = false;
+}
+
+bool AnaglyphBusManager::is_main_thread() {
+	OS* os = OS::get_singleton();
+	return os->get_thread_caller_id() == os->get_main_thread_id();
+}
+
+void AnaglyphBusManager::schedule_flush() {
+	if (flush_scheduled) {
+		return;
+	}
+	flush_scheduled = true;
+	callable_mp_static(&AnaglyphBusManager::flush_deferred).call_deferred();
+}
+
+void AnaglyphBusManager::flush_deferred() {
+	AnaglyphBusManager* self = get_singleton();
+	self->mutex->lock();
+	self->flush_scheduled = false;
+	AudioServer* audio = self->audio;
+
+	if (self->pending_adoption) {
+		self->pending_adoption = false;
+		if (!self->layout_adopted) {
+			self->adopt_layout_buses();
+		}
+	}
+
+	for (int i = 0; i < self->pending_additions; i++) {
+		if (self->total_bus_count() >= self->max_anaglyph_buses || self->is_layout_fixed()) {
+			break;
+		}
+		StringName name = self->add_bus(StringName(a_bus_name));
+		int index = self->get_bus_index(name);
+		Ref<AnaglyphEffect> effect = memnew(AnaglyphEffect);
+		audio->add_bus_effect(index, effect);
+		self->anaglyph_buses.push_back(name);
+	}
+	self->pending_additions = 0;
+
+	if (self->pending_drain_check) {
+		self->pending_drain_check = false;
+		self->update_draining_buses();
+	}
+
+	if (self->pending_gain_refresh) {
+		self->pending_gain_refresh = false;
+		self->refresh_bus_gains();
+	}
+
+	for (int i = 0; i < self->pending_sends.size(); i++) {
+		int index = self->get_bus_index(self->pending_sends[i].bus);
+		if (index >= 0) {
+			audio->set_bus_send(index, self->pending_sends[i].send);
+		}
+	}
+	self->pending_sends.clear();
+
+	for (int i = 0; i < self->pending_removals.size(); i++) {
+		int index = self->get_bus_index(self->pending_removals[i]);
+		if (index >= 0) {
+			audio->remove_bus(index);
+			AnaglyphHelpers::print("Removed Anaglyph audio bus ", self->pending_removals[i]);
+		}
+		self->created_buses.erase(self->pending_removals[i]);
+	}
+	self->pending_removals.clear();
+
+	if (self->pending_silent_bus) {
+		self->pending_silent_bus = false;
+		self->get_silent_bus();
+	}
+
+	// Last, so that these see everything above.
+	self->carry_out_deferred_borrows();
+	self->mutex->unlock();
+	self->reset_pending_effects();
+}
+
+void AnaglyphBusManager::reset_pending_effects() {
+	// Resetting waits for the AudioServer lock, so this must not hold our
+	// mutex. Otherwise, anyone who takes them the other way around
+	// (holding the AudioServer lock, then asking us for something)
+	// deadlocks with us.
+	Vector<Ref<AudioEffect>> effects;
+	{
+		MutexLock lock(*mutex.ptr());
+		effects = pending_resets;
+		pending_resets.clear();
+	}
+	for (int i = 0; i < effects.size(); i++) {
+		AnaglyphEffect* effect = Object::cast_to<AnaglyphEffect>(effects[i].ptr());
+		if (effect != nullptr) {
+			effect->reset_state();
+			continue;
+		}
+		AnaglyphRoomEffect* room = Object::cast_to<AnaglyphRoomEffect>(effects[i].ptr());
+		if (room != nullptr) {
+			room->reset_state();
+		}
+	}
+}
+
+StringName AnaglyphBusManager::take_deferred_borrow(
+	DeferredKind kind,
+	ObjectID borrower,
+	const StringName& base_bus,
+	const Ref<AnaglyphEffectData>& data,
+	bool allow_reset,
+	Ref<AudioEffect>& out_effect
+) {
+	out_effect = Ref<AudioEffect>(nullptr);
+	if (borrower.is_null()) {
+		// Nobody to hand it to later.
+		return StringName();
+	}
+	for (int i = 0; i < deferred_borrows.size(); i++) {
+		const DeferredBorrow& borrow = deferred_borrows[i];
+		if (borrow.kind != kind || borrow.borrower != borrower) {
+			continue;
+		}
+		if (!borrow.done) {
+			// Still waiting for the main thread.
+			return StringName();
+		}
+		DeferredBorrow taken = borrow;
+		deferred_borrows.remove_at(i);
+		if (taken.base_bus == base_bus && taken.data == data) {
+			if (!taken.name.is_empty()) {
+				out_effect = taken.effect;
+				return taken.name;
+			}
+			// There was no bus. Ask again below.
+		}
+		else {
+			// Asked for something else in the meantime.
+			return_deferred_borrow(taken);
+		}
+		break;
+	}
+
+	DeferredBorrow borrow;
+	borrow.kind = kind;
+	borrow.borrower = borrower;
+	borrow.base_bus = base_bus;
+	borrow.data = data;
+	borrow.allow_reset = allow_reset;
+	borrow.done = false;
+	borrow.done_msec = 0;
+	deferred_borrows.push_back(borrow);
+	schedule_flush();
+	return StringName();
+}
+
+void AnaglyphBusManager::return_deferred_borrow(const DeferredBorrow& borrow) {
+	if (borrow.name.is_empty()) {
+		return;
+	}
+	if (borrow.kind == DEFERRED_ANAGLYPH) {
+		// Nothing played on it.
+		return_anaglyph_bus(borrow.name, false, borrow.borrower);
+	}
+	else if (borrow.kind == DEFERRED_PANNER) {
+		return_light_bus(LIGHT_PANNER, borrow.name);
+	}
+	else {
+		return_light_bus(LIGHT_AMBISONIC, borrow.name);
+	}
+}
+
+void AnaglyphBusManager::carry_out_deferred_borrows() {
+	// Borrowing may sweep this list, so take the requests out first.
+	Vector<DeferredBorrow> requests;
+	for (int i = deferred_borrows.size() - 1; i >= 0; i--) {
+		if (!deferred_borrows[i].done) {
+			requests.push_back(deferred_borrows[i]);
+			deferred_borrows.remove_at(i);
+		}
+	}
+	uint64_t now = Time::get_singleton()->get_ticks_msec();
+	for (int i = requests.size() - 1; i >= 0; i--) {
+		DeferredBorrow borrow = requests[i];
+		if (borrow.kind == DEFERRED_ANAGLYPH) {
+			Ref<AnaglyphEffect> effect;
+			StringName name = lend_anaglyph_bus(borrow.base_bus, borrow.data, effect, borrow.allow_reset, borrow.borrower);
+			if (name != borrow.base_bus) {
+				borrow.name = name;
+				borrow.effect = effect;
+			}
+		}
+		else if (borrow.kind == DEFERRED_PANNER) {
+			borrow.name = borrow_light_bus(LIGHT_PANNER, borrow.base_bus, borrow.effect, borrow.borrower);
+		}
+		else {
+			Ref<AnaglyphAmbisonicEncoderEffect> effect;
+			borrow.name = borrow_ambisonic_bus(effect, borrow.borrower);
+			borrow.effect = effect;
+		}
+		borrow.done = true;
+		borrow.done_msec = now;
+		deferred_borrows.push_back(borrow);
+	}
+}
+
+void AnaglyphBusManager::sweep_deferred_borrows() {
+	uint64_t now = Time::get_singleton()->get_ticks_msec();
+	for (int i = deferred_borrows.size() - 1; i >= 0; i--) {
+		DeferredBorrow borrow = deferred_borrows[i];
+		bool gone = ObjectDB::get_instance(borrow.borrower) == nullptr;
+		bool stale = borrow.done && now - borrow.done_msec >= deferred_borrow_msec;
+		if (!gone && !stale) {
+			continue;
+		}
+		deferred_borrows.remove_at(i);
+		// (A freed borrower's bus is reclaimed with the rest of its buses.)
+		if (!gone) {
+			return_deferred_borrow(borrow);
+		}
+	}
+}
+
 AnaglyphBusManager* AnaglyphBusManager::get_singleton() {
+	// This is created on module initialization, so normally this doesn't
+	// race. The lazy path is just a safety net.
 	if (singleton == nullptr) {
 		singleton = new AnaglyphBusManager();
 		if (singleton == nullptr) {
@@ -74,19 +625,64 @@ AnaglyphBusManager* AnaglyphBusManager::get_singleton() {
 	return singleton;
 }
 
+void AnaglyphBusManager::free_singleton() {
+	if (singleton != nullptr) {
+		delete singleton;
+		singleton = nullptr;
+	}
+}
+
 AnaglyphBusManager::AnaglyphBusManager() {
 	anaglyph_buses = Vector<StringName>();
 	audio = AudioServer::get_singleton();
 	used_anaglyph_buses = 0;
 	max_anaglyph_buses = 4;
+	for (int kind = 0; kind < LIGHT_KIND_COUNT; kind++) {
+		light_pools[kind].max_buses = 32;
+		light_pools[kind].used_buses = 0;
+	}
+	ambisonic_output_bus = StringName("Master");
+	shared_reverb = false;
+	max_room_buses = 4;
+	preparing = false;
+	cluster_tolerance = 0;
+	last_poll_msec = 0;
+	layout_adopted = false;
+	layout_declares_buses = false;
+
+	mutex.instantiate();
+	pending_additions = 0;
+	pending_adoption = false;
+	pending_silent_bus = false;
+	pending_drain_check = false;
+	silent_bus_ready = false;
+	pending_gain_refresh = false;
+	flush_scheduled = false;
 }
 
 AnaglyphBusManager::~AnaglyphBusManager() {
 	// I don't *think* have to free Vectors?
-	// I mean, it's a singleton, I don't have to care anyways.
+	// The mutex is a Ref<>, so that one cleans up after itself.
 }
 
 void AnaglyphBusManager::prepare_anaglyph_buses(int count) {
+	MutexLock lock(*mutex.ptr());
+	if (!is_main_thread()) {
+		// Preparing is creating buses, and that's main thread business.
+		pending_adoption = true;
+		pending_additions += MAX(count, 0);
+		schedule_flush();
+		return;
+	}
+	if (!layout_adopted) {
+		adopt_layout_buses();
+	}
+	if (is_layout_fixed()) {
+		// Buses from the layout get their effect (and thus their warm-up)
+		// when the layout is loaded, and we don't add to a fixed layout.
+		return;
+	}
+
 	int maximum_added = max_anaglyph_buses - total_bus_count();
 	if (count < 0)
 		count = 0;
@@ -101,20 +697,56 @@ void AnaglyphBusManager::prepare_anaglyph_buses(int count) {
 		//  loop iterates at most, like, 3 times.)
 		Ref<AnaglyphEffectData> placeholder_data = memnew(AnaglyphEffectData);
 		Ref<AnaglyphEffect> placeholder_effect = nullptr;
-		StringName borrow = borrow_anaglyph_bus("Master", placeholder_data, placeholder_effect);
-		return_anaglyph_bus(borrow);
+		preparing = true;
+		StringName borrow = lend_anaglyph_bus("Master", placeholder_data, placeholder_effect, false, ObjectID());
+		preparing = false;
+		// Nothing played on it, so there's nothing to drain.
+		return_anaglyph_bus(borrow, false);
 	}
 }
 
 StringName AnaglyphBusManager::borrow_anaglyph_bus(
 	const StringName& base_bus,
 	const Ref<AnaglyphEffectData>& anaglyph_data,
-	Ref<AnaglyphEffect> &out_effect
+	Ref<AnaglyphEffect> &out_effect,
+	bool allow_reset,
+	ObjectID borrower
+) {
+	StringName name = lend_anaglyph_bus(base_bus, anaglyph_data, out_effect, allow_reset, borrower);
+	reset_pending_effects();
+	return name;
+}
+
+StringName AnaglyphBusManager::lend_anaglyph_bus(
+	const StringName& base_bus,
+	const Ref<AnaglyphEffectData>& anaglyph_data,
+	Ref<AnaglyphEffect> &out_effect,
+	bool allow_reset,
+	ObjectID borrower
 ) {
+	MutexLock lock(*mutex.ptr());
+	if (!is_main_thread()) {
+		Ref<AudioEffect> effect;
+		StringName name = take_deferred_borrow(DEFERRED_ANAGLYPH, borrower, base_bus, anaglyph_data, allow_reset, effect);
+		out_effect = effect;
+		return name.is_empty() ? base_bus : name;
+	}
+	if (!layout_adopted) {
+		adopt_layout_buses();
+	}
+	update_draining_buses();
+	if (anaglyph_buses.size() == 0) {
+		// We're about to create a new bus or give up. Before that, check
+		// whether someone's been hogging one without existing.
+		sweep_borrowers();
+	}
+
 	// Grab or create a bus.
 	// Grabbing may fail if AudioServer::set_bus_layout did a thing.
 	StringName name;
 	int index = -1;
+	// Whether the bus still has some previous tail that needs to be cut.
+	bool needs_reset = false;
 	if (anaglyph_buses.size() > 0) {
 		int last = anaglyph_buses.size() - 1;
 		name = anaglyph_buses.get(last);
@@ -124,17 +756,33 @@ StringName AnaglyphBusManager::borrow_anaglyph_bus(
 			// This means AudioServer::set_bus_layout did a thing.
 			// All of our storage is invalidated and we need to
 			// restart from scratch.
-			anaglyph_buses.clear();
+			// The new layout may have declared buses of its own.
+			invalidate_layout();
+			adopt_layout_buses();
+			if (anaglyph_buses.size() > 0) {
+				int new_last = anaglyph_buses.size() - 1;
+				name = anaglyph_buses.get(new_last);
+				index = get_bus_index(name);
+				anaglyph_buses.remove_at(new_last);
+			}
 		}
 		else {
 			anaglyph_buses.remove_at(last);
 		}
 	}
+	if (index == -1 && allow_reset && draining_buses.size() > 0) {
+		// No quiet buses, but we're allowed to cut a tail short.
+		// The oldest one has had the most time to decay.
+		name = draining_buses[0].name;
+		index = get_bus_index(name);
+		draining_buses.remove_at(0);
+		needs_reset = index != -1;
+	}
 	if (index == -1) {
 		// Either the pool was empty or everything was invalidated.
 		// Either way, grab a new bus if it doesn't push us past the limit.
 
-		if (total_bus_count() < max_anaglyph_buses) {
+		if (total_bus_count() < max_anaglyph_buses && !is_layout_fixed()) {
 			name = add_bus(StringName(a_bus_name));
 			index = get_bus_index(name);
 		}
@@ -146,10 +794,25 @@ StringName AnaglyphBusManager::borrow_anaglyph_bus(
 
 	// We added a new Anaglyph bus, so add to the active count
 	used_anaglyph_buses++;
+	borrowers.insert(name, borrower);
+
+	// With shared reverb, this bus sends to its room instead.
+	StringName room;
+	if (shared_reverb && !preparing && anaglyph_data != nullptr && !anaglyph_data->get_bypass_reverb()) {
+		room = borrow_room_bus(anaglyph_data, base_bus, name);
+		// (Adding a room may have shifted us.)
+		index = get_bus_index(name);
+	}
+	if (!room.is_empty()) {
+		room_of.insert(name, room);
+	}
+	StringName send = room.is_empty() ? base_bus : room;
 
 	// Set the anaglyph data.
+	// (Buses only lack an effect if we just created them ourselves.)
 	if (audio->get_bus_effect_count(index) == 0) {
 		Ref<AnaglyphEffect> effect = memnew(AnaglyphEffect);
+		effect->set_reverb_shared(!room.is_empty());
 		effect->set_effect_data(anaglyph_data);
 		audio->add_bus_effect(index, effect);
 		out_effect = effect;
@@ -160,64 +823,707 @@ StringName AnaglyphBusManager::borrow_anaglyph_bus(
 			AnaglyphHelpers::print_error("Internal Anaglyph busses have been messed with... Uhh... Don't do that.");
 		}
 		else {
+			if (needs_reset) {
+				// (Once we let go of our mutex, see `reset_pending_effects()`.)
+				pending_resets.push_back(effect);
+			}
+			effect->set_reverb_shared(!room.is_empty());
 			effect->set_effect_data(anaglyph_data);
 		}
 		out_effect = effect;
 	}
 
-	// Reroute it into the base bus
-	audio->set_bus_send(index, base_bus);
+	if (cluster_tolerance > 0 && !borrower.is_null() && out_effect != nullptr) {
+		// Its position comes with the first `place_cluster_member()`.
+		Cluster cluster;
+		cluster.data = anaglyph_data;
+		cluster.base_bus = base_bus;
+		cluster.effect = out_effect;
+		cluster.direction_sum = Vector3();
+		cluster.distance_sum = 0;
+		cluster.placed_count = 0;
+		ClusterMember member;
+		member.id = borrower;
+		member.placed = false;
+		member.drifted = false;
+		member.distance = 0;
+		cluster.members.push_back(member);
+		clusters.insert(name, cluster);
+	}
+
+	// Reroute it into the base bus (or its room)
+	audio->set_bus_send(index, send);
 	return name;
 }
 
-void AnaglyphBusManager::return_anaglyph_bus(const StringName& anaglyph_bus) {
+void AnaglyphBusManager::return_anaglyph_bus(const StringName& anaglyph_bus, bool drain, ObjectID borrower) {
+	MutexLock lock(*mutex.ptr());
+	if (clusters.has(anaglyph_bus)) {
+		Cluster& cluster = clusters[anaglyph_bus];
+		bool was_member = remove_cluster_member(cluster, borrower);
+		if (cluster.members.size() > 0) {
+			// Others still play through it. If it was the one who borrowed
+			// it, the next in line is now responsible for it.
+			if (was_member && borrowers.has(anaglyph_bus) && borrowers[anaglyph_bus] == borrower) {
+				borrowers[anaglyph_bus] = cluster.members[0].id;
+			}
+			return;
+		}
+		clusters.erase(anaglyph_bus);
+	}
 	// We're assuming proper input.
 	// Just return it to the list if the list isn't too full.
 	// Otherwise, delete the bus instead.
 	// (That may happen if the user reduces max_anaglyph_buses during runtime.)
+	if (!borrowers.erase(anaglyph_bus)) {
+		// Already returned (or never borrowed). Don't count it twice.
+		return;
+	}
 	used_anaglyph_buses--;
+	// The tail still drains through the room, but the room may be
+	// reconfigured once nobody's in it any more. That only cuts the
+	// reverb tail short.
+	if (room_of.has(anaglyph_bus)) {
+		return_room_bus(room_of[anaglyph_bus]);
+		room_of.erase(anaglyph_bus);
+	}
 	bool push = total_bus_count() < max_anaglyph_buses;
-	if (push) {
+	if (push && drain) {
+		DrainingBus draining;
+		draining.name = anaglyph_bus;
+		draining.returned_msec = Time::get_singleton()->get_ticks_msec();
 		// Source: returns `true` on failure.
+		push &= !draining_buses.push_back(draining);
+	}
+	else if (push) {
 		push &= !anaglyph_buses.push_back(anaglyph_bus);
 	}
 	if (!push) {
-		int index = get_bus_index(anaglyph_bus);
+		remove_managed_bus(anaglyph_bus);
+	}
+}
+
+void AnaglyphBusManager::remove_managed_bus(const StringName& name) {
+	if (adopted_buses.has(name)) {
+		// Don't touch the declared layout. It just sits unused until
+		// there's room for it again.
+		adopted_buses.erase(name);
+	}
+	else if (!is_main_thread()) {
+		pending_removals.push_back(name);
+		schedule_flush();
+	}
+	else {
+		int index = get_bus_index(name);
 		if (index >= 0) {
 			audio->remove_bus(index);
-			AnaglyphHelpers::print("Removed Anaglyph audio bus ", anaglyph_bus);
+			AnaglyphHelpers::print("Removed Anaglyph audio bus ", name);
 		}
+		created_buses.erase(name);
 	}
 }
 
 StringName AnaglyphBusManager::get_silent_bus() {
+	MutexLock lock(*mutex.ptr());
 	StringName name = StringName(s_bus_name);
+	if (!is_main_thread()) {
+		// Until the main thread gets to it, whoever uses it may be heard
+		// for a frame. Better than touching the AudioServer here.
+		if (!silent_bus_ready) {
+			pending_silent_bus = true;
+			schedule_flush();
+		}
+		return name;
+	}
 	int index = guarantee_bus(name);
-	audio->set_bus_mute(index, true);
-	return s_bus_name;
+	if (!audio->is_bus_mute(index)) {
+		audio->set_bus_mute(index, true);
+	}
+	silent_bus_ready = true;
+	return name;
 }
 
 void AnaglyphBusManager::set_max_anaglyph_buses(int max) {
+	MutexLock lock(*mutex.ptr());
 	// By default, we won't prepare the new space, so we only need to do
 	// anything when we decrease size.
 	// When decreasing, we need to ensure
-	//   anaglyph_buses.size() + used_anaglyph_buses < max
-	// We can only change the former.
+	//   anaglyph_buses.size() + draining_buses.size() + used_anaglyph_buses < max
+	// We can only change the former two. Draining buses go first, as they're
+	// the least useful right now.
 	// (Note that this is always true when increasing.)
 	if (total_bus_count() >= max) {
-		int new_size = max - used_anaglyph_buses;
+		int new_draining_size = max - used_anaglyph_buses;
+		if (new_draining_size < 0) {
+			new_draining_size = 0;
+		}
+		for (int i = new_draining_size; i < draining_buses.size(); i++) {
+			remove_managed_bus(draining_buses[i].name);
+		}
+		if (new_draining_size < draining_buses.size()) {
+			draining_buses.resize(new_draining_size);
+		}
+		int new_size = max - used_anaglyph_buses - draining_buses.size();
 		if (new_size < 0) {
 			new_size = 0;
 		}
-		int delta = anaglyph_buses.size() - new_size;
-		if (delta > 0) {
-			AnaglyphHelpers::print("Removed ", delta, " Anaglyph audio buses");
+		for (int i = new_size; i < anaglyph_buses.size(); i++) {
+			remove_managed_bus(anaglyph_buses[i]);
 		}
 		anaglyph_buses.resize(new_size);
 	}
 	max_anaglyph_buses = max;
+	// There may be declared buses we skipped because they didn't fit.
+	layout_adopted = false;
 }
 
 int AnaglyphBusManager::get_max_anaglyph_buses() {
+	MutexLock lock(*mutex.ptr());
 	return max_anaglyph_buses;
+}
+
+Ref<AudioEffect> AnaglyphBusManager::create_light_effect(LightKind kind) {
+	if (kind == LIGHT_AMBISONIC) {
+		return memnew(AnaglyphAmbisonicEncoderEffect);
+	}
+	return memnew(AnaglyphPannerEffect);
+}
+
+bool AnaglyphBusManager::is_light_effect(LightKind kind, const Ref<AudioEffect>& effect) {
+	if (kind == LIGHT_AMBISONIC) {
+		return Object::cast_to<AnaglyphAmbisonicEncoderEffect>(effect.ptr()) != nullptr;
+	}
+	return Object::cast_to<AnaglyphPannerEffect>(effect.ptr()) != nullptr;
+}
+
+StringName AnaglyphBusManager::add_light_bus(LightKind kind) {
+	StringName name = add_bus(StringName(light_bus_names[kind]));
+	int index = get_bus_index(name);
+	audio->add_bus_effect(index, create_light_effect(kind));
+	return name;
+}
+
+StringName AnaglyphBusManager::borrow_light_bus(LightKind kind, const StringName& send, Ref<AudioEffect>& out_effect, ObjectID borrower) {
+	LightPool& pool = light_pools[kind];
+	if (!layout_adopted) {
+		adopt_layout_buses();
+	}
+	if (pool.idle.size() == 0) {
+		sweep_borrowers();
+	}
+
+	StringName name;
+	int index = -1;
+	if (pool.idle.size() > 0) {
+		name = pool.idle[pool.idle.size() - 1];
+		index = get_bus_index(name);
+		if (index == -1) {
+			// AudioServer::set_bus_layout did a thing, see
+			// `borrow_anaglyph_bus()`.
+			invalidate_layout();
+			adopt_layout_buses();
+			if (pool.idle.size() > 0) {
+				name = pool.idle[pool.idle.size() - 1];
+				index = get_bus_index(name);
+			}
+		}
+		if (index != -1) {
+			pool.idle.remove_at(pool.idle.size() - 1);
+		}
+	}
+	if (index == -1) {
+		if (pool.total_bus_count() < pool.max_buses && !is_layout_fixed()) {
+			name = add_light_bus(kind);
+			index = get_bus_index(name);
+		}
+		else {
+			out_effect = Ref<AudioEffect>(nullptr);
+			return StringName();
+		}
+	}
+
+	Ref<AudioEffect> effect = audio->get_bus_effect(index, 0);
+	if (!is_light_effect(kind, effect)) {
+		AnaglyphHelpers::print_error("Internal ", light_descriptions[kind], " busses have been messed with... Uhh... Don't do that.");
+		out_effect = Ref<AudioEffect>(nullptr);
+		return StringName();
+	}
+	pool.used_buses++;
+	pool.borrowers.insert(name, borrower);
+	// Whatever the previous user left behind shouldn't be heard.
+	if (kind == LIGHT_AMBISONIC) {
+		Object::cast_to<AnaglyphAmbisonicEncoderEffect>(effect.ptr())->reset_state();
+	}
+	else {
+		Object::cast_to<AnaglyphPannerEffect>(effect.ptr())->reset_state();
+	}
+	out_effect = effect;
+	audio->set_bus_send(index, send);
+	return name;
+}
+
+void AnaglyphBusManager::return_light_bus(LightKind kind, const StringName& name) {
+	LightPool& pool = light_pools[kind];
+	if (!pool.borrowers.erase(name)) {
+		return;
+	}
+	pool.used_buses--;
+	if (pool.total_bus_count() < pool.max_buses) {
+		pool.idle.push_back(name);
+	}
+	else {
+		remove_managed_bus(name);
+	}
+}
+
+void AnaglyphBusManager::set_max_light_buses(LightKind kind, int max) {
+	LightPool& pool = light_pools[kind];
+	max = MAX(max, 0);
+	// Only idle buses can go. Borrowed ones go once they're returned.
+	while (pool.idle.size() > 0 && pool.total_bus_count() > max) {
+		StringName name = pool.idle[pool.idle.size() - 1];
+		pool.idle.remove_at(pool.idle.size() - 1);
+		remove_managed_bus(name);
+	}
+	pool.max_buses = max;
+}
+
+int AnaglyphBusManager::guarantee_decode_bus() {
+	StringName name = StringName(d_bus_name);
+	int index = get_bus_index(name);
+	if (index == -1) {
+		if (is_layout_fixed()) {
+			// Adding it now would put it after the declared ambisonic buses.
+			return -1;
+		}
+		add_bus(name);
+		index = get_bus_index(name);
+		audio->set_bus_send(index, ambisonic_output_bus);
+	}
+	if (audio->get_bus_effect_count(index) == 0) {
+		Ref<AnaglyphAmbisonicDecoderEffect> effect = memnew(AnaglyphAmbisonicDecoderEffect);
+		audio->add_bus_effect(index, effect);
+	}
+	else if (Object::cast_to<AnaglyphAmbisonicDecoderEffect>(audio->get_bus_effect(index, 0).ptr()) == nullptr) {
+		AnaglyphHelpers::print_warning("Bus ", name, " looks like the ambisonic decode bus, but its first effect is not an AnaglyphAmbisonicDecoderEffect.");
+		return -1;
+	}
+	return index;
+}
+
+StringName AnaglyphBusManager::borrow_panner_bus(
+	const StringName& base_bus,
+	Ref<AnaglyphPannerEffect>& out_effect,
+	ObjectID borrower
+) {
+	MutexLock lock(*mutex.ptr());
+	Ref<AudioEffect> effect;
+	StringName name;
+	if (is_main_thread()) {
+		name = borrow_light_bus(LIGHT_PANNER, base_bus, effect, borrower);
+	}
+	else {
+		name = take_deferred_borrow(DEFERRED_PANNER, borrower, base_bus, Ref<AnaglyphEffectData>(), false, effect);
+	}
+	out_effect = effect;
+	if (name.is_empty()) {
+		return base_bus;
+	}
+	return name;
+}
+
+void AnaglyphBusManager::return_panner_bus(const StringName& panner_bus) {
+	MutexLock lock(*mutex.ptr());
+	return_light_bus(LIGHT_PANNER, panner_bus);
+}
+
+void AnaglyphBusManager::set_max_panner_buses(int max) {
+	MutexLock lock(*mutex.ptr());
+	set_max_light_buses(LIGHT_PANNER, max);
+}
+
+int AnaglyphBusManager::get_max_panner_buses() {
+	MutexLock lock(*mutex.ptr());
+	return light_pools[LIGHT_PANNER].max_buses;
+}
+
+StringName AnaglyphBusManager::borrow_ambisonic_bus(
+	Ref<AnaglyphAmbisonicEncoderEffect>& out_effect,
+	ObjectID borrower
+) {
+	MutexLock lock(*mutex.ptr());
+	out_effect = Ref<AnaglyphAmbisonicEncoderEffect>(nullptr);
+	Ref<AudioEffect> effect;
+	if (!is_main_thread()) {
+		StringName name = take_deferred_borrow(DEFERRED_AMBISONIC, borrower, StringName(d_bus_name), Ref<AnaglyphEffectData>(), false, effect);
+		out_effect = effect;
+		return name;
+	}
+	if (!layout_adopted) {
+		adopt_layout_buses();
+	}
+	// Encoders without a decoder are just silence.
+	if (guarantee_decode_bus() == -1) {
+		return StringName();
+	}
+	StringName name = borrow_light_bus(LIGHT_AMBISONIC, StringName(d_bus_name), effect, borrower);
+	out_effect = effect;
+	return name;
+}
+
+void AnaglyphBusManager::return_ambisonic_bus(const StringName& ambisonic_bus) {
+	MutexLock lock(*mutex.ptr());
+	return_light_bus(LIGHT_AMBISONIC, ambisonic_bus);
+}
+
+void AnaglyphBusManager::set_max_ambisonic_buses(int max) {
+	MutexLock lock(*mutex.ptr());
+	set_max_light_buses(LIGHT_AMBISONIC, max);
+}
+
+int AnaglyphBusManager::get_max_ambisonic_buses() {
+	MutexLock lock(*mutex.ptr());
+	return light_pools[LIGHT_AMBISONIC].max_buses;
+}
+
+void AnaglyphBusManager::set_ambisonic_output_bus(const StringName& bus) {
+	MutexLock lock(*mutex.ptr());
+	ambisonic_output_bus = bus;
+	StringName name = StringName(d_bus_name);
+	if (is_main_thread()) {
+		int index = get_bus_index(name);
+		if (index >= 0) {
+			audio->set_bus_send(index, bus);
+		}
+	}
+	else {
+		PendingSend pending;
+		pending.bus = name;
+		pending.send = bus;
+		pending_sends.push_back(pending);
+		schedule_flush();
+	}
+}
+
+StringName AnaglyphBusManager::get_ambisonic_output_bus() {
+	MutexLock lock(*mutex.ptr());
+	return ambisonic_output_bus;
+}
+
+String AnaglyphBusManager::room_key(const Ref<AnaglyphEffectData>& data, const StringName& send) {
+	// Exact float comparisons are fine, as these all come straight from
+	// the inspector or code, not from any arithmetic.
+	return String(send)
+		+ "|" + String::num(data->get_room_id())
+		+ "|" + itos(data->get_reverb_type())
+		+ "|" + String::num(data->get_reverb_gain())
+		+ "|" + String(data->get_reverb_EQ());
+}
+
+StringName AnaglyphBusManager::add_room_bus(const StringName& send) {
+	int send_index = get_bus_index(send);
+	if (send_index == -1) {
+		return StringName();
+	}
+	StringName name = add_bus(StringName(r_bus_name), send_index + 1);
+	int index = get_bus_index(name);
+	audio->add_bus_effect(index, memnew(AnaglyphRoomEffect));
+	audio->set_bus_send(index, send);
+	Room room;
+	room.bus = name;
+	room.users = 0;
+	rooms.push_back(room);
+	return name;
+}
+
+StringName AnaglyphBusManager::borrow_room_bus(const Ref<AnaglyphEffectData>& data, const StringName& send, const StringName& source) {
+	if (!is_main_thread()) {
+		// This adds, reconfigures and reroutes room buses on the spot.
+		// Borrows off the main thread are deferred before they get here
+		// (see `take_deferred_borrow()`), so this shouldn't happen.
+		AnaglyphHelpers::print_error("Tried to borrow a room bus off the main thread.");
+		return StringName();
+	}
+	if (AnaglyphBridge::is_native()) {
+		// No reverb to share.
+		return StringName();
+	}
+	String key = room_key(data, send);
+
+	// Preferably a room that's already set up like this, otherwise an empty
+	// one we can reconfigure.
+	int chosen = -1;
+	for (int i = 0; i < rooms.size(); i++) {
+		if (rooms[i].key == key) {
+			chosen = i;
+			break;
+		}
+	}
+	if (chosen == -1) {
+		for (int i = 0; i < rooms.size(); i++) {
+			if (rooms[i].users == 0) {
+				chosen = i;
+				break;
+			}
+		}
+	}
+	if (chosen == -1) {
+		if (rooms.size() >= max_room_buses || is_layout_fixed()) {
+			return StringName();
+		}
+		if (add_room_bus(send).is_empty()) {
+			return StringName();
+		}
+		chosen = rooms.size() - 1;
+	}
+
+	Room& room = rooms.write[chosen];
+	// AudioServer sends anything that goes backwards to Master instead, so
+	// the room must sit between the two.
+	int room_index = get_bus_index(room.bus);
+	int send_index = get_bus_index(send);
+	int source_index = get_bus_index(source);
+	if (room_index == -1 || room_index <= send_index || room_index >= source_index) {
+		return StringName();
+	}
+	Ref<AnaglyphRoomEffect> effect = audio->get_bus_effect(room_index, 0);
+	if (effect == nullptr) {
+		AnaglyphHelpers::print_error("Internal room busses have been messed with... Uhh... Don't do that.");
+		return StringName();
+	}
+	if (room.key != key) {
+		// Nobody's in here, so the old tail can go. (Once we let go of our
+		// mutex, see `reset_pending_effects()`.)
+		pending_resets.push_back(effect);
+		effect->set_reverb_from(data);
+		room.key = key;
+		audio->set_bus_send(room_index, send);
+	}
+	room.users++;
+	return room.bus;
+}
+
+void AnaglyphBusManager::return_room_bus(const StringName& room) {
+	for (int i = 0; i < rooms.size(); i++) {
+		if (rooms[i].bus == room) {
+			rooms.write[i].users = MAX(rooms[i].users - 1, 0);
+			return;
+		}
+	}
+}
+
+void AnaglyphBusManager::set_shared_reverb(bool shared) {
+	MutexLock lock(*mutex.ptr());
+	shared_reverb = shared;
+}
+
+bool AnaglyphBusManager::get_shared_reverb() {
+	MutexLock lock(*mutex.ptr());
+	return shared_reverb;
+}
+
+void AnaglyphBusManager::set_max_room_buses(int max) {
+	MutexLock lock(*mutex.ptr());
+	max = MAX(max, 0);
+	// Only empty rooms can go. Rooms that are in use stay.
+	for (int i = rooms.size() - 1; i >= 0 && rooms.size() > max; i--) {
+		if (rooms[i].users > 0) {
+			continue;
+		}
+		StringName name = rooms[i].bus;
+		rooms.remove_at(i);
+		remove_managed_bus(name);
+	}
+	max_room_buses = max;
+}
+
+int AnaglyphBusManager::get_max_room_buses() {
+	MutexLock lock(*mutex.ptr());
+	return max_room_buses;
+}
+
+Vector3 AnaglyphBusManager::polar_to_direction(const Vector3& polar) {
+	// x right, y up, z forward.
+	float azimuth = Math::deg_to_rad(polar.x);
+	float elevation = Math::deg_to_rad(polar.y);
+	float horizontal = Math::cos(elevation);
+	return Vector3(Math::sin(azimuth) * horizontal, Math::sin(elevation), Math::cos(azimuth) * horizontal);
+}
+
+Vector3 AnaglyphBusManager::direction_to_polar(const Vector3& direction, float distance) {
+	float horizontal = Math::sqrt(direction.x * direction.x + direction.z * direction.z);
+	return Vector3(
+		Math::rad_to_deg(Math::atan2(direction.x, direction.z)),
+		Math::rad_to_deg(Math::atan2(direction.y, horizontal)),
+		distance
+	);
+}
+
+bool AnaglyphBusManager::fits_cluster(const Cluster& cluster, const Vector3& direction, float distance, float tolerance_scale) const {
+	if (cluster.placed_count == 0) {
+		return false;
+	}
+	float length = cluster.direction_sum.length();
+	if (length < 1e-4f) {
+		// Everyone's all over the place, there's no centre to be near.
+		return false;
+	}
+	float angle = MIN(cluster_tolerance * tolerance_scale, 180.0f);
+	if (direction.dot(cluster.direction_sum / length) < Math::cos(Math::deg_to_rad(angle))) {
+		return false;
+	}
+	float centroid_distance = MAX(cluster.distance_sum / cluster.placed_count, 0.1f);
+	distance = MAX(distance, 0.1f);
+	float ratio = MAX(distance, centroid_distance) / MIN(distance, centroid_distance);
+	return ratio <= cluster_distance_ratio * tolerance_scale;
+}
+
+void AnaglyphBusManager::unplace_cluster_member(Cluster& cluster, ClusterMember& member) {
+	if (!member.placed || member.drifted) {
+		return;
+	}
+	cluster.direction_sum -= member.direction;
+	cluster.distance_sum -= member.distance;
+	cluster.placed_count--;
+	member.placed = false;
+}
+
+bool AnaglyphBusManager::remove_cluster_member(Cluster& cluster, ObjectID id) {
+	for (int i = 0; i < cluster.members.size(); i++) {
+		if (cluster.members[i].id == id) {
+			unplace_cluster_member(cluster, cluster.members.write[i]);
+			cluster.members.remove_at(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+void AnaglyphBusManager::sweep_cluster_members() {
+	for (KeyValue<StringName, Cluster>& kv : clusters) {
+		Cluster& cluster = kv.value;
+		for (int i = cluster.members.size() - 1; i >= 0; i--) {
+			ObjectID id = cluster.members[i].id;
+			// (The borrower is left to `sweep_borrowers()`, which also
+			//  returns the bus if it was the last one.)
+			bool is_borrower = borrowers.has(kv.key) && borrowers[kv.key] == id;
+			if (!is_borrower && ObjectDB::get_instance(id) == nullptr) {
+				remove_cluster_member(cluster, id);
+			}
+		}
+	}
+}
+
+StringName AnaglyphBusManager::join_anaglyph_cluster(
+	const StringName& base_bus,
+	const Ref<AnaglyphEffectData>& anaglyph_data,
+	const Vector3& polar,
+	Ref<AnaglyphEffect>& out_effect,
+	ObjectID member
+) {
+	MutexLock lock(*mutex.ptr());
+	out_effect = Ref<AnaglyphEffect>(nullptr);
+	if (cluster_tolerance <= 0 || member.is_null() || anaglyph_data == nullptr) {
+		return StringName();
+	}
+	// By value, as players usually have their own copy of the same
+	// settings (see `dupe_protection`, and the oneshot pool).
+	uint32_t settings_hash = anaglyph_data->hash_settings();
+	Vector3 direction = polar_to_direction(polar);
+	// The closest centroid wins.
+	StringName best;
+	float best_dot = -2;
+	for (const KeyValue<StringName, Cluster>& kv : clusters) {
+		const Cluster& cluster = kv.value;
+		// Different settings (or bus) sound different, so that can't be
+		// shared. (The cluster's data may have changed since, so this hashes
+		// it again instead of remembering.)
+		if (cluster.base_bus != base_bus || cluster.data == nullptr || cluster.data->hash_settings() != settings_hash) {
+			continue;
+		}
+		if (!fits_cluster(cluster, direction, polar.z, 1)) {
+			continue;
+		}
+		float dot = direction.dot(cluster.direction_sum.normalized());
+		if (dot > best_dot) {
+			best_dot = dot;
+			best = kv.key;
+		}
+	}
+	if (best.is_empty()) {
+		return StringName();
+	}
+
+	Cluster& cluster = clusters[best];
+	ClusterMember joined;
+	joined.id = member;
+	joined.placed = true;
+	joined.drifted = false;
+	joined.direction = direction;
+	joined.distance = polar.z;
+	cluster.members.push_back(joined);
+	cluster.direction_sum += direction;
+	cluster.distance_sum += polar.z;
+	cluster.placed_count++;
+	out_effect = cluster.effect;
+	return best;
+}
+
+AnaglyphBusManager::ClusterPlacement AnaglyphBusManager::place_cluster_member(const StringName& anaglyph_bus, ObjectID member, const Vector3& polar) {
+	MutexLock lock(*mutex.ptr());
+	if (!clusters.has(anaglyph_bus)) {
+		return CLUSTER_NONE;
+	}
+	Cluster& cluster = clusters[anaglyph_bus];
+	int index = -1;
+	for (int i = 0; i < cluster.members.size(); i++) {
+		if (cluster.members[i].id == member) {
+			index = i;
+			break;
+		}
+	}
+	if (index == -1) {
+		return CLUSTER_NONE;
+	}
+	ClusterMember& self = cluster.members.write[index];
+	if (self.drifted) {
+		return CLUSTER_DRIFTED;
+	}
+
+	unplace_cluster_member(cluster, self);
+	Vector3 direction = polar_to_direction(polar);
+	// Only when there's someone else to compare with. On your own, you're
+	// always in the centre.
+	if (cluster.placed_count > 0 && !fits_cluster(cluster, direction, polar.z, cluster_hysteresis)) {
+		self.drifted = true;
+	}
+	else {
+		self.placed = true;
+		self.direction = direction;
+		self.distance = polar.z;
+		cluster.direction_sum += direction;
+		cluster.distance_sum += polar.z;
+		cluster.placed_count++;
+	}
+
+	// Everyone moves the bus every frame, which is a bit redundant, but
+	// it's only three parameters.
+	if (cluster.placed_count > 0 && cluster.direction_sum.length() >= 1e-4f) {
+		Vector3 centroid = direction_to_polar(cluster.direction_sum, cluster.distance_sum / cluster.placed_count);
+		cluster.effect->set_azimuth(centroid.x);
+		cluster.effect->set_elevation(centroid.y);
+		cluster.effect->set_distance(centroid.z);
+	}
+	return self.drifted ? CLUSTER_DRIFTED : CLUSTER_PLACED;
+}
+
+void AnaglyphBusManager::set_cluster_tolerance(float degrees) {
+	MutexLock lock(*mutex.ptr());
+	// (Existing clusters stay until they empty out, even when turned off.)
+	cluster_tolerance = CLAMP(degrees, 0.0f, 180.0f);
+}
+
+float AnaglyphBusManager::get_cluster_tolerance() {
+	MutexLock lock(*mutex.ptr());
+	return cluster_tolerance;
 }
\ No newline at end of file
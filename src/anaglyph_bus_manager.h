@@ -1,17 +1,123 @@
 #ifndef GDANAGLYPH_BUSES
 #define GDANAGLYPH_BUSES
 
+#include "anaglyph_ambisonic_effect.h"
 #include "anaglyph_effect.h"
+#include "anaglyph_panner_effect.h"
+#include "anaglyph_room_effect.h"
 
 #include <godot_cpp/classes/audio_server.hpp>
+#include <godot_cpp/classes/mutex.hpp>
+#include <godot_cpp/core/object_id.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/hash_set.hpp>
 
 namespace godot {
+	// All public methods are safe to call from any thread (e.g. from nodes
+	// in a threaded process group). The AudioServer (adding/removing buses,
+	// rerouting them, but also looking them up and setting up their effects)
+	// is only ever touched on the main thread. Whatever needs it on another
+	// thread is deferred to the main thread's next idle time instead.
+	// Borrowing too: off the main thread, a borrow only leaves a request,
+	// and the borrower gets the bus when it asks again after that.
 	class AnaglyphBusManager {
 
 	private:
 		static AnaglyphBusManager* singleton;
 
+		// Guards everything below. Godot's mutexes are reentrant, which we
+		// need as e.g. `prepare_anaglyph_buses()` borrows and returns.
+		Ref<Mutex> mutex;
+
+		// AudioServer mutations requested off the main thread, waiting for
+		// `flush_deferred()`.
+		struct PendingSend {
+			StringName bus;
+			StringName send;
+		};
+		Vector<PendingSend> pending_sends;
+		Vector<StringName> pending_removals;
+		// Buses to create (with effect) and put in the pool, see
+		// `prepare_anaglyph_buses()`.
+		int pending_additions;
+		bool pending_adoption;
+		bool pending_silent_bus;
+		// Draining buses are only checked on the main thread, as that reads
+		// their meters.
+		bool pending_drain_check;
+		// Whether the silent bus exists and is muted, as far as we know.
+		bool silent_bus_ready;
+		bool pending_gain_refresh;
+		bool flush_scheduled;
+
+		// Borrows requested off the main thread. The main thread carries
+		// them out, and the bus then waits in here until its borrower asks
+		// again (which players do every so often anyway).
+		enum DeferredKind {
+			DEFERRED_ANAGLYPH = 0,
+			DEFERRED_PANNER = 1,
+			DEFERRED_AMBISONIC = 2
+		};
+		struct DeferredBorrow {
+			DeferredKind kind;
+			ObjectID borrower;
+			StringName base_bus;
+			Ref<AnaglyphEffectData> data;
+			bool allow_reset;
+			// Whether the main thread got to it. If so, `name` is the
+			// borrowed bus, or empty if there was none.
+			bool done;
+			uint64_t done_msec;
+			StringName name;
+			Ref<AudioEffect> effect;
+		};
+		Vector<DeferredBorrow> deferred_borrows;
+		// Buses nobody came to pick up are given back after this long.
+		static const uint64_t deferred_borrow_msec;
+		// Hands out the bus of an earlier request by `borrower`, if it's
+		// there and still fits. Otherwise leaves a (new) request and returns
+		// an empty name.
+		StringName take_deferred_borrow(
+			DeferredKind kind,
+			ObjectID borrower,
+			const StringName& base_bus,
+			const Ref<AnaglyphEffectData>& data,
+			bool allow_reset,
+			Ref<AudioEffect>& out_effect
+		);
+		// Gives a bus from a request back, without it ever being used.
+		void return_deferred_borrow(const DeferredBorrow& borrow);
+		// Carries out all requests. Main thread only.
+		void carry_out_deferred_borrows();
+		// Forgets requests of freed borrowers, and gives back buses that
+		// weren't picked up in time.
+		void sweep_deferred_borrows();
+
+		static bool is_main_thread();
+		// Ensures `flush_deferred()` runs on the main thread soon-ish.
+		void schedule_flush();
+		// Executes all pending AudioServer mutations. Main thread only.
+		static void flush_deferred();
+
+		// Effects of borrowed buses whose previous tail should be cut
+		// (AnaglyphEffects and AnaglyphRoomEffects). Resetting takes the
+		// AudioServer lock, so these wait until our mutex is released.
+		Vector<Ref<AudioEffect>> pending_resets;
+		// Resets all of the above. Must not be called with the mutex held.
+		void reset_pending_effects();
+
+		// Returned buses still ring out with the reverb tail (and Anaglyph's
+		// internal latency) of whoever used them last. They sit in here until
+		// their meters say they're quiet, and only then go back to the pool.
+		struct DrainingBus {
+			StringName name;
+			uint64_t returned_msec;
+		};
+
+		// Idle buses that are quiet and ready to go.
 		Vector<StringName> anaglyph_buses;
+		// Returned buses that are still ringing out.
+		Vector<DrainingBus> draining_buses;
 		// Maximum allowed Anaglyph buses. Beyond this, no new buses are
 		// introduced, and instead a fallback should be used.
 		// If this is reduced, it won't stop existing Anaglyph buses from
@@ -21,6 +127,217 @@ namespace godot {
 		// The total amount of buses that exist, both inactive and active.
 		// `max_anaglyph_buses` should only be compared with this number.
 		int total_bus_count() const;
+
+		// A draining bus counts as silent once both its meters dip below
+		// this, and it has drained for at least `min_drain_msec`.
+		// If it somehow never gets silent, it's forced back into the pool
+		// after `max_drain_msec`.
+		static const float drain_threshold_db;
+		static const uint64_t min_drain_msec;
+		static const uint64_t max_drain_msec;
+
+		// Moves all draining buses whose tail has died out back to the pool.
+		// Main thread only.
+		void update_draining_buses();
+		// Does the borrowing of `borrow_anaglyph_bus()`, except for the
+		// resets, which are left in `pending_resets`.
+		StringName lend_anaglyph_bus(
+			const StringName& base_bus,
+			const Ref<AnaglyphEffectData>& anaglyph_data,
+			Ref<AnaglyphEffect>& out_effect,
+			bool allow_reset,
+			ObjectID borrower
+		);
+		// Gets rid of a bus of ours that's no longer in any pool (of any
+		// kind, rooms too): removes it (on the main thread), unless it was
+		// declared in the layout.
+		void remove_managed_bus(const StringName& name);
+
+		// Who borrowed which bus. Nodes can get freed without ever returning
+		// their bus, so we can't trust borrowers to clean up after themselves.
+		// A bus is in here exactly as long as it's counted in
+		// `used_anaglyph_buses`, so returning is only ever accounted once.
+		// (Borrowers without an ID, like our own preparation, are stored as
+		//  the null ObjectID and never swept.)
+		HashMap<StringName, ObjectID> borrowers;
+		// Returns all buses whose borrower no longer exists.
+		void sweep_borrowers();
+
+		// Crowds, rain, swarms: lots of sources in about the same direction.
+		// With clustering on, a player that wants an Anaglyph bus first
+		// looks for a borrowed one whose sources are close enough in
+		// direction and distance, and plays through that instead. The bus
+		// then sits at the centroid of everyone in it, and whoever wanders
+		// too far from that centroid leaves again.
+		// Every borrowed bus (with a borrower) is a cluster of its own,
+		// whose first member is its borrower. The bus only goes back to the
+		// pool when its last member leaves.
+		struct ClusterMember {
+			ObjectID id;
+			// Whether `direction` and `distance` are set yet.
+			bool placed;
+			// Wandered off, and doesn't count towards the centroid any more.
+			bool drifted;
+			Vector3 direction;
+			float distance;
+		};
+		struct Cluster {
+			Ref<AnaglyphEffectData> data;
+			StringName base_bus;
+			Ref<AnaglyphEffect> effect;
+			Vector<ClusterMember> members;
+			// Over all placed members that haven't drifted.
+			Vector3 direction_sum;
+			float distance_sum;
+			int placed_count;
+		};
+		HashMap<StringName, Cluster> clusters;
+		// In degrees. Zero disables clustering.
+		float cluster_tolerance;
+		// Members leave once they're this much further off than
+		// `cluster_tolerance` (and `cluster_distance_ratio`) allows joining.
+		static const float cluster_hysteresis;
+		// Only sources whose distances are within this factor of the
+		// centroid's can join. Anaglyph's attenuation and parallax care
+		// about distance too.
+		static const float cluster_distance_ratio;
+		// Azimuth/elevation/distance to a unit vector, and back.
+		static Vector3 polar_to_direction(const Vector3& polar);
+		static Vector3 direction_to_polar(const Vector3& direction, float distance);
+		// Whether a source at `direction` and `distance` is within
+		// `tolerance_scale` times the tolerances of the cluster's centroid.
+		bool fits_cluster(const Cluster& cluster, const Vector3& direction, float distance, float tolerance_scale) const;
+		// Takes a member out of the centroid (but not the cluster).
+		static void unplace_cluster_member(Cluster& cluster, ClusterMember& member);
+		// Returns whether it was a member.
+		static bool remove_cluster_member(Cluster& cluster, ObjectID id);
+		// Drops all members that no longer exist.
+		void sweep_cluster_members();
+
+		// Buses whose effect costs next to nothing are pools of their own,
+		// for players too far away to deserve Anaglyph but close enough to
+		// want some direction:
+		// - panner buses, with an AnaglyphPannerEffect, which send to
+		//   whatever bus the player wants;
+		// - ambisonic buses, with an AnaglyphAmbisonicEncoderEffect, which
+		//   all send to the decode bus.
+		// These pools are a lot bigger, and don't drain: a returned bus is
+		// idle right away, and gets reset (which fades in) when borrowed
+		// again.
+		enum LightKind {
+			LIGHT_PANNER = 0,
+			LIGHT_AMBISONIC = 1,
+			LIGHT_KIND_COUNT = 2
+		};
+		struct LightPool {
+			Vector<StringName> idle;
+			HashMap<StringName, ObjectID> borrowers;
+			int max_buses;
+			int used_buses;
+
+			int total_bus_count() const { return idle.size() + used_buses; }
+		};
+		LightPool light_pools[LIGHT_KIND_COUNT];
+		static char* light_bus_names[LIGHT_KIND_COUNT];
+		static Ref<AudioEffect> create_light_effect(LightKind kind);
+		// Whether this is the effect this kind of bus should have first.
+		static bool is_light_effect(LightKind kind, const Ref<AudioEffect>& effect);
+		// Adds a bus of this kind with its effect, and returns its name.
+		// Main thread only.
+		StringName add_light_bus(LightKind kind);
+		// Like `borrow_anaglyph_bus()`. Returns an empty name if there is no
+		// free bus. Main thread only.
+		StringName borrow_light_bus(LightKind kind, const StringName& send, Ref<AudioEffect>& out_effect, ObjectID borrower);
+		void return_light_bus(LightKind kind, const StringName& name);
+		void set_max_light_buses(LightKind kind, int max);
+
+		// All ambisonic buses send to this one bus, whose decoder renders
+		// them all at once. AudioServer only lets buses send to buses before
+		// them, so this must come before every ambisonic bus. When we create
+		// buses ourselves, that's a given, as this one is created first.
+		static char* d_bus_name;
+		// Where the decode bus sends to.
+		StringName ambisonic_output_bus;
+		// Makes sure the decode bus exists and has its decoder, and returns
+		// its index, or -1 if it can't be had. Main thread only.
+		int guarantee_decode_bus();
+
+		// With shared reverb on, Anaglyph buses bypass their own reverb and
+		// send into a room bus instead, which does the reverb for every
+		// Anaglyph bus with the same reverb settings and base bus at once.
+		// Room buses with nobody in them stay around (quietly, once their
+		// tail is done), and get reconfigured for whatever room is needed
+		// next.
+		struct Room {
+			StringName bus;
+			// What it's currently configured for, see `room_key()`. Empty
+			// for rooms that haven't been used yet.
+			String key;
+			int users;
+		};
+		Vector<Room> rooms;
+		// Which room each borrowed Anaglyph bus sends into.
+		HashMap<StringName, StringName> room_of;
+		bool shared_reverb;
+		int max_room_buses;
+		// Set while `prepare_anaglyph_buses()` borrows, which shouldn't drag
+		// rooms into existence.
+		bool preparing;
+		static char* r_bus_name;
+		// Sources with the same key can share a room.
+		static String room_key(const Ref<AnaglyphEffectData>& data, const StringName& send);
+		// Adds a room bus right after `send`, so that it can send there and
+		// the Anaglyph buses after it can send to it. Main thread only.
+		StringName add_room_bus(const StringName& send);
+		// Gets a room bus for this data that the Anaglyph bus `source` can
+		// send into. Returns an empty name if there is none, in which case
+		// the Anaglyph bus should just do its own reverb. Main thread only,
+		// and refuses (with an error) anywhere else.
+		StringName borrow_room_bus(const Ref<AnaglyphEffectData>& data, const StringName& send, const StringName& source);
+		void return_room_bus(const StringName& room);
+
+		// Creating buses mid-game resizes all of AudioServer's bus arrays and
+		// fires layout-changed signals, which hitches. So users can instead
+		// declare Anaglyph buses in their bus layout (any bus named
+		// `[Anaglyph_Bus]`, `[Anaglyph_Bus] 1`, ...), which we then adopt.
+		// The same goes for panner buses (`[Anaglyph_Panner]`, ...),
+		// ambisonic buses (`[Anaglyph_Ambisonic]`, ...), the decode bus
+		// (`[Anaglyph_Ambisonic_Decode]`), and room buses
+		// (`[Anaglyph_Room]`, ...).
+		// Once we've adopted anything, we never add or remove buses ourselves
+		// and the bus graph stays as the user declared it.
+		HashSet<StringName> adopted_buses;
+		// Buses we added ourselves. These are already in (or borrowed from)
+		// one of our pools, so the layout scan must never adopt them.
+		HashSet<StringName> created_buses;
+		// Whether we've looked through the current layout yet.
+		bool layout_adopted;
+		// Whether the current layout declares any Anaglyph buses at all.
+		bool layout_declares_buses;
+		// Looks for declared Anaglyph buses we don't know about yet, and puts
+		// them in the pool.
+		void adopt_layout_buses();
+		// Whether adopted buses exist, in which case the bus graph is fixed.
+		bool is_layout_fixed() const;
+		// AudioServer::set_bus_layout did a thing and none of our bus names
+		// can be trusted any more.
+		void invalidate_layout();
+
+		// Players estimate how loud they are every frame, which includes
+		// the volume of the bus they play on. That may happen off the main
+		// thread, so the buses anyone asked about are read in here on the
+		// main thread (on `poll()`), and players read this instead.
+		struct BusGain {
+			float volume_db;
+			bool mute;
+		};
+		HashMap<StringName, BusGain> bus_gains;
+		// Reads every bus in `bus_gains` again. Main thread only.
+		void refresh_bus_gains();
+
+		// `poll()` only does actual work once every this many msec.
+		static const uint64_t poll_interval_msec;
+		uint64_t last_poll_msec;
 		
 		// These were formerly a StringName, but godot crashes on trying to
 		// static-init most of its types.
@@ -29,9 +346,10 @@ namespace godot {
 
 		AudioServer* audio;
 
-		// Adds an audio bus, and returns its index.
+		// Adds an audio bus at this index (or at the end), and returns its
+		// name.
 		// If the name is taken, it adds a digit until it isn't taken any more.
-		StringName add_bus(StringName base_name);
+		StringName add_bus(StringName base_name, int at_position = -1);
 		// Guarantees the existence of a bus, and returns its index.
 		int guarantee_bus(StringName name);
 		// Godot is name-first reorder-second.
@@ -42,6 +360,8 @@ namespace godot {
 
 	public:
 		static AnaglyphBusManager* get_singleton();
+		// Frees the singleton. Only to be called on module deinitialization.
+		static void free_singleton();
 
 		AnaglyphBusManager();
 		~AnaglyphBusManager();
@@ -54,22 +374,121 @@ namespace godot {
 
 		// Tries to get a free anaglyph'd bus, which gets its output rerouted
 		// into the base bus.
-		// If there is no free bus, directly returns the base bus.
+		// If there is no free bus, directly returns the base bus. Off the
+		// main thread, that's also what the first try returns; see the top.
 		// If an Anaglyph bus is returned, out_effect will be set to the bus's
 		// effect. Otherwise, it will be set to nullptr.
+		// Quiet buses are always preferred. If there are none, but there are
+		// buses still draining their previous tail, `allow_reset` decides
+		// whether we may cut that tail short and reset the bus for immediate
+		// reuse. Otherwise, we wait for the tail to die out.
+		// The `borrower` is remembered so that the bus can be reclaimed if the
+		// borrower gets freed without returning it.
 		StringName borrow_anaglyph_bus(
 			const StringName& base_bus,
 			const Ref<AnaglyphEffectData>& anaglyph_data,
-			Ref<AnaglyphEffect>& out_effect
+			Ref<AnaglyphEffect>& out_effect,
+			bool allow_reset = false,
+			ObjectID borrower = ObjectID()
 		);
 		// Once you're done with a bus, return it.
-		// This does not do any validation.
-		void return_anaglyph_bus(const StringName& anaglyph_bus);
+		// Returning a bus that is not borrowed (e.g. returning twice) is
+		// ignored.
+		// If `drain` is true, the bus first needs to ring out before anyone
+		// can borrow it without resetting it. Only pass false if you know the
+		// bus hasn't been playing anything.
+		// With clustering, `borrower` leaves the bus's cluster, and the bus
+		// only goes back to the pool if nobody else is still in it.
+		void return_anaglyph_bus(const StringName& anaglyph_bus, bool drain = true, ObjectID borrower = ObjectID());
+
+		// How `place_cluster_member()` went.
+		enum ClusterPlacement {
+			// The bus isn't clustered, so set its position yourself.
+			CLUSTER_NONE = 0,
+			// The bus has been moved to its cluster's centroid.
+			CLUSTER_PLACED = 1,
+			// This member wandered off, and should move to a bus of its own
+			// (and return this one once it's no longer heard on it).
+			CLUSTER_DRIFTED = 2
+		};
+		// Tries to join the cluster of an already borrowed bus with the same
+		// base bus and settings (compared by value), whose sources are close
+		// to `polar`. Returns the bus, or an empty name if none fits, in
+		// which case out_effect is set to nullptr. Return it like any other
+		// borrowed bus.
+		StringName join_anaglyph_cluster(
+			const StringName& base_bus,
+			const Ref<AnaglyphEffectData>& anaglyph_data,
+			const Vector3& polar,
+			Ref<AnaglyphEffect>& out_effect,
+			ObjectID member
+		);
+		// For every member of a (possibly) clustered bus, every frame,
+		// instead of setting the bus's position directly.
+		ClusterPlacement place_cluster_member(const StringName& anaglyph_bus, ObjectID member, const Vector3& polar);
+
+		// The angle, in degrees, within which sources may share an Anaglyph
+		// bus. Zero (the default) disables clustering.
+		void set_cluster_tolerance(float degrees);
+		float get_cluster_tolerance();
+		// Does periodic housekeeping: finished draining buses are put back
+		// into the pool, and buses of freed borrowers are reclaimed.
+		// This is cheap to call every frame, as it throttles itself.
+		void poll();
+
 		// Gets a muted bus.
 		StringName get_silent_bus();
 
+		// The volume of a bus, or -INF if it's muted. This is as of the last
+		// `poll()`, so it may lag behind by a bit. Off the main thread, buses
+		// nobody asked about before count as 0dB until the main thread has
+		// had a look.
+		float get_bus_gain_db(const StringName& bus);
+
 		void set_max_anaglyph_buses(int max);
 		int get_max_anaglyph_buses();
+
+		// Like `borrow_anaglyph_bus()`, but for a panner bus. If there is no
+		// free bus, directly returns the base bus, and out_effect will be set
+		// to nullptr.
+		StringName borrow_panner_bus(
+			const StringName& base_bus,
+			Ref<AnaglyphPannerEffect>& out_effect,
+			ObjectID borrower = ObjectID()
+		);
+		// Returning a bus that is not borrowed is ignored.
+		void return_panner_bus(const StringName& panner_bus);
+
+		void set_max_panner_buses(int max);
+		int get_max_panner_buses();
+
+		// Like `borrow_panner_bus()`, but for an ambisonic encoder bus,
+		// which always sends to the decode bus. If there is no free bus (or
+		// no decode bus), returns an empty name, and out_effect will be set
+		// to nullptr.
+		StringName borrow_ambisonic_bus(
+			Ref<AnaglyphAmbisonicEncoderEffect>& out_effect,
+			ObjectID borrower = ObjectID()
+		);
+		// Returning a bus that is not borrowed is ignored.
+		void return_ambisonic_bus(const StringName& ambisonic_bus);
+
+		void set_max_ambisonic_buses(int max);
+		int get_max_ambisonic_buses();
+
+		// The bus the decoded ambisonic mix goes to. "Master" by default.
+		void set_ambisonic_output_bus(const StringName& bus);
+		StringName get_ambisonic_output_bus();
+
+		// Whether Anaglyph buses share one reverb per room configuration,
+		// instead of each doing their own. Only affects buses borrowed
+		// after this is set. Off by default.
+		void set_shared_reverb(bool shared);
+		bool get_shared_reverb();
+
+		// Beyond this many rooms, Anaglyph buses do their own reverb again.
+		void set_max_room_buses(int max);
+		int get_max_room_buses();
 	};
 }
 
@@ -1,22 +1,67 @@
 #include "anaglyph_dll_bridge.h"
+#include "anaglyph_ambisonics.h"
+#include "anaglyph_float_mode.h"
+#include "anaglyph_native_backend.h"
 #include "helpers.h"
 
 #include <godot_cpp/classes/audio_server.hpp>
+#include <godot_cpp/classes/dir_access.hpp>
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/classes/project_settings.hpp>
 #include <godot_cpp/core/error_macros.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
 #include <godot_cpp/variant/variant.hpp>
+#include <string.h>
 
+#ifdef _WIN32
 #include <windows.h>
 #include <libloaderapi.h>
+#endif
 
 using namespace godot;
 
 UnityAudioEffectDefinition* AnaglyphBridge::anaglyph_definition = nullptr;
 bool AnaglyphBridge::loading_failed = false;
+bool AnaglyphBridge::native = false;
+UnityAudioEffectDefinition* AnaglyphBridge::dll_ambisonic_definition = nullptr;
 std::string AnaglyphBridge::dll_path = ".\\Anaglyph\\audioplugin_Anaglyph.dll";
 int AnaglyphBridge::computed_buffer_size = 0;
 
 typedef int(AUDIO_CALLING_CONVENTION* GetAudioEffectDefinitions)(UnityAudioEffectDefinition*** descptr);
 
+static const char* backend_setting = "audio/anaglyph/backend";
+static const char* flush_denormals_setting = "audio/anaglyph/flush_denormals";
+
+void AnaglyphBridge::register_project_settings() {
+	ProjectSettings* settings = ProjectSettings::get_singleton();
+	if (!settings->has_setting(backend_setting)) {
+		settings->set_setting(backend_setting, BACKEND_AUTO);
+	}
+	settings->set_initial_value(backend_setting, BACKEND_AUTO);
+	Dictionary info;
+	info["name"] = backend_setting;
+	info["type"] = Variant::INT;
+	info["hint"] = PROPERTY_HINT_ENUM;
+	info["hint_string"] = "Auto,Anaglyph Dll,Native";
+	settings->add_property_info(info);
+
+	if (!settings->has_setting(flush_denormals_setting)) {
+		settings->set_setting(flush_denormals_setting, true);
+	}
+	settings->set_initial_value(flush_denormals_setting, true);
+	Dictionary flush_info;
+	flush_info["name"] = flush_denormals_setting;
+	flush_info["type"] = Variant::BOOL;
+	settings->add_property_info(flush_info);
+	// (Only really there to compare against. There's no reason to turn
+	//  this off, other than suspecting it of something.)
+	AnaglyphFloatMode::set_enabled(settings->get_setting(flush_denormals_setting));
+}
+
+bool AnaglyphBridge::is_native() {
+	return native;
+}
+
 UnityAudioEffectDefinition* AnaglyphBridge::GetEffectData() {
 	if (anaglyph_definition != nullptr) {
 		return anaglyph_definition;
@@ -25,13 +70,30 @@ UnityAudioEffectDefinition* AnaglyphBridge::GetEffectData() {
 		return nullptr;
 	}
 
-	UnityAudioEffectDefinition* def = GetDataFromDLL();
+	int backend = BACKEND_AUTO;
+	ProjectSettings* settings = ProjectSettings::get_singleton();
+	if (settings != nullptr && settings->has_setting(backend_setting)) {
+		backend = settings->get_setting(backend_setting);
+	}
+
+	UnityAudioEffectDefinition* def = nullptr;
+	if (backend != BACKEND_NATIVE) {
+		def = GetDataFromDLL();
+		if (def != nullptr) {
+			AnaglyphHelpers::print("Finished processing Anaglyph dll!");
+			AnaglyphHelpers::print("Dll: ", def->name, " Version: ", def->pluginversion);
+		}
+	}
+	if (def == nullptr && backend != BACKEND_DLL) {
+		def = AnaglyphNativeBackend::get_definition();
+		anaglyph_definition = def;
+		native = true;
+		AnaglyphHelpers::print("Using the native binaural backend.");
+		LoadNativeHRIRs();
+	}
 	if (def == nullptr) {
 		loading_failed = true;
-		return def;
 	}
-	AnaglyphHelpers::print("Finished processing Anaglyph dll!");
-	AnaglyphHelpers::print("Dll: ", def->name, " Version: ", def->pluginversion);
 	return def;
 }
 
@@ -83,6 +145,10 @@ int AnaglyphBridge::get_dsp_buffer_size() {
 }
 
 UnityAudioEffectDefinition* AnaglyphBridge::GetDataFromDLL() {
+#ifndef _WIN32
+	AnaglyphHelpers::print("The Anaglyph dll is Windows-only, not loading it.");
+	return nullptr;
+#else
 	AnaglyphHelpers::print("Loading Anaglyph dll at ", dll_path.c_str());
 	HMODULE dll = LoadLibraryA(dll_path.c_str());
 	ERR_FAIL_NULL_V_MSG(dll, nullptr, "Did not find Anaglyph dll.");
@@ -99,10 +165,49 @@ UnityAudioEffectDefinition* AnaglyphBridge::GetDataFromDLL() {
 	if (effects != 1)
 		AnaglyphHelpers::print_warning("Expected Anaglyph to have 1 effect, but got ", effects, " effects instead.\nThis _may_ not be fatal, but likely is.");
 	anaglyph_definition = *defs;
+	// Anaglyph 0.9.4c doesn't ship one, but if some version ever does, it
+	// will surely know its heads better than we do.
+	for (int i = 0; i < effects; i++) {
+		if ((defs[i]->flags & UnityAudioEffectDefinitionFlags_IsAmbisonicDecoder) != 0) {
+			dll_ambisonic_definition = defs[i];
+			AnaglyphHelpers::print("Using the dll's ambisonic decoder ", defs[i]->name);
+			break;
+		}
+	}
 
 	if (anaglyph_definition->pluginversion != 2308)
 		AnaglyphHelpers::print_warning("Expected Anaglyph version 0.9.4c (internal version 2308), but got internal version ", anaglyph_definition->pluginversion, " instead.\nWhile this still may work properly, this is not supported and may crash.");
 	return anaglyph_definition;
+#endif
+}
+
+void AnaglyphBridge::LoadNativeHRIRs() {
+	// Same place the export plugin copies the Anaglyph folder to.
+	String dir;
+	if (OS::get_singleton()->has_feature("editor")) {
+		dir = ProjectSettings::get_singleton()->globalize_path("res://Anaglyph/native_hrir");
+	}
+	else {
+		dir = OS::get_singleton()->get_executable_path().get_base_dir() + "/Anaglyph/native_hrir";
+	}
+	if (!DirAccess::dir_exists_absolute(dir)) {
+		AnaglyphHelpers::print("No ", dir, ", using the built-in spherical head model.");
+		return;
+	}
+	PackedStringArray files = DirAccess::get_files_at(dir);
+	// (Sorted, so that hrtf_id always means the same file.)
+	files.sort();
+	std::vector<std::string> paths;
+	for (int i = 0; i < files.size(); i++) {
+		if (files[i].get_extension() == "ahrir") {
+			paths.push_back((dir + "/" + files[i]).utf8().get_data());
+		}
+	}
+	std::vector<std::string> errors = AnaglyphNativeBackend::load_hrir_files(paths);
+	for (size_t i = 0; i < errors.size(); i++) {
+		AnaglyphHelpers::print_warning("Skipping HRIR file ", errors[i].c_str());
+	}
+	AnaglyphHelpers::print("Mapped ", (int)(paths.size() - errors.size()), " .ahrir file(s) from ", dir);
 }
 
 void AnaglyphBridge::DisableAnaglyph(std::string msg) {
@@ -113,7 +218,7 @@ void AnaglyphBridge::DisableAnaglyph(std::string msg) {
 	}
 }
 
-UNITY_AUDIODSP_RESULT AnaglyphBridge::Create(UnityAudioEffectState* state) {
+UNITY_AUDIODSP_RESULT AnaglyphBridge::Create(UnityAudioEffectState* state, int rate_divisor) {
 	GetEffectData(); // Just to ensure anaglyph is properly loaded.
 	if (anaglyph_definition == nullptr)
 		return UNITY_AUDIODSP_ERR_UNSUPPORTED;
@@ -124,14 +229,32 @@ UNITY_AUDIODSP_RESULT AnaglyphBridge::Create(UnityAudioEffectState* state) {
 
 	// Godots sample rate can be either 44.1 or 48, take note.
 	state->structsize = sizeof(UnityAudioEffectState);
-	state->samplerate = AudioServer::get_singleton()->get_mix_rate();
+	rate_divisor = MAX(rate_divisor, 1);
+	state->samplerate = AudioServer::get_singleton()->get_mix_rate() / rate_divisor;
 	state->flags = UnityAudioEffectStateFlags_IsPlaying;
 	// Anaglyph does not use this data on process but only on create.
 	// Makes sense, but slightly annoying.
-	state->dspbuffersize = get_dsp_buffer_size();
+	state->dspbuffersize = get_dsp_buffer_size() / rate_divisor;
 	state->hostapiversion = UNITY_AUDIO_PLUGIN_API_VERSION;
 
+	// The native backend would run at any rate, but .ahrir files only come
+	// at their own. At a reduced rate, it'd quietly swap the heads the user
+	// picked for the synthesized one, so rather not.
+	if (rate_divisor > 1 && is_native()) {
+		float mix_rate = AudioServer::get_singleton()->get_mix_rate();
+		if (AnaglyphNativeBackend::has_file_models(mix_rate) && !AnaglyphNativeBackend::has_file_models(state->samplerate)) {
+			AnaglyphHelpers::print_warning("None of the loaded .ahrir files are at ", state->samplerate, "Hz, so a reduced dsp_rate would lose them.");
+			return UNITY_AUDIODSP_ERR_UNSUPPORTED;
+		}
+	}
+
 	UNITY_AUDIODSP_RESULT res = anaglyph_definition->create(state);
+	if (res != UNITY_AUDIODSP_OK && rate_divisor > 1) {
+		// Only this rate is the problem. The caller can still go for the
+		// full rate, so don't take Anaglyph down with it.
+		AnaglyphHelpers::print_warning("Anaglyph did not accept a sample rate of ", state->samplerate, "Hz.");
+		return res;
+	}
 	if (res == UNITY_AUDIODSP_ERR_UNSUPPORTED) {
 		DisableAnaglyph("Internal Anaglyph error while initializing. Anaglyph has been disabled.");
 	}
@@ -187,8 +310,9 @@ UNITY_AUDIODSP_RESULT AnaglyphBridge::Process(UnityAudioEffectState* state, cons
 	// But this only sounds correct *without* the translation pass, which I
 	// really can't explain. Oh well.
 
-	int limit = AnaglyphBridge::get_dsp_buffer_size();
-	if (length != limit) {
+	// (Which is not `get_dsp_buffer_size()` for reduced rate instances.)
+	unsigned int limit = state->dspbuffersize;
+	if (!native && length != limit) {
 		DisableAnaglyph("Anaglyph's dsp buffer size doesn't match godot's. Disabling Anaglyph.");
 		for (int i = 0; i < length; i++) {
 			outbuffer[i] = inbuffer[i];
@@ -196,7 +320,13 @@ UNITY_AUDIODSP_RESULT AnaglyphBridge::Process(UnityAudioEffectState* state, cons
 		return UNITY_AUDIODSP_ERR_UNSUPPORTED;
 	}
 
-	UNITY_AUDIODSP_RESULT res = anaglyph_definition->process(state, (float*)inbuffer, (float*)outbuffer, length, 2, 2);
+	UNITY_AUDIODSP_RESULT res;
+	{
+		// Anaglyph keeps processing the reverb tail on silence, so flush
+		// its denormals. (See anaglyph_float_mode.h.)
+		AnaglyphFloatMode::Scope flush;
+		res = anaglyph_definition->process(state, (float*)inbuffer, (float*)outbuffer, length, 2, 2);
+	}
 
 	if (res == UNITY_AUDIODSP_ERR_UNSUPPORTED) {
 		DisableAnaglyph("Something unexpected went wrong while running Anaglyph. Anaglyph has been disabled.");
@@ -208,6 +338,47 @@ UNITY_AUDIODSP_RESULT AnaglyphBridge::Process(UnityAudioEffectState* state, cons
 	return res;
 }
 
+UnityAudioEffectDefinition* AnaglyphBridge::GetAmbisonicDecoder() {
+	GetEffectData(); // (To know whether the dll has one.)
+	if (dll_ambisonic_definition != nullptr) {
+		return dll_ambisonic_definition;
+	}
+	return AnaglyphAmbisonics::get_decoder_definition();
+}
+
+UNITY_AUDIODSP_RESULT AnaglyphBridge::CreateAmbisonicDecoder(UnityAudioEffectState* state, UnityAudioAmbisonicData* data) {
+	UnityAudioEffectDefinition* definition = GetAmbisonicDecoder();
+	// Same as `Create()`, but with the ambisonic data Unity would give a
+	// decoder. We have no source transforms (there's many sources in
+	// there), so the matrices are just identities.
+	memset(data, 0, sizeof(UnityAudioAmbisonicData));
+	for (int i = 0; i < 4; i++) {
+		data->listenermatrix[i * 5] = 1;
+		data->sourcematrix[i * 5] = 1;
+	}
+	data->spatialblend = 1;
+	data->stereopan = 0;
+	data->ambisonicOutChannels = 2;
+	data->volume = 1;
+
+	state->structsize = sizeof(UnityAudioEffectState);
+	state->samplerate = AudioServer::get_singleton()->get_mix_rate();
+	state->flags = UnityAudioEffectStateFlags_IsPlaying;
+	state->dspbuffersize = get_dsp_buffer_size();
+	state->hostapiversion = UNITY_AUDIO_PLUGIN_API_VERSION;
+	state->ambisonicdata = data;
+	return definition->create(state);
+}
+
+UNITY_AUDIODSP_RESULT AnaglyphBridge::ReleaseAmbisonicDecoder(UnityAudioEffectState* state) {
+	return GetAmbisonicDecoder()->release(state);
+}
+
+UNITY_AUDIODSP_RESULT AnaglyphBridge::ProcessAmbisonicDecoder(UnityAudioEffectState* state, float* inbuffer, float* outbuffer, unsigned int length, int channels) {
+	AnaglyphFloatMode::Scope flush;
+	return GetAmbisonicDecoder()->process(state, inbuffer, outbuffer, length, channels, 2);
+}
+
 UNITY_AUDIODSP_RESULT AnaglyphBridge::SetParam(UnityAudioEffectState* state, int index, float value) {
 	if (anaglyph_definition == nullptr) {
 		return UNITY_AUDIODSP_ERR_UNSUPPORTED;
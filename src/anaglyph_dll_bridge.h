@@ -10,7 +10,19 @@ namespace godot {
 	// This anaglyph dll is originally meant for Unity.
 	// This class handles reading out the data from the dll. See
 	// AudioPluginInterface.h
+	// Where the dll isn't available (or if the project says so), this uses
+	// our own `AnaglyphNativeBackend` instead, which pretends to be a Unity
+	// plugin as well.
 	class AnaglyphBridge {
+	public:
+		// The "audio/anaglyph/backend" project setting.
+		enum Backend {
+			// The dll if it loads, the native backend otherwise.
+			BACKEND_AUTO = 0,
+			BACKEND_DLL = 1,
+			BACKEND_NATIVE = 2
+		};
+
 	private:
 		// The actual reference that the dll gives us.
 		// This is constant throughout the lifetime of the program.
@@ -20,6 +32,15 @@ namespace godot {
 		// try again. Ensure that whenever this is true, *anaglyph_definition
 		// is the nullpointer.
 		static bool loading_failed;
+
+		// Whether `anaglyph_definition` is the native backend instead of the
+		// dll. The native backend doesn't care about buffer sizes.
+		static bool native;
+
+		// If the dll also has an effect flagged as an ambisonic decoder,
+		// this is it. Otherwise, the ambisonic bus uses our own decoder
+		// from `AnaglyphAmbisonics`.
+		static UnityAudioEffectDefinition* dll_ambisonic_definition;
 		
 		// Relative path to the dll.
 		// Note that anaglyph is picky, and that all the data needs to be
@@ -38,10 +59,22 @@ namespace godot {
 		// The workhorse of GetEffectData();
 		static UnityAudioEffectDefinition* GetDataFromDLL();
 
+		// Hands all .ahrir files in `Anaglyph/native_hrir/` (next to the
+		// project, or next to the executable in exports) to the native
+		// backend.
+		static void LoadNativeHRIRs();
+
 		// Disables anaglyph in case something goes wrong.
 		static void DisableAnaglyph(std::string msg);
 
 	public:
+		// Adds the backend project setting. Must happen before the first
+		// `GetEffectData()`, as that reads it.
+		static void register_project_settings();
+
+		// Whether we're using the native backend instead of the dll.
+		static bool is_native();
+
 		// Anaglyph is defined as a Unity plugin. A bunch of data needs to be
 		// read from the dll, which will get put in here.
 		// Loading may fail, in which case `nullptr` is returned.
@@ -55,7 +88,12 @@ namespace godot {
 		static int get_dsp_buffer_size();
 
 		// Create a new DSP instance.
-		static UNITY_AUDIODSP_RESULT Create(UnityAudioEffectState* state);
+		// With a `rate_divisor` above 1, the instance runs at that fraction
+		// of the mix rate, and takes blocks that much smaller. Resampling to
+		// and from that rate is up to the caller. If that rate is refused,
+		// this warns and returns the error, and `state` doesn't need to be
+		// released. Only refusing the full rate disables Anaglyph.
+		static UNITY_AUDIODSP_RESULT Create(UnityAudioEffectState* state, int rate_divisor = 1);
 
 		// Release an existing DSP instance.
 		static UNITY_AUDIODSP_RESULT Release(UnityAudioEffectState* state);
@@ -66,6 +104,20 @@ namespace godot {
 		// Apply the effect.
 		static UNITY_AUDIODSP_RESULT Process(UnityAudioEffectState* state, const AudioFrame* inbuffer, AudioFrame* outbuffer, unsigned int length);
 		
+		// The decoder for the ambisonic bus: the dll's, if it has one, our
+		// own otherwise. Never `nullptr`.
+		static UnityAudioEffectDefinition* GetAmbisonicDecoder();
+
+		// Create a new ambisonic decoder instance, with `data` as its
+		// ambisonic data (which must outlive the instance).
+		static UNITY_AUDIODSP_RESULT CreateAmbisonicDecoder(UnityAudioEffectState* state, UnityAudioAmbisonicData* data);
+
+		// Release an existing ambisonic decoder instance.
+		static UNITY_AUDIODSP_RESULT ReleaseAmbisonicDecoder(UnityAudioEffectState* state);
+
+		// Decode `channels` interleaved channels into interleaved stereo.
+		static UNITY_AUDIODSP_RESULT ProcessAmbisonicDecoder(UnityAudioEffectState* state, float* inbuffer, float* outbuffer, unsigned int length, int channels);
+
 		// Set a float param, as determined by its index.
 		static UNITY_AUDIODSP_RESULT SetParam(UnityAudioEffectState* state, int index, float value);
 		
@@ -1,7 +1,11 @@
 #include "anaglyph_effect.h"
 #include "anaglyph_dll_bridge.h"
+#include "anaglyph_float_mode.h"
 #include "helpers.h"
 
+#include <godot_cpp/classes/audio_server.hpp>
+#include <utility>
+
 using namespace godot;
 
 AudioFrame* AnaglyphEffect::warmup_buffer = nullptr;
@@ -20,7 +24,7 @@ void AnaglyphEffectInstance::_process(const void* p_src_frames, AudioFrame* p_ds
 
 	// TODO: Why is this const void* and not const AudioFrame*?
 	// Assuming const AudioFrame* for now, and I'll see whether it crashes.
-	AnaglyphBridge::Process(&(base->state), (AudioFrame*)p_src_frames, p_dst_frames, (unsigned int)p_frame_count);
+	base->process((const AudioFrame*)p_src_frames, p_dst_frames, p_frame_count);
 }
 
 bool AnaglyphEffectInstance::_process_silence() const {
@@ -31,6 +35,9 @@ bool AnaglyphEffectInstance::_process_silence() const {
 }
 
 AnaglyphEffect::AnaglyphEffect() {
+	reverb_shared = false;
+	dsp_divisor = 1;
+
 	// Ensure Anaglyph is loaded if you try to add it as an effect.
 	UnityAudioEffectDefinition* defs = AnaglyphBridge::GetEffectData();
 
@@ -72,6 +79,31 @@ Ref<AudioEffectInstance> AnaglyphEffect::_instantiate() {
 	return ins;
 }
 
+void AnaglyphEffect::process(const AudioFrame* src, AudioFrame* dst, int count) {
+	// (For the resampler's filters. The bridge does the same for Anaglyph.)
+	AnaglyphFloatMode::Scope flush;
+	if (dsp_divisor == 1) {
+		AnaglyphBridge::Process(&state, src, dst, (unsigned int)count);
+		return;
+	}
+	if (!resampler.accepts(count)) {
+		// Anaglyph can't take this block at its rate. Godot's blocks don't
+		// change size, so this shouldn't really happen.
+		for (int i = 0; i < count; i++) {
+			dst[i] = src[i];
+		}
+		return;
+	}
+	int reduced = count / dsp_divisor;
+	resampler.decimate((const float*)src, (float*)reduced_input.ptrw(), count);
+	AnaglyphBridge::Process(&state, reduced_input.ptr(), reduced_output.ptrw(), (unsigned int)reduced);
+	resampler.interpolate((const float*)reduced_output.ptr(), (float*)dst, reduced);
+}
+
+double AnaglyphEffect::get_dsp_rate_latency() const {
+	return resampler.get_latency() / (double)AudioServer::get_singleton()->get_mix_rate();
+}
+
 void AnaglyphEffect::set_wet(const float percentage) {
 	ensure_effect_data_exists();
 	effect_data->set_wet(percentage);
@@ -317,13 +349,24 @@ void AnaglyphEffect::set_bypass_reverb(const bool value) {
 	send_bypass_reverb();
 }
 void AnaglyphEffect::send_bypass_reverb() {
-	AnaglyphBridge::SetParamBool(&state, 6, effect_data->get_bypass_reverb());
+	AnaglyphBridge::SetParamBool(&state, 6, effect_data->get_bypass_reverb() || reverb_shared);
 }
 bool AnaglyphEffect::get_bypass_reverb() {
 	ensure_effect_data_exists();
 	return effect_data->get_bypass_reverb();
 }
 
+void AnaglyphEffect::set_reverb_shared(const bool shared) {
+	reverb_shared = shared;
+	// (Otherwise, this gets sent with the data.)
+	if (effect_data != nullptr) {
+		send_bypass_reverb();
+	}
+}
+bool AnaglyphEffect::get_reverb_shared() const {
+	return reverb_shared;
+}
+
 void AnaglyphEffect::set_azimuth(const float value) {
 	ensure_effect_data_exists();
 	effect_data->set_azimuth(value);
@@ -363,6 +406,61 @@ float AnaglyphEffect::get_distance() {
 	return effect_data->get_distance();
 }
 
+void AnaglyphEffect::set_dsp_rate(const AnaglyphEffectData::DSPRate value) {
+	ensure_effect_data_exists();
+	effect_data->set_dsp_rate(value);
+	send_dsp_rate();
+}
+void AnaglyphEffect::send_dsp_rate() {
+	recreate_state();
+}
+bool AnaglyphEffect::recreate_state() {
+	int divisor = (int)effect_data->get_dsp_rate();
+	if (divisor == dsp_divisor || AnaglyphBridge::GetEffectData() == nullptr) {
+		return false;
+	}
+	// Anaglyph only reads the rate on create, so this needs a new instance.
+	// Creating one loads the model, which can take up to a second, so that
+	// happens before taking the lock. Only swapping it in can't happen
+	// halfway through a block.
+	UnityAudioEffectState new_state{};
+	if (AnaglyphBridge::Create(&new_state, divisor) != UNITY_AUDIODSP_OK && divisor != 1) {
+		AnaglyphHelpers::print_warning("Anaglyph did not accept running at 1/", divisor, " of the mix rate. Running at the full rate instead.");
+		// (A refused rate leaves nothing to release.)
+		new_state = UnityAudioEffectState{};
+		AnaglyphBridge::Create(&new_state);
+		divisor = 1;
+		// (Directly, so that this doesn't come back here.)
+		effect_data->dsp_rate = AnaglyphEffectData::DSP_RATE_FULL;
+	}
+	AnaglyphResampler new_resampler;
+	new_resampler.set_divisor(divisor);
+	if (reduced_input.size() == 0) {
+		// (Only used at reduced rates, so the audio thread isn't reading
+		//  these yet.)
+		reduced_input.resize(AnaglyphResampler::max_frames / 2);
+		reduced_output.resize(AnaglyphResampler::max_frames / 2);
+	}
+
+	AudioServer::get_singleton()->lock();
+	UnityAudioEffectState old_state = state;
+	state = new_state;
+	dsp_divisor = divisor;
+	// (Swapping moves the filter buffers, it doesn't allocate.)
+	std::swap(resampler, new_resampler);
+	AudioServer::get_singleton()->unlock();
+	AnaglyphBridge::Release(&old_state);
+
+	// The new instance starts from the dll's defaults.
+	// (This calls back into here, but then the rate is already right.)
+	set_effect_data(effect_data);
+	return true;
+}
+AnaglyphEffectData::DSPRate AnaglyphEffect::get_dsp_rate() {
+	ensure_effect_data_exists();
+	return effect_data->get_dsp_rate();
+}
+
 void AnaglyphEffect::ensure_effect_data_exists() {
 	if (effect_data == nullptr) {
 		Ref<AnaglyphEffectData> data = Ref<AnaglyphEffectData>{};
@@ -381,6 +479,10 @@ void AnaglyphEffect::set_effect_data(Ref<AnaglyphEffectData> data) {
 	}
 	effect_data = data;
 	effect_data->most_recent_effect = this;
+	// (First, as a new instance gets sent all the rest anyway.)
+	if (recreate_state()) {
+		return;
+	}
 	// hoo boyoboy time for this list again *again*
 	set_wet(get_wet());
 	set_gain(get_gain());
@@ -411,6 +513,27 @@ void AnaglyphEffect::set_effect_data(Ref<AnaglyphEffectData> data) {
 	set_distance(get_distance());
 }
 
+void AnaglyphEffect::reset_state() {
+	// The audio thread may be halfway through processing this very state,
+	// so wait until it's done with the block.
+	// This also re-applies the parameters that we pin to constant values.
+	AudioServer::get_singleton()->lock();
+	AnaglyphBridge::Reset(&state);
+	resampler.reset();
+	AudioServer::get_singleton()->unlock();
+	// Resetting brings everything back to the dll's defaults, which are not
+	// necessarily ours.
+	ensure_effect_data_exists();
+	set_effect_data(effect_data);
+}
+
+void AnaglyphEffect::reset_state_unlocked() {
+	AnaglyphBridge::Reset(&state);
+	resampler.reset();
+	ensure_effect_data_exists();
+	set_effect_data(effect_data);
+}
+
 void AnaglyphEffect::_bind_methods() {
 	// (See https://docs.godotengine.org/en/latest/classes/class_%40globalscope.html#enum-globalscope-propertyhint
 	//  for how the hint string works.)
@@ -447,8 +570,15 @@ void AnaglyphEffect::_bind_methods() {
 	REGISTER(FLOAT, elevation, AnaglyphEffect, "angle", PROPERTY_HINT_RANGE, "-90,90,0.1,degrees");
 	REGISTER(FLOAT, distance, AnaglyphEffect, "meters", PROPERTY_HINT_RANGE, "0.1,10,0.1,suffix:m");
 
+	ADD_GROUP("Performance", "");
+	REGISTER(INT, dsp_rate, AnaglyphEffect, "rate", PROPERTY_HINT_ENUM, "Full:1,Half:2,Quarter:4");
+
 	ClassDB::bind_method(D_METHOD("set_effect_data", "data"), &AnaglyphEffect::set_effect_data);
+	ClassDB::bind_method(D_METHOD("reset_state"), &AnaglyphEffect::reset_state);
+	ClassDB::bind_method(D_METHOD("get_dsp_rate_latency"), &AnaglyphEffect::get_dsp_rate_latency);
 
 	// Steal the helper method into this class.
-	ClassDB::bind_static_method("AnaglyphEffect", D_METHOD("calculate_polar_position", "source", "listener"), &AnaglyphHelpers::calculate_polar_position);
+	// (It's overloaded, so point at the Node3D version explicitly.)
+	Vector3 (*calculate_polar_position)(Node3D*, Node3D*) = &AnaglyphHelpers::calculate_polar_position;
+	ClassDB::bind_static_method("AnaglyphEffect", D_METHOD("calculate_polar_position", "source", "listener"), calculate_polar_position);
 }
\ No newline at end of file
@@ -3,11 +3,13 @@
 
 #include "AudioPluginInterface.h"
 #include "anaglyph_effect_data.h"
+#include "anaglyph_resampler.h"
 #include "register_macro.h"
 
 #include <godot_cpp/classes/audio_effect.hpp>
 #include <godot_cpp/classes/audio_effect_instance.hpp>
 #include <godot_cpp/classes/audio_frame.hpp>
+#include <godot_cpp/templates/vector.hpp>
 #include <godot_cpp/variant/vector3.hpp>
 
 namespace godot {
@@ -41,6 +43,8 @@ namespace godot {
 		GDCLASS(AnaglyphEffect, AudioEffect);
 		friend class AnaglyphEffectInstance;
 		friend class AnaglyphEffectData;
+		friend class AnaglyphOfflineRenderer;
+		friend class AudioStreamPlaybackAnaglyph;
 
 		UnityAudioEffectState state;
 		Ref<AnaglyphEffectData> effect_data;
@@ -56,8 +60,23 @@ namespace godot {
 		// This buffer is just to be always zero.
 		static AudioFrame* warmup_buffer;
 
+		// Whether a shared room bus does our reverb (see
+		// `AnaglyphRoomEffect`), in which case ours is bypassed no matter
+		// what the data says.
+		bool reverb_shared;
+
+		// The `DSPRate` `state` was created with. When that's not 1, blocks
+		// go down to that rate before Anaglyph, and back up after.
+		int dsp_divisor;
+		AnaglyphResampler resampler;
+		Vector<AudioFrame> reduced_input;
+		Vector<AudioFrame> reduced_output;
+
 		void ensure_effect_data_exists();
 
+		// Runs Anaglyph on a block, resampling around it if needed.
+		void process(const AudioFrame* src, AudioFrame* dst, int count);
+
 		// The following methods send the current data to Anaglyph.
 		void send_wet();
 		void send_gain();
@@ -87,6 +106,16 @@ namespace godot {
 		void send_elevation();
 		void send_distance();
 
+		// This one recreates `state` if the rate changed.
+		void send_dsp_rate();
+		// Recreates `state` at the data's rate and re-sends all data, if
+		// that rate is not what `state` has. Returns whether it did.
+		bool recreate_state();
+
+		// `reset_state()`, for whoever processes this effect themselves
+		// (so there's no block to wait for), from where they process it.
+		void reset_state_unlocked();
+
 	protected:
 		static void _bind_methods();
 
@@ -101,6 +130,23 @@ namespace godot {
 		// as well (until the next `set_effect_data()`.
 		void set_effect_data(Ref<AnaglyphEffectData> data);
 
+		// Clears everything Anaglyph has going on internally (the reverb
+		// tail, the HRTF crossfade history, ...), and then re-sends the
+		// current effect data.
+		// This allows reusing a bus immediately, instead of having to wait
+		// until the previous sound has died out.
+		void reset_state();
+
+		// How much the reduced DSP rate delays the sound, in seconds. Zero
+		// at full rate. This is on top of whatever latency Anaglyph itself
+		// has.
+		double get_dsp_rate_latency() const;
+
+		// For the bus manager: whether this bus sends into a room bus that
+		// does the reverb instead.
+		void set_reverb_shared(const bool shared);
+		bool get_reverb_shared() const;
+
 		// Below are the same properties as in anaglyph_effect_data.h,
 		// re-exposed. The difference is that these don't just set the data
 		// internally, but also send the data to Anaglyph.
@@ -213,6 +259,13 @@ namespace godot {
 		void set_distance(const float meters);
 		float get_distance();
 
+		// ===================
+		// === Performance ===
+		// ===================
+		// The rate Anaglyph runs at, as a fraction of the mix rate.
+		void set_dsp_rate(const AnaglyphEffectData::DSPRate rate);
+		AnaglyphEffectData::DSPRate get_dsp_rate();
+
 		// Not exposing/implementing the following:
 		// 00 - Bypass                - Unnecessary as Godot also has one.
 		// 02 - Bypass ITD            - Not exposed in the VST either.
@@ -35,11 +35,84 @@ AnaglyphEffectData::AnaglyphEffectData() {
 	elevation = 0;
 	distance = 0.3;
 
+	dsp_rate = DSP_RATE_FULL;
+
 	most_recent_effect = nullptr;
 }
 
 AnaglyphEffectData::~AnaglyphEffectData() { }
 
+void AnaglyphEffectData::copy_from(const Ref<AnaglyphEffectData>& other) {
+	if (other == nullptr || other.ptr() == this) {
+		return;
+	}
+	wet = other->wet;
+	gain = other->gain;
+
+	hrtf_id = other->hrtf_id;
+	use_custom_circumference = other->use_custom_circumference;
+	head_circumference = other->head_circumference;
+	responsiveness = other->responsiveness;
+	bypass_binaural = other->bypass_binaural;
+
+	bypass_parallax = other->bypass_parallax;
+	bypass_shadow = other->bypass_shadow;
+	bypass_micro_oscillations = other->bypass_micro_oscillations;
+
+	min_attenuation = other->min_attenuation;
+	max_attenuation = other->max_attenuation;
+	attenuation_exponent = other->attenuation_exponent;
+	bypass_attenuation = other->bypass_attenuation;
+
+	room_id = other->room_id;
+	reverb_type = other->reverb_type;
+	reverb_gain = other->reverb_gain;
+	reverb_EQ = other->reverb_EQ;
+	bypass_reverb = other->bypass_reverb;
+
+	azimuth = other->azimuth;
+	elevation = other->elevation;
+	distance = other->distance;
+
+	dsp_rate = other->dsp_rate;
+
+	// Don't leave whoever's listening to us out of date.
+	if (most_recent_effect != nullptr) {
+		most_recent_effect->set_effect_data(Ref<AnaglyphEffectData>(this));
+	}
+}
+
+uint32_t AnaglyphEffectData::hash_settings() const {
+	uint32_t h = hash_murmur3_one_float(wet);
+	h = hash_murmur3_one_float(gain, h);
+
+	h = hash_murmur3_one_float(hrtf_id, h);
+	h = hash_murmur3_one_32(use_custom_circumference, h);
+	h = hash_murmur3_one_float(head_circumference, h);
+	h = hash_murmur3_one_float(responsiveness, h);
+	h = hash_murmur3_one_32(bypass_binaural, h);
+
+	h = hash_murmur3_one_32(bypass_parallax, h);
+	h = hash_murmur3_one_32(bypass_shadow, h);
+	h = hash_murmur3_one_32(bypass_micro_oscillations, h);
+
+	h = hash_murmur3_one_float(min_attenuation, h);
+	h = hash_murmur3_one_float(max_attenuation, h);
+	h = hash_murmur3_one_float(attenuation_exponent, h);
+	h = hash_murmur3_one_32(bypass_attenuation, h);
+
+	h = hash_murmur3_one_float(room_id, h);
+	h = hash_murmur3_one_32(reverb_type, h);
+	h = hash_murmur3_one_float(reverb_gain, h);
+	h = hash_murmur3_one_float(reverb_EQ.x, h);
+	h = hash_murmur3_one_float(reverb_EQ.y, h);
+	h = hash_murmur3_one_float(reverb_EQ.z, h);
+	h = hash_murmur3_one_32(bypass_reverb, h);
+
+	h = hash_murmur3_one_32(dsp_rate, h);
+	return hash_fmix32(h);
+}
+
 void AnaglyphEffectData::set_wet(const float percentage) {
 	wet = CLAMP(percentage, 0, 100);
 	if (most_recent_effect != nullptr) {
@@ -270,7 +343,19 @@ float AnaglyphEffectData::get_distance() {
 	return distance;
 }
 
+void AnaglyphEffectData::set_dsp_rate(const DSPRate value) {
+	dsp_rate = value == DSP_RATE_HALF || value == DSP_RATE_QUARTER ? value : DSP_RATE_FULL;
+	if (most_recent_effect != nullptr) {
+		most_recent_effect->send_dsp_rate();
+	}
+}
+AnaglyphEffectData::DSPRate AnaglyphEffectData::get_dsp_rate() {
+	return dsp_rate;
+}
+
 void AnaglyphEffectData::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("copy_from", "other"), &AnaglyphEffectData::copy_from);
+
 	// (See https://docs.godotengine.org/en/latest/classes/class_%40globalscope.html#enum-globalscope-propertyhint
 	//  for how the hint string works.)
 	REGISTER(FLOAT, wet, AnaglyphEffectData, "percentage", PROPERTY_HINT_RANGE, "0,100,0.1,suffix:%");
@@ -306,8 +391,15 @@ void AnaglyphEffectData::_bind_methods() {
 	REGISTER(FLOAT, elevation, AnaglyphEffectData, "angle", PROPERTY_HINT_RANGE, "-90,90,0.1,degrees");
 	REGISTER(FLOAT, distance, AnaglyphEffectData, "meters", PROPERTY_HINT_RANGE, "0.1,10,0.1,suffix:m");
 
+	ADD_GROUP("Performance", "");
+	REGISTER(INT, dsp_rate, AnaglyphEffectData, "rate", PROPERTY_HINT_ENUM, "Full:1,Half:2,Quarter:4");
+
 	BIND_ENUM_CONSTANT(ANAGLYPH_REVERB_OMNI);
 	BIND_ENUM_CONSTANT(ANAGLYPH_REVERB_2D);
 	BIND_ENUM_CONSTANT(ANAGLYPH_REVERB_3D_1);
 	BIND_ENUM_CONSTANT(ANAGLYPH_REVERB_3D_2);
+
+	BIND_ENUM_CONSTANT(DSP_RATE_FULL);
+	BIND_ENUM_CONSTANT(DSP_RATE_HALF);
+	BIND_ENUM_CONSTANT(DSP_RATE_QUARTER);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <godot_cpp/classes/resource.hpp>
 #include <godot_cpp/classes/wrapped.hpp>
+#include <godot_cpp/templates/hashfuncs.hpp>
 #include <godot_cpp/variant/vector3.hpp>
 
 namespace godot {
@@ -33,6 +34,14 @@ namespace godot {
 			ANAGLYPH_REVERB_3D_2 = 3
 		};
 
+		// The rate the DSP instance runs at, as a fraction of the
+		// AudioServer's mix rate.
+		enum DSPRate {
+			DSP_RATE_FULL = 1,
+			DSP_RATE_HALF = 2,
+			DSP_RATE_QUARTER = 4
+		};
+
 	private:
 		float wet;
 		float gain;
@@ -62,6 +71,8 @@ namespace godot {
 		float elevation;
 		float distance;
 
+		DSPRate dsp_rate;
+
 		// (Raw pointer instead of Ref<> to not get cyclic ref.
 		//  This thing won't be accessed when it's not Ref<>'d either any more)
 		// The most recent AnaglyphEffect to send updates to.
@@ -75,6 +86,14 @@ namespace godot {
 		AnaglyphEffectData();
 		~AnaglyphEffectData();
 
+		// Copies all settings of `other` into this one, without allocating a
+		// new resource like `duplicate()` does.
+		void copy_from(const Ref<AnaglyphEffectData>& other);
+
+		// A hash of all settings except the position, so that the render
+		// cache can tell whether two oneshots would sound the same.
+		uint32_t hash_settings() const;
+
 		// ======================
 		// === The usual ones ===
 		// ======================
@@ -182,10 +201,21 @@ namespace godot {
 		// Distance, in meters [0.1,10].
 		void set_distance(const float meters);
 		float get_distance();
+
+		// ===================
+		// === Performance ===
+		// ===================
+		// The rate Anaglyph runs at, as a fraction of the mix rate. Lower
+		// rates lose everything above a quarter (or an eighth) of the mix
+		// rate, but cost about half (or a quarter) as much. Changing this
+		// recreates the DSP instance, so don't animate it.
+		void set_dsp_rate(const DSPRate rate);
+		DSPRate get_dsp_rate();
 	};
 
 }
 
 VARIANT_ENUM_CAST(AnaglyphEffectData::AnaglyphReverbType);
+VARIANT_ENUM_CAST(AnaglyphEffectData::DSPRate);
 
 #endif // GDANAGLYPH_EFFECT_DATA
\ No newline at end of file
@@ -0,0 +1,104 @@
+#ifndef GDANAGLYPH_FFT
+#define GDANAGLYPH_FFT
+
+// This header is deliberately godot-free, so that it can also be compiled by
+// the standalone benchmarks in `bench/`.
+
+#include <math.h>
+#include <vector>
+
+namespace godot {
+	// A plain radix-2 complex FFT on split (re/im) arrays.
+	// The convolution sizes here are small (a few hundred points), and the
+	// expensive part is the multiply-accumulate over all partitions anyway,
+	// so this doesn't try to be clever.
+	class AnaglyphFFT {
+	private:
+		int size;
+		std::vector<int> bit_reverse;
+		// cos/sin(2 pi k / size) for k in [0, size/2).
+		std::vector<float> cos_table;
+		std::vector<float> sin_table;
+
+		void transform(float* re, float* im, bool inverse) const {
+			for (int i = 0; i < size; i++) {
+				int j = bit_reverse[i];
+				if (j > i) {
+					float t = re[i]; re[i] = re[j]; re[j] = t;
+					t = im[i]; im[i] = im[j]; im[j] = t;
+				}
+			}
+			float sign = inverse ? 1.0f : -1.0f;
+			for (int length = 2; length <= size; length *= 2) {
+				int half = length / 2;
+				int step = size / length;
+				for (int start = 0; start < size; start += length) {
+					for (int k = 0; k < half; k++) {
+						float wr = cos_table[k * step];
+						float wi = sign * sin_table[k * step];
+						int a = start + k;
+						int b = a + half;
+						float tr = re[b] * wr - im[b] * wi;
+						float ti = re[b] * wi + im[b] * wr;
+						re[b] = re[a] - tr;
+						im[b] = im[a] - ti;
+						re[a] += tr;
+						im[a] += ti;
+					}
+				}
+			}
+		}
+
+	public:
+		AnaglyphFFT() {
+			size = 0;
+		}
+
+		// `n` must be a power of two.
+		void init(int n) {
+			size = n;
+			int bits = 0;
+			while ((1 << bits) < n) {
+				bits++;
+			}
+			bit_reverse.resize(n);
+			for (int i = 0; i < n; i++) {
+				int r = 0;
+				for (int b = 0; b < bits; b++) {
+					if (i & (1 << b)) {
+						r |= 1 << (bits - 1 - b);
+					}
+				}
+				bit_reverse[i] = r;
+			}
+			cos_table.resize(n / 2);
+			sin_table.resize(n / 2);
+			for (int k = 0; k < n / 2; k++) {
+				double angle = 2.0 * 3.14159265358979323846 * k / n;
+				cos_table[k] = (float)cos(angle);
+				sin_table[k] = (float)sin(angle);
+			}
+		}
+
+		int get_size() const {
+			return size;
+		}
+
+		// In-place forward transform, unnormalized.
+		void forward(float* re, float* im) const {
+			transform(re, im, false);
+		}
+
+		// In-place inverse transform, including the 1/n.
+		void inverse(float* re, float* im) const {
+			transform(re, im, true);
+			float scale = 1.0f / size;
+			for (int i = 0; i < size; i++) {
+				re[i] *= scale;
+				im[i] *= scale;
+			}
+		}
+	};
+}
+
+#endif // GDANAGLYPH_FFT
\ No newline at end of file
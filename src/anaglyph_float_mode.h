@@ -0,0 +1,96 @@
+#ifndef GDANAGLYPH_FLOAT_MODE
+#define GDANAGLYPH_FLOAT_MODE
+
+// Godot-free, so that the benchmark in `bench/` can use it too.
+
+#include <stdint.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GDANAGLYPH_FLOAT_MODE_SSE
+#include <xmmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define GDANAGLYPH_FLOAT_MODE_ARM64
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+namespace godot {
+	// Reverb tails (and any filter's state, really) decay towards zero
+	// forever, and once they get below ~1e-38 they turn into denormals. Those
+	// are *way* slower on most cpus (on x86 easily 100x per operation), and
+	// because `_process_silence()` keeps running on silence, that slowdown
+	// hits exactly when nothing can be heard anymore.
+	// So, around all DSP, tell the cpu to flush them to zero instead:
+	// - x86: FTZ (results) and DAZ (inputs) in the MXCSR.
+	// - arm64: FZ in the FPCR, which does both.
+	// Anything else is left alone.
+	//
+	// The previous mode is restored afterwards, as the audio thread isn't
+	// ours, and neither is the dll's.
+	class AnaglyphFloatMode {
+		static inline bool enabled = true;
+
+#if defined(GDANAGLYPH_FLOAT_MODE_SSE)
+		static const uint64_t flush_bits = 0x8040; // FTZ | DAZ
+		static uint64_t read_mode() { return _mm_getcsr(); }
+		static void write_mode(uint64_t mode) { _mm_setcsr((unsigned int)mode); }
+#elif defined(GDANAGLYPH_FLOAT_MODE_ARM64)
+		static const uint64_t flush_bits = (uint64_t)1 << 24; // FZ
+#if defined(_MSC_VER) && !defined(__clang__)
+		// (FPCR is op0=3, op1=3, CRn=4, CRm=4, op2=0.)
+		static uint64_t read_mode() { return (uint64_t)_ReadStatusReg(ARM64_SYSREG(3, 3, 4, 4, 0)); }
+		static void write_mode(uint64_t mode) { _WriteStatusReg(ARM64_SYSREG(3, 3, 4, 4, 0), (__int64)mode); }
+#else
+		static uint64_t read_mode() {
+			uint64_t mode;
+			__asm__ __volatile__("mrs %0, fpcr" : "=r"(mode));
+			return mode;
+		}
+		static void write_mode(uint64_t mode) { __asm__ __volatile__("msr fpcr, %0" : : "r"(mode)); }
+#endif
+#else
+		static const uint64_t flush_bits = 0;
+		static uint64_t read_mode() { return 0; }
+		static void write_mode(uint64_t) { }
+#endif
+
+	public:
+		// Flushes denormals for as long as this is in scope, if enabled.
+		// Nesting these is fine (and nearly free, as the inner ones don't
+		// need to change anything).
+		class Scope {
+			uint64_t previous;
+			bool changed;
+
+		public:
+			Scope() {
+				previous = 0;
+				changed = false;
+				if (!enabled || flush_bits == 0) {
+					return;
+				}
+				previous = read_mode();
+				if ((previous & flush_bits) != flush_bits) {
+					write_mode(previous | flush_bits);
+					changed = true;
+				}
+			}
+			~Scope() {
+				if (changed) {
+					write_mode(previous);
+				}
+			}
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+		};
+
+		// On by default. Only affects Scopes created afterwards.
+		static void set_enabled(bool p_enabled) { enabled = p_enabled; }
+		static bool is_enabled() { return enabled; }
+		// Whether this platform has a mode to set at all.
+		static bool is_supported() { return flush_bits != 0; }
+	};
+}
+
+#endif // GDANAGLYPH_FLOAT_MODE
\ No newline at end of file
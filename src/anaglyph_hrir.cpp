@@ -0,0 +1,214 @@
+#include "anaglyph_hrir.h"
+#include "anaglyph_fft.h"
+#include "anaglyph_hrir_file.h"
+
+#include <math.h>
+
+using namespace godot;
+
+static const float PI_F = 3.14159265f;
+static const float DEG2RAD = PI_F / 180.0f;
+
+AnaglyphHRIRSet::AnaglyphHRIRSet() {
+	sample_rate = 0;
+	ir_length = 0;
+	direction_count = 0;
+	azimuths = nullptr;
+	elevations = nullptr;
+	directions = nullptr;
+	left = nullptr;
+	right = nullptr;
+	mapping = nullptr;
+}
+
+AnaglyphHRIRSet::~AnaglyphHRIRSet() {
+	delete mapping;
+}
+
+void AnaglyphHRIRSet::init(float p_sample_rate, int p_ir_length, int p_direction_count) {
+	sample_rate = p_sample_rate;
+	ir_length = p_ir_length;
+	direction_count = p_direction_count;
+	size_t n = direction_count;
+	storage.assign(n * 5 + n * ir_length * 2, 0);
+	azimuths = storage.data();
+	elevations = azimuths + n;
+	directions = elevations + n;
+	left = directions + n * 3;
+	right = left + n * ir_length;
+	spectra.clear();
+}
+
+void AnaglyphHRIRSet::set_direction(int index, float azimuth, float elevation, const float* left_ir, const float* right_ir) {
+	// (These all point into `storage`, so this cast is fine.)
+	float az = azimuth * DEG2RAD;
+	float el = elevation * DEG2RAD;
+	((float*)azimuths)[index] = azimuth;
+	((float*)elevations)[index] = elevation;
+	float* dir = (float*)directions + index * 3;
+	dir[0] = sinf(az) * cosf(el);
+	dir[1] = sinf(el);
+	dir[2] = cosf(az) * cosf(el);
+	float* l = (float*)get_left(index);
+	float* r = (float*)get_right(index);
+	for (int i = 0; i < ir_length; i++) {
+		l[i] = left_ir[i];
+		r[i] = right_ir[i];
+	}
+}
+
+// One ear of the spherical head model. `cos_incidence` is the cosine of the
+// angle between the ear's axis and the source, `pinna_azimuth` is the
+// source's azimuth as seen from this ear, folded into [-90, 90].
+static void spherical_head_ear(float sample_rate, float head_radius, float cos_incidence, float pinna_azimuth, float elevation, float* out, int length) {
+	const float speed_of_sound = 343.0f;
+	// Head shadow: a one-pole one-zero filter whose zero moves with the
+	// angle of incidence. Facing the ear, highs get boosted a little; behind
+	// the head, they get cut.
+	const float alpha_min = 0.1f;
+	const float theta_min = 150.0f * DEG2RAD;
+	float theta = acosf(fmaxf(-1.0f, fminf(1.0f, cos_incidence)));
+	float alpha = (1 + alpha_min / 2) + (1 - alpha_min / 2) * cosf(theta / theta_min * PI_F);
+	float beta = 2 * speed_of_sound / head_radius;
+	// Bilinear transform.
+	float k = 2 * sample_rate;
+	float b0 = (alpha * k + beta) / (k + beta);
+	float b1 = (beta - alpha * k) / (k + beta);
+	float a1 = (beta - k) / (k + beta);
+
+	std::vector<float> shadow(length, 0);
+	float x_prev = 0;
+	float y_prev = 0;
+	for (int n = 0; n < length; n++) {
+		float x = n == 0 ? 1.0f : 0.0f;
+		float y = b0 * x + b1 * x_prev - a1 * y_prev;
+		shadow[n] = y;
+		x_prev = x;
+		y_prev = y;
+	}
+
+	// Pinna echoes, whose delays depend on elevation. The paper's values are
+	// in samples at 44.1kHz. The reflections are toned down quite a bit, as
+	// the paper's full strength sounds rather hollow.
+	const float rho[5] = { 0.5f, -1.0f, 0.5f, -0.25f, 0.25f };
+	const float a[5] = { 1, 5, 5, 5, 5 };
+	const float b[5] = { 2, 4, 7, 11, 13 };
+	const float d[5] = { 1, 0.5f, 0.5f, 0.5f, 0.5f };
+	const float strength = 0.25f;
+	for (int n = 0; n < length; n++) {
+		out[n] = shadow[n];
+	}
+	float rate_scale = sample_rate / 44100.0f;
+	for (int r = 0; r < 5; r++) {
+		float tau = a[r] * cosf(pinna_azimuth * DEG2RAD / 2) * sinf(d[r] * (90.0f - elevation) * DEG2RAD) + b[r];
+		int delay = (int)lroundf(tau * rate_scale);
+		for (int n = 0; n + delay < length; n++) {
+			out[n + delay] += strength * rho[r] * shadow[n];
+		}
+	}
+}
+
+AnaglyphHRIRSet* AnaglyphHRIRSet::generate_spherical_head(float sample_rate, float head_radius) {
+	const int azimuth_step = 10;
+	const int elevation_step = 15;
+	// The head shadow filter has died down by then even at 96kHz.
+	int length = sample_rate > 50000 ? 256 : 128;
+
+	int azimuth_count = 360 / azimuth_step;
+	int elevation_count = 180 / elevation_step + 1;
+	AnaglyphHRIRSet* set = new AnaglyphHRIRSet();
+	set->init(sample_rate, length, azimuth_count * elevation_count);
+
+	std::vector<float> left_ir(length);
+	std::vector<float> right_ir(length);
+	int index = 0;
+	for (int e = 0; e < elevation_count; e++) {
+		float elevation = -90.0f + e * elevation_step;
+		for (int a = 0; a < azimuth_count; a++) {
+			float azimuth = -180.0f + a * azimuth_step;
+			float x = sinf(azimuth * DEG2RAD) * cosf(elevation * DEG2RAD);
+			// Azimuth seen from each ear, with back folded onto front (the
+			// pinna model only covers the front half).
+			float folded = azimuth;
+			if (folded > 90) {
+				folded = 180 - folded;
+			}
+			else if (folded < -90) {
+				folded = -180 - folded;
+			}
+			spherical_head_ear(sample_rate, head_radius, x, folded, elevation, right_ir.data(), length);
+			spherical_head_ear(sample_rate, head_radius, -x, -folded, elevation, left_ir.data(), length);
+			set->set_direction(index, azimuth, elevation, left_ir.data(), right_ir.data());
+			index++;
+		}
+	}
+	return set;
+}
+
+int AnaglyphHRIRSet::find_nearest(float azimuth, float elevation) const {
+	float az = azimuth * DEG2RAD;
+	float el = elevation * DEG2RAD;
+	float x = sinf(az) * cosf(el);
+	float y = sinf(el);
+	float z = cosf(az) * cosf(el);
+	int best = 0;
+	float best_dot = -2;
+	int count = get_direction_count();
+	for (int i = 0; i < count; i++) {
+		const float* dir = directions + i * 3;
+		float dot = dir[0] * x + dir[1] * y + dir[2] * z;
+		if (dot > best_dot) {
+			best_dot = dot;
+			best = i;
+		}
+	}
+	return best;
+}
+
+const AnaglyphHRIRSet::Spectra& AnaglyphHRIRSet::prepare(int partition_size) {
+	const Spectra* existing = get_spectra(partition_size);
+	if (existing != nullptr) {
+		return *existing;
+	}
+
+	// Built in place, as moving it around would invalidate re and im.
+	spectra.emplace_back();
+	Spectra& result = spectra.back();
+	result.partition_size = partition_size;
+	result.partitions = (ir_length + partition_size - 1) / partition_size;
+	int bins = 2 * partition_size;
+	int count = get_direction_count();
+	size_t total = (size_t)count * result.partitions * bins;
+	result.storage.assign(total * 2, 0);
+	result.re = result.storage.data();
+	result.im = result.re + total;
+
+	AnaglyphFFT fft;
+	fft.init(bins);
+	for (int dir = 0; dir < count; dir++) {
+		for (int p = 0; p < result.partitions; p++) {
+			float* re = (float*)result.get_re(dir, p);
+			float* im = (float*)result.get_im(dir, p);
+			// This partition in the first half, zeros in the second, as
+			// overlap-save wants.
+			for (int i = 0; i < partition_size; i++) {
+				int sample = p * partition_size + i;
+				if (sample < ir_length) {
+					re[i] = get_left(dir)[sample];
+					im[i] = get_right(dir)[sample];
+				}
+			}
+			fft.forward(re, im);
+		}
+	}
+	return result;
+}
+
+const AnaglyphHRIRSet::Spectra* AnaglyphHRIRSet::get_spectra(int partition_size) const {
+	for (size_t i = 0; i < spectra.size(); i++) {
+		if (spectra[i].partition_size == partition_size) {
+			return &spectra[i];
+		}
+	}
+	return nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+#ifndef GDANAGLYPH_HRIR
+#define GDANAGLYPH_HRIR
+
+// Deliberately godot-free, just like anaglyph_simd.h and anaglyph_fft.h.
+
+#include <deque>
+#include <stddef.h>
+#include <vector>
+
+namespace godot {
+	class AnaglyphMappedFile;
+
+	// A set of head-related impulse responses: for a bunch of directions, how
+	// a click from there sounds in each ear. Used by the native backend.
+	//
+	// The IRs here contain no interaural time difference (ITD). That is
+	// applied separately with delay lines, so that it can change smoothly
+	// instead of being crossfaded between directions.
+	//
+	// A set either owns its data, or points straight into a mapped .ahrir
+	// file (see `AnaglyphHRIRFile`). Either way, it can't be copied.
+	class AnaglyphHRIRSet {
+		friend class AnaglyphHRIRFile;
+
+	public:
+		// The IRs of all directions, cut into partitions and transformed for
+		// uniformly partitioned convolution with FFTs of 2 * partition_size.
+		// Both ears are packed into a single complex spectrum as
+		// FFT(left + i * right). Convolving a real signal with that gives the
+		// left ear in the real part, and the right ear in the imaginary part,
+		// so one FFT pair does both ears.
+		struct Spectra {
+			int partition_size;
+			int partitions;
+			// [direction][partition][bin], with 2 * partition_size bins.
+			const float* re;
+			const float* im;
+			// What re and im point into, unless they're in a mapped file.
+			std::vector<float> storage;
+
+			const float* get_re(int direction, int partition) const {
+				return re + ((size_t)direction * partitions + partition) * 2 * partition_size;
+			}
+			const float* get_im(int direction, int partition) const {
+				return im + ((size_t)direction * partitions + partition) * 2 * partition_size;
+			}
+		};
+
+	private:
+		float sample_rate;
+		int ir_length;
+		int direction_count;
+		// Per direction, in degrees, with the same conventions as Anaglyph:
+		// azimuth 90 is right, elevation 90 is up.
+		const float* azimuths;
+		const float* elevations;
+		// Per direction, the unit vector (x right, y up, z forward).
+		const float* directions;
+		// [direction][sample]
+		const float* left;
+		const float* right;
+		// What all of the above point into, in that order, if we own it.
+		std::vector<float> storage;
+		// Otherwise, they point into this.
+		AnaglyphMappedFile* mapping;
+
+		// (A deque, so that handing out references stays valid when more
+		//  partition sizes get prepared later.)
+		std::deque<Spectra> spectra;
+
+	public:
+		AnaglyphHRIRSet();
+		~AnaglyphHRIRSet();
+		AnaglyphHRIRSet(const AnaglyphHRIRSet&) = delete;
+		AnaglyphHRIRSet& operator=(const AnaglyphHRIRSet&) = delete;
+
+		// Builds a set from Brown & Duda's structural model (a spherical
+		// head-shadow filter, plus some pinna echoes for elevation). This is
+		// nowhere near measured HRTFs, but it is small, needs no files, and
+		// gives convincing left/right and some up/down.
+		// "A structural model for binaural sound synthesis", 1998.
+		static AnaglyphHRIRSet* generate_spherical_head(float sample_rate, float head_radius);
+
+		// Sets up an empty set that is to be filled with `set_direction()`.
+		// Not for mapped sets.
+		void init(float sample_rate, int ir_length, int direction_count);
+		// Sets direction `index`, whose IRs are `ir_length` samples each.
+		void set_direction(int index, float azimuth, float elevation, const float* left_ir, const float* right_ir);
+
+		float get_sample_rate() const { return sample_rate; }
+		int get_ir_length() const { return ir_length; }
+		int get_direction_count() const { return direction_count; }
+		float get_azimuth(int index) const { return azimuths[index]; }
+		float get_elevation(int index) const { return elevations[index]; }
+		const float* get_left(int index) const { return left + (size_t)index * ir_length; }
+		const float* get_right(int index) const { return right + (size_t)index * ir_length; }
+
+		// The direction closest (by angle) to the given one.
+		int find_nearest(float azimuth, float elevation) const;
+
+		// Computes the spectra for this partition size if they don't exist
+		// yet. This allocates, so don't call it from the audio thread.
+		const Spectra& prepare(int partition_size);
+		// Returns nullptr if `prepare()` wasn't called for this size.
+		const Spectra* get_spectra(int partition_size) const;
+	};
+}
+
+#endif // GDANAGLYPH_HRIR
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "anaglyph_hrir_file.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace godot;
+
+const char AnaglyphHRIRFile::magic[8] = { 'G', 'D', 'A', 'H', 'R', 'I', 'R', 0 };
+
+AnaglyphMappedFile::AnaglyphMappedFile() {
+	data = nullptr;
+	size = 0;
+#ifdef _WIN32
+	file_handle = INVALID_HANDLE_VALUE;
+	mapping_handle = nullptr;
+#endif
+}
+
+AnaglyphMappedFile::~AnaglyphMappedFile() {
+	close();
+}
+
+bool AnaglyphMappedFile::open(const std::string& path) {
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	file_handle = file;
+	mapping_handle = mapping;
+	data = (const uint8_t*)view;
+	size = (size_t)file_size.QuadPart;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void* view = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	// (The mapping stays valid without the descriptor.)
+	::close(fd);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+	data = (const uint8_t*)view;
+	size = info.st_size;
+#endif
+	return true;
+}
+
+void AnaglyphMappedFile::close() {
+	if (data == nullptr) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle(mapping_handle);
+	CloseHandle(file_handle);
+	file_handle = INVALID_HANDLE_VALUE;
+	mapping_handle = nullptr;
+#else
+	munmap((void*)data, size);
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+static uint64_t align_up(uint64_t offset) {
+	return (offset + AnaglyphHRIRFile::alignment - 1) / AnaglyphHRIRFile::alignment * AnaglyphHRIRFile::alignment;
+}
+
+// Whether [offset, offset + bytes) is aligned and inside the file.
+static bool section_fits(uint64_t offset, uint64_t bytes, size_t file_size) {
+	return offset % AnaglyphHRIRFile::alignment == 0 && offset <= file_size && bytes <= file_size - offset;
+}
+
+AnaglyphHRIRSet* AnaglyphHRIRFile::load(const std::string& path, std::string& out_error) {
+	AnaglyphMappedFile* file = new AnaglyphMappedFile();
+	if (!file->open(path)) {
+		delete file;
+		out_error = "Could not open or map the file.";
+		return nullptr;
+	}
+
+	Header header;
+	if (file->get_size() < sizeof(Header)) {
+		delete file;
+		out_error = "File too small to be an .ahrir file.";
+		return nullptr;
+	}
+	memcpy(&header, file->get_data(), sizeof(Header));
+	if (memcmp(header.magic, magic, sizeof(magic)) != 0 || header.header_size != sizeof(Header)) {
+		delete file;
+		out_error = "Not an .ahrir file.";
+		return nullptr;
+	}
+	if (header.version != version) {
+		delete file;
+		out_error = "Unsupported .ahrir version " + std::to_string(header.version) + ".";
+		return nullptr;
+	}
+	uint64_t n = header.direction_count;
+	uint64_t bins = (uint64_t)header.partition_size * 2;
+	uint64_t spectrum_floats = n * header.partitions * bins;
+	bool valid = n > 0 && header.ir_length > 0 && header.partition_size > 0
+		&& (header.partition_size & (header.partition_size - 1)) == 0
+		&& header.partitions == (header.ir_length + header.partition_size - 1) / header.partition_size
+		&& section_fits(header.directions_offset, n * 5 * sizeof(float), file->get_size())
+		&& section_fits(header.irs_offset, n * header.ir_length * 2 * sizeof(float), file->get_size())
+		&& section_fits(header.spectra_offset, spectrum_floats * 2 * sizeof(float), file->get_size());
+	if (!valid) {
+		delete file;
+		out_error = "Corrupt .ahrir file.";
+		return nullptr;
+	}
+
+	AnaglyphHRIRSet* set = new AnaglyphHRIRSet();
+	set->mapping = file;
+	set->sample_rate = header.sample_rate;
+	set->ir_length = header.ir_length;
+	set->direction_count = header.direction_count;
+	const float* directions = (const float*)(file->get_data() + header.directions_offset);
+	set->azimuths = directions;
+	set->elevations = directions + n;
+	set->directions = directions + n * 2;
+	set->left = (const float*)(file->get_data() + header.irs_offset);
+	set->right = set->left + n * header.ir_length;
+
+	set->spectra.emplace_back();
+	AnaglyphHRIRSet::Spectra& spectra = set->spectra.back();
+	spectra.partition_size = header.partition_size;
+	spectra.partitions = header.partitions;
+	spectra.re = (const float*)(file->get_data() + header.spectra_offset);
+	spectra.im = spectra.re + spectrum_floats;
+	return set;
+}
+
+// Writes `bytes`, then pads with zeros up to the next aligned offset.
+static bool write_section(FILE* f, const void* data, uint64_t bytes, uint64_t& offset) {
+	if (bytes > 0 && fwrite(data, 1, bytes, f) != bytes) {
+		return false;
+	}
+	offset += bytes;
+	static const char zeros[AnaglyphHRIRFile::alignment] = {};
+	uint64_t padding = align_up(offset) - offset;
+	if (padding > 0 && fwrite(zeros, 1, padding, f) != padding) {
+		return false;
+	}
+	offset += padding;
+	return true;
+}
+
+bool AnaglyphHRIRFile::save(AnaglyphHRIRSet& set, int partition_size, const std::string& path, std::string& out_error) {
+	const AnaglyphHRIRSet::Spectra& spectra = set.prepare(partition_size);
+	uint64_t n = set.get_direction_count();
+	uint64_t ir_floats = n * set.get_ir_length();
+	uint64_t spectrum_floats = n * spectra.partitions * 2 * partition_size;
+
+	Header header;
+	memset(&header, 0, sizeof(Header));
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.header_size = sizeof(Header);
+	header.sample_rate = set.get_sample_rate();
+	header.ir_length = set.get_ir_length();
+	header.direction_count = n;
+	header.partition_size = partition_size;
+	header.partitions = spectra.partitions;
+	header.directions_offset = align_up(sizeof(Header));
+	header.irs_offset = align_up(header.directions_offset + n * 5 * sizeof(float));
+	header.spectra_offset = align_up(header.irs_offset + ir_floats * 2 * sizeof(float));
+
+	FILE* f = fopen(path.c_str(), "wb");
+	if (f == nullptr) {
+		out_error = "Could not open the file for writing.";
+		return false;
+	}
+	uint64_t offset = 0;
+	bool ok = write_section(f, &header, sizeof(Header), offset);
+	// (Azimuths, elevations and unit vectors are contiguous in memory too.)
+	ok = ok && write_section(f, set.azimuths, n * 5 * sizeof(float), offset);
+	ok = ok && fwrite(set.left, sizeof(float), ir_floats, f) == ir_floats;
+	offset += ir_floats * sizeof(float);
+	ok = ok && write_section(f, set.right, ir_floats * sizeof(float), offset);
+	ok = ok && fwrite(spectra.re, sizeof(float), spectrum_floats, f) == spectrum_floats;
+	offset += spectrum_floats * sizeof(float);
+	ok = ok && write_section(f, spectra.im, spectrum_floats * sizeof(float), offset);
+	fclose(f);
+	if (!ok) {
+		out_error = "Could not write the file.";
+	}
+	return ok;
+}
\ No newline at end of file
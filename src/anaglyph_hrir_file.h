@@ -0,0 +1,81 @@
+#ifndef GDANAGLYPH_HRIR_FILE
+#define GDANAGLYPH_HRIR_FILE
+
+// Godot-free, as the conversion tool in `tools/` also uses this.
+
+#include "anaglyph_hrir.h"
+
+#include <stdint.h>
+#include <string>
+
+namespace godot {
+	// A read-only memory mapping of a whole file. Unmapped on destruction.
+	class AnaglyphMappedFile {
+	private:
+		const uint8_t* data;
+		size_t size;
+#ifdef _WIN32
+		void* file_handle;
+		void* mapping_handle;
+#endif
+
+	public:
+		AnaglyphMappedFile();
+		~AnaglyphMappedFile();
+		AnaglyphMappedFile(const AnaglyphMappedFile&) = delete;
+		AnaglyphMappedFile& operator=(const AnaglyphMappedFile&) = delete;
+
+		bool open(const std::string& path);
+		void close();
+
+		const uint8_t* get_data() const { return data; }
+		size_t get_size() const { return size; }
+	};
+
+	// The .ahrir format: an `AnaglyphHRIRSet` exactly as it is in memory, so
+	// that loading it is mapping the file and pointing into it. There is no
+	// decoding, no resampling, and no FFTs at load time; the pages come in
+	// when they're first used, and processes that map the same file share
+	// them.
+	//
+	// The layout is a `Header`, followed by sections that all start at a
+	// multiple of `alignment` bytes:
+	// - directions: azimuths[n], elevations[n], unit vectors[3n];
+	// - irs: left[n][ir_length], right[n][ir_length];
+	// - spectra: re[n][partitions][2 * partition_size], then im likewise.
+	// All floats are little-endian IEEE, which is everything we run on.
+	//
+	// The IRs must already be at the rate they'll be played at. Convert
+	// (and resample) with `tools/ahrir_convert.cpp`.
+	class AnaglyphHRIRFile {
+	public:
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			uint32_t header_size;
+			float sample_rate;
+			uint32_t ir_length;
+			uint32_t direction_count;
+			uint32_t partition_size;
+			uint32_t partitions;
+			uint32_t reserved;
+			uint64_t directions_offset;
+			uint64_t irs_offset;
+			uint64_t spectra_offset;
+		};
+
+		static const char magic[8];
+		static const uint32_t version = 1;
+		// Enough for any SIMD load, and a cache line besides.
+		static const uint64_t alignment = 64;
+
+		// Maps the file and returns a set that points into it, or nullptr
+		// (with the reason in `out_error`) if it's not a valid .ahrir file.
+		static AnaglyphHRIRSet* load(const std::string& path, std::string& out_error);
+
+		// Writes the set, with spectra for the given partition size.
+		static bool save(AnaglyphHRIRSet& set, int partition_size, const std::string& path, std::string& out_error);
+	};
+}
+
+#endif // GDANAGLYPH_HRIR_FILE
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "anaglyph_listener_registry.h"
+#include "helpers.h"
+
+#include <godot_cpp/classes/audio_listener3d.hpp>
+#include <godot_cpp/classes/camera3d.hpp>
+#include <godot_cpp/classes/engine.hpp>
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/classes/scene_tree.hpp>
+#include <godot_cpp/core/mutex_lock.hpp>
+#include <godot_cpp/variant/callable_method_pointer.hpp>
+
+using namespace godot;
+
+AnaglyphListenerRegistry* AnaglyphListenerRegistry::singleton = nullptr;
+
+AnaglyphListenerRegistry* AnaglyphListenerRegistry::get_singleton() {
+	// Same as the bus manager, this is created on module initialization.
+	if (singleton == nullptr) {
+		singleton = new AnaglyphListenerRegistry();
+	}
+	return singleton;
+}
+
+void AnaglyphListenerRegistry::free_singleton() {
+	if (singleton != nullptr) {
+		delete singleton;
+		singleton = nullptr;
+	}
+}
+
+AnaglyphListenerRegistry::AnaglyphListenerRegistry() {
+	mutex.instantiate();
+	hookup_scheduled = false;
+}
+
+AnaglyphListenerRegistry::~AnaglyphListenerRegistry() {
+	// On deinit the tree is long gone, so there's nothing to disconnect.
+}
+
+bool AnaglyphListenerRegistry::is_main_thread() {
+	OS* os = OS::get_singleton();
+	return os->get_thread_caller_id() == os->get_main_thread_id();
+}
+
+void AnaglyphListenerRegistry::hook_into_tree(SceneTree* tree) {
+	ObjectID tree_id = ObjectID(tree->get_instance_id());
+	if (connected_tree == tree_id) {
+		return;
+	}
+	connected_tree = tree_id;
+	listeners.clear();
+	cache.clear();
+
+	tree->connect("node_added", callable_mp_static(&AnaglyphListenerRegistry::on_node_added));
+	tree->connect("node_removed", callable_mp_static(&AnaglyphListenerRegistry::on_node_removed));
+
+	// Anything that entered before we connected, we need to find ourselves.
+	// This only happens once.
+	Window* root = tree->get_root();
+	if (root == nullptr) {
+		return;
+	}
+	TypedArray<Node> existing = root->find_children("*", "AudioListener3D", true, false);
+	for (int i = 0; i < existing.size(); i++) {
+		Node* node = Object::cast_to<Node>(existing[i]);
+		if (node != nullptr) {
+			listeners.push_back(ObjectID(node->get_instance_id()));
+		}
+	}
+	AnaglyphHelpers::print("Listener registry found ", listeners.size(), " AudioListener3D(s).");
+}
+
+void AnaglyphListenerRegistry::hook_deferred(uint64_t tree_id) {
+	AnaglyphListenerRegistry* self = get_singleton();
+	MutexLock lock(*self->mutex.ptr());
+	self->hookup_scheduled = false;
+	SceneTree* scene_tree = Object::cast_to<SceneTree>(ObjectDB::get_instance(tree_id));
+	if (scene_tree != nullptr) {
+		self->hook_into_tree(scene_tree);
+	}
+}
+
+void AnaglyphListenerRegistry::on_node_added(Node* node) {
+	if (Object::cast_to<AudioListener3D>(node) == nullptr) {
+		return;
+	}
+	AnaglyphListenerRegistry* self = get_singleton();
+	MutexLock lock(*self->mutex.ptr());
+	ObjectID id = ObjectID(node->get_instance_id());
+	if (!self->listeners.has(id)) {
+		self->listeners.push_back(id);
+	}
+}
+
+void AnaglyphListenerRegistry::on_node_removed(Node* node) {
+	if (Object::cast_to<AudioListener3D>(node) == nullptr) {
+		return;
+	}
+	AnaglyphListenerRegistry* self = get_singleton();
+	MutexLock lock(*self->mutex.ptr());
+	self->listeners.erase(ObjectID(node->get_instance_id()));
+	// Whoever used this listener this frame should stop doing so.
+	self->cache.clear();
+}
+
+Node3D* AnaglyphListenerRegistry::find_listener_node(Viewport* viewport) {
+	// Mirrors what AudioStreamPlayer3D does: a current listener wins,
+	// otherwise it's the camera.
+	// https://github.com/godotengine/godot/blob/e7c39efdb15eaaeb133ed8d0ff0ba0891f8ca676/scene/3d/audio_stream_player_3d.cpp#L355
+	for (int i = 0; i < listeners.size(); i++) {
+		AudioListener3D* listener = Object::cast_to<AudioListener3D>(ObjectDB::get_instance(listeners[i]));
+		if (listener == nullptr) {
+			continue;
+		}
+		if (listener->is_current() && listener->get_viewport() == viewport) {
+			return listener;
+		}
+	}
+	return viewport->get_camera_3d();
+}
+
+Node3D* AnaglyphListenerRegistry::get_listener_node(Viewport* viewport) {
+	if (viewport == nullptr) {
+		return nullptr;
+	}
+	MutexLock lock(*mutex.ptr());
+
+	SceneTree* tree = viewport->get_tree();
+	if (tree != nullptr && connected_tree != ObjectID(tree->get_instance_id())) {
+		if (is_main_thread()) {
+			hook_into_tree(tree);
+		}
+		else if (!hookup_scheduled) {
+			hookup_scheduled = true;
+			callable_mp_static(&AnaglyphListenerRegistry::hook_deferred).bind(tree->get_instance_id()).call_deferred();
+		}
+	}
+
+	uint64_t viewport_id = viewport->get_instance_id();
+	uint64_t frame = Engine::get_singleton()->get_process_frames();
+	CachedListener* cached = cache.getptr(viewport_id);
+	if (cached != nullptr && cached->frame == frame) {
+		return Object::cast_to<Node3D>(ObjectDB::get_instance(cached->node));
+	}
+
+	Node3D* node = find_listener_node(viewport);
+	if (node == nullptr) {
+		cache.erase(viewport_id);
+		return nullptr;
+	}
+	// The quaternion extraction is the expensive-ish part, so this is what
+	// we really want to do only once.
+	CachedListener entry;
+	entry.frame = frame;
+	entry.node = ObjectID(node->get_instance_id());
+	Transform3D transform = node->get_global_transform();
+	entry.state.position = transform.origin;
+	entry.state.inverse_rotation = transform.basis.get_rotation_quaternion().inverse();
+	cache.insert(viewport_id, entry);
+	return node;
+}
+
+bool AnaglyphListenerRegistry::get_listener(Viewport* viewport, ListenerState& out_state) {
+	MutexLock lock(*mutex.ptr());
+	if (get_listener_node(viewport) == nullptr) {
+		return false;
+	}
+	out_state = cache.get(viewport->get_instance_id()).state;
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#ifndef GDANAGLYPH_LISTENERS
+#define GDANAGLYPH_LISTENERS
+
+#include <godot_cpp/classes/mutex.hpp>
+#include <godot_cpp/classes/node3d.hpp>
+#include <godot_cpp/classes/viewport.hpp>
+#include <godot_cpp/core/object_id.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/vector.hpp>
+
+namespace godot {
+	// Every playing AudioStreamPlayerAnaglyph needs to know where the listener
+	// is, every frame. Instead of having all of them look it up themselves,
+	// they ask this class, which looks it up once per viewport per frame.
+	//
+	// Viewport::get_audio_listener_3d() is not exposed, so we keep track of
+	// all AudioListener3Ds ourselves via the SceneTree's node_added and
+	// node_removed signals. If a viewport has a current AudioListener3D, that
+	// one is used. Otherwise, the viewport's camera is, just like Godot does.
+	//
+	// All public methods are safe to call from any thread.
+	class AnaglyphListenerRegistry {
+
+	public:
+		// The listener's transform, decomposed the way the polar position
+		// calculation wants it.
+		struct ListenerState {
+			Vector3 position;
+			// The inverse of the listener's global rotation, so that
+			// `inverse_rotation.xform(delta)` brings world-space into
+			// listener-space.
+			Quaternion inverse_rotation;
+		};
+
+	private:
+		static AnaglyphListenerRegistry* singleton;
+
+		Ref<Mutex> mutex;
+
+		// All AudioListener3Ds currently in the tree.
+		Vector<ObjectID> listeners;
+		// The tree whose signals we're connected to. Null if we haven't
+		// hooked into any tree yet.
+		ObjectID connected_tree;
+		// Connecting signals may only happen on the main thread. If the first
+		// query comes from elsewhere, this is done deferred.
+		bool hookup_scheduled;
+
+		struct CachedListener {
+			uint64_t frame;
+			ObjectID node;
+			ListenerState state;
+		};
+		// Keyed by the viewport's instance id.
+		HashMap<uint64_t, CachedListener> cache;
+
+		static bool is_main_thread();
+		// Connects to the tree's signals and registers all listeners already
+		// in it. Main thread only.
+		void hook_into_tree(SceneTree* tree);
+		static void hook_deferred(uint64_t tree_id);
+		static void on_node_added(Node* node);
+		static void on_node_removed(Node* node);
+
+		// Does the actual lookup that is cached.
+		Node3D* find_listener_node(Viewport* viewport);
+
+	public:
+		static AnaglyphListenerRegistry* get_singleton();
+		// Frees the singleton. Only to be called on module deinitialization.
+		static void free_singleton();
+
+		AnaglyphListenerRegistry();
+		~AnaglyphListenerRegistry();
+
+		// Gets the listener of this viewport, as it was at the start of this
+		// frame. Returns false if there is no listener or camera at all.
+		bool get_listener(Viewport* viewport, ListenerState& out_state);
+		// Gets the node that is currently listening in this viewport. This is
+		// either a current AudioListener3D, or the viewport's camera.
+		// Returns nullptr if neither exist.
+		Node3D* get_listener_node(Viewport* viewport);
+	};
+}
+
+#endif // GDANAGLYPH_LISTENERS
\ No newline at end of file
@@ -0,0 +1,411 @@
+#include "anaglyph_native_backend.h"
+#include "anaglyph_hrir_file.h"
+#include "anaglyph_simd.h"
+
+#include <algorithm>
+#include <math.h>
+#include <mutex>
+#include <string.h>
+
+using namespace godot;
+
+std::vector<AnaglyphHRIRSet*> AnaglyphNativeBackend::hrir_sets;
+std::vector<AnaglyphHRIRSet*> AnaglyphNativeBackend::file_sets;
+
+// Instances may be created from whatever thread creates the effect.
+static std::mutex hrir_mutex;
+
+static const float PI_F = 3.14159265f;
+static const float DEG2RAD = PI_F / 180.0f;
+static const float speed_of_sound = 343.0f;
+static const float default_head_radius = 0.0875f;
+// Enough for the ITD of an 80cm head at 192kHz.
+static const int delay_line_size = 256;
+
+UnityAudioEffectDefinition* AnaglyphNativeBackend::get_definition() {
+	static UnityAudioEffectDefinition definition;
+	static bool initialized = false;
+	if (!initialized) {
+		memset(&definition, 0, sizeof(definition));
+		definition.structsize = sizeof(UnityAudioEffectDefinition);
+		definition.paramstructsize = sizeof(UnityAudioParameterDefinition);
+		definition.apiversion = UNITY_AUDIO_PLUGIN_API_VERSION;
+		definition.pluginversion = 1;
+		definition.numparameters = PARAM_COUNT;
+		// Nobody reads the parameter definitions, so there are none.
+		definition.paramdefs = nullptr;
+		strncpy(definition.name, "GDAnaglyph native", sizeof(definition.name) - 1);
+		definition.create = &create;
+		definition.release = &release;
+		definition.reset = &reset;
+		definition.process = &process;
+		definition.setfloatparameter = &set_float_parameter;
+		definition.getfloatparameter = &get_float_parameter;
+		initialized = true;
+	}
+	return &definition;
+}
+
+std::vector<std::string> AnaglyphNativeBackend::load_hrir_files(const std::vector<std::string>& paths) {
+	std::vector<std::string> errors;
+	std::vector<AnaglyphHRIRSet*> loaded;
+	for (size_t i = 0; i < paths.size(); i++) {
+		std::string error;
+		AnaglyphHRIRSet* set = AnaglyphHRIRFile::load(paths[i], error);
+		if (set == nullptr) {
+			errors.push_back(paths[i] + ": " + error);
+			continue;
+		}
+		loaded.push_back(set);
+	}
+	std::lock_guard<std::mutex> lock(hrir_mutex);
+	// Sets are never freed, as running instances may still point into them.
+	// Loading is a one-time thing anyway.
+	file_sets.insert(file_sets.end(), loaded.begin(), loaded.end());
+	return errors;
+}
+
+bool AnaglyphNativeBackend::has_file_models(float sample_rate) {
+	std::lock_guard<std::mutex> lock(hrir_mutex);
+	for (size_t i = 0; i < file_sets.size(); i++) {
+		if (file_sets[i]->get_sample_rate() == sample_rate) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void AnaglyphNativeBackend::find_models(float sample_rate, std::vector<AnaglyphHRIRSet*>& out_models) {
+	std::lock_guard<std::mutex> lock(hrir_mutex);
+	find_models_locked(sample_rate, out_models);
+}
+
+void AnaglyphNativeBackend::find_models_locked(float sample_rate, std::vector<AnaglyphHRIRSet*>& out_models) {
+	out_models.clear();
+	// (Files at other rates would play at the wrong pitch, so skip those.)
+	for (size_t i = 0; i < file_sets.size(); i++) {
+		if (file_sets[i]->get_sample_rate() == sample_rate) {
+			out_models.push_back(file_sets[i]);
+		}
+	}
+	if (out_models.empty()) {
+		AnaglyphHRIRSet* set = nullptr;
+		for (size_t i = 0; i < hrir_sets.size(); i++) {
+			if (hrir_sets[i]->get_sample_rate() == sample_rate) {
+				set = hrir_sets[i];
+				break;
+			}
+		}
+		if (set == nullptr) {
+			set = AnaglyphHRIRSet::generate_spherical_head(sample_rate, default_head_radius);
+			hrir_sets.push_back(set);
+		}
+		out_models.push_back(set);
+	}
+}
+
+void AnaglyphNativeBackend::get_models(Instance* instance) {
+	// Sets are shared, and two instances created at once may both find a
+	// partition size missing. So prepare under the same lock.
+	std::lock_guard<std::mutex> lock(hrir_mutex);
+	std::vector<AnaglyphHRIRSet*> sets;
+	find_models_locked(instance->sample_rate, sets);
+	instance->models.clear();
+	instance->model_spectra.clear();
+	for (size_t i = 0; i < sets.size(); i++) {
+		// Free for files written with this partition size, otherwise the
+		// spectra are computed once here.
+		instance->models.push_back(sets[i]);
+		instance->model_spectra.push_back(&sets[i]->prepare(instance->partition_size));
+	}
+}
+
+float AnaglyphNativeBackend::get_scaled(const Instance* instance, int index, float min, float max) {
+	return instance->params[index] * (max - min) + min;
+}
+
+void AnaglyphNativeBackend::reset_params(Instance* instance) {
+	for (int i = 0; i < PARAM_COUNT; i++) {
+		instance->params[i] = 0;
+	}
+	// The same defaults as AnaglyphEffectData, normalized.
+	instance->params[PARAM_WET] = 1;
+	instance->params[PARAM_GAIN] = 40.0f / 55.0f;
+	instance->params[PARAM_ATTENUATION_EXPONENT] = 0.5f;
+	instance->params[PARAM_HEAD_CIRCUMFERENCE] = (57.5f - 20.0f) / 60.0f;
+	instance->params[PARAM_ELEVATION] = 0.5f;
+	instance->params[PARAM_AZIMUTH] = 0.5f;
+	instance->params[PARAM_DISTANCE] = (0.3f - 0.1f) / 9.9f;
+	instance->params[PARAM_MAX_ATTENUATION] = 1;
+}
+
+void AnaglyphNativeBackend::reset_buffers(Instance* instance) {
+	std::fill(instance->input_block.begin(), instance->input_block.end(), 0.0f);
+	std::fill(instance->output_block.begin(), instance->output_block.end(), 0.0f);
+	std::fill(instance->history.begin(), instance->history.end(), 0.0f);
+	std::fill(instance->fdl_re.begin(), instance->fdl_re.end(), 0.0f);
+	std::fill(instance->fdl_im.begin(), instance->fdl_im.end(), 0.0f);
+	std::fill(instance->delay_left.begin(), instance->delay_left.end(), 0.0f);
+	std::fill(instance->delay_right.begin(), instance->delay_right.end(), 0.0f);
+	instance->block_fill = 0;
+	instance->fdl_position = 0;
+	instance->delay_write = 0;
+	instance->model = -1;
+	instance->direction = -1;
+	// Start without any ramps.
+	instance->fresh = true;
+}
+
+UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK AnaglyphNativeBackend::create(UnityAudioEffectState* state) {
+	Instance* instance = new Instance();
+	instance->sample_rate = state->samplerate;
+	int partition_size = max_partition_size;
+	while (partition_size > 16 && partition_size > (int)state->dspbuffersize) {
+		partition_size /= 2;
+	}
+	instance->partition_size = partition_size;
+	get_models(instance);
+	instance->fft.init(2 * partition_size);
+	instance->fdl_partitions = 1;
+	for (size_t i = 0; i < instance->model_spectra.size(); i++) {
+		if (instance->model_spectra[i]->partitions > instance->fdl_partitions) {
+			instance->fdl_partitions = instance->model_spectra[i]->partitions;
+		}
+	}
+
+	// All allocations happen here, so that processing never allocates.
+	int bins = 2 * partition_size;
+	instance->input_block.resize(2 * partition_size);
+	instance->output_block.resize(2 * partition_size);
+	instance->history.resize(bins);
+	instance->fdl_re.resize((size_t)instance->fdl_partitions * bins);
+	instance->fdl_im.resize((size_t)instance->fdl_partitions * bins);
+	instance->acc_re.resize(bins);
+	instance->acc_im.resize(bins);
+	instance->fade_re.resize(bins);
+	instance->fade_im.resize(bins);
+	instance->delay_left.resize(delay_line_size);
+	instance->delay_right.resize(delay_line_size);
+
+	reset_params(instance);
+	reset_buffers(instance);
+	state->effectdata = instance;
+	return UNITY_AUDIODSP_OK;
+}
+
+UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK AnaglyphNativeBackend::release(UnityAudioEffectState* state) {
+	Instance* instance = (Instance*)state->effectdata;
+	delete instance;
+	state->effectdata = nullptr;
+	return UNITY_AUDIODSP_OK;
+}
+
+UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK AnaglyphNativeBackend::reset(UnityAudioEffectState* state) {
+	Instance* instance = (Instance*)state->effectdata;
+	if (instance == nullptr) {
+		return UNITY_AUDIODSP_ERR_UNSUPPORTED;
+	}
+	reset_params(instance);
+	reset_buffers(instance);
+	return UNITY_AUDIODSP_OK;
+}
+
+UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK AnaglyphNativeBackend::set_float_parameter(UnityAudioEffectState* state, int index, float value) {
+	Instance* instance = (Instance*)state->effectdata;
+	if (instance == nullptr || index < 0 || index >= PARAM_COUNT) {
+		return UNITY_AUDIODSP_ERR_UNSUPPORTED;
+	}
+	instance->params[index] = value;
+	return UNITY_AUDIODSP_OK;
+}
+
+UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK AnaglyphNativeBackend::get_float_parameter(UnityAudioEffectState* state, int index, float* value, char* valuestr) {
+	Instance* instance = (Instance*)state->effectdata;
+	if (instance == nullptr || index < 0 || index >= PARAM_COUNT) {
+		return UNITY_AUDIODSP_ERR_UNSUPPORTED;
+	}
+	if (value != nullptr) {
+		*value = instance->params[index];
+	}
+	if (valuestr != nullptr) {
+		valuestr[0] = 0;
+	}
+	return UNITY_AUDIODSP_OK;
+}
+
+void AnaglyphNativeBackend::convolve(Instance* instance, int model, int direction, float* re, float* im) {
+	const AnaglyphHRIRSet::Spectra* spectra = instance->model_spectra[model];
+	int bins = 2 * instance->partition_size;
+	int partitions = spectra->partitions;
+	std::fill(re, re + bins, 0.0f);
+	std::fill(im, im + bins, 0.0f);
+	for (int p = 0; p < partitions; p++) {
+		// Partition p of the filter goes with the input from p blocks ago.
+		int slot = (instance->fdl_position - p + instance->fdl_partitions) % instance->fdl_partitions;
+		AnaglyphSIMD::complex_multiply_accumulate(
+			instance->fdl_re.data() + (size_t)slot * bins, instance->fdl_im.data() + (size_t)slot * bins,
+			spectra->get_re(direction, p), spectra->get_im(direction, p),
+			re, im,
+			bins
+		);
+	}
+	instance->fft.inverse(re, im);
+}
+
+void AnaglyphNativeBackend::process_block(Instance* instance) {
+	int size = instance->partition_size;
+	int bins = 2 * size;
+	float* input = instance->input_block.data();
+	float* output = instance->output_block.data();
+
+	// Distance attenuation and gain, ramped over the block.
+	float distance = get_scaled(instance, PARAM_DISTANCE, 0.1f, 10);
+	float gain = powf(10.0f, get_scaled(instance, PARAM_GAIN, -40, 15) / 20.0f);
+	if (instance->params[PARAM_BYPASS_ATTENUATION] == 0) {
+		float min_distance = get_scaled(instance, PARAM_MIN_ATTENUATION, 0.1f, 10);
+		float max_distance = fmaxf(min_distance, get_scaled(instance, PARAM_MAX_ATTENUATION, 0.1f, 10));
+		float exponent = get_scaled(instance, PARAM_ATTENUATION_EXPONENT, 0, 2);
+		float clamped = fminf(fmaxf(distance, min_distance), max_distance);
+		gain *= powf(min_distance / clamped, exponent);
+	}
+	if (instance->fresh) {
+		instance->current_gain = gain;
+	}
+	float start_gain = instance->current_gain;
+	instance->current_gain = gain;
+	float wet = instance->params[PARAM_WET];
+
+	if (instance->params[PARAM_BYPASS_BINAURAL] != 0) {
+		for (int i = 0; i < size; i++) {
+			float g = start_gain + (gain - start_gain) * (i + 1) / size;
+			float scale = (1 - wet) + wet * g;
+			output[2 * i] = input[2 * i] * scale;
+			output[2 * i + 1] = input[2 * i + 1] * scale;
+		}
+		instance->model = -1;
+		instance->direction = -1;
+		instance->fresh = true;
+		return;
+	}
+
+	// Overlap-save: the FFT input is the previous block followed by this one.
+	float* history = instance->history.data();
+	for (int i = 0; i < size; i++) {
+		history[i] = history[size + i];
+		history[size + i] = 0.5f * (input[2 * i] + input[2 * i + 1]);
+	}
+	instance->fdl_position = (instance->fdl_position + 1) % instance->fdl_partitions;
+	float* slot_re = instance->fdl_re.data() + (size_t)instance->fdl_position * bins;
+	float* slot_im = instance->fdl_im.data() + (size_t)instance->fdl_position * bins;
+	memcpy(slot_re, history, bins * sizeof(float));
+	std::fill(slot_im, slot_im + bins, 0.0f);
+	instance->fft.forward(slot_re, slot_im);
+
+	float azimuth = get_scaled(instance, PARAM_AZIMUTH, -180, 180);
+	float elevation = get_scaled(instance, PARAM_ELEVATION, -90, 90);
+	// Same mapping as Anaglyph: n models get the ids 0/(n-1), 1/(n-1), ...
+	int model_count = (int)instance->models.size();
+	int model = (int)lroundf(instance->params[PARAM_HRTF_ID] * (model_count - 1));
+	model = model < 0 ? 0 : (model >= model_count ? model_count - 1 : model);
+	int previous_model = instance->model;
+	int previous = instance->direction;
+	int direction = previous;
+	if (previous < 0 || model != previous_model || azimuth != instance->direction_azimuth || elevation != instance->direction_elevation) {
+		direction = instance->models[model]->find_nearest(azimuth, elevation);
+		instance->direction_azimuth = azimuth;
+		instance->direction_elevation = elevation;
+	}
+	instance->model = model;
+	instance->direction = direction;
+
+	float* re = instance->acc_re.data();
+	float* im = instance->acc_im.data();
+	convolve(instance, model, direction, re, im);
+	if (previous >= 0 && (previous != direction || previous_model != model)) {
+		float* old_re = instance->fade_re.data();
+		float* old_im = instance->fade_im.data();
+		convolve(instance, previous_model, previous, old_re, old_im);
+		for (int i = 0; i < size; i++) {
+			float t = (i + 0.5f) / size;
+			re[size + i] = old_re[size + i] * (1 - t) + re[size + i] * t;
+			im[size + i] = old_im[size + i] * (1 - t) + im[size + i] * t;
+		}
+	}
+
+	// Woodworth's ITD, from the lateral angle. The far ear gets delayed.
+	float head_radius = default_head_radius;
+	if (instance->params[PARAM_USE_CUSTOM_CIRCUMFERENCE] != 0) {
+		head_radius = get_scaled(instance, PARAM_HEAD_CIRCUMFERENCE, 20, 80) / 100.0f / (2 * PI_F);
+	}
+	float lateral = asinf(fminf(1.0f, fmaxf(-1.0f, sinf(azimuth * DEG2RAD) * cosf(elevation * DEG2RAD))));
+	float itd = head_radius / speed_of_sound * (fabsf(lateral) + sinf(fabsf(lateral))) * instance->sample_rate;
+	itd = fminf(itd, delay_line_size - 2.0f);
+	float target_left = lateral > 0 ? itd : 0;
+	float target_right = lateral > 0 ? 0 : itd;
+	if (instance->fresh) {
+		instance->current_delay_left = target_left;
+		instance->current_delay_right = target_right;
+	}
+	float start_left = instance->current_delay_left;
+	float start_right = instance->current_delay_right;
+	instance->current_delay_left = target_left;
+	instance->current_delay_right = target_right;
+
+	const int mask = delay_line_size - 1;
+	float* delay_left = instance->delay_left.data();
+	float* delay_right = instance->delay_right.data();
+	for (int i = 0; i < size; i++) {
+		int write = instance->delay_write;
+		delay_left[write] = re[size + i];
+		delay_right[write] = im[size + i];
+		instance->delay_write = (write + 1) & mask;
+
+		float t = (i + 1.0f) / size;
+		float d_left = start_left + (target_left - start_left) * t;
+		float d_right = start_right + (target_right - start_right) * t;
+		int whole_left = (int)d_left;
+		int whole_right = (int)d_right;
+		float frac_left = d_left - whole_left;
+		float frac_right = d_right - whole_right;
+		float left = delay_left[(write - whole_left) & mask] * (1 - frac_left) + delay_left[(write - whole_left - 1) & mask] * frac_left;
+		float right = delay_right[(write - whole_right) & mask] * (1 - frac_right) + delay_right[(write - whole_right - 1) & mask] * frac_right;
+
+		float g = start_gain + (gain - start_gain) * t;
+		output[2 * i] = input[2 * i] * (1 - wet) + left * g * wet;
+		output[2 * i + 1] = input[2 * i + 1] * (1 - wet) + right * g * wet;
+	}
+	instance->fresh = false;
+}
+
+UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK AnaglyphNativeBackend::process(UnityAudioEffectState* state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int outchannels) {
+	Instance* instance = (Instance*)state->effectdata;
+	if (instance == nullptr || inchannels != 2 || outchannels != 2) {
+		return UNITY_AUDIODSP_ERR_UNSUPPORTED;
+	}
+	// Work in partitions regardless of what the buffer size is. This costs
+	// one partition of latency, but means we never care about the length.
+	int size = instance->partition_size;
+	float* input = instance->input_block.data();
+	float* output = instance->output_block.data();
+	unsigned int done = 0;
+	while (done < length) {
+		int fill = instance->block_fill;
+		int count = size - fill;
+		if ((unsigned int)count > length - done) {
+			count = length - done;
+		}
+		// (Copy the input first, as it may be the same buffer as the output.)
+		for (int i = 0; i < 2 * count; i++) {
+			float sample = inbuffer[2 * done + i];
+			outbuffer[2 * done + i] = output[2 * fill + i];
+			input[2 * fill + i] = sample;
+		}
+		done += count;
+		instance->block_fill += count;
+		if (instance->block_fill == size) {
+			process_block(instance);
+			instance->block_fill = 0;
+		}
+	}
+	return UNITY_AUDIODSP_OK;
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+#ifndef GDANAGLYPH_NATIVE
+#define GDANAGLYPH_NATIVE
+
+// Godot-free, so that it can be benchmarked outside of Godot.
+
+#include "AudioPluginInterface.h"
+#include "anaglyph_fft.h"
+#include "anaglyph_hrir.h"
+
+#include <string>
+#include <vector>
+
+namespace godot {
+	// A binaural renderer of our own, for wherever the Anaglyph dll isn't
+	// available (which is everywhere except Windows).
+	//
+	// It pretends to be a Unity plugin, just like Anaglyph, so that the
+	// bridge can use it without anything else in the extension knowing.
+	// It takes the same parameters (by the same indices), but only supports
+	// a subset:
+	// - azimuth, elevation and distance;
+	// - wet, gain;
+	// - head circumference (for the ITD only);
+	// - the distance attenuation parameters;
+	// - bypass binaural;
+	// - the HRTF id, which selects one of the .ahrir files (see
+	//   `AnaglyphHRIRFile`) at this sample rate, in alphabetical order, the
+	//   same way Anaglyph selects its models.
+	// Everything else (reverb, parallax, head shadow bypass, micro
+	// oscillations) is accepted but ignored. Without any .ahrir files, a
+	// synthesized spherical head is used.
+	//
+	// The HRIRs are convolved with uniformly partitioned overlap-save
+	// convolution. Partitions are small, so the latency is only one
+	// partition, and the cost is mostly the multiply-accumulate over
+	// partitions, which is done with `AnaglyphSIMD`. Whenever the direction
+	// changes, the old and new filters run side by side for one partition
+	// and get crossfaded.
+	class AnaglyphNativeBackend {
+	public:
+		// The parameter indices we understand. See anaglyph_effect.h.
+		enum Param {
+			PARAM_BYPASS_ATTENUATION = 3,
+			PARAM_BYPASS_BINAURAL = 4,
+			PARAM_USE_CUSTOM_CIRCUMFERENCE = 8,
+			PARAM_HRTF_ID = 15,
+			PARAM_WET = 18,
+			PARAM_ATTENUATION_EXPONENT = 19,
+			PARAM_GAIN = 20,
+			PARAM_HEAD_CIRCUMFERENCE = 25,
+			PARAM_ELEVATION = 26,
+			PARAM_AZIMUTH = 27,
+			PARAM_DISTANCE = 28,
+			PARAM_MIN_ATTENUATION = 30,
+			PARAM_MAX_ATTENUATION = 31,
+			PARAM_COUNT = 33
+		};
+
+	private:
+		// What lives in `state->effectdata`.
+		struct Instance {
+			// All params, normalized to [0,1] just like Anaglyph's.
+			float params[PARAM_COUNT];
+
+			float sample_rate;
+			// All sets hrtf_id can choose from, prepared for our size.
+			std::vector<const AnaglyphHRIRSet*> models;
+			std::vector<const AnaglyphHRIRSet::Spectra*> model_spectra;
+			AnaglyphFFT fft;
+			int partition_size;
+
+			// Input is collected until there's a partition's worth. Output
+			// lags one partition behind. Both interleaved stereo.
+			std::vector<float> input_block;
+			std::vector<float> output_block;
+			int block_fill;
+
+			// The last two partitions of mono input.
+			std::vector<float> history;
+			// Frequency-domain delay line: the spectra of the last
+			// `fdl_partitions` input partitions. That is the most any of
+			// the models needs.
+			std::vector<float> fdl_re;
+			std::vector<float> fdl_im;
+			int fdl_partitions;
+			int fdl_position;
+			// Scratch.
+			std::vector<float> acc_re;
+			std::vector<float> acc_im;
+			std::vector<float> fade_re;
+			std::vector<float> fade_im;
+
+			// The model and direction whose filter is currently running, and
+			// the az/el it was looked up for (to skip the lookup when still).
+			int model;
+			int direction;
+			float direction_azimuth;
+			float direction_elevation;
+
+			// ITD delay lines per ear, and the current delays in samples.
+			std::vector<float> delay_left;
+			std::vector<float> delay_right;
+			int delay_write;
+			float current_delay_left;
+			float current_delay_right;
+
+			float current_gain;
+			bool fresh;
+		};
+
+		// One synthesized set per sample rate, shared between all instances
+		// and kept around until the end of the program.
+		static std::vector<AnaglyphHRIRSet*> hrir_sets;
+		// All .ahrir files, in the order they were given.
+		static std::vector<AnaglyphHRIRSet*> file_sets;
+		// Fills in the instance's models for its sample rate and partition
+		// size.
+		static void get_models(Instance* instance);
+		// `find_models()`, for when `hrir_mutex` is already held.
+		static void find_models_locked(float sample_rate, std::vector<AnaglyphHRIRSet*>& out_models);
+
+		static float get_scaled(const Instance* instance, int index, float min, float max);
+		static void reset_params(Instance* instance);
+		static void reset_buffers(Instance* instance);
+		// Runs the convolution with `model`'s `direction` filter on the
+		// current FDL contents. The last partition_size samples of re/im are
+		// the left and right ear.
+		static void convolve(Instance* instance, int model, int direction, float* re, float* im);
+		static void process_block(Instance* instance);
+
+		static UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK create(UnityAudioEffectState* state);
+		static UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK release(UnityAudioEffectState* state);
+		static UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK reset(UnityAudioEffectState* state);
+		static UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK process(UnityAudioEffectState* state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int outchannels);
+		static UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK set_float_parameter(UnityAudioEffectState* state, int index, float value);
+		static UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK get_float_parameter(UnityAudioEffectState* state, int index, float* value, char* valuestr);
+
+	public:
+		// The largest partition size we use. Smaller DSP buffers use their
+		// own size instead.
+		static const int max_partition_size = 128;
+
+		// A definition that the bridge can use just like the dll's.
+		static UnityAudioEffectDefinition* get_definition();
+
+		// Maps these .ahrir files, so that hrtf_id can select them. Files
+		// that fail to load are skipped, and their errors are returned.
+		// Instances created before this keep using what they had.
+		static std::vector<std::string> load_hrir_files(const std::vector<std::string>& paths);
+
+		// All sets hrtf_id chooses from at this sample rate, in hrtf_id
+		// order. If there are no files at this rate, that's the synthesized
+		// head. Also used by the ambisonic decoder, to pick the same heads.
+		static void find_models(float sample_rate, std::vector<AnaglyphHRIRSet*>& out_models);
+		// Whether any .ahrir file is at this sample rate.
+		static bool has_file_models(float sample_rate);
+	};
+}
+
+#endif // GDANAGLYPH_NATIVE
\ No newline at end of file
@@ -0,0 +1,255 @@
+#include "anaglyph_offline_renderer.h"
+#include "anaglyph_dll_bridge.h"
+#include "helpers.h"
+
+#include <godot_cpp/classes/audio_server.hpp>
+#include <godot_cpp/classes/time.hpp>
+
+using namespace godot;
+
+AnaglyphOfflineRenderer::AnaglyphOfflineRenderer() { }
+
+AnaglyphOfflineRenderer::~AnaglyphOfflineRenderer() { }
+
+bool AnaglyphOfflineRenderer::WAVReader::init(const Ref<AudioStreamWAV>& wav, const PackedByteArray& bytes, float output_rate) {
+	AudioStreamWAV::Format format = wav->get_format();
+	if (format != AudioStreamWAV::FORMAT_8_BITS && format != AudioStreamWAV::FORMAT_16_BITS) {
+		AnaglyphHelpers::print_error("Can only render 8 or 16 bit AudioStreamWAVs offline (this one is compressed). Re-import it without compression.");
+		return false;
+	}
+	sixteen_bits = format == AudioStreamWAV::FORMAT_16_BITS;
+	stereo = wav->is_stereo();
+	data = bytes.ptr();
+	int frame_size = (sixteen_bits ? 2 : 1) * (stereo ? 2 : 1);
+	frames = bytes.size() / frame_size;
+	step = wav->get_mix_rate() / (double)output_rate;
+	return frames > 0 && step > 0;
+}
+
+AudioFrame AnaglyphOfflineRenderer::WAVReader::get_frame(int64_t index) const {
+	AudioFrame frame = AudioFrame();
+	if (index < 0 || index >= frames) {
+		return frame;
+	}
+	int channels = stereo ? 2 : 1;
+	if (sixteen_bits) {
+		const int16_t* samples = (const int16_t*)data + index * channels;
+		frame.left = samples[0] / 32768.0f;
+		frame.right = samples[channels - 1] / 32768.0f;
+	}
+	else {
+		const int8_t* samples = (const int8_t*)data + index * channels;
+		frame.left = samples[0] / 128.0f;
+		frame.right = samples[channels - 1] / 128.0f;
+	}
+	return frame;
+}
+
+AudioFrame AnaglyphOfflineRenderer::WAVReader::sample(int64_t index) const {
+	double position = index * step;
+	int64_t base = (int64_t)position;
+	float t = (float)(position - base);
+	AudioFrame a = get_frame(base);
+	AudioFrame b = get_frame(base + 1);
+	AudioFrame res = AudioFrame();
+	res.left = a.left + (b.left - a.left) * t;
+	res.right = a.right + (b.right - a.right) * t;
+	return res;
+}
+
+int64_t AnaglyphOfflineRenderer::WAVReader::get_output_frames() const {
+	return (int64_t)Math::ceil(frames / step);
+}
+
+void AnaglyphOfflineRenderer::write_wav_header(const Ref<FileAccess>& file, int mix_rate) {
+	// See http://soundfile.sapp.org/doc/WaveFormat/ (with format 3, floats).
+	file->store_buffer(String("RIFF").to_ascii_buffer());
+	file->store_32(0); // Filled in later.
+	file->store_buffer(String("WAVEfmt ").to_ascii_buffer());
+	file->store_32(16);
+	file->store_16(3); // IEEE float
+	file->store_16(2);
+	file->store_32(mix_rate);
+	file->store_32(mix_rate * 2 * sizeof(float));
+	file->store_16(2 * sizeof(float));
+	file->store_16(32);
+	file->store_buffer(String("data").to_ascii_buffer());
+	file->store_32(0); // Filled in later.
+}
+
+void AnaglyphOfflineRenderer::finish_wav(const Ref<FileAccess>& file, uint64_t frames) {
+	uint32_t data_size = (uint32_t)(frames * 2 * sizeof(float));
+	file->seek(4);
+	file->store_32(36 + data_size);
+	file->seek(40);
+	file->store_32(data_size);
+}
+
+Vector3 AnaglyphOfflineRenderer::sample_timeline(const PackedFloat32Array& times, const PackedVector3Array& positions, float time) {
+	int count = MIN(times.size(), positions.size());
+	if (time <= times[0] || count == 1) {
+		return positions[0];
+	}
+	for (int i = 1; i < count; i++) {
+		if (time < times[i]) {
+			float span = times[i] - times[i - 1];
+			float t = span > 0 ? (time - times[i - 1]) / span : 1;
+			return positions[i - 1].lerp(positions[i], t);
+		}
+	}
+	return positions[count - 1];
+}
+
+Dictionary AnaglyphOfflineRenderer::render(
+	Ref<AudioStream> stream,
+	Ref<AnaglyphEffectData> settings,
+	PackedFloat32Array times,
+	PackedVector3Array positions,
+	String path,
+	float tail_seconds
+) {
+	Dictionary result;
+	Ref<AudioStreamWAV> wav = stream;
+	if (wav == nullptr) {
+		AnaglyphHelpers::print_error("Can only render AudioStreamWAVs offline in this Godot version.");
+		return result;
+	}
+	if (positions.size() == 0 || times.size() != positions.size()) {
+		AnaglyphHelpers::print_error("Offline render needs at least one position, and exactly one time per position (got ", positions.size(), " positions and ", times.size(), " times).");
+		return result;
+	}
+
+	// Anaglyph runs at whatever rate the AudioServer runs at.
+	float mix_rate = AudioServer::get_singleton()->get_mix_rate();
+	PackedByteArray bytes = wav->get_data();
+	WAVReader reader;
+	if (!reader.init(wav, bytes, mix_rate)) {
+		return result;
+	}
+
+	Ref<FileAccess> file = FileAccess::open(path, FileAccess::WRITE);
+	if (file == nullptr) {
+		AnaglyphHelpers::print_error("Could not open \"", path, "\" to render to (", FileAccess::get_open_error(), ").");
+		return result;
+	}
+	write_wav_header(file, (int)mix_rate);
+
+	// Our own instance, so that nothing that's playing gets disturbed.
+	// Copy the settings, as positions get written into them.
+	Ref<AnaglyphEffect> effect;
+	effect.instantiate();
+	Ref<AnaglyphEffectData> data;
+	data.instantiate();
+	if (settings != nullptr) {
+		data->copy_from(settings);
+	}
+	effect->set_effect_data(data);
+
+	int block = AnaglyphBridge::get_dsp_buffer_size();
+	// (Reverb and Anaglyph's own latency would otherwise get cut off.)
+	int64_t total_frames = reader.get_output_frames() + (int64_t)(MAX(tail_seconds, 0) * mix_rate);
+	Vector<AudioFrame> in_buffer;
+	Vector<AudioFrame> out_buffer;
+	in_buffer.resize(block);
+	out_buffer.resize(block);
+	PackedByteArray out_bytes;
+	out_bytes.resize(block * sizeof(AudioFrame));
+
+	uint64_t start_usec = Time::get_singleton()->get_ticks_usec();
+	int64_t rendered = 0;
+	while (rendered < total_frames) {
+		// Anaglyph smooths positions itself, so once per block is plenty.
+		Vector3 position = sample_timeline(times, positions, rendered / mix_rate);
+		Vector3 polar = AnaglyphHelpers::calculate_polar_position(position, Vector3(), Quaternion());
+		effect->set_azimuth(polar.x);
+		effect->set_elevation(polar.y);
+		effect->set_distance(polar.z);
+
+		AudioFrame* in = in_buffer.ptrw();
+		for (int i = 0; i < block; i++) {
+			in[i] = reader.sample(rendered + i);
+		}
+		// Anaglyph only takes full blocks, so the last one is padded with
+		// silence and written out whole.
+		// (Through the effect, so that a reduced `dsp_rate` sounds the same
+		// as it would live.)
+		effect->process(in, out_buffer.ptrw(), block);
+
+		int64_t count = MIN((int64_t)block, total_frames - rendered);
+		memcpy(out_bytes.ptrw(), out_buffer.ptr(), count * sizeof(AudioFrame));
+		if (count < block) {
+			out_bytes.resize(count * sizeof(AudioFrame));
+		}
+		file->store_buffer(out_bytes);
+		rendered += count;
+	}
+	uint64_t elapsed_usec = Time::get_singleton()->get_ticks_usec() - start_usec;
+
+	finish_wav(file, rendered);
+	file->close();
+
+	double duration = rendered / (double)mix_rate;
+	double elapsed = MAX(elapsed_usec, (uint64_t)1) / 1000000.0;
+	result["frames"] = rendered;
+	result["duration"] = duration;
+	result["elapsed"] = elapsed;
+	result["realtime_factor"] = duration / elapsed;
+	AnaglyphHelpers::print("Rendered ", duration, "s of audio to ", path, " in ", elapsed, "s (", duration / elapsed, "x realtime).");
+	return result;
+}
+
+bool AnaglyphOfflineRenderer::render_fixed(
+	const Ref<AudioStreamWAV>& wav,
+	const Ref<AnaglyphEffect>& effect,
+	const Vector3& polar,
+	float tail_seconds,
+	Vector<AudioFrame>& out
+) {
+	float mix_rate = AudioServer::get_singleton()->get_mix_rate();
+	PackedByteArray bytes = wav->get_data();
+	WAVReader reader;
+	if (!reader.init(wav, bytes, mix_rate)) {
+		return false;
+	}
+
+	// (Before the reset, so that Anaglyph doesn't glide in from wherever
+	//  the previous render was.)
+	effect->set_azimuth(polar.x);
+	effect->set_elevation(polar.y);
+	effect->set_distance(polar.z);
+	effect->reset_state();
+
+	int block = AnaglyphBridge::get_dsp_buffer_size();
+	int64_t total_frames = reader.get_output_frames() + (int64_t)(MAX(tail_seconds, 0) * mix_rate);
+	// Whole blocks, the end gets cut off below anyway.
+	int64_t blocks = (total_frames + block - 1) / block;
+	out.resize(blocks * block);
+	Vector<AudioFrame> in_buffer;
+	in_buffer.resize(block);
+	AudioFrame* in = in_buffer.ptrw();
+	AudioFrame* dst = out.ptrw();
+	for (int64_t b = 0; b < blocks; b++) {
+		for (int i = 0; i < block; i++) {
+			in[i] = reader.sample(b * block + i);
+		}
+		effect->process(in, dst + b * block, block);
+	}
+
+	// Most of the tail is usually silence, which is just wasted memory.
+	const float silence = 0.0001f; // (-80dB)
+	int64_t length = out.size();
+	while (length > 0 && Math::abs(dst[length - 1].left) < silence && Math::abs(dst[length - 1].right) < silence) {
+		length--;
+	}
+	out.resize(length);
+	return length > 0;
+}
+
+void AnaglyphOfflineRenderer::_bind_methods() {
+	ClassDB::bind_static_method(
+		"AnaglyphOfflineRenderer",
+		D_METHOD("render", "stream", "settings", "times", "positions", "path", "tail_seconds"),
+		&AnaglyphOfflineRenderer::render,
+		DEFVAL(1.0)
+	);
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef GDANAGLYPH_OFFLINE_RENDERER
+#define GDANAGLYPH_OFFLINE_RENDERER
+
+#include "anaglyph_effect.h"
+
+#include <godot_cpp/classes/audio_stream.hpp>
+#include <godot_cpp/classes/audio_stream_wav.hpp>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/templates/vector.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+
+namespace godot {
+	// Renders a sound through its own Anaglyph instance straight into a
+	// .wav file, as fast as the CPU allows. No audio device, AudioServer
+	// mixing, or scene tree involved, so this also works with --headless.
+	//
+	// Godot 4.3 gives extensions no way to decode arbitrary AudioStreams
+	// (AudioStreamPlayback::mix_audio only exists from 4.4 on), so for now
+	// only uncompressed AudioStreamWAVs are supported, decoded by hand.
+	class AnaglyphOfflineRenderer : public RefCounted {
+		GDCLASS(AnaglyphOfflineRenderer, RefCounted);
+		// (For the WAVReader.)
+		friend class AudioStreamPlaybackAnaglyph;
+
+	private:
+		// Reads (and linearly resamples) the PCM data of an AudioStreamWAV.
+		struct WAVReader {
+			const uint8_t* data;
+			int64_t frames;
+			bool stereo;
+			bool sixteen_bits;
+			// Source frames per output frame.
+			double step;
+
+			// Returns false (with an error) for unsupported formats.
+			bool init(const Ref<AudioStreamWAV>& wav, const PackedByteArray& bytes, float output_rate);
+			AudioFrame get_frame(int64_t index) const;
+			// The output frame `index` after resampling.
+			AudioFrame sample(int64_t index) const;
+			int64_t get_output_frames() const;
+		};
+
+		// A 32-bit float stereo .wav. The sizes are filled in by `finish_wav()`.
+		static void write_wav_header(const Ref<FileAccess>& file, int mix_rate);
+		static void finish_wav(const Ref<FileAccess>& file, uint64_t frames);
+
+		// The listener-space position at `time`, linearly interpolated.
+		static Vector3 sample_timeline(const PackedFloat32Array& times, const PackedVector3Array& positions, float time);
+
+	protected:
+		static void _bind_methods();
+
+	public:
+		AnaglyphOfflineRenderer();
+		~AnaglyphOfflineRenderer();
+
+		// Plays `stream` with `settings` along a timeline of positions, and
+		// writes the result to `path`. Positions are relative to a listener
+		// at the origin looking down -Z (just like an untransformed Camera3D),
+		// and `times` are in seconds, ascending.
+		// Returns a Dictionary with the "frames" and "duration" rendered, how
+		// long that took ("elapsed"), and the "realtime_factor" that gives.
+		// The Dictionary is empty on failure.
+		static Dictionary render(
+			Ref<AudioStream> stream,
+			Ref<AnaglyphEffectData> settings,
+			PackedFloat32Array times,
+			PackedVector3Array positions,
+			String path,
+			float tail_seconds = 1.0
+		);
+
+		// Plays `wav` from one fixed listener-relative (azimuth, elevation,
+		// distance) through `effect`, into `out` at the mix rate. The effect
+		// must have its settings already, and gets reset first. Silence at
+		// the end of the tail is cut off.
+		// This is for `AnaglyphRenderCache`, which keeps one effect around
+		// for this instead of creating one every time.
+		static bool render_fixed(
+			const Ref<AudioStreamWAV>& wav,
+			const Ref<AnaglyphEffect>& effect,
+			const Vector3& polar,
+			float tail_seconds,
+			Vector<AudioFrame>& out
+		);
+	};
+}
+
+#endif // GDANAGLYPH_OFFLINE_RENDERER
\ No newline at end of file
@@ -0,0 +1,227 @@
+#include "anaglyph_oneshot_pool.h"
+#include "audio_stream_player_anaglyph.h"
+#include "helpers.h"
+
+using namespace godot;
+
+AnaglyphOneshotPool* AnaglyphOneshotPool::singleton = nullptr;
+
+AnaglyphOneshotPool* AnaglyphOneshotPool::get_singleton() {
+	if (singleton == nullptr) {
+		singleton = new AnaglyphOneshotPool();
+	}
+	return singleton;
+}
+
+void AnaglyphOneshotPool::free_singleton() {
+	if (singleton != nullptr) {
+		delete singleton;
+		singleton = nullptr;
+	}
+}
+
+AnaglyphOneshotPool::AnaglyphOneshotPool() {
+	pool_size = 16;
+	overflow = OVERFLOW_ALLOCATE;
+	merge_distance = 0.5;
+	polyphony = 8;
+}
+
+AnaglyphOneshotPool::~AnaglyphOneshotPool() {
+	// The nodes themselves belong to the tree, which cleans them up.
+}
+
+AudioStreamPlayerAnaglyph* AnaglyphOneshotPool::get_node(ObjectID id) {
+	return Object::cast_to<AudioStreamPlayerAnaglyph>(ObjectDB::get_instance(id));
+}
+
+AudioStreamPlayerAnaglyph* AnaglyphOneshotPool::create(Node* parent, bool pooled) {
+	AudioStreamPlayerAnaglyph* node = memnew(AudioStreamPlayerAnaglyph);
+	// Pooled nodes keep their data around and copy new settings into it, so
+	// give them their own.
+	Ref<AnaglyphEffectData> data;
+	data.instantiate();
+	node->set_anaglyph_data(data);
+	node->set_dupe_protection(false);
+	node->set_delete_on_finish(!pooled);
+	node->pooled = pooled;
+	// A single sound. Polyphony keeps both children running (and so rules
+	// out virtualizing), so that only kicks in once something's merged.
+	node->set_max_polyphony(1);
+	// Oneshots come in bursts, so don't wait for previous tails to die out.
+	node->set_bus_reuse(AudioStreamPlayerAnaglyph::BUS_REUSE_RESET);
+	parent->add_child(node, true, Node::INTERNAL_MODE_BACK);
+	return node;
+}
+
+void AnaglyphOneshotPool::move_to(AudioStreamPlayerAnaglyph* node, Node* parent) {
+	// Oneshots follow their parent around, so a reused node can't stay under
+	// whoever used it last.
+	if (node->get_parent() != parent) {
+		node->reparent(parent, false);
+	}
+}
+
+AudioStreamPlayerAnaglyph* AnaglyphOneshotPool::acquire(Node* parent) {
+	// Anyone idle?
+	while (idle.size() > 0) {
+		ObjectID id = idle[idle.size() - 1];
+		idle.remove_at(idle.size() - 1);
+		AudioStreamPlayerAnaglyph* node = get_node(id);
+		// Someone may have freed it behind our back.
+		if (node == nullptr || !node->is_inside_tree()) {
+			continue;
+		}
+		active.push_back(id);
+		node->set_process_internal(true);
+		node->set_max_polyphony(1);
+		move_to(node, parent);
+		return node;
+	}
+
+	// Clean up whoever got freed (or taken out of the tree) while playing.
+	for (int i = active.size() - 1; i >= 0; i--) {
+		AudioStreamPlayerAnaglyph* node = get_node(active[i]);
+		if (node == nullptr || !node->is_inside_tree()) {
+			active.remove_at(i);
+		}
+	}
+
+	if (active.size() < pool_size) {
+		AudioStreamPlayerAnaglyph* node = create(parent, true);
+		active.push_back(ObjectID(node->get_instance_id()));
+		return node;
+	}
+
+	while (overflow == OVERFLOW_STEAL_OLDEST && active.size() > 0) {
+		ObjectID id = active[0];
+		active.remove_at(0);
+		AudioStreamPlayerAnaglyph* node = get_node(id);
+		// (Can't be stale right after the cleanup above, unless freeing one
+		//  node took others with it. Then it's just no longer ours.)
+		if (node == nullptr || !node->is_inside_tree()) {
+			continue;
+		}
+		active.push_back(id);
+		// (Stopping doesn't emit `finished`, so this doesn't release it.)
+		node->stop();
+		node->oneshot_voice_ends.clear();
+		node->set_max_polyphony(1);
+		move_to(node, parent);
+		return node;
+	}
+	if (overflow == OVERFLOW_DROP) {
+		AnaglyphHelpers::print("Oneshot pool is full (", pool_size, " playing), dropping a oneshot.");
+		return nullptr;
+	}
+	// Allocate a temporary one, just like before there was a pool.
+	return create(parent, false);
+}
+
+void AnaglyphOneshotPool::release(AudioStreamPlayerAnaglyph* node) {
+	ObjectID id = ObjectID(node->get_instance_id());
+	active.erase(id);
+	if (idle.size() + active.size() >= pool_size) {
+		// The pool shrunk in the meantime.
+		node->queue_free();
+		return;
+	}
+	node->set_process_internal(false);
+	idle.push_back(id);
+}
+
+AudioStreamPlayerAnaglyph* AnaglyphOneshotPool::find_merge_target(
+	const Ref<AudioStream>& stream,
+	const Vector3& global_position,
+	float volume_db,
+	const Ref<AnaglyphEffectData>& settings,
+	const StringName& bus
+) {
+	if (merge_distance <= 0 || polyphony <= 1) {
+		return nullptr;
+	}
+	// Newest first, those have the most voices left.
+	for (int i = active.size() - 1; i >= 0; i--) {
+		AudioStreamPlayerAnaglyph* node = get_node(active[i]);
+		if (node != nullptr && can_merge(node, stream, global_position, volume_db, settings, bus)) {
+			return node;
+		}
+	}
+	return nullptr;
+}
+
+bool AnaglyphOneshotPool::can_merge(
+	AudioStreamPlayerAnaglyph* node,
+	const Ref<AudioStream>& stream,
+	const Vector3& global_position,
+	float volume_db,
+	const Ref<AnaglyphEffectData>& settings,
+	const StringName& bus
+) {
+	if (merge_distance <= 0 || polyphony <= 1 || !node->is_inside_tree()) {
+		return false;
+	}
+	// Once full, start a new node, as otherwise the oldest voice gets cut.
+	// Virtual ones have no children playing to add a voice to.
+	if (node->is_virtual || node->count_oneshot_voices() >= polyphony) {
+		return false;
+	}
+	ObjectID settings_id = settings != nullptr ? ObjectID(settings->get_instance_id()) : ObjectID();
+	if (node->get_stream() != stream
+		|| node->oneshot_settings != settings_id
+		|| node->get_volume_db() != volume_db
+		|| node->get_bus() != bus
+	) {
+		return false;
+	}
+	if (node->get_global_position().distance_squared_to(global_position) > merge_distance * merge_distance) {
+		return false;
+	}
+	return node->get_playing();
+}
+
+Ref<AnaglyphEffectData> AnaglyphOneshotPool::get_default_data() {
+	if (default_data == nullptr) {
+		default_data.instantiate();
+	}
+	return default_data;
+}
+
+void AnaglyphOneshotPool::set_pool_size(int size) {
+	pool_size = MAX(size, 0);
+	while (idle.size() > 0 && idle.size() + active.size() > pool_size) {
+		AudioStreamPlayerAnaglyph* node = get_node(idle[idle.size() - 1]);
+		idle.remove_at(idle.size() - 1);
+		if (node != nullptr) {
+			node->queue_free();
+		}
+	}
+}
+
+int AnaglyphOneshotPool::get_pool_size() const {
+	return pool_size;
+}
+
+void AnaglyphOneshotPool::set_overflow(Overflow p_overflow) {
+	overflow = p_overflow;
+}
+
+AnaglyphOneshotPool::Overflow AnaglyphOneshotPool::get_overflow() const {
+	return overflow;
+}
+
+void AnaglyphOneshotPool::set_merge_distance(float meters) {
+	merge_distance = MAX(meters, 0);
+}
+
+float AnaglyphOneshotPool::get_merge_distance() const {
+	return merge_distance;
+}
+
+void AnaglyphOneshotPool::set_polyphony(int voices) {
+	polyphony = MAX(voices, 1);
+}
+
+int AnaglyphOneshotPool::get_polyphony() const {
+	return polyphony;
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+#ifndef GDANAGLYPH_ONESHOT_POOL
+#define GDANAGLYPH_ONESHOT_POOL
+
+#include "anaglyph_effect_data.h"
+
+#include <godot_cpp/classes/audio_stream.hpp>
+#include <godot_cpp/classes/node.hpp>
+#include <godot_cpp/core/object_id.hpp>
+#include <godot_cpp/templates/vector.hpp>
+
+namespace godot {
+	class AudioStreamPlayerAnaglyph;
+
+	// `play_oneshot()` used to create a new node (which in turn creates two
+	// child players) for every sound, and free it afterwards. Bursts of
+	// oneshots then mean a lot of allocating and tree-shuffling.
+	// Instead, finished oneshot nodes are kept around in here and reused.
+	//
+	// Pooled nodes stay in the tree, but don't process while idle.
+	// Oneshots of the same sound right next to a playing one are added to
+	// that one as an extra voice, so that a burst from a single emitter only
+	// takes up a single Anaglyph bus.
+	// Only to be used from the main thread (just like adding nodes).
+	class AnaglyphOneshotPool {
+
+	public:
+		// What to do when all `pool_size` nodes are playing.
+		// (Same values as AudioStreamPlayerAnaglyph::OneshotOverflow.)
+		enum Overflow {
+			OVERFLOW_ALLOCATE = 0,
+			OVERFLOW_STEAL_OLDEST = 1,
+			OVERFLOW_DROP = 2
+		};
+
+	private:
+		static AnaglyphOneshotPool* singleton;
+
+		// Nodes that are done playing, ready to go.
+		Vector<ObjectID> idle;
+		// Nodes that are playing, oldest first.
+		Vector<ObjectID> active;
+
+		int pool_size;
+		Overflow overflow;
+		// Nearby oneshots of the same sound are merged into one node, up to
+		// `polyphony` sounds per node. A distance of 0 disables this.
+		float merge_distance;
+		int polyphony;
+
+		// Used for oneshots without settings, so that we don't have to create
+		// a new one each time.
+		Ref<AnaglyphEffectData> default_data;
+
+		// Creates a new node under `parent`, which is reused if `pooled`.
+		AudioStreamPlayerAnaglyph* create(Node* parent, bool pooled);
+		AudioStreamPlayerAnaglyph* get_node(ObjectID id);
+		// Reparents a reused node to `parent` if it isn't there already.
+		void move_to(AudioStreamPlayerAnaglyph* node, Node* parent);
+
+	public:
+		static AnaglyphOneshotPool* get_singleton();
+		// Frees the singleton. Only to be called on module deinitialization.
+		static void free_singleton();
+
+		AnaglyphOneshotPool();
+		~AnaglyphOneshotPool();
+
+		// Gets a node under `parent` that is ready to be set up and played.
+		// Returns nullptr if the pool is full and the overflow policy is to
+		// drop.
+		// Nodes that are not pooled (because of `OVERFLOW_ALLOCATE`) delete
+		// themselves once done.
+		AudioStreamPlayerAnaglyph* acquire(Node* parent);
+		// Called by pooled nodes when they're finished.
+		void release(AudioStreamPlayerAnaglyph* node);
+		// Finds a playing pooled node that this oneshot can be added to as an
+		// extra voice. Returns nullptr if there is none.
+		AudioStreamPlayerAnaglyph* find_merge_target(
+			const Ref<AudioStream>& stream,
+			const Vector3& global_position,
+			float volume_db,
+			const Ref<AnaglyphEffectData>& settings,
+			const StringName& bus
+		);
+		// Whether this oneshot can be added to `node`, one of ours.
+		bool can_merge(
+			AudioStreamPlayerAnaglyph* node,
+			const Ref<AudioStream>& stream,
+			const Vector3& global_position,
+			float volume_db,
+			const Ref<AnaglyphEffectData>& settings,
+			const StringName& bus
+		);
+
+		// Settings that pooled oneshots without their own settings use.
+		Ref<AnaglyphEffectData> get_default_data();
+
+		// The maximum amount of pooled nodes. Reducing this frees idle nodes
+		// beyond the new size right away, and playing ones once done.
+		void set_pool_size(int size);
+		int get_pool_size() const;
+
+		void set_overflow(Overflow p_overflow);
+		Overflow get_overflow() const;
+
+		void set_merge_distance(float meters);
+		float get_merge_distance() const;
+
+		// Nodes play a single sound with polyphony 1, and only switch to this
+		// once a second sound is merged into them.
+		void set_polyphony(int voices);
+		int get_polyphony() const;
+	};
+}
+
+#endif // GDANAGLYPH_ONESHOT_POOL
\ No newline at end of file
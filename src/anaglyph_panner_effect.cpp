@@ -0,0 +1,233 @@
+#include "anaglyph_panner_effect.h"
+#include "anaglyph_float_mode.h"
+
+#include <godot_cpp/classes/audio_server.hpp>
+#include <godot_cpp/core/math.hpp>
+
+using namespace godot;
+
+// How strong the cues get, for a source right next to one ear.
+// These are rough averages of measured heads (the actual cues depend
+// heavily on frequency), tuned by ear to sound about as wide as Anaglyph
+// does at the same position.
+static const float speed_of_sound = 343;
+static const float shadow_db = 9;
+static const float shadow_corner_hz = 1500;
+static const float ild_db = 3;
+// Within a meter the ILD grows, up to this much extra right at the head.
+static const float near_field_db = 4;
+static const float rear_db = 4;
+// After a reset, fade in over this long.
+static const float fade_seconds = 0.005;
+
+AnaglyphPannerEffectInstance::AnaglyphPannerEffectInstance() { }
+
+AnaglyphPannerEffectInstance::~AnaglyphPannerEffectInstance() { }
+
+void AnaglyphPannerEffectInstance::_bind_methods() { }
+
+void AnaglyphPannerEffectInstance::_process(const void* p_src_frames, AudioFrame* p_dst_frames, int32_t p_frame_count) {
+	// (Same assumption as AnaglyphEffectInstance, this is an AudioFrame*.)
+	// The head shadow filter decays into denormals after a sound ends.
+	AnaglyphFloatMode::Scope flush;
+	base->process((const AudioFrame*)p_src_frames, p_dst_frames, p_frame_count);
+}
+
+AnaglyphPannerEffect::AnaglyphPannerEffect() {
+	azimuth = 0;
+	elevation = 0;
+	distance = 1;
+	head_circumference = 57.5;
+	mix_rate = AudioServer::get_singleton()->get_mix_rate();
+	reset_requested = false;
+	clear_state();
+	// Nothing to click against when we're brand new.
+	fade = 1;
+}
+
+AnaglyphPannerEffect::~AnaglyphPannerEffect() { }
+
+Ref<AudioEffectInstance> AnaglyphPannerEffect::_instantiate() {
+	Ref<AnaglyphPannerEffectInstance> ins;
+	ins.instantiate();
+	ins->base = Ref<AnaglyphPannerEffect>(this);
+
+	return ins;
+}
+
+void AnaglyphPannerEffect::clear_state() {
+	for (int i = 0; i < delay_size; i++) {
+		delay_line[i] = 0;
+	}
+	delay_write = 0;
+	for (int e = 0; e < 2; e++) {
+		Ear& ear = ears[e];
+		ear.delay = 0;
+		ear.gain = 1;
+		ear.shelf_db = 0;
+		ear.x1 = ear.x2 = ear.y1 = ear.y2 = 0;
+		update_shelf(ear);
+	}
+	snap = true;
+	fade = 0;
+}
+
+void AnaglyphPannerEffect::update_shelf(Ear& ear) const {
+	// https://www.w3.org/TR/audio-eq-cookbook/ with a shelf slope of 1.
+	float a = Math::pow(10.0f, ear.shelf_db / 40.0f);
+	float w0 = 2 * (float)Math_PI * MIN(shadow_corner_hz, mix_rate * 0.45f) / mix_rate;
+	float cos_w0 = Math::cos(w0);
+	float alpha = Math::sin(w0) * (float)Math_SQRT12;
+	float sqrt_a_alpha = 2 * Math::sqrt(a) * alpha;
+
+	float a0 = (a + 1) - (a - 1) * cos_w0 + sqrt_a_alpha;
+	ear.b0 = a * ((a + 1) + (a - 1) * cos_w0 + sqrt_a_alpha) / a0;
+	ear.b1 = -2 * a * ((a - 1) + (a + 1) * cos_w0) / a0;
+	ear.b2 = a * ((a + 1) + (a - 1) * cos_w0 - sqrt_a_alpha) / a0;
+	ear.a1 = 2 * ((a - 1) - (a + 1) * cos_w0) / a0;
+	ear.a2 = ((a + 1) - (a - 1) * cos_w0 - sqrt_a_alpha) / a0;
+}
+
+void AnaglyphPannerEffect::process(const AudioFrame* src, AudioFrame* dst, int count) {
+	if (reset_requested) {
+		reset_requested = false;
+		clear_state();
+	}
+	if (count <= 0) {
+		return;
+	}
+
+	// Everything is decided once per block, and glides over the block.
+	float az = Math::deg_to_rad(azimuth);
+	float el = Math::deg_to_rad(elevation);
+	// How far to the side we are, regardless of front/back or up/down.
+	// Positive is right.
+	float lateral = Math::asin(CLAMP(Math::sin(az) * Math::cos(el), -1.0f, 1.0f));
+	float side = Math::abs(lateral);
+	float side_sin = Math::sin(side);
+
+	// Woodworth: the path around a sphere to the far ear.
+	float radius = head_circumference / 100.0f / (2 * (float)Math_PI);
+	float itd = radius / speed_of_sound * (side + side_sin) * mix_rate;
+	itd = MIN(itd, (float)(delay_size - 2));
+
+	float nearness = CLAMP((1 - distance) / 0.9f, 0.0f, 1.0f);
+	float far_gain = Math::db_to_linear(-(ild_db + near_field_db * nearness) * side_sin);
+	float rear = MAX(-Math::cos(az), 0.0f) * Math::cos(el);
+
+	// Sound from the right reaches the left ear [0] last.
+	int far = lateral > 0 ? 0 : 1;
+	float target_delay[2];
+	float target_gain[2];
+	for (int e = 0; e < 2; e++) {
+		Ear& ear = ears[e];
+		bool is_far = e == far;
+		target_delay[e] = is_far ? itd : 0;
+		target_gain[e] = is_far ? far_gain : 1;
+		float target_shelf = -rear_db * rear - (is_far ? shadow_db * side_sin : 0);
+		if (snap) {
+			ear.delay = target_delay[e];
+			ear.gain = target_gain[e];
+			ear.shelf_db = target_shelf;
+		}
+		else {
+			// The filter can't glide per sample without recomputing its
+			// coefficients every sample, so it eases in over a few blocks.
+			ear.shelf_db += (target_shelf - ear.shelf_db) * 0.5f;
+		}
+		update_shelf(ear);
+	}
+	snap = false;
+
+	const int mask = delay_size - 1;
+	float inv_count = 1.0f / count;
+	float fade_step = 1.0f / (fade_seconds * mix_rate);
+	float delay_step[2];
+	float gain_step[2];
+	for (int e = 0; e < 2; e++) {
+		delay_step[e] = (target_delay[e] - ears[e].delay) * inv_count;
+		gain_step[e] = (target_gain[e] - ears[e].gain) * inv_count;
+	}
+
+	for (int i = 0; i < count; i++) {
+		delay_line[delay_write] = (src[i].left + src[i].right) * 0.5f;
+		if (fade < 1) {
+			fade = MIN(fade + fade_step, 1.0f);
+		}
+
+		float out[2];
+		for (int e = 0; e < 2; e++) {
+			Ear& ear = ears[e];
+			ear.delay += delay_step[e];
+			ear.gain += gain_step[e];
+
+			int whole = (int)ear.delay;
+			float frac = ear.delay - whole;
+			float a = delay_line[(delay_write - whole) & mask];
+			float b = delay_line[(delay_write - whole - 1) & mask];
+			float x = a + (b - a) * frac;
+
+			float y = ear.b0 * x + ear.b1 * ear.x1 + ear.b2 * ear.x2 - ear.a1 * ear.y1 - ear.a2 * ear.y2;
+			ear.x2 = ear.x1;
+			ear.x1 = x;
+			ear.y2 = ear.y1;
+			ear.y1 = y;
+			out[e] = y * ear.gain * fade;
+		}
+		dst[i].left = out[0];
+		dst[i].right = out[1];
+		delay_write = (delay_write + 1) & mask;
+	}
+
+	// (Floating point drift over the block.)
+	for (int e = 0; e < 2; e++) {
+		ears[e].delay = target_delay[e];
+		ears[e].gain = target_gain[e];
+	}
+}
+
+void AnaglyphPannerEffect::set_azimuth(const float degrees) {
+	azimuth = CLAMP(degrees, -180, 180);
+}
+
+float AnaglyphPannerEffect::get_azimuth() const {
+	return azimuth;
+}
+
+void AnaglyphPannerEffect::set_elevation(const float degrees) {
+	elevation = CLAMP(degrees, -90, 90);
+}
+
+float AnaglyphPannerEffect::get_elevation() const {
+	return elevation;
+}
+
+void AnaglyphPannerEffect::set_distance(const float meters) {
+	distance = MAX(meters, 0);
+}
+
+float AnaglyphPannerEffect::get_distance() const {
+	return distance;
+}
+
+void AnaglyphPannerEffect::set_head_circumference(const float cm) {
+	head_circumference = CLAMP(cm, 20, 80);
+}
+
+float AnaglyphPannerEffect::get_head_circumference() const {
+	return head_circumference;
+}
+
+void AnaglyphPannerEffect::reset_state() {
+	// The audio thread may be halfway a block, so let it do this itself.
+	reset_requested = true;
+}
+
+void AnaglyphPannerEffect::_bind_methods() {
+	REGISTER(FLOAT, azimuth, AnaglyphPannerEffect, "angle", PROPERTY_HINT_RANGE, "-180,180,0.1,degrees");
+	REGISTER(FLOAT, elevation, AnaglyphPannerEffect, "angle", PROPERTY_HINT_RANGE, "-90,90,0.1,degrees");
+	REGISTER(FLOAT, distance, AnaglyphPannerEffect, "meters", PROPERTY_HINT_RANGE, "0,10,0.01,or_greater,suffix:m");
+	REGISTER(FLOAT, head_circumference, AnaglyphPannerEffect, "cm", PROPERTY_HINT_RANGE, "20,80,0.1,suffix:cm");
+
+	ClassDB::bind_method(D_METHOD("reset_state"), &AnaglyphPannerEffect::reset_state);
+}
\ No newline at end of file
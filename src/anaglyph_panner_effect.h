@@ -0,0 +1,112 @@
+#ifndef GDANAGLYPH_PANNER
+#define GDANAGLYPH_PANNER
+
+#include "register_macro.h"
+
+#include <godot_cpp/classes/audio_effect.hpp>
+#include <godot_cpp/classes/audio_effect_instance.hpp>
+#include <godot_cpp/classes/audio_frame.hpp>
+
+namespace godot {
+
+	class AnaglyphPannerEffect;
+
+	class AnaglyphPannerEffectInstance : public AudioEffectInstance {
+		GDCLASS(AnaglyphPannerEffectInstance, AudioEffectInstance);
+		friend class AnaglyphPannerEffect;
+
+		Ref<AnaglyphPannerEffect> base;
+
+	protected:
+		static void _bind_methods();
+
+	public:
+		AnaglyphPannerEffectInstance();
+		~AnaglyphPannerEffectInstance();
+
+		void _process(const void* p_src_frames, AudioFrame* p_dst_frames, int32_t p_frame_count) override;
+	};
+
+	// A cheap stand-in for the AnaglyphEffect, for sources that are too far
+	// away (or too many) to justify a full HRTF instance.
+	// It takes the mono sum of whatever comes in, and gives it the three
+	// cues that matter most for left/right:
+	// - The interaural time difference, as a (fractional) delay on the far
+	//   ear, following Woodworth's spherical head.
+	// - Head shadow, as a high-shelf cut on the far ear.
+	// - The interaural level difference, as a broadband gain on the far ear,
+	//   which grows for sources right next to the head.
+	// On top of that, sources behind get both ears dulled a little, which
+	// is the cheapest front/back cue there is.
+	// Attenuation over distance is *not* done here, that's the job of
+	// whatever plays into this bus.
+	class AnaglyphPannerEffect : public AudioEffect {
+		GDCLASS(AnaglyphPannerEffect, AudioEffect);
+		friend class AnaglyphPannerEffectInstance;
+
+		float azimuth;
+		float elevation;
+		float distance;
+		float head_circumference;
+
+		// Everything below is only touched by the audio thread, except
+		// `reset_requested`, which the audio thread picks up at the start
+		// of the next block.
+		bool reset_requested;
+
+		// Must be a power of two, and comfortably more than the largest ITD
+		// at the highest sample rate (~0.7ms at 192kHz is ~130 samples).
+		static const int delay_size = 256;
+		float delay_line[delay_size];
+		int delay_write;
+
+		struct Ear {
+			// In samples.
+			float delay;
+			float gain;
+			float shelf_db;
+			// RBJ high-shelf, direct form I.
+			float b0, b1, b2, a1, a2;
+			float x1, x2, y1, y2;
+		};
+		Ear ears[2];
+		// Whether the next block should jump to its targets instead of
+		// gliding there from wherever the previous sound left off.
+		bool snap;
+		// Fades in after a reset, so that a reused bus doesn't click.
+		float fade;
+
+		float mix_rate;
+
+		void clear_state();
+		// Sets the shelf coefficients of this ear for its current `shelf_db`.
+		void update_shelf(Ear& ear) const;
+		void process(const AudioFrame* src, AudioFrame* dst, int count);
+
+	protected:
+		static void _bind_methods();
+
+	public:
+		AnaglyphPannerEffect();
+		~AnaglyphPannerEffect();
+
+		Ref<AudioEffectInstance> _instantiate() override;
+
+		void set_azimuth(const float degrees);
+		float get_azimuth() const;
+
+		void set_elevation(const float degrees);
+		float get_elevation() const;
+
+		void set_distance(const float meters);
+		float get_distance() const;
+
+		void set_head_circumference(const float cm);
+		float get_head_circumference() const;
+
+		// Forgets whatever was playing, for when the bus gets a new user.
+		void reset_state();
+	};
+}
+
+#endif // GDANAGLYPH_PANNER
\ No newline at end of file
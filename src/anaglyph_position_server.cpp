@@ -0,0 +1,324 @@
+#include "anaglyph_position_server.h"
+#include "anaglyph_dll_bridge.h"
+#include "anaglyph_listener_registry.h"
+
+#include <godot_cpp/classes/audio_server.hpp>
+#include <godot_cpp/classes/engine.hpp>
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/core/mutex_lock.hpp>
+
+using namespace godot;
+
+AnaglyphPositionServer* AnaglyphPositionServer::singleton = nullptr;
+
+const float AnaglyphPositionServer::max_compensated_latency = 0.5;
+const uint64_t AnaglyphPositionServer::stale_motion_usec = 250000;
+
+AnaglyphPositionServer* AnaglyphPositionServer::get_singleton() {
+	// Same as the bus manager, this is created on module initialization.
+	if (singleton == nullptr) {
+		singleton = new AnaglyphPositionServer();
+	}
+	return singleton;
+}
+
+void AnaglyphPositionServer::free_singleton() {
+	if (singleton != nullptr) {
+		delete singleton;
+		singleton = nullptr;
+	}
+}
+
+AnaglyphPositionServer::AnaglyphPositionServer() {
+	mutex.instantiate();
+	latency_compensation = false;
+	extra_latency = 0;
+	latency_frame = UINT64_MAX;
+	frame_latency = 0;
+}
+
+AnaglyphPositionServer::~AnaglyphPositionServer() { }
+
+bool AnaglyphPositionServer::is_main_thread() {
+	OS* os = OS::get_singleton();
+	return os->get_thread_caller_id() == os->get_main_thread_id();
+}
+
+int AnaglyphPositionServer::register_source(Node3D* source) {
+	MutexLock lock(*mutex.ptr());
+	int index;
+	if (free_slots.size() > 0) {
+		index = free_slots[free_slots.size() - 1];
+		free_slots.remove_at(free_slots.size() - 1);
+	}
+	else {
+		index = slots.size();
+		slots.push_back(Slot{});
+	}
+	Slot& slot = slots.write[index];
+	slot.in_use = true;
+	slot.source = source;
+	slot.source_id = ObjectID(source->get_instance_id());
+	Viewport* viewport = source->get_viewport();
+	slot.viewport_id = viewport != nullptr ? viewport->get_instance_id() : 0;
+	// Never queried, so not in any batch until it asks.
+	slot.queried_frame = 0;
+	slot.queried_on_main = true;
+	slot.computed_frame = UINT64_MAX;
+	slot.polar = Vector3();
+	slot.last_position = Vector3();
+	slot.last_position_usec = 0;
+	slot.velocity = Vector3();
+	return index;
+}
+
+void AnaglyphPositionServer::unregister_source(int slot) {
+	MutexLock lock(*mutex.ptr());
+	if (slot < 0 || slot >= slots.size() || !slots[slot].in_use) {
+		return;
+	}
+	Slot& s = slots.write[slot];
+	s.in_use = false;
+	s.source = nullptr;
+	s.source_id = ObjectID();
+	free_slots.push_back(slot);
+}
+
+void AnaglyphPositionServer::set_latency_compensation(bool enabled) {
+	MutexLock lock(*mutex.ptr());
+	latency_compensation = enabled;
+	latency_frame = UINT64_MAX;
+}
+
+bool AnaglyphPositionServer::get_latency_compensation() {
+	MutexLock lock(*mutex.ptr());
+	return latency_compensation;
+}
+
+void AnaglyphPositionServer::set_extra_latency(float seconds) {
+	MutexLock lock(*mutex.ptr());
+	extra_latency = CLAMP(seconds, 0, max_compensated_latency);
+	latency_frame = UINT64_MAX;
+}
+
+float AnaglyphPositionServer::get_extra_latency() {
+	MutexLock lock(*mutex.ptr());
+	return extra_latency;
+}
+
+float AnaglyphPositionServer::get_compensated_latency() {
+	MutexLock lock(*mutex.ptr());
+	AudioServer* audio = AudioServer::get_singleton();
+	// What we send now is picked up at the start of the next DSP block, and
+	// then still has to get through the driver.
+	float block = AnaglyphBridge::get_dsp_buffer_size() / audio->get_mix_rate();
+	float latency = block + (float)audio->get_output_latency() + extra_latency;
+	return CLAMP(latency, 0, max_compensated_latency);
+}
+
+float AnaglyphPositionServer::get_frame_latency(uint64_t frame) {
+	if (!latency_compensation) {
+		return 0;
+	}
+	// (The output latency is queried from the driver, so only once a frame.)
+	if (latency_frame != frame) {
+		latency_frame = frame;
+		frame_latency = get_compensated_latency();
+	}
+	return frame_latency;
+}
+
+Vector3 AnaglyphPositionServer::track_source(Slot& slot, const Vector3& position, uint64_t usec, float latency) {
+	uint64_t elapsed = usec - slot.last_position_usec;
+	if (slot.last_position_usec == 0 || elapsed > stale_motion_usec) {
+		slot.velocity = Vector3();
+	}
+	else if (elapsed > 0) {
+		Vector3 velocity = (position - slot.last_position) / (elapsed / 1000000.0);
+		// Smooth it a little, physics steps and frames don't always line up.
+		slot.velocity = slot.velocity.lerp(velocity, 0.5);
+	}
+	slot.last_position = position;
+	slot.last_position_usec = usec;
+	return position + slot.velocity * latency;
+}
+
+bool AnaglyphPositionServer::get_listener_frame(Viewport* viewport, uint64_t frame, float latency, AnaglyphSIMD::ListenerFrame& out_frame) {
+	AnaglyphListenerRegistry::ListenerState listener;
+	if (!AnaglyphListenerRegistry::get_singleton()->get_listener(viewport, listener)) {
+		return false;
+	}
+	Vector3 position = listener.position;
+	Quaternion inverse_rotation = listener.inverse_rotation;
+
+	// Track how the listener moves, once per frame.
+	uint64_t viewport_id = viewport->get_instance_id();
+	ListenerMotion* motion = listener_motion.getptr(viewport_id);
+	if (motion == nullptr) {
+		ListenerMotion fresh;
+		fresh.frame = frame;
+		fresh.usec = Time::get_singleton()->get_ticks_usec();
+		fresh.position = position;
+		fresh.rotation = inverse_rotation.inverse();
+		fresh.velocity = Vector3();
+		fresh.angular_velocity = Vector3();
+		listener_motion.insert(viewport_id, fresh);
+		motion = listener_motion.getptr(viewport_id);
+	}
+	else if (motion->frame != frame) {
+		uint64_t usec = Time::get_singleton()->get_ticks_usec();
+		uint64_t elapsed = usec - motion->usec;
+		Quaternion rotation = inverse_rotation.inverse();
+		if (elapsed > stale_motion_usec || elapsed == 0) {
+			motion->velocity = Vector3();
+			motion->angular_velocity = Vector3();
+		}
+		else {
+			double seconds = elapsed / 1000000.0;
+			motion->velocity = motion->velocity.lerp((position - motion->position) / seconds, 0.5);
+			// The rotation that got us from last frame to this frame.
+			Quaternion delta = rotation * motion->rotation.inverse();
+			if (delta.w < 0) {
+				delta = -delta;
+			}
+			Vector3 axis = Vector3(delta.x, delta.y, delta.z);
+			float sin_half = axis.length();
+			Vector3 angular_velocity;
+			if (sin_half > 1e-6) {
+				float angle = 2 * Math::atan2(sin_half, (float)delta.w);
+				angular_velocity = axis / sin_half * (angle / seconds);
+			}
+			motion->angular_velocity = motion->angular_velocity.lerp(angular_velocity, 0.5);
+		}
+		motion->frame = frame;
+		motion->usec = usec;
+		motion->position = position;
+		motion->rotation = rotation;
+	}
+
+	if (latency > 0) {
+		position += motion->velocity * latency;
+		float angular_speed = motion->angular_velocity.length();
+		if (angular_speed > 1e-6) {
+			Quaternion turn = Quaternion(motion->angular_velocity / angular_speed, angular_speed * latency);
+			inverse_rotation = (turn * motion->rotation).inverse();
+		}
+	}
+
+	out_frame.position[0] = position.x;
+	out_frame.position[1] = position.y;
+	out_frame.position[2] = position.z;
+	const Quaternion& q = inverse_rotation;
+	AnaglyphSIMD::set_rotation(out_frame, q.x, q.y, q.z, q.w);
+	return true;
+}
+
+void AnaglyphPositionServer::compute_batch(int slot, Viewport* viewport, uint64_t frame) {
+	float latency = get_frame_latency(frame);
+	AnaglyphSIMD::ListenerFrame listener;
+	if (!get_listener_frame(viewport, frame, latency, listener)) {
+		return;
+	}
+	uint64_t usec = Time::get_singleton()->get_ticks_usec();
+	uint64_t viewport_id = viewport->get_instance_id();
+
+	// Gather everyone that is still asking for positions.
+	batch_slots.clear();
+	batch_x.clear();
+	batch_y.clear();
+	batch_z.clear();
+	for (int i = 0; i < slots.size(); i++) {
+		Slot& s = slots.write[i];
+		if (!s.in_use || s.viewport_id != viewport_id) {
+			continue;
+		}
+		if (i != slot && (s.queried_frame + 1 < frame || !s.queried_on_main)) {
+			continue;
+		}
+		// Slots get unregistered on exit_tree, so this should never fail.
+		// Better safe than sorry though.
+		if (ObjectDB::get_instance(s.source_id) == nullptr) {
+			continue;
+		}
+		Vector3 position = track_source(s, s.source->get_global_position(), usec, latency);
+		batch_slots.push_back(i);
+		batch_x.push_back(position.x);
+		batch_y.push_back(position.y);
+		batch_z.push_back(position.z);
+	}
+
+	int count = batch_slots.size();
+	batch_azimuth.resize(count);
+	batch_elevation.resize(count);
+	batch_distance.resize(count);
+	AnaglyphSIMD::cartesian_to_polar(
+		listener,
+		batch_x.ptr(), batch_y.ptr(), batch_z.ptr(),
+		batch_azimuth.ptrw(), batch_elevation.ptrw(), batch_distance.ptrw(),
+		count
+	);
+
+	for (int i = 0; i < count; i++) {
+		Slot& s = slots.write[batch_slots[i]];
+		s.polar = Vector3(batch_azimuth[i], batch_elevation[i], batch_distance[i]);
+		s.computed_frame = frame;
+	}
+	batch_frames.insert(viewport_id, frame);
+}
+
+void AnaglyphPositionServer::compute_single(int slot, Viewport* viewport, uint64_t frame) {
+	float latency = get_frame_latency(frame);
+	AnaglyphSIMD::ListenerFrame listener;
+	if (!get_listener_frame(viewport, frame, latency, listener)) {
+		return;
+	}
+	Slot& s = slots.write[slot];
+	uint64_t usec = Time::get_singleton()->get_ticks_usec();
+	Vector3 position = track_source(s, s.source->get_global_position(), usec, latency);
+	// (real_t might be a double.)
+	float x = position.x, y = position.y, z = position.z;
+	float azimuth, elevation, distance;
+	AnaglyphSIMD::cartesian_to_polar(
+		listener,
+		&x, &y, &z,
+		&azimuth, &elevation, &distance,
+		1
+	);
+	s.polar = Vector3(azimuth, elevation, distance);
+	s.computed_frame = frame;
+}
+
+bool AnaglyphPositionServer::get_polar_position(int slot, Vector3& out_polar) {
+	MutexLock lock(*mutex.ptr());
+	if (slot < 0 || slot >= slots.size() || !slots[slot].in_use) {
+		return false;
+	}
+	uint64_t frame = Engine::get_singleton()->get_process_frames();
+	bool main_thread = is_main_thread();
+	slots.write[slot].queried_frame = frame;
+	slots.write[slot].queried_on_main = main_thread;
+
+	if (slots[slot].computed_frame != frame) {
+		Viewport* viewport = slots[slot].source->get_viewport();
+		if (viewport == nullptr) {
+			return false;
+		}
+		uint64_t* batch_frame = batch_frames.getptr(viewport->get_instance_id());
+		bool batch_done = batch_frame != nullptr && *batch_frame == frame;
+		if (!batch_done && main_thread) {
+			compute_batch(slot, viewport, frame);
+		}
+		else {
+			// Either we're a latecomer this frame, or on some other thread.
+			compute_single(slot, viewport, frame);
+		}
+		if (slots[slot].computed_frame != frame) {
+			// No listener.
+			return false;
+		}
+	}
+
+	out_polar = slots[slot].polar;
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#ifndef GDANAGLYPH_POSITIONS
+#define GDANAGLYPH_POSITIONS
+
+#include "anaglyph_simd.h"
+
+#include <godot_cpp/classes/mutex.hpp>
+#include <godot_cpp/classes/node3d.hpp>
+#include <godot_cpp/classes/viewport.hpp>
+#include <godot_cpp/core/object_id.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/vector.hpp>
+
+namespace godot {
+	// Computes the polar positions (wrt the listener) of all sources at once.
+	// Sources register a slot, and the first time any source asks for its
+	// position in a frame, the positions of all sources in that viewport are
+	// gathered and converted in one batch (see `AnaglyphSIMD`). All other
+	// sources then just read their result.
+	//
+	// Sources that haven't asked for their position in the last frame are
+	// considered inactive and are not part of the batch. When they do ask,
+	// they are computed separately once, and are part of the batch again
+	// from the next frame on.
+	//
+	// Anaglyph (and the audio driver) only play what we send them some time
+	// later. With latency compensation, sources and listener are extrapolated
+	// forward by that time using their tracked (angular) velocities, so that
+	// fast-moving things don't sound like they lag behind.
+	//
+	// All public methods are safe to call from any thread. Batches are only
+	// done on the main thread though, as we can't read other nodes' transforms
+	// from inside a threaded process group. Off the main thread, each source
+	// is computed separately (with the same kernel).
+	class AnaglyphPositionServer {
+
+	private:
+		static AnaglyphPositionServer* singleton;
+
+		Ref<Mutex> mutex;
+
+		struct Slot {
+			bool in_use;
+			Node3D* source;
+			ObjectID source_id;
+			uint64_t viewport_id;
+			// The last frame this slot asked for its position.
+			uint64_t queried_frame;
+			// Whether it asked from the main thread. Threaded sources compute
+			// themselves, so there's no point including them in batches.
+			bool queried_on_main;
+			// The frame `polar` was computed in.
+			uint64_t computed_frame;
+			Vector3 polar;
+
+			// For extrapolation.
+			Vector3 last_position;
+			uint64_t last_position_usec;
+			Vector3 velocity;
+		};
+		Vector<Slot> slots;
+		Vector<int> free_slots;
+
+		// The frame each viewport last had its batch computed in.
+		HashMap<uint64_t, uint64_t> batch_frames;
+
+		// How each viewport's listener is moving. Updated once per frame.
+		struct ListenerMotion {
+			uint64_t frame;
+			uint64_t usec;
+			Vector3 position;
+			Quaternion rotation;
+			Vector3 velocity;
+			// Axis times rad/s, in world space.
+			Vector3 angular_velocity;
+		};
+		HashMap<uint64_t, ListenerMotion> listener_motion;
+
+		bool latency_compensation;
+		float extra_latency;
+		// Never extrapolate further than this. Beyond it, guesses about where
+		// things go are just wrong.
+		static const float max_compensated_latency;
+		// Compensated latency for the current frame.
+		uint64_t latency_frame;
+		float frame_latency;
+		float get_frame_latency(uint64_t frame);
+
+		// Velocities are smoothed, and reset if we haven't seen a source for
+		// this long (as it may have teleported in the meantime).
+		static const uint64_t stale_motion_usec;
+		// Updates the slot's velocity, and returns where it will be after the
+		// compensated latency.
+		Vector3 track_source(Slot& slot, const Vector3& position, uint64_t usec, float latency);
+
+		// Scratch space for the SoA batch, to not reallocate every frame.
+		Vector<int> batch_slots;
+		Vector<float> batch_x;
+		Vector<float> batch_y;
+		Vector<float> batch_z;
+		Vector<float> batch_azimuth;
+		Vector<float> batch_elevation;
+		Vector<float> batch_distance;
+
+		static bool is_main_thread();
+		bool get_listener_frame(Viewport* viewport, uint64_t frame, float latency, AnaglyphSIMD::ListenerFrame& out_frame);
+		// Computes all active slots in this viewport, including `slot`.
+		void compute_batch(int slot, Viewport* viewport, uint64_t frame);
+		// Computes only this slot.
+		void compute_single(int slot, Viewport* viewport, uint64_t frame);
+
+	public:
+		static AnaglyphPositionServer* get_singleton();
+		// Frees the singleton. Only to be called on module deinitialization.
+		static void free_singleton();
+
+		AnaglyphPositionServer();
+		~AnaglyphPositionServer();
+
+		// Registers a source that is inside the tree, and returns its slot.
+		// The source must unregister before leaving the tree.
+		int register_source(Node3D* source);
+		// Frees the slot. Ignores invalid slots.
+		void unregister_source(int slot);
+
+		// Whether to extrapolate positions by the audio latency.
+		void set_latency_compensation(bool enabled);
+		bool get_latency_compensation();
+		// Anaglyph's own latency is invisible to us, so it can be added here.
+		void set_extra_latency(float seconds);
+		float get_extra_latency();
+		// The DSP block plus the output latency, plus the extra latency,
+		// clamped to `max_compensated_latency`. Also when compensation is off.
+		float get_compensated_latency();
+
+		// Gets the azimuth [x], elevation [y], and distance [z] of this slot's
+		// source as in `AnaglyphHelpers::calculate_polar_position`.
+		// Returns false if there is no listener.
+		bool get_polar_position(int slot, Vector3& out_polar);
+	};
+}
+
+#endif // GDANAGLYPH_POSITIONS
\ No newline at end of file
@@ -0,0 +1,319 @@
+#include "anaglyph_render_cache.h"
+#include "anaglyph_offline_renderer.h"
+#include "audio_stream_player_anaglyph.h"
+#include "helpers.h"
+
+#include <godot_cpp/classes/audio_server.hpp>
+#include <godot_cpp/classes/audio_stream_playback_polyphonic.hpp>
+#include <godot_cpp/classes/audio_stream_player.hpp>
+#include <godot_cpp/classes/audio_stream_polyphonic.hpp>
+#include <godot_cpp/classes/viewport.hpp>
+#include <godot_cpp/classes/worker_thread_pool.hpp>
+#include <godot_cpp/core/math.hpp>
+
+using namespace godot;
+
+AnaglyphRenderCache* AnaglyphRenderCache::singleton = nullptr;
+
+// Further away than this, a oneshot's node wouldn't use Anaglyph anyway.
+// (It's the default `max_anaglyph_range`, and also as far as Anaglyph goes.)
+static const float max_distance = 10;
+
+AnaglyphRenderCache* AnaglyphRenderCache::get_singleton() {
+	if (singleton == nullptr) {
+		singleton = new AnaglyphRenderCache();
+	}
+	return singleton;
+}
+
+void AnaglyphRenderCache::free_singleton() {
+	if (singleton != nullptr) {
+		delete singleton;
+		singleton = nullptr;
+	}
+}
+
+AnaglyphRenderCache::AnaglyphRenderCache() {
+	used_bytes = 0;
+	use_counter = 0;
+	max_bytes = 0;
+	angle_step = 5;
+	distance_step = 0.25;
+	job_task = -1;
+	job_stale = false;
+}
+
+AnaglyphRenderCache::~AnaglyphRenderCache() {
+	// The worker still uses our scratch effect.
+	if (job_task != -1) {
+		WorkerThreadPool::get_singleton()->wait_for_task_completion(job_task);
+	}
+	// The player belongs to the tree, which cleans it up.
+}
+
+bool AnaglyphRenderCache::is_cacheable(const Ref<AudioStream>& stream) {
+	Ref<AudioStreamWAV> wav = stream;
+	if (wav == nullptr || wav->get_loop_mode() != AudioStreamWAV::LOOP_DISABLED) {
+		return false;
+	}
+	AudioStreamWAV::Format format = wav->get_format();
+	if (format != AudioStreamWAV::FORMAT_8_BITS && format != AudioStreamWAV::FORMAT_16_BITS) {
+		return false;
+	}
+	return wav->get_length() <= max_source_seconds;
+}
+
+Vector3 AnaglyphRenderCache::snap(const Vector3& polar) const {
+	// Rendered at the center of the cell, so that everything in it is off
+	// by at most half a step.
+	float azimuth = Math::round(polar.x / angle_step) * angle_step;
+	float elevation = Math::round(polar.y / angle_step) * angle_step;
+	float distance = Math::round(polar.z / distance_step) * distance_step;
+	// (-180 and 180 are the same place.)
+	if (azimuth <= -180) {
+		azimuth += 360;
+	}
+	return Vector3(
+		CLAMP(azimuth, -180, 180),
+		CLAMP(elevation, -90, 90),
+		CLAMP(distance, 0.1, max_distance)
+	);
+}
+
+String AnaglyphRenderCache::make_key(const Ref<AudioStream>& stream, const Vector3& snapped, uint32_t settings_hash) const {
+	return itos(stream->get_instance_id())
+		+ "|" + itos((int64_t)Math::round(snapped.x * 100))
+		+ "|" + itos((int64_t)Math::round(snapped.y * 100))
+		+ "|" + itos((int64_t)Math::round(snapped.z * 100))
+		+ "|" + itos(settings_hash);
+}
+
+Ref<AudioStreamWAV> AnaglyphRenderCache::render(const Ref<AudioStreamWAV>& wav, const Vector3& snapped) {
+	Vector<AudioFrame> frames;
+	if (!AnaglyphOfflineRenderer::render_fixed(wav, scratch_effect, snapped, tail_seconds, frames)) {
+		return Ref<AudioStreamWAV>();
+	}
+
+	// 16 bits is plenty for playback, and half the memory of floats.
+	PackedByteArray bytes;
+	bytes.resize(frames.size() * 2 * sizeof(int16_t));
+	int16_t* samples = (int16_t*)bytes.ptrw();
+	const AudioFrame* src = frames.ptr();
+	for (int64_t i = 0; i < frames.size(); i++) {
+		samples[2 * i] = (int16_t)CLAMP(src[i].left * 32767.0f, -32768.0f, 32767.0f);
+		samples[2 * i + 1] = (int16_t)CLAMP(src[i].right * 32767.0f, -32768.0f, 32767.0f);
+	}
+
+	Ref<AudioStreamWAV> rendered;
+	rendered.instantiate();
+	rendered->set_format(AudioStreamWAV::FORMAT_16_BITS);
+	rendered->set_stereo(true);
+	rendered->set_mix_rate((int)AudioServer::get_singleton()->get_mix_rate());
+	rendered->set_data(bytes);
+	return rendered;
+}
+
+void AnaglyphRenderCache::start_job(const String& key, const Ref<AudioStreamWAV>& wav, const Vector3& snapped, const Ref<AnaglyphEffectData>& settings) {
+	// (Set up here, as the settings may change on the main thread while the
+	//  worker renders.)
+	if (scratch_effect == nullptr) {
+		scratch_effect.instantiate();
+		scratch_data.instantiate();
+	}
+	scratch_data->copy_from(settings);
+	scratch_effect->set_effect_data(scratch_data);
+
+	job.key = key;
+	job.wav = wav;
+	job.snapped = snapped;
+	job.rendered = Ref<AudioStreamWAV>();
+	job_stale = false;
+	job_task = WorkerThreadPool::get_singleton()->add_task(callable_mp_static(&AnaglyphRenderCache::run_job), false, "Anaglyph oneshot render");
+}
+
+void AnaglyphRenderCache::run_job() {
+	AnaglyphRenderCache* self = get_singleton();
+	self->job.rendered = self->render(self->job.wav, self->job.snapped);
+}
+
+void AnaglyphRenderCache::collect_job(bool wait) {
+	if (job_task == -1) {
+		return;
+	}
+	WorkerThreadPool* pool = WorkerThreadPool::get_singleton();
+	if (!wait && !pool->is_task_completed(job_task)) {
+		return;
+	}
+	// (Also needed when it's done, to free the task.)
+	pool->wait_for_task_completion(job_task);
+	job_task = -1;
+
+	Ref<AudioStreamWAV> rendered = job.rendered;
+	String key = job.key;
+	job.wav = Ref<AudioStreamWAV>();
+	job.rendered = Ref<AudioStreamWAV>();
+	if (job_stale || rendered == nullptr) {
+		return;
+	}
+	int64_t bytes = rendered->get_data().size();
+	if (bytes > max_bytes) {
+		// Never going to fit.
+		return;
+	}
+	make_room(bytes);
+	Entry entry;
+	entry.rendered = rendered;
+	entry.bytes = bytes;
+	entry.last_used = ++use_counter;
+	entries.insert(key, entry);
+	used_bytes += bytes;
+}
+
+void AnaglyphRenderCache::make_room(int64_t bytes) {
+	while (entries.size() > 0 && used_bytes + bytes > max_bytes) {
+		// A linear search, but there won't be that many entries, and this
+		// only happens once a render is done (which is way worse).
+		const String* oldest = nullptr;
+		uint64_t oldest_use = UINT64_MAX;
+		for (const KeyValue<String, Entry>& kv : entries) {
+			if (kv.value.last_used < oldest_use) {
+				oldest_use = kv.value.last_used;
+				oldest = &kv.key;
+			}
+		}
+		String key = *oldest;
+		used_bytes -= entries[key].bytes;
+		entries.erase(key);
+	}
+}
+
+bool AnaglyphRenderCache::play_rendered(Node* parent, const Ref<AudioStreamWAV>& rendered, float volume_db, const StringName& bus) {
+	AudioStreamPlayer* node = Object::cast_to<AudioStreamPlayer>(ObjectDB::get_instance(player));
+	if (node == nullptr || !node->is_inside_tree()) {
+		Ref<AudioStreamPolyphonic> polyphonic;
+		polyphonic.instantiate();
+		polyphonic->set_polyphony(polyphony);
+		node = memnew(AudioStreamPlayer);
+		node->set_stream(polyphonic);
+		parent->add_child(node, true, Node::INTERNAL_MODE_BACK);
+		player = ObjectID(node->get_instance_id());
+	}
+	if (!node->is_playing()) {
+		node->play();
+	}
+	Ref<AudioStreamPlaybackPolyphonic> playback = node->get_stream_playback();
+	if (playback == nullptr) {
+		return false;
+	}
+	// (The bus here is per voice, so one player does for all buses.)
+	int64_t id = playback->play_stream(rendered, 0, volume_db, 1.0, AudioServer::PLAYBACK_TYPE_DEFAULT, bus);
+	return id != AudioStreamPlaybackPolyphonic::INVALID_ID;
+}
+
+bool AnaglyphRenderCache::play(
+	Node* parent,
+	const Ref<AudioStream>& stream,
+	const Vector3& global_position,
+	float volume_db,
+	const Ref<AnaglyphEffectData>& settings,
+	const StringName& bus
+) {
+	Batch batch;
+	begin_batch(parent, stream, settings, batch);
+	return play(batch, parent, stream, global_position, volume_db, settings, bus);
+}
+
+void AnaglyphRenderCache::begin_batch(Node* parent, const Ref<AudioStream>& stream, const Ref<AnaglyphEffectData>& settings, Batch& out_batch) {
+	out_batch.usable = false;
+	out_batch.settings_hash = 0;
+	collect_job(false);
+	if (max_bytes <= 0 || !AudioStreamPlayerAnaglyph::get_anaglyph_enabled() || !is_cacheable(stream)) {
+		return;
+	}
+	Viewport* viewport = Object::cast_to<Viewport>(parent);
+	if (viewport == nullptr) {
+		viewport = parent->get_viewport();
+	}
+	if (viewport == nullptr || !AnaglyphListenerRegistry::get_singleton()->get_listener(viewport, out_batch.listener)) {
+		return;
+	}
+	// (Hashing all settings isn't free, so only once per batch.)
+	out_batch.settings_hash = settings->hash_settings();
+	out_batch.usable = true;
+}
+
+bool AnaglyphRenderCache::play(
+	const Batch& batch,
+	Node* parent,
+	const Ref<AudioStream>& stream,
+	const Vector3& global_position,
+	float volume_db,
+	const Ref<AnaglyphEffectData>& settings,
+	const StringName& bus
+) {
+	if (!batch.usable) {
+		return false;
+	}
+	Vector3 polar = AnaglyphHelpers::calculate_polar_position(global_position, batch.listener.position, batch.listener.inverse_rotation);
+	if (polar.z >= max_distance) {
+		return false;
+	}
+	Vector3 snapped = snap(polar);
+
+	String key = make_key(stream, snapped, batch.settings_hash);
+	Entry* entry = entries.getptr(key);
+	if (entry == nullptr) {
+		// Render it for next time. If something else is rendering, this one
+		// gets its turn when it plays again.
+		if (job_task == -1) {
+			start_job(key, stream, snapped, settings);
+		}
+		return false;
+	}
+	entry->last_used = ++use_counter;
+	return play_rendered(parent, entry->rendered, volume_db, bus);
+}
+
+void AnaglyphRenderCache::clear() {
+	entries.clear();
+	used_bytes = 0;
+	// Whatever's rendering now is for the old data (or grid).
+	job_stale = job_task != -1;
+}
+
+void AnaglyphRenderCache::set_max_bytes(int64_t bytes) {
+	max_bytes = MAX(bytes, (int64_t)0);
+	make_room(0);
+}
+
+int64_t AnaglyphRenderCache::get_max_bytes() const {
+	return max_bytes;
+}
+
+int64_t AnaglyphRenderCache::get_used_bytes() const {
+	return used_bytes;
+}
+
+void AnaglyphRenderCache::set_angle_step(float degrees) {
+	degrees = CLAMP(degrees, 0.1, 90);
+	if (degrees != angle_step) {
+		angle_step = degrees;
+		clear();
+	}
+}
+
+float AnaglyphRenderCache::get_angle_step() const {
+	return angle_step;
+}
+
+void AnaglyphRenderCache::set_distance_step(float meters) {
+	meters = CLAMP(meters, 0.01, 10);
+	if (meters != distance_step) {
+		distance_step = meters;
+		clear();
+	}
+}
+
+float AnaglyphRenderCache::get_distance_step() const {
+	return distance_step;
+}
\ No newline at end of file
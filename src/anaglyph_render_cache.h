@@ -0,0 +1,159 @@
+#ifndef GDANAGLYPH_RENDER_CACHE
+#define GDANAGLYPH_RENDER_CACHE
+
+#include "anaglyph_effect.h"
+#include "anaglyph_listener_registry.h"
+
+#include <godot_cpp/classes/audio_stream.hpp>
+#include <godot_cpp/classes/audio_stream_wav.hpp>
+#include <godot_cpp/classes/node.hpp>
+#include <godot_cpp/core/object_id.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+
+namespace godot {
+	// Lots of oneshots are short cues that play from the same few places
+	// relative to the listener, with the same settings, over and over. Each
+	// of those used to get its own node, Anaglyph bus and full HRTF
+	// processing, only to sound exactly the same as last time.
+	//
+	// Instead, this renders such a oneshot once (offline, through a scratch
+	// effect that's kept around for this, on a worker thread), and plays the
+	// binaural result straight from memory afterwards. All of those play through a single
+	// AudioStreamPlayer with an AudioStreamPolyphonic, so they don't need a
+	// node or an Anaglyph bus of their own.
+	// Positions are snapped to a grid of `angle_step` degrees and
+	// `distance_step` meters, so that "about the same place" counts as the
+	// same place. When the renders take up more than `max_bytes`, the ones
+	// that played longest ago are dropped.
+	//
+	// This only works for what the offline renderer can read: uncompressed,
+	// non-looping AudioStreamWAVs.
+	// Only to be used from the main thread.
+	class AnaglyphRenderCache {
+		static AnaglyphRenderCache* singleton;
+
+		struct Entry {
+			Ref<AudioStreamWAV> rendered;
+			int64_t bytes;
+			// The `use_counter` of when this last played.
+			uint64_t last_used;
+		};
+		// Keyed by stream, snapped position, and settings hash.
+		HashMap<String, Entry> entries;
+		int64_t used_bytes;
+		uint64_t use_counter;
+
+		// Zero disables the cache.
+		int64_t max_bytes;
+		float angle_step;
+		float distance_step;
+
+		// Long sounds would keep the worker busy for a while, and they aren't
+		// cue-like anyway.
+		static const int max_source_seconds = 5;
+		// How much of the reverb tail to render at most.
+		static const int tail_seconds = 2;
+
+		// The effect renders go through, and the settings it uses.
+		Ref<AnaglyphEffect> scratch_effect;
+		Ref<AnaglyphEffectData> scratch_data;
+
+		// A render takes way longer than a frame, so it happens on a worker
+		// thread. There's only ever one going (there's only one scratch
+		// effect), and until it's done, misses are played the usual way.
+		struct Job {
+			String key;
+			Ref<AudioStreamWAV> wav;
+			Vector3 snapped;
+			// Written by the worker.
+			Ref<AudioStreamWAV> rendered;
+		};
+		Job job;
+		// The WorkerThreadPool task, or -1 if there's no render going.
+		int64_t job_task;
+		// Set by `clear()` during a render, whose result is then dropped.
+		bool job_stale;
+		// Starts rendering `key` in the background.
+		void start_job(const String& key, const Ref<AudioStreamWAV>& wav, const Vector3& snapped, const Ref<AnaglyphEffectData>& settings);
+		// On the worker thread.
+		static void run_job();
+		// Puts a finished render in the cache. With `wait`, waits for it to
+		// finish first.
+		void collect_job(bool wait);
+		// The AudioStreamPlayer that plays everything, with its polyphony.
+		ObjectID player;
+		static const int polyphony = 32;
+
+		// Whether `stream` is something we can render.
+		static bool is_cacheable(const Ref<AudioStream>& stream);
+		// Snaps `polar` to the grid.
+		Vector3 snap(const Vector3& polar) const;
+		String make_key(const Ref<AudioStream>& stream, const Vector3& snapped, uint32_t settings_hash) const;
+		// Renders into a new stereo 16 bit wav with the scratch effect as it
+		// is set up. Null on failure.
+		Ref<AudioStreamWAV> render(const Ref<AudioStreamWAV>& wav, const Vector3& snapped);
+		// Drops the least recently played entries until `bytes` more fit.
+		void make_room(int64_t bytes);
+		// Plays on the shared player, which is created under `parent` if
+		// it's not there. Returns false if all its voices are in use.
+		bool play_rendered(Node* parent, const Ref<AudioStreamWAV>& rendered, float volume_db, const StringName& bus);
+
+	public:
+		// Everything `play()` looks up that's the same for a whole batch of
+		// oneshots of one stream with one set of settings.
+		struct Batch {
+			// False if none of them can come from the cache.
+			bool usable;
+			AnaglyphListenerRegistry::ListenerState listener;
+			uint32_t settings_hash;
+		};
+
+		static AnaglyphRenderCache* get_singleton();
+		// Frees the singleton. Only to be called on module deinitialization.
+		static void free_singleton();
+
+		AnaglyphRenderCache();
+		~AnaglyphRenderCache();
+
+		// Plays a oneshot from the cache. If it's not in there yet, starts
+		// rendering it for next time. Returns false if it can't (cache
+		// disabled, uncacheable stream, too far for Anaglyph, not rendered
+		// yet, ...), in which case it should be played the usual way.
+		bool play(
+			Node* parent,
+			const Ref<AudioStream>& stream,
+			const Vector3& global_position,
+			float volume_db,
+			const Ref<AnaglyphEffectData>& settings,
+			const StringName& bus
+		);
+		// The same, in two steps: first what's shared, then every sound.
+		void begin_batch(Node* parent, const Ref<AudioStream>& stream, const Ref<AnaglyphEffectData>& settings, Batch& out_batch);
+		bool play(
+			const Batch& batch,
+			Node* parent,
+			const Ref<AudioStream>& stream,
+			const Vector3& global_position,
+			float volume_db,
+			const Ref<AnaglyphEffectData>& settings,
+			const StringName& bus
+		);
+
+		// Drops all renders. Needed when a stream's data changes, as
+		// streams are only told apart by their instance.
+		void clear();
+
+		// Reducing this drops renders right away.
+		void set_max_bytes(int64_t bytes);
+		int64_t get_max_bytes() const;
+		int64_t get_used_bytes() const;
+
+		// Changing these drops all renders, as they're on the old grid.
+		void set_angle_step(float degrees);
+		float get_angle_step() const;
+		void set_distance_step(float meters);
+		float get_distance_step() const;
+	};
+}
+
+#endif // GDANAGLYPH_RENDER_CACHE
\ No newline at end of file
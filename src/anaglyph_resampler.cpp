@@ -0,0 +1,162 @@
+#include "anaglyph_resampler.h"
+#include "anaglyph_simd.h"
+
+#include <math.h>
+#include <string.h>
+
+using namespace godot;
+
+const float* AnaglyphResampler::coefficients() {
+	static float taps[half_taps];
+	static bool computed = false;
+	if (computed) {
+		return taps;
+	}
+	// h[n] = sinc(n / 2) / 2 for odd n = 2m + 1, under a Blackman window
+	// that spans all 4 * half_taps - 1 taps. The center tap is 1/2.
+	const double pi = 3.14159265358979323846;
+	double sum = 0;
+	double raw[half_taps];
+	for (int m = 0; m < half_taps; m++) {
+		double n = 2 * m + 1;
+		double sinc = sin(pi * n / 2) / (pi * n / 2);
+		double x = pi * n / (2 * half_taps);
+		double window = 0.42 + 0.5 * cos(x) + 0.08 * cos(2 * x);
+		raw[m] = 0.5 * sinc * window;
+		sum += raw[m];
+	}
+	// Scale the odd taps so that DC passes exactly: 1/2 + 2 * sum = 1.
+	for (int m = 0; m < half_taps; m++) {
+		taps[m] = (float)(raw[m] * 0.25 / sum);
+	}
+	computed = true;
+	return taps;
+}
+
+AnaglyphResampler::AnaglyphResampler() {
+	divisor = 1;
+}
+
+void AnaglyphResampler::set_divisor(int p_divisor) {
+	if (p_divisor != 2 && p_divisor != 4) {
+		p_divisor = 1;
+	}
+	divisor = p_divisor;
+	coefficients(); // (So that the audio thread doesn't compute them.)
+
+	int stages = divisor == 4 ? 2 : divisor == 2 ? 1 : 0;
+	for (int s = 0; s < 2; s++) {
+		// (Stage s takes max_frames >> s frames.)
+		int in_frames = s < stages ? (max_frames >> s) : 0;
+		for (int c = 0; c < 2; c++) {
+			decimators[s].odd[c].assign(s < stages ? 2 * half_taps - 1 + in_frames / 2 : 0, 0.0f);
+			decimators[s].even[c].assign(s < stages ? half_taps - 1 + in_frames / 2 : 0, 0.0f);
+			interpolators[s].input[c].assign(s < stages ? 2 * half_taps - 1 + in_frames / 2 : 0, 0.0f);
+		}
+	}
+	between.assign(stages == 2 ? max_frames : 0, 0.0f);
+	scratch.assign(stages > 0 ? max_frames / 2 : 0, 0.0f);
+}
+
+int AnaglyphResampler::get_divisor() const {
+	return divisor;
+}
+
+int AnaglyphResampler::get_latency() const {
+	// Going down and back up through one stage delays by 2 * half_taps - 2
+	// and 2 * half_taps - 1 frames at its higher rate. The second stage's
+	// frames are twice as long.
+	int stage = 4 * half_taps - 3;
+	if (divisor == 2) {
+		return stage;
+	}
+	if (divisor == 4) {
+		return stage + 2 * stage;
+	}
+	return 0;
+}
+
+void AnaglyphResampler::reset() {
+	for (int s = 0; s < 2; s++) {
+		for (int c = 0; c < 2; c++) {
+			decimators[s].odd[c].assign(decimators[s].odd[c].size(), 0.0f);
+			decimators[s].even[c].assign(decimators[s].even[c].size(), 0.0f);
+			interpolators[s].input[c].assign(interpolators[s].input[c].size(), 0.0f);
+		}
+	}
+}
+
+bool AnaglyphResampler::accepts(int count) const {
+	return divisor > 1 && count > 0 && count <= max_frames && count % divisor == 0;
+}
+
+void AnaglyphResampler::decimate_stage(Decimator& stage, const float* in, float* out, int count) {
+	int n = count / 2;
+	const float* taps = coefficients();
+	float* filtered = scratch.data();
+	for (int c = 0; c < 2; c++) {
+		float* odd = stage.odd[c].data();
+		float* even = stage.even[c].data();
+		float* odd_new = odd + 2 * half_taps - 1;
+		float* even_new = even + half_taps - 1;
+		for (int i = 0; i < n; i++) {
+			even_new[i] = in[4 * i + c];
+			odd_new[i] = in[4 * i + 2 + c];
+		}
+		// The odd phase goes through the filter, and the even phase meets
+		// the center tap, delayed to line up.
+		AnaglyphSIMD::symmetric_fir(odd, taps, half_taps, filtered, n);
+		for (int i = 0; i < n; i++) {
+			out[2 * i + c] = 0.5f * even[i] + filtered[i];
+		}
+		memmove(odd, odd + n, (2 * half_taps - 1) * sizeof(float));
+		memmove(even, even + n, (half_taps - 1) * sizeof(float));
+	}
+}
+
+void AnaglyphResampler::interpolate_stage(Interpolator& stage, const float* in, float* out, int count) {
+	const float* taps = coefficients();
+	float* filtered = scratch.data();
+	for (int c = 0; c < 2; c++) {
+		float* input = stage.input[c].data();
+		float* input_new = input + 2 * half_taps - 1;
+		for (int i = 0; i < count; i++) {
+			input_new[i] = in[2 * i + c];
+		}
+		// Of the zero-stuffed signal, one phase only meets the odd taps,
+		// and the other only the center tap. (The 2 makes up for the
+		// zeroes.)
+		AnaglyphSIMD::symmetric_fir(input, taps, half_taps, filtered, count);
+		for (int i = 0; i < count; i++) {
+			out[4 * i + c] = 2 * filtered[i];
+			out[4 * i + 2 + c] = input[i + half_taps];
+		}
+		memmove(input, input + count, (2 * half_taps - 1) * sizeof(float));
+	}
+}
+
+void AnaglyphResampler::decimate(const float* in, float* out, int count) {
+	if (divisor == 2) {
+		decimate_stage(decimators[0], in, out, count);
+	}
+	else if (divisor == 4) {
+		decimate_stage(decimators[0], in, between.data(), count);
+		decimate_stage(decimators[1], between.data(), out, count / 2);
+	}
+	else {
+		memcpy(out, in, 2 * count * sizeof(float));
+	}
+}
+
+void AnaglyphResampler::interpolate(const float* in, float* out, int count) {
+	if (divisor == 2) {
+		interpolate_stage(interpolators[0], in, out, count);
+	}
+	else if (divisor == 4) {
+		interpolate_stage(interpolators[1], in, between.data(), count);
+		interpolate_stage(interpolators[0], between.data(), out, 2 * count);
+	}
+	else {
+		memcpy(out, in, 2 * count * sizeof(float));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#ifndef GDANAGLYPH_RESAMPLER
+#define GDANAGLYPH_RESAMPLER
+
+// Godot-free, like the SIMD kernels it uses.
+
+#include <vector>
+
+namespace godot {
+	// Brings interleaved stereo down to half or a quarter of the sample rate
+	// and back up again, so that a DSP instance can run at a lower rate than
+	// the AudioServer. Distant sources don't have much above 10kHz left
+	// anyway, and half the samples is about half the work.
+	//
+	// Each factor of two is a halfband FIR: a windowed sinc with every other
+	// tap zero, so that going down only needs the odd taps on one phase
+	// (plus a plain delay on the other), and going up does the same on the
+	// zero-stuffed signal. That's `half_taps` multiply-adds per output
+	// frame per channel, done by `AnaglyphSIMD::symmetric_fir()`.
+	// Quarter rate is two of these stages after each other.
+	//
+	// This is meant for the audio thread: nothing allocates after
+	// `set_divisor()`.
+	class AnaglyphResampler {
+	public:
+		// The most full-rate frames one call may take. More than the
+		// AudioServer ever mixes at once.
+		static const int max_frames = 4096;
+		// The filter has 4 * half_taps - 1 taps, half of which are zero.
+		static const int half_taps = 8;
+
+	private:
+		// One factor of two down, per channel.
+		struct Decimator {
+			// The odd input frames with `2 * half_taps - 1` frames of history
+			// before them, and the even ones with `half_taps - 1`.
+			std::vector<float> odd[2];
+			std::vector<float> even[2];
+		};
+		// One factor of two up, per channel.
+		struct Interpolator {
+			// The input with `2 * half_taps - 1` frames of history.
+			std::vector<float> input[2];
+		};
+
+		int divisor;
+		// [stage], where stage 0 is between full and half rate, and stage 1
+		// between half and quarter rate.
+		Decimator decimators[2];
+		Interpolator interpolators[2];
+		// Interleaved half rate frames, between two stages.
+		std::vector<float> between;
+		std::vector<float> scratch;
+
+		// The `half_taps` nonzero odd taps on one side of the filter,
+		// nearest to the center first.
+		static const float* coefficients();
+
+		void decimate_stage(Decimator& stage, const float* in, float* out, int count);
+		void interpolate_stage(Interpolator& stage, const float* in, float* out, int count);
+
+	public:
+		AnaglyphResampler();
+
+		// 1 (which does nothing), 2, or 4. Anything else counts as 1.
+		// This allocates, and clears the history.
+		void set_divisor(int divisor);
+		int get_divisor() const;
+
+		// The delay a `decimate()` followed by an `interpolate()` adds, in
+		// full-rate frames.
+		int get_latency() const;
+
+		// Forgets the history, as if silence came before.
+		void reset();
+
+		// Whether `count` full-rate frames can go through here. Otherwise,
+		// just don't resample that block.
+		bool accepts(int count) const;
+
+		// Turns `count` full-rate frames into `count / divisor` frames.
+		void decimate(const float* in, float* out, int count);
+		// Turns `count` reduced-rate frames into `count * divisor` frames.
+		void interpolate(const float* in, float* out, int count);
+	};
+}
+
+#endif // GDANAGLYPH_RESAMPLER
\ No newline at end of file
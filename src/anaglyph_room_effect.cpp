@@ -0,0 +1,195 @@
+#include "anaglyph_room_effect.h"
+#include "anaglyph_dll_bridge.h"
+#include "anaglyph_float_mode.h"
+#include "helpers.h"
+
+#include <godot_cpp/classes/audio_server.hpp>
+
+using namespace godot;
+
+AnaglyphRoomEffectInstance::AnaglyphRoomEffectInstance() { }
+
+AnaglyphRoomEffectInstance::~AnaglyphRoomEffectInstance() { }
+
+void AnaglyphRoomEffectInstance::_bind_methods() { }
+
+void AnaglyphRoomEffectInstance::_process(const void* p_src_frames, AudioFrame* p_dst_frames, int32_t p_frame_count) {
+	// (Also covers mixing the wet signal back in, not just the reverb.)
+	AnaglyphFloatMode::Scope flush;
+	base->process((const AudioFrame*)p_src_frames, p_dst_frames, p_frame_count);
+}
+
+bool AnaglyphRoomEffectInstance::_process_silence() const {
+	return base->silent_frames < (int64_t)(AnaglyphRoomEffect::tail_seconds * base->mix_rate);
+}
+
+AnaglyphRoomEffect::AnaglyphRoomEffect() {
+	// (The same defaults as AnaglyphEffectData.)
+	room_id = 0.5;
+	reverb_type = AnaglyphEffectData::ANAGLYPH_REVERB_2D;
+	reverb_gain = 0;
+	reverb_EQ = Vector3(0, 0, 0);
+	mix_rate = AudioServer::get_singleton()->get_mix_rate();
+	silent_frames = (int64_t)(tail_seconds * mix_rate);
+	created = false;
+
+	UnityAudioEffectDefinition* defs = AnaglyphBridge::GetEffectData();
+	if (defs == nullptr || AnaglyphBridge::is_native()) {
+		// Nothing to share, so this just passes everything on.
+		return;
+	}
+	UnityAudioEffectState st{};
+	state = st;
+	created = AnaglyphBridge::Create(&state) == UNITY_AUDIODSP_OK;
+	if (created) {
+		send_all();
+	}
+}
+
+AnaglyphRoomEffect::~AnaglyphRoomEffect() {
+	if (created) {
+		AnaglyphBridge::Release(&state);
+	}
+}
+
+Ref<AudioEffectInstance> AnaglyphRoomEffect::_instantiate() {
+	Ref<AnaglyphRoomEffectInstance> ins;
+	ins.instantiate();
+	ins->base = Ref<AnaglyphRoomEffect>(this);
+
+	return ins;
+}
+
+void AnaglyphRoomEffect::send_all() {
+	if (!created) {
+		return;
+	}
+	// (See anaglyph_effect.h for the meaning of these magic numbers.)
+	// Reverb only, so that only the reverb gets added to what comes in.
+	AnaglyphBridge::SetParamBool(&state, 7, true);
+	AnaglyphBridge::SetParamScaled(&state, 18, 100, 0, 100);
+	AnaglyphBridge::SetParamScaled(&state, 20, 0, -40, 15);
+	// What comes in is already binaural and attenuated.
+	AnaglyphBridge::SetParamBool(&state, 4, true);
+	AnaglyphBridge::SetParamBool(&state, 1, true);
+	AnaglyphBridge::SetParamBool(&state, 3, true);
+	AnaglyphBridge::SetParamBool(&state, 5, true);
+	AnaglyphBridge::SetParamBool(&state, 9, true);
+	AnaglyphBridge::SetParamBool(&state, 6, false);
+	AnaglyphBridge::SetParamScaled(&state, 27, 0, -180, 180);
+	AnaglyphBridge::SetParamScaled(&state, 26, 0, -90, 90);
+	AnaglyphBridge::SetParamScaled(&state, 28, 1, 0.1, 10);
+
+	AnaglyphBridge::SetParam(&state, 16, room_id);
+	AnaglyphBridge::SetParamScaled(&state, 13, (float)reverb_type, 0, 3);
+	AnaglyphBridge::SetParamScaled(&state, 21, reverb_gain, -40, 15);
+	AnaglyphBridge::SetParamScaled(&state, 22, reverb_EQ.x, -40, 15);
+	AnaglyphBridge::SetParamScaled(&state, 23, reverb_EQ.y, -40, 15);
+	AnaglyphBridge::SetParamScaled(&state, 24, reverb_EQ.z, -40, 15);
+}
+
+void AnaglyphRoomEffect::process(const AudioFrame* src, AudioFrame* dst, int count) {
+	bool silent = true;
+	for (int i = 0; i < count && silent; i++) {
+		silent = src[i].left == 0 && src[i].right == 0;
+	}
+	silent_frames = silent ? silent_frames + count : 0;
+
+	if (!created) {
+		for (int i = 0; i < count; i++) {
+			dst[i] = src[i];
+		}
+		return;
+	}
+	if (reverb_buffer.size() < count) {
+		// Only happens the first few blocks, if ever.
+		reverb_buffer.resize(count);
+	}
+	AudioFrame* reverb = reverb_buffer.ptrw();
+	AnaglyphBridge::Process(&state, src, reverb, (unsigned int)count);
+	for (int i = 0; i < count; i++) {
+		dst[i].left = src[i].left + reverb[i].left;
+		dst[i].right = src[i].right + reverb[i].right;
+	}
+}
+
+void AnaglyphRoomEffect::set_reverb_from(const Ref<AnaglyphEffectData>& data) {
+	if (data == nullptr) {
+		return;
+	}
+	set_room_id(data->get_room_id());
+	set_reverb_type(data->get_reverb_type());
+	set_reverb_gain(data->get_reverb_gain());
+	set_reverb_EQ(data->get_reverb_EQ());
+}
+
+void AnaglyphRoomEffect::reset_state() {
+	if (!created) {
+		return;
+	}
+	// The audio thread may be processing this state right now, so wait for
+	// it to finish the block, just like AnaglyphEffect does.
+	// Resetting brings everything back to the dll's defaults, which are
+	// very much not ours.
+	AudioServer::get_singleton()->lock();
+	AnaglyphBridge::Reset(&state);
+	send_all();
+	AudioServer::get_singleton()->unlock();
+}
+
+void AnaglyphRoomEffect::set_room_id(const float id) {
+	room_id = CLAMP(id, 0, 1);
+	if (created) {
+		AnaglyphBridge::SetParam(&state, 16, room_id);
+	}
+}
+
+float AnaglyphRoomEffect::get_room_id() const {
+	return room_id;
+}
+
+void AnaglyphRoomEffect::set_reverb_type(const AnaglyphEffectData::AnaglyphReverbType type) {
+	reverb_type = type;
+	if (created) {
+		AnaglyphBridge::SetParamScaled(&state, 13, (float)reverb_type, 0, 3);
+	}
+}
+
+AnaglyphEffectData::AnaglyphReverbType AnaglyphRoomEffect::get_reverb_type() const {
+	return reverb_type;
+}
+
+void AnaglyphRoomEffect::set_reverb_gain(const float dB) {
+	reverb_gain = CLAMP(dB, -40, 15);
+	if (created) {
+		AnaglyphBridge::SetParamScaled(&state, 21, reverb_gain, -40, 15);
+	}
+}
+
+float AnaglyphRoomEffect::get_reverb_gain() const {
+	return reverb_gain;
+}
+
+void AnaglyphRoomEffect::set_reverb_EQ(const Vector3 dB) {
+	reverb_EQ.x = CLAMP(dB.x, -40, 15);
+	reverb_EQ.y = CLAMP(dB.y, -40, 15);
+	reverb_EQ.z = CLAMP(dB.z, -40, 15);
+	if (created) {
+		AnaglyphBridge::SetParamScaled(&state, 22, reverb_EQ.x, -40, 15);
+		AnaglyphBridge::SetParamScaled(&state, 23, reverb_EQ.y, -40, 15);
+		AnaglyphBridge::SetParamScaled(&state, 24, reverb_EQ.z, -40, 15);
+	}
+}
+
+Vector3 AnaglyphRoomEffect::get_reverb_EQ() const {
+	return reverb_EQ;
+}
+
+void AnaglyphRoomEffect::_bind_methods() {
+	REGISTER(FLOAT, room_id, AnaglyphRoomEffect, "id", PROPERTY_HINT_RANGE, "0,1");
+	REGISTER(INT, reverb_type, AnaglyphRoomEffect, "type", PROPERTY_HINT_ENUM, "OMNI:0,2D:1,3D 1st:2, 3D 2nd:3");
+	REGISTER(FLOAT, reverb_gain, AnaglyphRoomEffect, "dB", PROPERTY_HINT_RANGE, "-40,15,0.1,suffix:dB");
+	REGISTER(VECTOR3, reverb_EQ, AnaglyphRoomEffect, "dB", PROPERTY_HINT_RANGE, "-40,15,0.1,suffix:dB");
+
+	ClassDB::bind_method(D_METHOD("reset_state"), &AnaglyphRoomEffect::reset_state);
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#ifndef GDANAGLYPH_ROOM
+#define GDANAGLYPH_ROOM
+
+#include "AudioPluginInterface.h"
+#include "anaglyph_effect_data.h"
+#include "register_macro.h"
+
+#include <godot_cpp/classes/audio_effect.hpp>
+#include <godot_cpp/classes/audio_effect_instance.hpp>
+#include <godot_cpp/classes/audio_frame.hpp>
+#include <godot_cpp/templates/vector.hpp>
+
+namespace godot {
+
+	class AnaglyphRoomEffect;
+
+	class AnaglyphRoomEffectInstance : public AudioEffectInstance {
+		GDCLASS(AnaglyphRoomEffectInstance, AudioEffectInstance);
+		friend class AnaglyphRoomEffect;
+
+		Ref<AnaglyphRoomEffect> base;
+
+	protected:
+		static void _bind_methods();
+
+	public:
+		AnaglyphRoomEffectInstance();
+		~AnaglyphRoomEffectInstance();
+
+		void _process(const void* p_src_frames, AudioFrame* p_dst_frames, int32_t p_frame_count) override;
+		// Only for as long as the reverb still has a tail to play.
+		bool _process_silence() const override;
+	};
+
+	// Only the reverb half of an AnaglyphEffect, shared by every Anaglyph
+	// bus in the same room.
+	// Reverb is most of what makes an Anaglyph instance expensive, but all
+	// sources in a room have the same reverb settings anyway. So instead,
+	// the Anaglyph buses bypass their own reverb and send into one of these,
+	// which adds a single instance's reverb on top of everything that comes
+	// in. That makes reverb cost per room instead of per source.
+	// The reverb gets the already binaural sum as input instead of every
+	// source separately, so the "3D" reverb types can't place the early
+	// reflections per source like they normally would.
+	// The native backend has no reverb, so with it this does nothing.
+	class AnaglyphRoomEffect : public AudioEffect {
+		GDCLASS(AnaglyphRoomEffect, AudioEffect);
+		friend class AnaglyphRoomEffectInstance;
+
+		UnityAudioEffectState state;
+		bool created;
+
+		float room_id;
+		AnaglyphEffectData::AnaglyphReverbType reverb_type;
+		float reverb_gain;
+		Vector3 reverb_EQ;
+
+		// Only the audio thread touches these.
+		Vector<AudioFrame> reverb_buffer;
+		// How long the input has been silent, in frames. After
+		// `tail_seconds`, there's surely no reverb left.
+		int64_t silent_frames;
+		static const int tail_seconds = 5;
+		float mix_rate;
+
+		// Sets everything that isn't reverb to "leave the signal alone",
+		// and then the reverb settings.
+		void send_all();
+		void process(const AudioFrame* src, AudioFrame* dst, int count);
+
+	protected:
+		static void _bind_methods();
+
+	public:
+		AnaglyphRoomEffect();
+		~AnaglyphRoomEffect();
+
+		Ref<AudioEffectInstance> _instantiate() override;
+
+		// Takes over the reverb settings of this data, leaving everything
+		// else.
+		void set_reverb_from(const Ref<AnaglyphEffectData>& data);
+
+		// Clears the reverb tail.
+		void reset_state();
+
+		// As in AnaglyphEffect.
+		void set_room_id(const float id);
+		float get_room_id() const;
+
+		void set_reverb_type(const AnaglyphEffectData::AnaglyphReverbType type);
+		AnaglyphEffectData::AnaglyphReverbType get_reverb_type() const;
+
+		void set_reverb_gain(const float dB);
+		float get_reverb_gain() const;
+
+		void set_reverb_EQ(const Vector3 dB);
+		Vector3 get_reverb_EQ() const;
+	};
+}
+
+#endif // GDANAGLYPH_ROOM
\ No newline at end of file
@@ -0,0 +1,354 @@
+#ifndef GDANAGLYPH_SIMD
+#define GDANAGLYPH_SIMD
+
+// This header is deliberately godot-free, so that it can also be compiled by
+// the standalone benchmarks in `bench/`.
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GDANAGLYPH_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define GDANAGLYPH_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace godot {
+
+	// Vectorized math that's done for a lot of sources at once.
+	// On x86_64 this uses SSE2 (which every x86_64 cpu has, so no special
+	// compiler flags needed), on arm64 NEON, and otherwise plain floats that
+	// the compiler can hopefully vectorize itself.
+	class AnaglyphSIMD {
+	public:
+		// The rotation that brings world-space into listener-space, as a 3x3
+		// row-major matrix.
+		struct ListenerFrame {
+			float position[3];
+			float rotation[9];
+		};
+
+		// Converts a quaternion (x,y,z,w) into the rotation matrix of a
+		// ListenerFrame. The quaternion must be normalized.
+		static void set_rotation(ListenerFrame& frame, float x, float y, float z, float w) {
+			float* m = frame.rotation;
+			m[0] = 1 - 2 * (y * y + z * z); m[1] = 2 * (x * y - z * w);     m[2] = 2 * (x * z + y * w);
+			m[3] = 2 * (x * y + z * w);     m[4] = 1 - 2 * (x * x + z * z); m[5] = 2 * (y * z - x * w);
+			m[6] = 2 * (x * z - y * w);     m[7] = 2 * (y * z + x * w);     m[8] = 1 - 2 * (x * x + y * y);
+		}
+
+		// Batched version of `AnaglyphHelpers::calculate_polar_position`.
+		// Takes `count` world-space positions in SoA layout, and writes the
+		// azimuth (deg), elevation (deg), and distance (m) of each of them.
+		// The inputs and outputs may not alias, and need not be aligned.
+		//
+		// Instead of atan2f/asinf this uses a polynomial atan2 (and computes
+		// elevation as atan2(y, horizontal distance), which is the same angle).
+		// The angles are off by at most 2e-6 rad (~0.0001 degrees) from the
+		// libm versions, which is way below what anyone can hear.
+		static void cartesian_to_polar(
+			const ListenerFrame& frame,
+			const float* px, const float* py, const float* pz,
+			float* out_azimuth, float* out_elevation, float* out_distance,
+			int count
+		);
+
+		// Approximates atan2 for a single float with the same polynomial, for
+		// reference.
+		static float atan2_approx(float y, float x);
+
+		// acc += a * b for `count` complex numbers in split (re/im) layout.
+		// This is the inner loop of partitioned convolution.
+		// The arrays need not be aligned. The accumulators may not alias the
+		// inputs.
+		static void complex_multiply_accumulate(
+			const float* a_re, const float* a_im,
+			const float* b_re, const float* b_im,
+			float* acc_re, float* acc_im,
+			int count
+		);
+
+		// acc += in * gain, with the gain going linearly from `start_gain`
+		// to `end_gain` over the `count` samples (reaching it at the last).
+		// This is all an ambisonic encoder does, once per channel.
+		static void scale_accumulate(
+			const float* in,
+			float start_gain, float end_gain,
+			float* acc,
+			int count
+		);
+
+		// out[j] = sum over m < half_taps of
+		//     coeffs[m] * (in[j + half_taps - 1 - m] + in[j + half_taps + m]),
+		// so a symmetric FIR of 2 * half_taps taps over in[j .. j + 2 * half_taps - 1].
+		// Both halves of the halfband resampler (see `anaglyph_resampler.h`)
+		// boil down to this.
+		// `in` must have `count + 2 * half_taps - 1` floats. The output may
+		// not alias the input.
+		static void symmetric_fir(
+			const float* in,
+			const float* coeffs, int half_taps,
+			float* out,
+			int count
+		);
+	};
+
+	namespace anaglyph_simd_internal {
+		// Minimal abstraction over 4-float registers, so that the kernel only
+		// needs to be written once.
+#if defined(GDANAGLYPH_SIMD_SSE2)
+		typedef __m128 F4;
+		inline F4 set1(float f) { return _mm_set1_ps(f); }
+		inline F4 load(const float* p) { return _mm_loadu_ps(p); }
+		inline void store(float* p, F4 v) { _mm_storeu_ps(p, v); }
+		inline F4 add(F4 a, F4 b) { return _mm_add_ps(a, b); }
+		inline F4 sub(F4 a, F4 b) { return _mm_sub_ps(a, b); }
+		inline F4 mul(F4 a, F4 b) { return _mm_mul_ps(a, b); }
+		inline F4 div(F4 a, F4 b) { return _mm_div_ps(a, b); }
+		inline F4 sqrt(F4 a) { return _mm_sqrt_ps(a); }
+		inline F4 min(F4 a, F4 b) { return _mm_min_ps(a, b); }
+		inline F4 max(F4 a, F4 b) { return _mm_max_ps(a, b); }
+		inline F4 abs(F4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+		// Returns a where mask is set, b otherwise.
+		inline F4 select(F4 mask, F4 a, F4 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+		inline F4 less(F4 a, F4 b) { return _mm_cmplt_ps(a, b); }
+		// Copies the sign bit of s onto a.
+		inline F4 copysign(F4 a, F4 s) {
+			F4 sign = _mm_set1_ps(-0.0f);
+			return _mm_or_ps(_mm_andnot_ps(sign, a), _mm_and_ps(sign, s));
+		}
+#elif defined(GDANAGLYPH_SIMD_NEON)
+		typedef float32x4_t F4;
+		inline F4 set1(float f) { return vdupq_n_f32(f); }
+		inline F4 load(const float* p) { return vld1q_f32(p); }
+		inline void store(float* p, F4 v) { vst1q_f32(p, v); }
+		inline F4 add(F4 a, F4 b) { return vaddq_f32(a, b); }
+		inline F4 sub(F4 a, F4 b) { return vsubq_f32(a, b); }
+		inline F4 mul(F4 a, F4 b) { return vmulq_f32(a, b); }
+		inline F4 div(F4 a, F4 b) { return vdivq_f32(a, b); }
+		inline F4 sqrt(F4 a) { return vsqrtq_f32(a); }
+		inline F4 min(F4 a, F4 b) { return vminq_f32(a, b); }
+		inline F4 max(F4 a, F4 b) { return vmaxq_f32(a, b); }
+		inline F4 abs(F4 a) { return vabsq_f32(a); }
+		inline F4 select(F4 mask, F4 a, F4 b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+		inline F4 less(F4 a, F4 b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+		inline F4 copysign(F4 a, F4 s) {
+			uint32x4_t sign = vdupq_n_u32(0x80000000u);
+			return vbslq_f32(sign, s, a);
+		}
+#else
+		struct F4 {
+			float v[4];
+		};
+		inline F4 set1(float f) { F4 r; for (int i = 0; i < 4; i++) r.v[i] = f; return r; }
+		inline F4 load(const float* p) { F4 r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+		inline void store(float* p, F4 a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+		inline F4 add(F4 a, F4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+		inline F4 sub(F4 a, F4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+		inline F4 mul(F4 a, F4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+		inline F4 div(F4 a, F4 b) { for (int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+		inline F4 sqrt(F4 a) { for (int i = 0; i < 4; i++) a.v[i] = sqrtf(a.v[i]); return a; }
+		inline F4 min(F4 a, F4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+		inline F4 max(F4 a, F4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+		inline F4 abs(F4 a) { for (int i = 0; i < 4; i++) a.v[i] = fabsf(a.v[i]); return a; }
+		// (Masks are stored as 0 or 1.)
+		inline F4 select(F4 mask, F4 a, F4 b) { for (int i = 0; i < 4; i++) a.v[i] = mask.v[i] != 0 ? a.v[i] : b.v[i]; return a; }
+		inline F4 less(F4 a, F4 b) { F4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] < b.v[i] ? 1.0f : 0.0f; return r; }
+		inline F4 copysign(F4 a, F4 s) { for (int i = 0; i < 4; i++) a.v[i] = copysignf(a.v[i], s.v[i]); return a; }
+#endif
+
+		// atan2(y, x) for four lanes at once.
+		// First reduce to atan(a) with a in [0,1], and use a minimax
+		// polynomial there. Then undo the reduction with the usual octant
+		// fixups. atan2(0, 0) gives 0, just like the old code special-cased.
+		inline F4 atan2(F4 y, F4 x) {
+			F4 ax = abs(x);
+			F4 ay = abs(y);
+			F4 hi = max(ax, ay);
+			F4 lo = min(ax, ay);
+			// (The max prevents 0/0.)
+			F4 a = div(lo, max(hi, set1(1e-30f)));
+			F4 s = mul(a, a);
+			F4 p = set1(-0.0117212f);
+			p = add(mul(p, s), set1(0.05265332f));
+			p = add(mul(p, s), set1(-0.11643287f));
+			p = add(mul(p, s), set1(0.19354346f));
+			p = add(mul(p, s), set1(-0.33262347f));
+			p = add(mul(p, s), set1(0.99997726f));
+			F4 r = mul(p, a);
+			// |y| > |x|: atan(y/x) = pi/2 - atan(x/y)
+			r = select(less(ax, ay), sub(set1(1.57079637f), r), r);
+			// x < 0: mirror into the left half
+			r = select(less(x, set1(0.0f)), sub(set1(3.14159274f), r), r);
+			return copysign(r, y);
+		}
+
+		// The actual kernel, four sources at once.
+		inline void polar4(
+			const AnaglyphSIMD::ListenerFrame& frame,
+			const float* px, const float* py, const float* pz,
+			float* out_azimuth, float* out_elevation, float* out_distance
+		) {
+			const float* m = frame.rotation;
+			F4 dx = sub(load(px), set1(frame.position[0]));
+			F4 dy = sub(load(py), set1(frame.position[1]));
+			F4 dz = sub(load(pz), set1(frame.position[2]));
+
+			// Rotate into listener space, and flip handedness.
+			F4 rx = add(add(mul(set1(m[0]), dx), mul(set1(m[1]), dy)), mul(set1(m[2]), dz));
+			F4 ry = add(add(mul(set1(m[3]), dx), mul(set1(m[4]), dy)), mul(set1(m[5]), dz));
+			F4 rz = add(add(mul(set1(m[6]), dx), mul(set1(m[7]), dy)), mul(set1(m[8]), dz));
+			rz = sub(set1(0.0f), rz);
+
+			F4 horizontal_sq = add(mul(rx, rx), mul(rz, rz));
+			F4 horizontal = sqrt(horizontal_sq);
+			F4 dist = sqrt(add(horizontal_sq, mul(ry, ry)));
+			dist = max(dist, set1(0.001f));
+
+			const F4 rad2deg = set1(57.2957805f);
+			store(out_azimuth, mul(atan2(rx, rz), rad2deg));
+			store(out_elevation, mul(atan2(ry, horizontal), rad2deg));
+			store(out_distance, dist);
+		}
+	}
+
+	inline void AnaglyphSIMD::cartesian_to_polar(
+		const ListenerFrame& frame,
+		const float* px, const float* py, const float* pz,
+		float* out_azimuth, float* out_elevation, float* out_distance,
+		int count
+	) {
+		int i = 0;
+		for (; i + 4 <= count; i += 4) {
+			anaglyph_simd_internal::polar4(
+				frame, px + i, py + i, pz + i,
+				out_azimuth + i, out_elevation + i, out_distance + i
+			);
+		}
+		int remaining = count - i;
+		if (remaining == 0) {
+			return;
+		}
+		// Pad the last few into a full register.
+		float tail_in[3][4] = {};
+		float tail_out[3][4];
+		for (int j = 0; j < remaining; j++) {
+			tail_in[0][j] = px[i + j];
+			tail_in[1][j] = py[i + j];
+			tail_in[2][j] = pz[i + j];
+		}
+		anaglyph_simd_internal::polar4(
+			frame, tail_in[0], tail_in[1], tail_in[2],
+			tail_out[0], tail_out[1], tail_out[2]
+		);
+		for (int j = 0; j < remaining; j++) {
+			out_azimuth[i + j] = tail_out[0][j];
+			out_elevation[i + j] = tail_out[1][j];
+			out_distance[i + j] = tail_out[2][j];
+		}
+	}
+
+	inline void AnaglyphSIMD::complex_multiply_accumulate(
+		const float* a_re, const float* a_im,
+		const float* b_re, const float* b_im,
+		float* acc_re, float* acc_im,
+		int count
+	) {
+		using namespace anaglyph_simd_internal;
+		int i = 0;
+		for (; i + 4 <= count; i += 4) {
+			F4 ar = load(a_re + i);
+			F4 ai = load(a_im + i);
+			F4 br = load(b_re + i);
+			F4 bi = load(b_im + i);
+			F4 re = sub(mul(ar, br), mul(ai, bi));
+			F4 im = add(mul(ar, bi), mul(ai, br));
+			store(acc_re + i, add(load(acc_re + i), re));
+			store(acc_im + i, add(load(acc_im + i), im));
+		}
+		for (; i < count; i++) {
+			acc_re[i] += a_re[i] * b_re[i] - a_im[i] * b_im[i];
+			acc_im[i] += a_re[i] * b_im[i] + a_im[i] * b_re[i];
+		}
+	}
+
+	inline void AnaglyphSIMD::scale_accumulate(
+		const float* in,
+		float start_gain, float end_gain,
+		float* acc,
+		int count
+	) {
+		using namespace anaglyph_simd_internal;
+		if (count <= 0) {
+			return;
+		}
+		float step = (end_gain - start_gain) / count;
+		int i = 0;
+		if (step == 0) {
+			F4 g = set1(end_gain);
+			for (; i + 4 <= count; i += 4) {
+				store(acc + i, add(load(acc + i), mul(load(in + i), g)));
+			}
+		}
+		else {
+			// The gains of lanes i..i+3, advanced by four steps at a time.
+			float lanes[4] = { start_gain + step, start_gain + 2 * step, start_gain + 3 * step, start_gain + 4 * step };
+			F4 g = load(lanes);
+			F4 g_step = set1(4 * step);
+			for (; i + 4 <= count; i += 4) {
+				store(acc + i, add(load(acc + i), mul(load(in + i), g)));
+				g = add(g, g_step);
+			}
+		}
+		for (; i < count; i++) {
+			acc[i] += in[i] * (start_gain + step * (i + 1));
+		}
+	}
+
+	inline void AnaglyphSIMD::symmetric_fir(
+		const float* in,
+		const float* coeffs, int half_taps,
+		float* out,
+		int count
+	) {
+		using namespace anaglyph_simd_internal;
+		// Four outputs at a time, going over the taps on the outside. The
+		// taps are few (and the same for all four), so this stays in
+		// registers.
+		int i = 0;
+		for (; i + 4 <= count; i += 4) {
+			F4 acc = set1(0.0f);
+			const float* center = in + i + half_taps;
+			for (int m = 0; m < half_taps; m++) {
+				F4 pair = add(load(center - 1 - m), load(center + m));
+				acc = add(acc, mul(set1(coeffs[m]), pair));
+			}
+			store(out + i, acc);
+		}
+		for (; i < count; i++) {
+			float acc = 0;
+			const float* center = in + i + half_taps;
+			for (int m = 0; m < half_taps; m++) {
+				acc += coeffs[m] * (center[-1 - m] + center[m]);
+			}
+			out[i] = acc;
+		}
+	}
+
+	inline float AnaglyphSIMD::atan2_approx(float y, float x) {
+		float in_y[4] = { y, 0, 0, 0 };
+		float in_x[4] = { x, 0, 0, 0 };
+		float out[4];
+		anaglyph_simd_internal::store(
+			out,
+			anaglyph_simd_internal::atan2(
+				anaglyph_simd_internal::load(in_y),
+				anaglyph_simd_internal::load(in_x)
+			)
+		);
+		return out[0];
+	}
+}
+
+#endif // GDANAGLYPH_SIMD
\ No newline at end of file
@@ -0,0 +1,250 @@
+#include "audio_stream_anaglyph.h"
+#include "anaglyph_dll_bridge.h"
+#include "helpers.h"
+
+#include <godot_cpp/classes/audio_server.hpp>
+#include <godot_cpp/core/mutex_lock.hpp>
+#include <string.h>
+
+using namespace godot;
+
+AudioStreamPlaybackAnaglyph::AudioStreamPlaybackAnaglyph() {
+	active = false;
+	position = 0;
+	tail_left = 0;
+	loops = 0;
+	mutex.instantiate();
+	polar_position = Vector3(0, 0, 1);
+	own_polar_position = false;
+	reset_requested = false;
+	out_read = 0;
+}
+
+AudioStreamPlaybackAnaglyph::~AudioStreamPlaybackAnaglyph() { }
+
+void AudioStreamPlaybackAnaglyph::_start(double from_pos) {
+	// Whatever the previous play left in Anaglyph shouldn't be heard.
+	{
+		MutexLock lock(*mutex.ptr());
+		reset_requested = true;
+	}
+	position = 0;
+	loops = 0;
+	_seek(from_pos);
+	tail_left = (int64_t)(base->tail_time * AudioServer::get_singleton()->get_mix_rate());
+	// (Nothing rendered yet.)
+	out_read = out_block.size();
+	active = true;
+}
+
+void AudioStreamPlaybackAnaglyph::_stop() {
+	active = false;
+}
+
+bool AudioStreamPlaybackAnaglyph::_is_playing() const {
+	return active;
+}
+
+int32_t AudioStreamPlaybackAnaglyph::_get_loop_count() const {
+	return loops;
+}
+
+double AudioStreamPlaybackAnaglyph::_get_playback_position() const {
+	return position / wav->get_mix_rate();
+}
+
+void AudioStreamPlaybackAnaglyph::_seek(double p_position) {
+	position = CLAMP(p_position, 0.0, wav->get_length()) * wav->get_mix_rate();
+}
+
+void AudioStreamPlaybackAnaglyph::render_block(double rate_scale) {
+	AudioFrame* in = in_block.ptrw();
+	int block = in_block.size();
+	bool looping = wav->get_loop_mode() != AudioStreamWAV::LOOP_DISABLED;
+	int64_t loop_begin = wav->get_loop_begin();
+	int64_t loop_end = wav->get_loop_end() > loop_begin ? wav->get_loop_end() : reader.frames;
+	// Source frames per output frame. (Other loop modes than forward are
+	// played forward as well.)
+	double step = wav->get_mix_rate() / (double)AudioServer::get_singleton()->get_mix_rate() * rate_scale;
+
+	for (int i = 0; i < block; i++) {
+		if (position >= reader.frames && !looping) {
+			in[i] = AudioFrame();
+			tail_left--;
+			continue;
+		}
+		int64_t base_frame = (int64_t)position;
+		float t = (float)(position - base_frame);
+		AudioFrame a = reader.get_frame(base_frame);
+		AudioFrame b = reader.get_frame(looping && base_frame + 1 >= loop_end ? loop_begin : base_frame + 1);
+		in[i].left = a.left + (b.left - a.left) * t;
+		in[i].right = a.right + (b.right - a.right) * t;
+		position += step;
+		if (looping && position >= loop_end) {
+			position -= loop_end - loop_begin;
+			loops++;
+		}
+	}
+
+	effect->process(in, out_block.ptrw(), block);
+	out_read = 0;
+}
+
+int32_t AudioStreamPlaybackAnaglyph::_mix(AudioFrame* buffer, double rate_scale, int32_t frames) {
+	// (On the audio thread, so that it doesn't race with processing.)
+	bool reset;
+	{
+		MutexLock lock(*mutex.ptr());
+		reset = reset_requested;
+		reset_requested = false;
+	}
+	if (reset) {
+		// We're the only one processing this effect, so there's nothing to
+		// wait for.
+		effect->reset_state_unlocked();
+	}
+	Vector3 polar = get_polar_position();
+	effect->set_azimuth(polar.x);
+	effect->set_elevation(polar.y);
+	effect->set_distance(polar.z);
+
+	int written = 0;
+	int block = out_block.size();
+	while (written < frames) {
+		if (out_read >= block) {
+			if (!active || tail_left <= 0) {
+				break;
+			}
+			render_block(rate_scale);
+		}
+		int count = MIN(frames - written, block - out_read);
+		memcpy(buffer + written, out_block.ptr() + out_read, count * sizeof(AudioFrame));
+		out_read += count;
+		written += count;
+	}
+	for (int i = written; i < frames; i++) {
+		buffer[i] = AudioFrame();
+	}
+	// Only done once the last block has been handed out in full. Any
+	// earlier, and the player stops mixing us with part of it still unheard.
+	if (tail_left <= 0 && out_read >= block) {
+		active = false;
+	}
+	return frames;
+}
+
+void AudioStreamPlaybackAnaglyph::set_polar_position(const Vector3 polar) {
+	MutexLock lock(*mutex.ptr());
+	polar_position = polar;
+	own_polar_position = true;
+}
+
+Vector3 AudioStreamPlaybackAnaglyph::get_polar_position() const {
+	{
+		MutexLock lock(*mutex.ptr());
+		if (own_polar_position) {
+			return polar_position;
+		}
+	}
+	return base->get_polar_position();
+}
+
+void AudioStreamPlaybackAnaglyph::_bind_methods() {
+	REGISTER(VECTOR3, polar_position, AudioStreamPlaybackAnaglyph, "polar", PROPERTY_HINT_NONE, "");
+}
+
+AudioStreamAnaglyph::AudioStreamAnaglyph() {
+	mutex.instantiate();
+	polar_position = Vector3(0, 0, 1);
+	tail_time = 1;
+}
+
+AudioStreamAnaglyph::~AudioStreamAnaglyph() { }
+
+Ref<AudioStreamPlayback> AudioStreamAnaglyph::_instantiate_playback() const {
+	if (stream == nullptr) {
+		AnaglyphHelpers::print_error("AudioStreamAnaglyph has no stream to play.");
+		return Ref<AudioStreamPlayback>();
+	}
+	Ref<AudioStreamPlaybackAnaglyph> playback;
+	playback.instantiate();
+	playback->base = Ref<AudioStreamAnaglyph>(const_cast<AudioStreamAnaglyph*>(this));
+	playback->wav = stream;
+	playback->bytes = stream->get_data();
+	// (The rate only matters to the reader's own resampling, which isn't
+	//  used here.)
+	if (!playback->reader.init(stream, playback->bytes, stream->get_mix_rate())) {
+		return Ref<AudioStreamPlayback>();
+	}
+
+	// Every playback is its own instance, with its own copy of the settings.
+	Ref<AnaglyphEffectData> data;
+	data.instantiate();
+	if (anaglyph_settings != nullptr) {
+		data->copy_from(anaglyph_settings);
+	}
+	playback->effect.instantiate();
+	playback->effect->set_effect_data(data);
+
+	int block = AnaglyphBridge::get_dsp_buffer_size();
+	playback->in_block.resize(block);
+	playback->out_block.resize(block);
+	playback->out_read = block;
+	return playback;
+}
+
+String AudioStreamAnaglyph::_get_stream_name() const {
+	return stream != nullptr ? stream->get_name() : String();
+}
+
+double AudioStreamAnaglyph::_get_length() const {
+	return stream != nullptr ? stream->get_length() : 0.0;
+}
+
+void AudioStreamAnaglyph::set_stream(const Ref<AudioStreamWAV>& p_stream) {
+	if (p_stream != nullptr) {
+		AudioStreamWAV::Format format = p_stream->get_format();
+		if (format != AudioStreamWAV::FORMAT_8_BITS && format != AudioStreamWAV::FORMAT_16_BITS) {
+			AnaglyphHelpers::print_error("AudioStreamAnaglyph can only play 8 or 16 bit AudioStreamWAVs (this one is compressed). Re-import it without compression.");
+			return;
+		}
+	}
+	stream = p_stream;
+}
+
+Ref<AudioStreamWAV> AudioStreamAnaglyph::get_stream() const {
+	return stream;
+}
+
+void AudioStreamAnaglyph::set_anaglyph_settings(const Ref<AnaglyphEffectData>& settings) {
+	anaglyph_settings = settings;
+}
+
+Ref<AnaglyphEffectData> AudioStreamAnaglyph::get_anaglyph_settings() const {
+	return anaglyph_settings;
+}
+
+void AudioStreamAnaglyph::set_polar_position(const Vector3 polar) {
+	MutexLock lock(*mutex.ptr());
+	polar_position = polar;
+}
+
+Vector3 AudioStreamAnaglyph::get_polar_position() const {
+	MutexLock lock(*mutex.ptr());
+	return polar_position;
+}
+
+void AudioStreamAnaglyph::set_tail_time(const float seconds) {
+	tail_time = CLAMP(seconds, 0, 10);
+}
+
+float AudioStreamAnaglyph::get_tail_time() const {
+	return tail_time;
+}
+
+void AudioStreamAnaglyph::_bind_methods() {
+	REGISTER(OBJECT, stream, AudioStreamAnaglyph, "stream", PROPERTY_HINT_RESOURCE_TYPE, "AudioStreamWAV");
+	REGISTER(OBJECT, anaglyph_settings, AudioStreamAnaglyph, "settings", PROPERTY_HINT_RESOURCE_TYPE, "AnaglyphEffectData");
+	REGISTER(VECTOR3, polar_position, AudioStreamAnaglyph, "polar", PROPERTY_HINT_NONE, "");
+	REGISTER(FLOAT, tail_time, AudioStreamAnaglyph, "seconds", PROPERTY_HINT_RANGE, "0,10,0.01,suffix:s");
+}
\ No newline at end of file
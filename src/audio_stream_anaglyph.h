@@ -0,0 +1,136 @@
+#ifndef GDANAGLYPH_AUDIO_STREAM
+#define GDANAGLYPH_AUDIO_STREAM
+
+#include "anaglyph_effect.h"
+#include "anaglyph_offline_renderer.h"
+#include "register_macro.h"
+
+#include <godot_cpp/classes/audio_stream.hpp>
+#include <godot_cpp/classes/audio_stream_playback.hpp>
+#include <godot_cpp/classes/audio_stream_wav.hpp>
+#include <godot_cpp/classes/mutex.hpp>
+#include <godot_cpp/templates/vector.hpp>
+
+namespace godot {
+	class AudioStreamAnaglyph;
+
+	// One playing AudioStreamAnaglyph. This has its own AnaglyphEffect
+	// (which isn't on any bus), and runs it on its own output in `_mix()`.
+	class AudioStreamPlaybackAnaglyph : public AudioStreamPlayback {
+		GDCLASS(AudioStreamPlaybackAnaglyph, AudioStreamPlayback);
+		friend class AudioStreamAnaglyph;
+
+		Ref<AudioStreamAnaglyph> base;
+		Ref<AudioStreamWAV> wav;
+		// (The reader points into this, so keep it alive.)
+		PackedByteArray bytes;
+		AnaglyphOfflineRenderer::WAVReader reader;
+		Ref<AnaglyphEffect> effect;
+
+		bool active;
+		// In source frames.
+		double position;
+		// Output frames of silence still to go through Anaglyph after the
+		// source ended, for the reverb tail.
+		int64_t tail_left;
+		int loops;
+
+		// Guards the three below, which are written from anywhere and
+		// picked up by `_mix()`.
+		Ref<Mutex> mutex;
+		Vector3 polar_position;
+		// Whether `polar_position` was set on this playback, instead of
+		// following the stream's.
+		bool own_polar_position;
+		// `_start()` may be called from inside the mix, where resetting
+		// (which waits for the mix) can't happen. So `_mix()` does it.
+		bool reset_requested;
+
+		// Anaglyph (well, the dll) only takes blocks of exactly
+		// `AnaglyphBridge::get_dsp_buffer_size()`, while `_mix()` may be
+		// asked for any amount. So render whole blocks, and hand them out
+		// over as many mixes as it takes.
+		Vector<AudioFrame> in_block;
+		Vector<AudioFrame> out_block;
+		int out_read;
+
+		// Renders the next block into `out_block`.
+		void render_block(double rate_scale);
+
+	protected:
+		static void _bind_methods();
+
+	public:
+		AudioStreamPlaybackAnaglyph();
+		~AudioStreamPlaybackAnaglyph();
+
+		void _start(double from_pos) override;
+		void _stop() override;
+		bool _is_playing() const override;
+		int32_t _get_loop_count() const override;
+		double _get_playback_position() const override;
+		void _seek(double position) override;
+		int32_t _mix(AudioFrame* buffer, double rate_scale, int32_t frames) override;
+
+		// (azimuth, elevation, distance), as `AnaglyphEffect.calculate_polar_position()`
+		// gives. Once set, this playback stops following the stream's.
+		void set_polar_position(const Vector3 polar);
+		Vector3 get_polar_position() const;
+	};
+
+	// Wraps an AudioStreamWAV so that it comes out binaural, without any
+	// bus of its own. Every playback does its own Anaglyph processing in its
+	// `_mix()`, so this can go in an ordinary AudioStreamPlayer (or be one
+	// of the streams of an AudioStreamPolyphonic), on any bus. Nothing about
+	// the bus layout changes on play or stop.
+	// The price is that nothing is shared: every voice is a full Anaglyph
+	// instance, no matter how many there are.
+	//
+	// Godot 4.3 gives extensions no way to mix another AudioStream's
+	// playback (AudioStreamPlayback::mix_audio only exists from 4.4 on), so
+	// just like the offline renderer this decodes uncompressed
+	// AudioStreamWAVs by hand, and takes nothing else.
+	class AudioStreamAnaglyph : public AudioStream {
+		GDCLASS(AudioStreamAnaglyph, AudioStream);
+		friend class AudioStreamPlaybackAnaglyph;
+
+		Ref<AudioStreamWAV> stream;
+		Ref<AnaglyphEffectData> anaglyph_settings;
+		// Guards `polar_position`, which playbacks read from the mix.
+		Ref<Mutex> mutex;
+		Vector3 polar_position;
+		float tail_time;
+
+	protected:
+		static void _bind_methods();
+
+	public:
+		AudioStreamAnaglyph();
+		~AudioStreamAnaglyph();
+
+		Ref<AudioStreamPlayback> _instantiate_playback() const override;
+		String _get_stream_name() const override;
+		double _get_length() const override;
+
+		// The sound to play. Must be uncompressed.
+		void set_stream(const Ref<AudioStreamWAV>& p_stream);
+		Ref<AudioStreamWAV> get_stream() const;
+
+		// Copied into every playback when it's created, so changes only
+		// apply to the next ones.
+		void set_anaglyph_settings(const Ref<AnaglyphEffectData>& settings);
+		Ref<AnaglyphEffectData> get_anaglyph_settings() const;
+
+		// Where all playbacks are that weren't given a position of their
+		// own, as (azimuth, elevation, distance).
+		void set_polar_position(const Vector3 polar);
+		Vector3 get_polar_position() const;
+
+		// How long to keep processing after the sound ended, so that
+		// Anaglyph's latency and reverb aren't cut off.
+		void set_tail_time(const float seconds);
+		float get_tail_time() const;
+	};
+}
+
+#endif // GDANAGLYPH_AUDIO_STREAM
\ No newline at end of file
@@ -1,10 +1,12 @@
 #include "audio_stream_player_anaglyph.h"
 #include "anaglyph_bus_manager.h"
 #include "anaglyph_dll_bridge.h"
+#include "anaglyph_listener_registry.h"
+#include "anaglyph_oneshot_pool.h"
+#include "anaglyph_position_server.h"
+#include "anaglyph_render_cache.h"
 #include "helpers.h"
 
-#include <godot_cpp/classes/audio_listener3d.hpp>
-#include <godot_cpp/classes/camera3d.hpp>
 #include <godot_cpp/classes/engine.hpp>
 #include <godot_cpp/classes/main_loop.hpp>
 #include <godot_cpp/classes/scene_tree.hpp>
@@ -13,6 +15,7 @@
 using namespace godot;
 
 bool AudioStreamPlayerAnaglyph::anaglyph_enabled = true;
+const float AudioStreamPlayerAnaglyph::virtual_hysteresis_db = 3;
 
 AudioStreamPlayerAnaglyph::AudioStreamPlayerAnaglyph() {
 	runtime_players = Players{};
@@ -29,23 +32,47 @@ AudioStreamPlayerAnaglyph::AudioStreamPlayerAnaglyph() {
 	bus = StringName("Master");
 
 	max_anaglyph_range = 10;
+	max_panner_range = 30;
+	mid_tier = MID_TIER_PANNER;
+	range_hysteresis = 1;
+	prewarm_time = 1;
 	forcing = FORCE_NONE;
+	bus_reuse = BUS_REUSE_AFTER_DRAIN;
 
 	dupe_protection = true;
 	delete_on_finish = false;
+	pooled = false;
+
+	using_anaglyph = false;
+	previous_distance = 0;
+	has_previous_distance = false;
+	radial_speed = 0;
+	last_borrow_attempt_msec = 0;
+	leaving_cluster = false;
+	fallback_panning_strength = 1;
+	last_mid_tier_attempt_msec = 0;
+	position_slot = -1;
+
+	path_state = PATH_FALLBACK;
+	anaglyph_mix = 0;
+	transition_to_anaglyph = false;
+	transition_time = 0.2;
+	snap_path = true;
+
+	is_virtual = false;
+	virtual_position = 0;
+	// Off. The estimate doesn't know Anaglyph's own attenuation, so it's up
+	// to the user to pick a threshold that suits their settings.
+	virtual_threshold_db = -120;
 
 	set_process_internal(true);
 }
 
 AudioStreamPlayerAnaglyph::~AudioStreamPlayerAnaglyph() {
-	// This shouldn't be needed, but in case someone frees a node that's still
-	// playing at the time.
-	// Like, who does that?
-	// But hey, just in case.
-	// (its 2300pm im probably fucking up destructor order hey future self TODO)
-	if (!Engine::get_singleton()->is_editor_hint()) {
-		return_anaglyph();
-	}
+	// Buses are returned on NOTIFICATION_PREDELETE already, while this node
+	// is still in a sensible state. Anything that slips through (the bus
+	// manager does not care about destructor order) gets swept up by the
+	// bus manager itself, as it tracks us by ObjectID.
 }
 
 bool AudioStreamPlayerAnaglyph::get_players(AudioStreamPlayerAnaglyph::Players& players) const {
@@ -85,6 +112,17 @@ void AudioStreamPlayerAnaglyph::_notification(int what) {
 	else if (what == NOTIFICATION_ENTER_TREE) {
 		enter_tree();
 	}
+	else if (what == NOTIFICATION_EXIT_TREE) {
+		exit_tree();
+	}
+	else if (what == NOTIFICATION_PREDELETE) {
+		// Someone freed us while playing. Like, who does that?
+		// But hey, just in case.
+		if (!Engine::get_singleton()->is_editor_hint()) {
+			return_anaglyph();
+			return_mid_tier();
+		}
+	}
 	else if (what == NOTIFICATION_INTERNAL_PROCESS) {
 		process();
 	}
@@ -102,17 +140,9 @@ PackedStringArray AudioStreamPlayerAnaglyph::_get_configuration_warnings() const
 }
 
 Node3D* AudioStreamPlayerAnaglyph::get_listener_node() const {
-	// I would've liked to copy the following code as verbatim as possible.
-	// Unfortunately, Viewport::get_audio_listener_3d() is not exposed.
-	// https://github.com/godotengine/godot/blob/e7c39efdb15eaaeb133ed8d0ff0ba0891f8ca676/scene/3d/audio_stream_player_3d.cpp#L355
-	// So instead just give up and return the camera's position.
-	// (I could add a method and ask the user to explicitly register the listener
-	//  node, but that feels very awkward.)
-	// TOOD: Not much I can do about it here, but what happens when you have
-	// multiple viewports/cameras?
-	Viewport* vp = get_viewport();
-	Camera3D* active_camera = vp->get_camera_3d();
-	return active_camera;
+	// Viewport::get_audio_listener_3d() is not exposed, so the registry keeps
+	// track of the AudioListener3Ds (and otherwise cameras) for us.
+	return AnaglyphListenerRegistry::get_singleton()->get_listener_node(get_viewport());
 }
 
 bool AudioStreamPlayerAnaglyph::try_add_children() {
@@ -144,6 +174,38 @@ void AudioStreamPlayerAnaglyph::enter_tree() {
 		players.anaglyph->set_owner(scene_root);
 		players.fallback->set_owner(scene_root);
 	}
+
+	if (!Engine::get_singleton()->is_editor_hint()) {
+		position_slot = AnaglyphPositionServer::get_singleton()->register_source(this);
+		// We decide which child plays, so they shouldn't start themselves.
+		// (They enter the tree after us, so this is in time.)
+		if (get_players(players)) {
+			players.anaglyph->set_autoplay(false);
+			players.fallback->set_autoplay(false);
+		}
+	}
+
+	// The children pause themselves when leaving the tree, and unpause when
+	// entering it again. If we were playing when we left, we gave our bus
+	// back, so grab one again if we need it.
+	if (!Engine::get_singleton()->is_editor_hint()
+		&& borrowed_bus.is_empty()
+		&& !user_bus.is_empty()
+		&& get_playing()
+	) {
+		reserve_anaglyph_if_needed();
+	}
+}
+
+void AudioStreamPlayerAnaglyph::exit_tree() {
+	// Leaving the tree pauses the children, so there's no point in holding
+	// on to a bus.
+	if (!Engine::get_singleton()->is_editor_hint()) {
+		return_anaglyph();
+		return_mid_tier();
+		AnaglyphPositionServer::get_singleton()->unregister_source(position_slot);
+		position_slot = -1;
+	}
 }
 
 void AudioStreamPlayerAnaglyph::ready() {
@@ -178,12 +240,19 @@ void AudioStreamPlayerAnaglyph::ready() {
 		anaglyph_data = anaglyph_data->duplicate();
 	}
 
-	// (The two child players should at all times be synced)
+	// Either child may be the one that finishes.
 	runtime_players.anaglyph->connect("finished", Callable(this, "_finish_signal_handler_internal_do_not_call"));
+	runtime_players.fallback->connect("finished", Callable(this, "_finish_signal_handler_internal_do_not_call"));
 
 	user_bus = bus;
+	fallback_panning_strength = runtime_players.fallback->get_panning_strength();
+	// Start out on the fallback, until we know where we are.
+	path_state = PATH_FALLBACK;
+	anaglyph_mix = 0;
+	snap_path = true;
+	apply_routing();
 	if (autoplay) {
-		borrow_anaglyph();
+		play();
 	}
 }
 
@@ -199,57 +268,455 @@ void AudioStreamPlayerAnaglyph::process() {
 		return;
 	}
 
+	AnaglyphBusManager::get_singleton()->poll();
+
 	// Only run when playing. (The other definition.)
 	if (!get_playing()) {
 		return;
 	}
 
 	// Get the anaglyph positional parameters
-	Node3D* camera = get_listener_node();
-	if (camera == nullptr) {
-		AnaglyphHelpers::print_warning("This scene has no 3D camera.\nThis AudioStreamPlayerAnaglyph has been removed from the scene.");
+	Vector3 polar;
+	if (!get_polar_position(polar)) {
+		AnaglyphHelpers::print_warning("This scene has no 3D camera or AudioListener3D.\nThis AudioStreamPlayerAnaglyph has been removed from the scene.");
 		get_parent()->remove_child(this);
 		this->queue_free();
 		return;
 	}
-	Vector3 polar = AnaglyphHelpers::calculate_polar_position(this, camera);
-	polar.z /= unit_size;
 
+	// Too quiet to hear, so don't bother decoding or spatializing at all.
+	float delta = (float)get_process_delta_time();
+	float loudness = estimate_loudness_db(polar);
+	if (is_virtual) {
+		if (!advance_virtual(delta)) {
+			// Ran out while no-one was listening.
+			is_virtual = false;
+			finish_signal();
+			return;
+		}
+		if (get_stream_paused() || loudness < virtual_threshold_db + virtual_hysteresis_db) {
+			return;
+		}
+		devirtualize();
+		return;
+	}
+	if (loudness < virtual_threshold_db && can_virtualize()) {
+		virtualize();
+		return;
+	}
+
+	update_reservation(polar, delta);
+	update_mid_tier(polar, delta);
+
+	bool use_anaglyph = wants_anaglyph_path(polar);
+	using_anaglyph = use_anaglyph;
+
+	// A reserved bus gets positions even when we're not using it yet, so the
+	// crossfade inside Anaglyph is already done by the time we switch.
+	// If we share it, the manager puts it between all of us instead.
+	if (has_anaglyph()) {
+		AnaglyphBusManager::ClusterPlacement placement = AnaglyphBusManager::get_singleton()->place_cluster_member(borrowed_bus, ObjectID(get_instance_id()), polar);
+		if (placement == AnaglyphBusManager::CLUSTER_NONE) {
+			borrowed_effect->set_azimuth(polar.x);
+			borrowed_effect->set_elevation(polar.y);
+			borrowed_effect->set_distance(polar.z);
+		}
+		else if (placement == AnaglyphBusManager::CLUSTER_DRIFTED) {
+			leaving_cluster = true;
+		}
+	}
+
+	update_path(use_anaglyph, (float)get_process_delta_time());
+}
+
+bool AudioStreamPlayerAnaglyph::wants_anaglyph_path(const Vector3& polar) const {
 	// Decide whether to process Anaglyph or the fallback.
 	// Switching between Anaglyph and the fallback should be as smooth as
 	// possible as it can happen at any time for a variety of reasons.
 	// Priority: global override > local override > default behaviour.
-	bool use_anaglyph = polar.z < max_anaglyph_range;
+	// Once we're in Anaglyph range, we stay there until we're a bit beyond
+	// it, so we don't flip-flop when someone's standing on the boundary.
+	float range = max_anaglyph_range;
+	if (using_anaglyph) {
+		range += range_hysteresis;
+	}
+	bool use_anaglyph = polar.z < range;
 	if (forcing == FORCE_ANAGLYPH_ON) {
 		use_anaglyph = true;
 	}
-	else if (forcing == FORCE_ANAGLYPH_OFF) {
-		use_anaglyph = false;
-	}
-	if (!get_anaglyph_enabled()) {
+	if (!anaglyph_allowed()) {
 		use_anaglyph = false;
 	}
 
 	// In *very* rare cases where I *really* hate users, this *might* happen.
 	// You'd have to ignore pretty much every warning in the documentation thuohg.
-	use_anaglyph &= borrowed_effect != nullptr;
+	// (Or, much more likely, the pool has run out.)
+	use_anaglyph &= has_anaglyph();
+	// Fade out of a cluster we've left, before looking for a new bus.
+	use_anaglyph &= !leaving_cluster;
+	return use_anaglyph;
+}
+
+bool AudioStreamPlayerAnaglyph::keeps_both_paths_running() const {
+	return max_polyphony > 1;
+}
+
+void AudioStreamPlayerAnaglyph::start_path(bool anaglyph_path) {
+	AudioStreamPlayer* a = runtime_players.anaglyph;
+	AudioStreamPlayer3D* f = runtime_players.fallback;
+	if (a == nullptr || f == nullptr) {
+		return;
+	}
+	if (anaglyph_path ? a->is_playing() : f->is_playing()) {
+		return;
+	}
+	// Nothing to continue from.
+	if (anaglyph_path ? !f->is_playing() : !a->is_playing()) {
+		return;
+	}
 
+	// godot-cpp has no way to feed one decoded stream into two players (no
+	// AudioStreamPlayback::mix_audio until 4.4), so instead we start the
+	// other child where this one is. The playback position is where the
+	// next mix continues from, and play() also starts at the next mix, so
+	// this lines up to within a mix chunk. During the crossfade that's not
+	// noticeable.
+	if (anaglyph_path) {
+		bool paused = f->get_stream_paused();
+		a->play(f->get_playback_position());
+		a->set_stream_paused(paused);
+	}
+	else {
+		bool paused = a->get_stream_paused();
+		f->play(a->get_playback_position());
+		f->set_stream_paused(paused);
+	}
+}
+
+void AudioStreamPlayerAnaglyph::stop_path(bool anaglyph_path) {
+	if (keeps_both_paths_running()) {
+		return;
+	}
+	if (runtime_players.anaglyph == nullptr || runtime_players.fallback == nullptr) {
+		return;
+	}
+	if (anaglyph_path) {
+		runtime_players.anaglyph->stop();
+	}
+	else {
+		runtime_players.fallback->stop();
+	}
+}
+
+void AudioStreamPlayerAnaglyph::apply_routing() {
 	// To ensure both are synced in playback, we don't remove the node from the
 	// tree or anything, we just send the inactive node's audio to a muted bus.
-	// TODO: Only update buses if use_anaglyph changes. Dunno how expensive the
-	// set_bus call is.
-	StringName anaglyph_bus = borrowed_bus;
+	// This only happens when the path changes, so it's fine that this isn't
+	// free.
 	StringName silent_bus = AnaglyphBusManager::get_singleton()->get_silent_bus();
+	bool anaglyph_audible = path_state != PATH_FALLBACK && has_anaglyph();
+	bool fallback_audible = path_state != PATH_ANAGLYPH || !has_anaglyph();
+	runtime_players.anaglyph->set_bus(anaglyph_audible ? borrowed_bus : silent_bus);
+	// With a mid-tier bus, the direction comes from there instead.
+	runtime_players.fallback->set_bus(fallback_audible ? (has_mid_tier() ? mid_tier_bus : user_bus) : silent_bus);
+	runtime_players.fallback->set_panning_strength(has_mid_tier() ? 0 : fallback_panning_strength);
+	apply_path_volumes();
+}
+
+void AudioStreamPlayerAnaglyph::apply_path_volumes() {
+	if (runtime_players.anaglyph == nullptr || runtime_players.fallback == nullptr) {
+		return;
+	}
+	// Equal-power, so that the loudness stays the same throughout.
+	float anaglyph_gain = Math::sin(anaglyph_mix * (float)Math_PI * 0.5f);
+	float fallback_gain = Math::cos(anaglyph_mix * (float)Math_PI * 0.5f);
+	// Muted ones are on the silent bus anyway, so don't bother with -inf.
+	float anaglyph_db = anaglyph_gain > 0.0001f ? Math::linear_to_db(anaglyph_gain) : -80.0f;
+	float fallback_db = fallback_gain > 0.0001f ? Math::linear_to_db(fallback_gain) : -80.0f;
+	if (path_state != PATH_TRANSITIONING) {
+		anaglyph_db = 0;
+		fallback_db = 0;
+	}
+	runtime_players.anaglyph->set_volume_db(volume + anaglyph_db);
+	runtime_players.fallback->set_volume_db(volume - gain_reduction_fallback + fallback_db);
+}
+
+void AudioStreamPlayerAnaglyph::update_path(bool use_anaglyph, float delta) {
+	float target = use_anaglyph ? 1.0f : 0.0f;
+
+	if (snap_path || transition_time <= 0) {
+		snap_path = false;
+		PathState new_state = use_anaglyph ? PATH_ANAGLYPH : PATH_FALLBACK;
+		if (new_state != path_state || anaglyph_mix != target) {
+			path_state = new_state;
+			anaglyph_mix = target;
+			transition_to_anaglyph = use_anaglyph;
+			start_path(use_anaglyph);
+			stop_path(!use_anaglyph);
+			apply_routing();
+		}
+		return;
+	}
+
+	if (path_state != PATH_TRANSITIONING) {
+		if (use_anaglyph == (path_state == PATH_ANAGLYPH)) {
+			// Steady state, nothing to do.
+			return;
+		}
+		path_state = PATH_TRANSITIONING;
+		start_path(use_anaglyph);
+		apply_routing();
+	}
+
+	// (If we change our minds halfway, just turn around from where we are.)
+	transition_to_anaglyph = use_anaglyph;
+	float step = delta / transition_time;
 	if (use_anaglyph) {
-		borrowed_effect->set_azimuth(polar.x);
-		borrowed_effect->set_elevation(polar.y);
-		borrowed_effect->set_distance(polar.z);
-		runtime_players.anaglyph->set_bus(anaglyph_bus);
-		runtime_players.fallback->set_bus(silent_bus);
+		anaglyph_mix = MIN(anaglyph_mix + step, 1.0f);
+	}
+	else {
+		anaglyph_mix = MAX(anaglyph_mix - step, 0.0f);
+	}
+
+	if (anaglyph_mix == target) {
+		path_state = use_anaglyph ? PATH_ANAGLYPH : PATH_FALLBACK;
+		stop_path(!use_anaglyph);
+		apply_routing();
 	}
 	else {
-		runtime_players.anaglyph->set_bus(silent_bus);
-		runtime_players.fallback->set_bus(user_bus);
+		apply_path_volumes();
+	}
+}
+
+void AudioStreamPlayerAnaglyph::snap_to_fallback() {
+	if (path_state == PATH_FALLBACK && anaglyph_mix == 0) {
+		return;
+	}
+	path_state = PATH_FALLBACK;
+	anaglyph_mix = 0;
+	transition_to_anaglyph = false;
+	if (runtime_players.anaglyph != nullptr && runtime_players.fallback != nullptr) {
+		start_path(false);
+		stop_path(true);
+		apply_routing();
+	}
+}
+
+float AudioStreamPlayerAnaglyph::estimate_loudness_db(const Vector3& polar) const {
+	AudioStreamPlayer3D* fallback = runtime_players.fallback;
+	if (fallback == nullptr) {
+		return 0;
+	}
+	// Mirrors AudioStreamPlayer3D's attenuation. It's only an estimate, as
+	// Anaglyph has its own attenuation, but it's the one users tune for
+	// loudness over distance anyway.
+	// https://github.com/godotengine/godot/blob/77dcf97d82cbfe4e4615475fa52ca03da645dbd8/scene/3d/audio_stream_player_3d.cpp#L208
+	float distance = MAX(polar.z, 0.0001f);
+	float max_distance = fallback->get_max_distance();
+	if (max_distance > 0 && distance * unit_size > max_distance) {
+		return -INFINITY;
+	}
+	float attenuation = 0;
+	switch (fallback->get_attenuation_model()) {
+		case AudioStreamPlayer3D::ATTENUATION_INVERSE_DISTANCE:
+			attenuation = Math::linear_to_db(1.0f / distance);
+			break;
+		case AudioStreamPlayer3D::ATTENUATION_INVERSE_SQUARE_DISTANCE:
+			attenuation = Math::linear_to_db(1.0f / (distance * distance));
+			break;
+		case AudioStreamPlayer3D::ATTENUATION_LOGARITHMIC:
+			attenuation = -20 * Math::log(distance + (float)CMP_EPSILON);
+			break;
+		default:
+			break;
+	}
+	attenuation = MIN(attenuation, fallback->get_max_db());
+
+	// Only the bus we output to, not whatever that one sends to in turn.
+	// (This may run off the main thread, so ask the bus manager, who reads
+	//  it on the main thread.)
+	float bus_db = AnaglyphBusManager::get_singleton()->get_bus_gain_db(user_bus);
+	return volume + attenuation + bus_db;
+}
+
+bool AudioStreamPlayerAnaglyph::can_virtualize() const {
+	// Voices can't be restored one by one, and mid-crossfade both children
+	// are busy. Streams without a length (generators and the like) can't be
+	// continued from a position.
+	return virtual_threshold_db > -120
+		&& !keeps_both_paths_running()
+		&& path_state != PATH_TRANSITIONING
+		&& audio_stream != nullptr
+		&& audio_stream->get_length() > 0;
+}
+
+void AudioStreamPlayerAnaglyph::virtualize() {
+	virtual_position = get_playback_position();
+	is_virtual = true;
+	// Stopping doesn't emit `finished`, so this doesn't look like the end
+	// of the sound to anyone.
+	return_anaglyph();
+	return_mid_tier();
+	runtime_players.anaglyph->stop();
+	runtime_players.fallback->stop();
+	path_state = PATH_FALLBACK;
+	anaglyph_mix = 0;
+}
+
+void AudioStreamPlayerAnaglyph::devirtualize() {
+	is_virtual = false;
+	bool paused = get_stream_paused();
+	begin_playback((float)virtual_position);
+	runtime_players.anaglyph->set_stream_paused(paused);
+	runtime_players.fallback->set_stream_paused(paused);
+}
+
+bool AudioStreamPlayerAnaglyph::advance_virtual(float delta) {
+	if (get_stream_paused()) {
+		return true;
+	}
+	virtual_position += delta * pitch_scale;
+	double length = audio_stream->get_length();
+	if (virtual_position < length) {
+		return true;
+	}
+	double loop_start;
+	if (!get_stream_loop(loop_start) || loop_start >= length) {
+		return false;
+	}
+	virtual_position = loop_start + Math::fmod(virtual_position - loop_start, length - loop_start);
+	return true;
+}
+
+bool AudioStreamPlayerAnaglyph::get_stream_loop(double& loop_start) const {
+	// There's no general way to ask a stream whether it loops, so just ask
+	// the built-in ones in their own words.
+	// (AudioStreamOggVorbis and AudioStreamMP3.)
+	Variant loop = audio_stream->get("loop");
+	if (loop.get_type() == Variant::BOOL) {
+		loop_start = (double)audio_stream->get("loop_offset");
+		return (bool)loop;
+	}
+	// (AudioStreamWAV, which counts in frames.)
+	Variant loop_mode = audio_stream->get("loop_mode");
+	if (loop_mode.get_type() == Variant::INT) {
+		int mix_rate = audio_stream->get("mix_rate");
+		loop_start = mix_rate > 0 ? (int)audio_stream->get("loop_begin") / (double)mix_rate : 0;
+		return (int)loop_mode != 0;
+	}
+	return false;
+}
+
+bool AudioStreamPlayerAnaglyph::get_polar_position(Vector3& polar) const {
+	// All players in this viewport are done in one go.
+	if (!AnaglyphPositionServer::get_singleton()->get_polar_position(position_slot, polar)) {
+		return false;
+	}
+	polar.z /= unit_size;
+	return true;
+}
+
+bool AudioStreamPlayerAnaglyph::anaglyph_allowed() const {
+	return forcing != FORCE_ANAGLYPH_OFF && get_anaglyph_enabled();
+}
+
+void AudioStreamPlayerAnaglyph::update_reservation(const Vector3& polar, float delta) {
+	float distance = polar.z;
+	if (delta > 0 && has_previous_distance) {
+		// Smooth it a little, positions can be jittery.
+		float speed = (distance - previous_distance) / delta;
+		radial_speed = Math::lerp(radial_speed, speed, 0.25f);
+	}
+	else if (delta <= 0) {
+		radial_speed = 0;
+	}
+	previous_distance = distance;
+	has_previous_distance = true;
+
+	bool want_bus;
+	if (!anaglyph_allowed()) {
+		want_bus = false;
+	}
+	else if (forcing == FORCE_ANAGLYPH_ON) {
+		want_bus = true;
+	}
+	else if (distance < max_anaglyph_range) {
+		want_bus = true;
+	}
+	else if (has_anaglyph() && distance < max_anaglyph_range + range_hysteresis) {
+		// Hang on to it for a bit.
+		want_bus = true;
+	}
+	else if (radial_speed < 0) {
+		// Approaching. Reserve a bus if we'll arrive within the time it takes
+		// Anaglyph to warm up.
+		float time_to_entry = (distance - max_anaglyph_range) / -radial_speed;
+		want_bus = time_to_entry < prewarm_time;
+	}
+	else {
+		want_bus = false;
+	}
+	if (leaving_cluster) {
+		// Once we've faded out, we're free to look for a better fit.
+		want_bus = false;
+	}
+
+	if (want_bus && !has_anaglyph()) {
+		uint64_t now = Time::get_singleton()->get_ticks_msec();
+		if (delta <= 0 || now - last_borrow_attempt_msec >= 250) {
+			last_borrow_attempt_msec = now;
+			borrow_anaglyph();
+		}
+	}
+	else if (!want_bus && !borrowed_bus.is_empty() && path_state == PATH_FALLBACK) {
+		// (If we're still fading out of Anaglyph, give it back once done.)
+		return_anaglyph();
+		using_anaglyph = false;
+	}
+}
+
+void AudioStreamPlayerAnaglyph::update_mid_tier(const Vector3& polar, float delta) {
+	// The mid tier doesn't need the dll, so it's also there when Anaglyph
+	// isn't. Only when explicitly asked for the plain fallback, stay away.
+	float range = max_panner_range;
+	if (has_mid_tier()) {
+		range += range_hysteresis;
+	}
+	bool want_mid_tier = forcing != FORCE_ANAGLYPH_OFF && polar.z < range;
+
+	if (want_mid_tier && !has_mid_tier()) {
+		uint64_t now = Time::get_singleton()->get_ticks_msec();
+		if (delta <= 0 || now - last_mid_tier_attempt_msec >= 250) {
+			last_mid_tier_attempt_msec = now;
+			borrow_mid_tier();
+		}
+	}
+	else if (!want_mid_tier && has_mid_tier()) {
+		return_mid_tier();
+	}
+
+	// Like the Anaglyph bus, it also gets positions while we're on the
+	// Anaglyph path, so it's ready when we go back.
+	if (panner_effect != nullptr) {
+		panner_effect->set_azimuth(polar.x);
+		panner_effect->set_elevation(polar.y);
+		panner_effect->set_distance(polar.z);
+	}
+	if (ambisonic_effect != nullptr) {
+		ambisonic_effect->set_azimuth(polar.x);
+		ambisonic_effect->set_elevation(polar.y);
+	}
+}
+
+void AudioStreamPlayerAnaglyph::reserve_anaglyph_if_needed() {
+	has_previous_distance = false;
+	Vector3 polar;
+	if (get_polar_position(polar)) {
+		update_reservation(polar, 0);
+	}
+	else {
+		// Figure it out next frame, if there's a listener by then.
+		return_anaglyph();
 	}
 }
 
@@ -282,16 +749,24 @@ void AudioStreamPlayerAnaglyph::copy_shared_properties() {
 	}
 
 	// The easy ones.
+	// (Autoplay is handled by us, as we decide which child plays.)
 	players.anaglyph->set_volume_db(volume);
 	players.anaglyph->set_pitch_scale(pitch_scale);
-	players.anaglyph->set_autoplay(autoplay);
+	players.anaglyph->set_autoplay(false);
+	players.anaglyph->set_max_polyphony(max_polyphony);
 	// (No anaglyph "set_unit_size"; we directly divide in this _process to
 	//  achieve that effect.)
 
 	players.fallback->set_volume_db(volume - gain_reduction_fallback);
 	players.fallback->set_pitch_scale(pitch_scale);
-	players.fallback->set_autoplay(autoplay);
+	players.fallback->set_autoplay(false);
+	players.fallback->set_max_polyphony(max_polyphony);
 	players.fallback->set_unit_size(unit_size);
+
+	// Halfway a crossfade, the volumes above aren't the whole story.
+	if (!Engine::get_singleton()->is_editor_hint()) {
+		apply_path_volumes();
+	}
 }
 
 void AudioStreamPlayerAnaglyph::set_stream(Ref<AudioStream> p_audio_stream) {
@@ -300,7 +775,9 @@ void AudioStreamPlayerAnaglyph::set_stream(Ref<AudioStream> p_audio_stream) {
 	// (I checked, even if it's set to the same, it stops.)
 	if (!Engine::get_singleton()->is_editor_hint()) {
 		return_anaglyph();
+		return_mid_tier();
 	}
+	is_virtual = false;
 	audio_stream = p_audio_stream;
 	copy_shared_properties();
 }
@@ -369,6 +846,27 @@ float AudioStreamPlayerAnaglyph::get_max_anaglyph_range() const {
 	return max_anaglyph_range;
 }
 
+void AudioStreamPlayerAnaglyph::set_max_panner_range(float meters) {
+	max_panner_range = MAX(meters, 0);
+}
+
+float AudioStreamPlayerAnaglyph::get_max_panner_range() const {
+	return max_panner_range;
+}
+
+void AudioStreamPlayerAnaglyph::set_mid_tier(MidTier tier) {
+	if (tier == mid_tier) {
+		return;
+	}
+	mid_tier = tier;
+	// The next update borrows the new kind.
+	return_mid_tier();
+}
+
+AudioStreamPlayerAnaglyph::MidTier AudioStreamPlayerAnaglyph::get_mid_tier() const {
+	return mid_tier;
+}
+
 void AudioStreamPlayerAnaglyph::play(float from_position) {
 	Players players = Players{};
 	if (!get_players_runtime(players)) {
@@ -376,9 +874,49 @@ void AudioStreamPlayerAnaglyph::play(float from_position) {
 		return;
 	}
 
-	borrow_anaglyph();
-	players.anaglyph->play(from_position);
-	players.fallback->play(from_position);
+	// With polyphony, playing again just adds a voice to what's already
+	// playing. All voices go through the same bus (and the same Anaglyph
+	// instance), so keep the bus and path we already have.
+	if (keeps_both_paths_running() && get_playing()) {
+		players.anaglyph->play(from_position);
+		players.fallback->play(from_position);
+		return;
+	}
+
+	is_virtual = false;
+	begin_playback(from_position);
+}
+
+void AudioStreamPlayerAnaglyph::begin_playback(float from_position) {
+	Players players = Players{};
+	if (!get_players_runtime(players)) {
+		return;
+	}
+
+	reserve_anaglyph_if_needed();
+
+	// Figure out where we start right away, so that only the right child
+	// starts playing.
+	Vector3 polar;
+	bool has_position = get_polar_position(polar);
+	if (has_position) {
+		update_mid_tier(polar, 0);
+	}
+	bool use_anaglyph = has_position && wants_anaglyph_path(polar);
+	using_anaglyph = use_anaglyph;
+	path_state = use_anaglyph ? PATH_ANAGLYPH : PATH_FALLBACK;
+	anaglyph_mix = use_anaglyph ? 1 : 0;
+	transition_to_anaglyph = use_anaglyph;
+	snap_path = false;
+	apply_routing();
+
+	if (use_anaglyph || keeps_both_paths_running()) {
+		players.anaglyph->play(from_position);
+	}
+	if (!use_anaglyph || keeps_both_paths_running()) {
+		players.fallback->play(from_position);
+	}
+	stop_path(!use_anaglyph);
 }
 
 void AudioStreamPlayerAnaglyph::seek(float to) {
@@ -388,6 +926,11 @@ void AudioStreamPlayerAnaglyph::seek(float to) {
 		return;
 	}
 
+	if (is_virtual) {
+		virtual_position = MAX(to, 0);
+		return;
+	}
+
 	players.anaglyph->seek(to);
 	players.fallback->seek(to);
 }
@@ -399,7 +942,9 @@ void AudioStreamPlayerAnaglyph::stop() {
 		return;
 	}
 
+	is_virtual = false;
 	return_anaglyph();
+	return_mid_tier();
 	players.anaglyph->stop();
 	players.fallback->stop();
 }
@@ -422,10 +967,9 @@ bool AudioStreamPlayerAnaglyph::get_playing() const {
 		return false;
 	}
 
-	// These should be synced unless (1) user error (2) *weirdness*.
-	// Not assuming any weird path.
-	// Same below for the other "direct" getters.
-	return players.anaglyph->is_playing();
+	// Only the audible child plays (or both, while crossfading). Virtual
+	// voices are still playing, just not to anyone.
+	return is_virtual || players.anaglyph->is_playing() || players.fallback->is_playing();
 }
 
 float AudioStreamPlayerAnaglyph::get_playback_position() const {
@@ -434,7 +978,19 @@ float AudioStreamPlayerAnaglyph::get_playback_position() const {
 		return 0;
 	}
 
-	return players.anaglyph->get_playback_position();
+	if (is_virtual) {
+		return virtual_position;
+	}
+
+	// Ask whoever is audible. While crossfading, the fallback's still the
+	// one we're syncing to.
+	if (path_state == PATH_ANAGLYPH && players.anaglyph->is_playing()) {
+		return players.anaglyph->get_playback_position();
+	}
+	if (!players.fallback->is_playing()) {
+		return players.anaglyph->get_playback_position();
+	}
+	return players.fallback->get_playback_position();
 }
 
 void AudioStreamPlayerAnaglyph::set_stream_paused(bool paused) {
@@ -449,11 +1005,16 @@ void AudioStreamPlayerAnaglyph::set_stream_paused(bool paused) {
 	if (Engine::get_singleton()->is_editor_hint()) {
 		return;
 	}
+	// Virtual voices don't have a bus either way.
+	if (is_virtual) {
+		return;
+	}
 	if (get_stream_paused()) {
 		return_anaglyph();
+		return_mid_tier();
 	}
 	else {
-		borrow_anaglyph();
+		reserve_anaglyph_if_needed();
 	}
 }
 
@@ -475,6 +1036,47 @@ bool AudioStreamPlayerAnaglyph::get_autoplay() const {
 	return autoplay;
 }
 
+void AudioStreamPlayerAnaglyph::set_max_polyphony(int voices) {
+	max_polyphony = MAX(voices, 1);
+	copy_shared_properties();
+}
+
+int AudioStreamPlayerAnaglyph::get_max_polyphony() const {
+	return max_polyphony;
+}
+
+void AudioStreamPlayerAnaglyph::set_range_hysteresis(float meters) {
+	range_hysteresis = MAX(meters, 0);
+}
+
+float AudioStreamPlayerAnaglyph::get_range_hysteresis() const {
+	return range_hysteresis;
+}
+
+void AudioStreamPlayerAnaglyph::set_prewarm_time(float seconds) {
+	prewarm_time = MAX(seconds, 0);
+}
+
+float AudioStreamPlayerAnaglyph::get_prewarm_time() const {
+	return prewarm_time;
+}
+
+void AudioStreamPlayerAnaglyph::set_transition_time(float seconds) {
+	transition_time = MAX(seconds, 0);
+}
+
+float AudioStreamPlayerAnaglyph::get_transition_time() const {
+	return transition_time;
+}
+
+void AudioStreamPlayerAnaglyph::set_virtual_threshold_db(float volume) {
+	virtual_threshold_db = volume;
+}
+
+float AudioStreamPlayerAnaglyph::get_virtual_threshold_db() const {
+	return virtual_threshold_db;
+}
+
 void AudioStreamPlayerAnaglyph::set_forcing(ForceStream p_forcing) {
 	forcing = p_forcing;
 }
@@ -483,6 +1085,14 @@ AudioStreamPlayerAnaglyph::ForceStream AudioStreamPlayerAnaglyph::get_forcing()
 	return forcing;
 }
 
+void AudioStreamPlayerAnaglyph::set_bus_reuse(BusReuse reuse) {
+	bus_reuse = reuse;
+}
+
+AudioStreamPlayerAnaglyph::BusReuse AudioStreamPlayerAnaglyph::get_bus_reuse() const {
+	return bus_reuse;
+}
+
 void AudioStreamPlayerAnaglyph::set_anaglyph_data(Ref<AnaglyphEffectData> p_anaglyph_data) {
 	anaglyph_data = p_anaglyph_data;
 }
@@ -529,55 +1139,287 @@ void AudioStreamPlayerAnaglyph::prepare_anaglyph_buses(int count) {
 	AnaglyphBusManager::get_singleton()->prepare_anaglyph_buses(count);
 }
 
-void AudioStreamPlayerAnaglyph::play_oneshot(
-	Ref<AudioStream> stream,
-	Vector3 global_position,
-	float volume_db,
-	Ref<AnaglyphEffectData> anaglyph_settings,
-	StringName bus
-) {
+void AudioStreamPlayerAnaglyph::set_max_panner_buses(int count) {
+	AnaglyphBusManager::get_singleton()->set_max_panner_buses(count);
+}
+
+int AudioStreamPlayerAnaglyph::get_max_panner_buses() {
+	return AnaglyphBusManager::get_singleton()->get_max_panner_buses();
+}
+
+void AudioStreamPlayerAnaglyph::set_max_ambisonic_buses(int count) {
+	AnaglyphBusManager::get_singleton()->set_max_ambisonic_buses(count);
+}
+
+int AudioStreamPlayerAnaglyph::get_max_ambisonic_buses() {
+	return AnaglyphBusManager::get_singleton()->get_max_ambisonic_buses();
+}
+
+void AudioStreamPlayerAnaglyph::set_ambisonic_order(int order) {
+	AnaglyphAmbisonicField::set_order(order);
+}
+
+int AudioStreamPlayerAnaglyph::get_ambisonic_order() {
+	return AnaglyphAmbisonicField::get_order();
+}
+
+void AudioStreamPlayerAnaglyph::set_ambisonic_output_bus(const StringName& bus) {
+	AnaglyphBusManager::get_singleton()->set_ambisonic_output_bus(bus);
+}
+
+StringName AudioStreamPlayerAnaglyph::get_ambisonic_output_bus() {
+	return AnaglyphBusManager::get_singleton()->get_ambisonic_output_bus();
+}
+
+void AudioStreamPlayerAnaglyph::set_shared_reverb(bool shared) {
+	AnaglyphBusManager::get_singleton()->set_shared_reverb(shared);
+}
+
+bool AudioStreamPlayerAnaglyph::get_shared_reverb() {
+	return AnaglyphBusManager::get_singleton()->get_shared_reverb();
+}
+
+void AudioStreamPlayerAnaglyph::set_max_room_buses(int count) {
+	AnaglyphBusManager::get_singleton()->set_max_room_buses(count);
+}
+
+int AudioStreamPlayerAnaglyph::get_max_room_buses() {
+	return AnaglyphBusManager::get_singleton()->get_max_room_buses();
+}
+
+void AudioStreamPlayerAnaglyph::set_cluster_tolerance(float degrees) {
+	AnaglyphBusManager::get_singleton()->set_cluster_tolerance(degrees);
+}
+
+float AudioStreamPlayerAnaglyph::get_cluster_tolerance() {
+	return AnaglyphBusManager::get_singleton()->get_cluster_tolerance();
+}
+
+void AudioStreamPlayerAnaglyph::set_latency_compensation(bool enabled) {
+	AnaglyphPositionServer::get_singleton()->set_latency_compensation(enabled);
+}
+
+bool AudioStreamPlayerAnaglyph::get_latency_compensation() {
+	return AnaglyphPositionServer::get_singleton()->get_latency_compensation();
+}
+
+void AudioStreamPlayerAnaglyph::set_extra_latency(float seconds) {
+	AnaglyphPositionServer::get_singleton()->set_extra_latency(seconds);
+}
+
+float AudioStreamPlayerAnaglyph::get_extra_latency() {
+	return AnaglyphPositionServer::get_singleton()->get_extra_latency();
+}
+
+float AudioStreamPlayerAnaglyph::get_compensated_latency() {
+	return AnaglyphPositionServer::get_singleton()->get_compensated_latency();
+}
+
+void AudioStreamPlayerAnaglyph::set_oneshot_pool_size(int size) {
+	AnaglyphOneshotPool::get_singleton()->set_pool_size(size);
+}
+
+int AudioStreamPlayerAnaglyph::get_oneshot_pool_size() {
+	return AnaglyphOneshotPool::get_singleton()->get_pool_size();
+}
+
+void AudioStreamPlayerAnaglyph::set_oneshot_overflow(OneshotOverflow overflow) {
+	AnaglyphOneshotPool::get_singleton()->set_overflow((AnaglyphOneshotPool::Overflow)overflow);
+}
+
+AudioStreamPlayerAnaglyph::OneshotOverflow AudioStreamPlayerAnaglyph::get_oneshot_overflow() {
+	return (OneshotOverflow)AnaglyphOneshotPool::get_singleton()->get_overflow();
+}
+
+void AudioStreamPlayerAnaglyph::set_oneshot_merge_distance(float meters) {
+	AnaglyphOneshotPool::get_singleton()->set_merge_distance(meters);
+}
+
+float AudioStreamPlayerAnaglyph::get_oneshot_merge_distance() {
+	return AnaglyphOneshotPool::get_singleton()->get_merge_distance();
+}
+
+void AudioStreamPlayerAnaglyph::set_oneshot_polyphony(int voices) {
+	AnaglyphOneshotPool::get_singleton()->set_polyphony(voices);
+}
+
+int AudioStreamPlayerAnaglyph::get_oneshot_polyphony() {
+	return AnaglyphOneshotPool::get_singleton()->get_polyphony();
+}
+
+void AudioStreamPlayerAnaglyph::set_oneshot_cache_size(int64_t bytes) {
+	AnaglyphRenderCache::get_singleton()->set_max_bytes(bytes);
+}
+
+int64_t AudioStreamPlayerAnaglyph::get_oneshot_cache_size() {
+	return AnaglyphRenderCache::get_singleton()->get_max_bytes();
+}
+
+int64_t AudioStreamPlayerAnaglyph::get_oneshot_cache_usage() {
+	return AnaglyphRenderCache::get_singleton()->get_used_bytes();
+}
+
+void AudioStreamPlayerAnaglyph::set_oneshot_cache_angle_step(float degrees) {
+	AnaglyphRenderCache::get_singleton()->set_angle_step(degrees);
+}
+
+float AudioStreamPlayerAnaglyph::get_oneshot_cache_angle_step() {
+	return AnaglyphRenderCache::get_singleton()->get_angle_step();
+}
+
+void AudioStreamPlayerAnaglyph::set_oneshot_cache_distance_step(float meters) {
+	AnaglyphRenderCache::get_singleton()->set_distance_step(meters);
+}
+
+float AudioStreamPlayerAnaglyph::get_oneshot_cache_distance_step() {
+	return AnaglyphRenderCache::get_singleton()->get_distance_step();
+}
+
+void AudioStreamPlayerAnaglyph::clear_oneshot_cache() {
+	AnaglyphRenderCache::get_singleton()->clear();
+}
+
+Node* AudioStreamPlayerAnaglyph::get_oneshot_parent(const Ref<AudioStream>& stream) {
 	if (Engine::get_singleton()->is_editor_hint()) {
 		AnaglyphHelpers::print_warning("Attempted to play Anaglyph oneshot in the editor. This is only supported when playing.");
-		return;
+		return nullptr;
 	}
 	if (stream == nullptr) {
 		AnaglyphHelpers::print_error("Could not play_oneshot a sound (provided stream was `null`).");
-		return;
+		return nullptr;
 	}
 
 	MainLoop* loop = Engine::get_singleton()->get_main_loop();
 	SceneTree* tree = (SceneTree*)loop;
 	if (tree == nullptr) {
 		AnaglyphHelpers::print_error("Could not play_oneshot a sound (could not find the scene tree).");
-		return;
+		return nullptr;
 	}
 	// The hierarchy Window : Viewport : Node is not exposed...
 	Node* parent = (Node*)tree->get_root();
 	if (parent == nullptr) {
 		AnaglyphHelpers::print_error("Could not play_oneshot a sound (could not find the scene root).");
-		return;
+		return nullptr;
 	}
+	return parent;
+}
 
-	AudioStreamPlayerAnaglyph* node = memnew(AudioStreamPlayerAnaglyph);
-	if (anaglyph_settings == nullptr) {
-		Ref<AnaglyphEffectData> default_data;
-		default_data.instantiate();
-		node->set_anaglyph_data(default_data);
+AudioStreamPlayerAnaglyph* AudioStreamPlayerAnaglyph::start_oneshot(
+	Node* parent,
+	const Ref<AudioStream>& stream,
+	const Vector3& global_position,
+	float volume_db,
+	const Ref<AnaglyphEffectData>& anaglyph_settings,
+	const StringName& bus,
+	const AnaglyphRenderCache::Batch& cache_batch
+) {
+	AnaglyphOneshotPool* pool = AnaglyphOneshotPool::get_singleton();
+	// If we've heard this sound from here before, just play that again.
+	// No node, and no bus.
+	const Ref<AnaglyphEffectData>& settings = anaglyph_settings != nullptr ? anaglyph_settings : pool->get_default_data();
+	if (AnaglyphRenderCache::get_singleton()->play(cache_batch, parent, stream, global_position, volume_db, settings, bus)) {
+		return nullptr;
 	}
-	else {
-		node->set_anaglyph_data(anaglyph_settings->duplicate());
+
+	// If the same sound is already playing right here (think machine guns
+	// or footsteps), add it as a voice to that one. That way it shares that
+	// one's bus, instead of taking up another.
+	AudioStreamPlayerAnaglyph* merge = pool->find_merge_target(stream, global_position, volume_db, anaglyph_settings, bus);
+	if (merge != nullptr) {
+		merge->add_oneshot_voice(pool->get_polyphony());
+		return merge;
 	}
-	node->set_dupe_protection(false);
-	node->set_delete_on_finish(true);
-	parent->add_child(node, true, INTERNAL_MODE_BACK);
-	
+
+	// Reuse a node that's done, instead of making one from scratch.
+	AudioStreamPlayerAnaglyph* node = pool->acquire(parent);
+	if (node == nullptr) {
+		// Pool's full, and we're told to drop.
+		return nullptr;
+	}
+	node->oneshot_settings = anaglyph_settings != nullptr ? ObjectID(anaglyph_settings->get_instance_id()) : ObjectID();
+	node->oneshot_voice_ends.clear();
+	node->get_anaglyph_data()->copy_from(anaglyph_settings != nullptr ? anaglyph_settings : pool->get_default_data());
+
 	node->set_global_position(global_position);
 	// These setters only afterwards as the children only get created on
 	// _enter_tree()
 	node->set_stream(stream);
 	node->set_volume_db(volume_db);
 	node->set_bus(bus);
+	node->track_oneshot_voice();
 	node->play();
+	return node;
+}
+
+void AudioStreamPlayerAnaglyph::play_oneshot(
+	Ref<AudioStream> stream,
+	Vector3 global_position,
+	float volume_db,
+	Ref<AnaglyphEffectData> anaglyph_settings,
+	StringName bus
+) {
+	Node* parent = get_oneshot_parent(stream);
+	if (parent == nullptr) {
+		return;
+	}
+	AnaglyphOneshotPool* pool = AnaglyphOneshotPool::get_singleton();
+	AnaglyphRenderCache::Batch cache_batch;
+	AnaglyphRenderCache::get_singleton()->begin_batch(parent, stream, anaglyph_settings != nullptr ? anaglyph_settings : pool->get_default_data(), cache_batch);
+	start_oneshot(parent, stream, global_position, volume_db, anaglyph_settings, bus, cache_batch);
+}
+
+void AudioStreamPlayerAnaglyph::play_oneshots(
+	Ref<AudioStream> stream,
+	PackedVector3Array global_positions,
+	PackedFloat32Array volumes_db,
+	Ref<AnaglyphEffectData> anaglyph_settings,
+	StringName bus
+) {
+	int count = global_positions.size();
+	if (volumes_db.size() != 0 && volumes_db.size() != count) {
+		AnaglyphHelpers::print_error("Could not play_oneshots (got ", count, " positions but ", volumes_db.size(), " volumes).");
+		return;
+	}
+	if (count == 0) {
+		return;
+	}
+	Node* parent = get_oneshot_parent(stream);
+	if (parent == nullptr) {
+		return;
+	}
+
+	// Everything the cache looks up that doesn't depend on the position,
+	// just once for the whole batch.
+	AnaglyphOneshotPool* pool = AnaglyphOneshotPool::get_singleton();
+	AnaglyphRenderCache::Batch cache_batch;
+	AnaglyphRenderCache::get_singleton()->begin_batch(parent, stream, anaglyph_settings != nullptr ? anaglyph_settings : pool->get_default_data(), cache_batch);
+	// Batches are usually bursts from a few places, so first try to merge
+	// into a node from this same batch, before looking through every
+	// oneshot that's playing.
+	Vector<AudioStreamPlayerAnaglyph*> started;
+
+	// Going through the raw pointers skips the per-element copy-on-write
+	// checks of the packed arrays.
+	const Vector3* positions = global_positions.ptr();
+	const float* volumes = volumes_db.size() > 0 ? volumes_db.ptr() : nullptr;
+	for (int i = 0; i < count; i++) {
+		float volume = volumes != nullptr ? volumes[i] : 0;
+		AudioStreamPlayerAnaglyph* merge = nullptr;
+		for (int j = started.size() - 1; j >= 0; j--) {
+			if (pool->can_merge(started[j], stream, positions[i], volume, anaglyph_settings, bus)) {
+				merge = started[j];
+				break;
+			}
+		}
+		if (merge != nullptr) {
+			merge->add_oneshot_voice(pool->get_polyphony());
+			continue;
+		}
+		AudioStreamPlayerAnaglyph* node = start_oneshot(parent, stream, positions[i], volume, anaglyph_settings, bus, cache_batch);
+		if (node != nullptr && !started.has(node)) {
+			started.push_back(node);
+		}
+	}
 }
 
 void AudioStreamPlayerAnaglyph::_bind_methods() {
@@ -592,12 +1434,20 @@ void AudioStreamPlayerAnaglyph::_bind_methods() {
 	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "playing", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_EDITOR), "set_playing", "is_playing");
 	REGISTER(BOOL, stream_paused, AudioStreamPlayerAnaglyph, "pause", PROPERTY_HINT_NONE, "");
 	REGISTER(BOOL, autoplay, AudioStreamPlayerAnaglyph, "autoplay", PROPERTY_HINT_NONE, "");
+	REGISTER(INT, max_polyphony, AudioStreamPlayerAnaglyph, "voices", PROPERTY_HINT_RANGE, "1,100,1");
 	// This one's hint string is filled by validate_property
 	REGISTER(STRING_NAME, bus, AudioStreamPlayerAnaglyph, "bus", PROPERTY_HINT_ENUM, "");
 
 	ADD_GROUP("Anaglyph settings", "");
 	REGISTER(FLOAT, max_anaglyph_range, AudioStreamPlayerAnaglyph, "max_anaglyph_range", PROPERTY_HINT_RANGE, "0,10,0.01,suffix:m");
+	REGISTER(FLOAT, max_panner_range, AudioStreamPlayerAnaglyph, "meters", PROPERTY_HINT_RANGE, "0,100,0.1,or_greater,suffix:m");
+	REGISTER(INT, mid_tier, AudioStreamPlayerAnaglyph, "tier", PROPERTY_HINT_ENUM, "Panner,Ambisonic");
+	REGISTER(FLOAT, range_hysteresis, AudioStreamPlayerAnaglyph, "meters", PROPERTY_HINT_RANGE, "0,5,0.01,suffix:m");
+	REGISTER(FLOAT, prewarm_time, AudioStreamPlayerAnaglyph, "seconds", PROPERTY_HINT_RANGE, "0,5,0.01,suffix:s");
+	REGISTER(FLOAT, transition_time, AudioStreamPlayerAnaglyph, "seconds", PROPERTY_HINT_RANGE, "0,2,0.01,suffix:s");
+	REGISTER(FLOAT, virtual_threshold_db, AudioStreamPlayerAnaglyph, "volume", PROPERTY_HINT_RANGE, "-120,0,0.1,suffix:dB");
 	REGISTER(INT, forcing, AudioStreamPlayerAnaglyph, "forcing", PROPERTY_HINT_ENUM, "None,Anaglyph On,Anaglyph Off");
+	REGISTER(INT, bus_reuse, AudioStreamPlayerAnaglyph, "reuse", PROPERTY_HINT_ENUM, "After Drain,Reset");
 	REGISTER_USAGE(OBJECT, anaglyph_data, AudioStreamPlayerAnaglyph, "anaglyph_data", PROPERTY_HINT_RESOURCE_TYPE, "AnaglyphEffectData", PROPERTY_USAGE_DEFAULT | PROPERTY_USAGE_EDITOR_INSTANTIATE_OBJECT);
 
 	ADD_GROUP("Misc settings", "");
@@ -608,6 +1458,16 @@ void AudioStreamPlayerAnaglyph::_bind_methods() {
 	BIND_ENUM_CONSTANT(FORCE_ANAGLYPH_ON);
 	BIND_ENUM_CONSTANT(FORCE_ANAGLYPH_OFF);
 
+	BIND_ENUM_CONSTANT(BUS_REUSE_AFTER_DRAIN);
+	BIND_ENUM_CONSTANT(BUS_REUSE_RESET);
+
+	BIND_ENUM_CONSTANT(MID_TIER_PANNER);
+	BIND_ENUM_CONSTANT(MID_TIER_AMBISONIC);
+
+	BIND_ENUM_CONSTANT(ONESHOT_OVERFLOW_ALLOCATE);
+	BIND_ENUM_CONSTANT(ONESHOT_OVERFLOW_STEAL_OLDEST);
+	BIND_ENUM_CONSTANT(ONESHOT_OVERFLOW_DROP);
+
 	ClassDB::bind_method(D_METHOD("play", "from_position"), &AudioStreamPlayerAnaglyph::play, DEFVAL(0.0));
 	ClassDB::bind_method(D_METHOD("seek", "to_position"), &AudioStreamPlayerAnaglyph::seek);
 	ClassDB::bind_method(D_METHOD("stop"), &AudioStreamPlayerAnaglyph::stop);
@@ -620,6 +1480,46 @@ void AudioStreamPlayerAnaglyph::_bind_methods() {
 	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_max_anaglyph_buses", "count"), AudioStreamPlayerAnaglyph::set_max_anaglyph_buses);
 
 	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("prepare_anaglyph_buses", "count"), AudioStreamPlayerAnaglyph::prepare_anaglyph_buses);
+
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_max_panner_buses"), AudioStreamPlayerAnaglyph::get_max_panner_buses);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_max_panner_buses", "count"), AudioStreamPlayerAnaglyph::set_max_panner_buses);
+
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_max_ambisonic_buses"), AudioStreamPlayerAnaglyph::get_max_ambisonic_buses);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_max_ambisonic_buses", "count"), AudioStreamPlayerAnaglyph::set_max_ambisonic_buses);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_ambisonic_order"), AudioStreamPlayerAnaglyph::get_ambisonic_order);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_ambisonic_order", "order"), AudioStreamPlayerAnaglyph::set_ambisonic_order);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_ambisonic_output_bus"), AudioStreamPlayerAnaglyph::get_ambisonic_output_bus);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_ambisonic_output_bus", "bus"), AudioStreamPlayerAnaglyph::set_ambisonic_output_bus);
+
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_shared_reverb"), AudioStreamPlayerAnaglyph::get_shared_reverb);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_shared_reverb", "shared"), AudioStreamPlayerAnaglyph::set_shared_reverb);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_max_room_buses"), AudioStreamPlayerAnaglyph::get_max_room_buses);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_max_room_buses", "count"), AudioStreamPlayerAnaglyph::set_max_room_buses);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_cluster_tolerance"), AudioStreamPlayerAnaglyph::get_cluster_tolerance);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_cluster_tolerance", "degrees"), AudioStreamPlayerAnaglyph::set_cluster_tolerance);
+
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_oneshot_pool_size"), AudioStreamPlayerAnaglyph::get_oneshot_pool_size);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_oneshot_pool_size", "size"), AudioStreamPlayerAnaglyph::set_oneshot_pool_size);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_oneshot_overflow"), AudioStreamPlayerAnaglyph::get_oneshot_overflow);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_oneshot_overflow", "overflow"), AudioStreamPlayerAnaglyph::set_oneshot_overflow);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_oneshot_merge_distance"), AudioStreamPlayerAnaglyph::get_oneshot_merge_distance);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_oneshot_merge_distance", "meters"), AudioStreamPlayerAnaglyph::set_oneshot_merge_distance);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_oneshot_polyphony"), AudioStreamPlayerAnaglyph::get_oneshot_polyphony);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_oneshot_polyphony", "voices"), AudioStreamPlayerAnaglyph::set_oneshot_polyphony);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_oneshot_cache_size"), AudioStreamPlayerAnaglyph::get_oneshot_cache_size);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_oneshot_cache_size", "bytes"), AudioStreamPlayerAnaglyph::set_oneshot_cache_size);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_oneshot_cache_usage"), AudioStreamPlayerAnaglyph::get_oneshot_cache_usage);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_oneshot_cache_angle_step"), AudioStreamPlayerAnaglyph::get_oneshot_cache_angle_step);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_oneshot_cache_angle_step", "degrees"), AudioStreamPlayerAnaglyph::set_oneshot_cache_angle_step);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_oneshot_cache_distance_step"), AudioStreamPlayerAnaglyph::get_oneshot_cache_distance_step);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_oneshot_cache_distance_step", "meters"), AudioStreamPlayerAnaglyph::set_oneshot_cache_distance_step);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("clear_oneshot_cache"), AudioStreamPlayerAnaglyph::clear_oneshot_cache);
+
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_latency_compensation"), AudioStreamPlayerAnaglyph::get_latency_compensation);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_latency_compensation", "enabled"), AudioStreamPlayerAnaglyph::set_latency_compensation);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_extra_latency"), AudioStreamPlayerAnaglyph::get_extra_latency);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("set_extra_latency", "seconds"), AudioStreamPlayerAnaglyph::set_extra_latency);
+	ClassDB::bind_static_method("AudioStreamPlayerAnaglyph", D_METHOD("get_compensated_latency"), AudioStreamPlayerAnaglyph::get_compensated_latency);
 	
 	ClassDB::bind_static_method(
 		"AudioStreamPlayerAnaglyph",
@@ -627,6 +1527,12 @@ void AudioStreamPlayerAnaglyph::_bind_methods() {
 		&AudioStreamPlayerAnaglyph::play_oneshot,
 		DEFVAL(0.0), DEFVAL(nullptr), DEFVAL("Master")
 	);
+	ClassDB::bind_static_method(
+		"AudioStreamPlayerAnaglyph",
+		D_METHOD("play_oneshots", "audio_stream", "global_positions", "volumes_db", "anaglyph_settings", "bus"),
+		&AudioStreamPlayerAnaglyph::play_oneshots,
+		DEFVAL(PackedFloat32Array()), DEFVAL(nullptr), DEFVAL("Master")
+	);
 
 	ADD_SIGNAL(MethodInfo("finished"));
 	ClassDB::bind_method(D_METHOD("_finish_signal_handler_internal_do_not_call"), &AudioStreamPlayerAnaglyph::finish_signal);
@@ -651,21 +1557,138 @@ void AudioStreamPlayerAnaglyph::borrow_anaglyph() {
 	if (!borrowed_bus.is_empty()) {
 		return_anaglyph();
 	}
-	borrowed_bus = AnaglyphBusManager::get_singleton()->borrow_anaglyph_bus(user_bus, anaglyph_data, borrowed_effect);
+	AnaglyphBusManager* manager = AnaglyphBusManager::get_singleton();
+	// Sharing someone else's bus is cheaper than taking one of our own.
+	Vector3 polar;
+	if (get_polar_position(polar)) {
+		borrowed_bus = manager->join_anaglyph_cluster(user_bus, anaglyph_data, polar, borrowed_effect, ObjectID(get_instance_id()));
+		if (has_anaglyph()) {
+			return;
+		}
+	}
+	borrowed_bus = manager->borrow_anaglyph_bus(
+		user_bus,
+		anaglyph_data,
+		borrowed_effect,
+		bus_reuse == BUS_REUSE_RESET,
+		ObjectID(get_instance_id())
+	);
+}
+
+bool AudioStreamPlayerAnaglyph::has_anaglyph() const {
+	return borrowed_effect != nullptr;
 }
 
 void AudioStreamPlayerAnaglyph::return_anaglyph() {
+	// Whatever's still routed to the bus we're giving away can't stay there.
+	if (!borrowed_bus.is_empty()) {
+		snap_to_fallback();
+	}
 	if (borrowed_bus != user_bus && !borrowed_bus.is_empty()) {
-		AnaglyphBusManager::get_singleton()->return_anaglyph_bus(borrowed_bus);
+		AnaglyphBusManager::get_singleton()->return_anaglyph_bus(borrowed_bus, true, ObjectID(get_instance_id()));
 	}
 	borrowed_bus = "";
 	borrowed_effect = Ref<AnaglyphEffect>(nullptr);
+	leaving_cluster = false;
+}
+
+void AudioStreamPlayerAnaglyph::borrow_mid_tier() {
+	if (!mid_tier_bus.is_empty()) {
+		return_mid_tier();
+	}
+	AnaglyphBusManager* manager = AnaglyphBusManager::get_singleton();
+	if (mid_tier == MID_TIER_AMBISONIC) {
+		mid_tier_bus = manager->borrow_ambisonic_bus(ambisonic_effect, ObjectID(get_instance_id()));
+	}
+	else {
+		mid_tier_bus = manager->borrow_panner_bus(user_bus, panner_effect, ObjectID(get_instance_id()));
+	}
+	if (!has_mid_tier()) {
+		// Pool's empty, we got the user bus (or nothing) back.
+		mid_tier_bus = "";
+		return;
+	}
+	if (panner_effect != nullptr && anaglyph_data != nullptr && anaglyph_data->get_use_custom_circumference()) {
+		panner_effect->set_head_circumference(anaglyph_data->get_head_circumference());
+	}
+	if (runtime_players.anaglyph != nullptr && runtime_players.fallback != nullptr) {
+		apply_routing();
+	}
+}
+
+bool AudioStreamPlayerAnaglyph::has_mid_tier() const {
+	return panner_effect != nullptr || ambisonic_effect != nullptr;
+}
+
+void AudioStreamPlayerAnaglyph::return_mid_tier() {
+	if (mid_tier_bus.is_empty()) {
+		return;
+	}
+	StringName returned = mid_tier_bus;
+	bool was_ambisonic = ambisonic_effect != nullptr;
+	mid_tier_bus = "";
+	panner_effect = Ref<AnaglyphPannerEffect>(nullptr);
+	ambisonic_effect = Ref<AnaglyphAmbisonicEncoderEffect>(nullptr);
+	// Get the fallback off the bus before someone else gets it.
+	if (runtime_players.anaglyph != nullptr && runtime_players.fallback != nullptr) {
+		apply_routing();
+	}
+	if (was_ambisonic) {
+		AnaglyphBusManager::get_singleton()->return_ambisonic_bus(returned);
+	}
+	else {
+		AnaglyphBusManager::get_singleton()->return_panner_bus(returned);
+	}
+}
+
+void AudioStreamPlayerAnaglyph::track_oneshot_voice() {
+	uint64_t end = UINT64_MAX;
+	double length = audio_stream != nullptr ? audio_stream->get_length() : 0;
+	double loop_start;
+	if (length > 0 && pitch_scale > 0 && !get_stream_loop(loop_start)) {
+		end = Time::get_singleton()->get_ticks_msec() + (uint64_t)(length / pitch_scale * 1000);
+	}
+	oneshot_voice_ends.push_back(end);
+}
+
+int AudioStreamPlayerAnaglyph::count_oneshot_voices() {
+	// The children don't tell us when a single voice is done, only when all
+	// of them are. So go by the clock instead.
+	uint64_t now = Time::get_singleton()->get_ticks_msec();
+	for (int i = oneshot_voice_ends.size() - 1; i >= 0; i--) {
+		if (oneshot_voice_ends[i] <= now) {
+			oneshot_voice_ends.remove_at(i);
+		}
+	}
+	return oneshot_voice_ends.size();
+}
+
+void AudioStreamPlayerAnaglyph::add_oneshot_voice(int polyphony) {
+	if (!keeps_both_paths_running()) {
+		// Up to now only the audible child played. From here on, both need
+		// to, as we can't hand over a bunch of voices at once.
+		set_max_polyphony(polyphony);
+		start_path(true);
+		start_path(false);
+	}
+	track_oneshot_voice();
+	play();
 }
 
 void AudioStreamPlayerAnaglyph::finish_signal() {
+	// While crossfading both children play, and we only finish once both
+	// are done.
+	if (get_playing()) {
+		return;
+	}
 	return_anaglyph();
+	return_mid_tier();
+	oneshot_voice_ends.clear();
 	emit_signal("finished");
-	if (delete_on_finish) {
+	if (pooled) {
+		AnaglyphOneshotPool::get_singleton()->release(this);
+	}
+	else if (delete_on_finish) {
 		this->queue_free();
 	}
 }
\ No newline at end of file
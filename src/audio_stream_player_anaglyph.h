@@ -1,7 +1,10 @@
 #ifndef GDANAGLYPH_PLAYER
 #define GDANAGLYPH_PLAYER
 
+#include "anaglyph_ambisonic_effect.h"
 #include "anaglyph_effect.h"
+#include "anaglyph_panner_effect.h"
+#include "anaglyph_render_cache.h"
 #include "register_macro.h"
 
 #include <godot_cpp/classes/audio_stream.hpp>
@@ -9,12 +12,15 @@
 #include <godot_cpp/classes/audio_stream_player3d.hpp>
 #include <godot_cpp/classes/audio_server.hpp>
 #include <godot_cpp/classes/node3d.hpp>
+#include <godot_cpp/templates/vector.hpp>
 
 namespace godot {
 	// An AudioStreamPlayer that pushes its audio through Anaglyph buses.
 	class AudioStreamPlayerAnaglyph : public Node3D {
 		GDCLASS(AudioStreamPlayerAnaglyph, Node3D);
 
+		friend class AnaglyphOneshotPool;
+
 	public:
 		enum ForceStream {
 			FORCE_NONE = 0,
@@ -22,7 +28,35 @@ namespace godot {
 			FORCE_ANAGLYPH_OFF = 2
 		};
 
+		enum BusReuse {
+			BUS_REUSE_AFTER_DRAIN = 0,
+			BUS_REUSE_RESET = 1
+		};
+
+		// What the fallback plays through within `max_panner_range`.
+		enum MidTier {
+			// A panner bus of its own.
+			MID_TIER_PANNER = 0,
+			// An ambisonic encoder bus, decoded together with all others.
+			MID_TIER_AMBISONIC = 1
+		};
+
+		// What `play_oneshot()` does when all pooled oneshots are playing.
+		enum OneshotOverflow {
+			ONESHOT_OVERFLOW_ALLOCATE = 0,
+			ONESHOT_OVERFLOW_STEAL_OLDEST = 1,
+			ONESHOT_OVERFLOW_DROP = 2
+		};
+
 	private:
+		// Which of the two children is audible.
+		enum PathState {
+			PATH_FALLBACK = 0,
+			PATH_ANAGLYPH = 1,
+			// Both are audible, and we're crossfading between them.
+			PATH_TRANSITIONING = 2
+		};
+
 		struct Players {
 			// The player to use when Anaglyph is enabled.
 			AudioStreamPlayer* anaglyph;
@@ -49,6 +83,9 @@ namespace godot {
 		StringName borrowed_bus;
 		// Synchronised with the above `borrowed_bus`, in order to set effect data.
 		Ref<AnaglyphEffect> borrowed_effect;
+		// We share `borrowed_bus` with a cluster we no longer fit in. We
+		// fade out to the fallback, and return it once that's done.
+		bool leaving_cluster;
 
 		Ref<AudioStream> audio_stream;
 		float volume;
@@ -60,16 +97,135 @@ namespace godot {
 		StringName bus;
 		
 		float max_anaglyph_range;
+		// Between Anaglyph range and this, the fallback plays through a
+		// panner or ambisonic bus, instead of panning by itself. Zero
+		// disables this.
+		float max_panner_range;
+		MidTier mid_tier;
+		float range_hysteresis;
+		float prewarm_time;
 		ForceStream forcing;
+		BusReuse bus_reuse;
 		Ref<AnaglyphEffectData> anaglyph_data;
 
 		bool dupe_protection;
 		bool delete_on_finish;
+		// Whether we belong to the AnaglyphOneshotPool, and should go back
+		// there instead of being deleted.
+		bool pooled;
+		// For merging oneshots into us: the settings we were started with
+		// (null for the defaults), and when each sound we've been given ends.
+		// (Never, for looping or endless streams.)
+		ObjectID oneshot_settings;
+		Vector<uint64_t> oneshot_voice_ends;
 
 		static bool anaglyph_enabled;
 
+		// Whether we're currently listening to the Anaglyph path (as opposed
+		// to the fallback). Needed for hysteresis.
+		bool using_anaglyph;
+		// For estimating when we'll enter Anaglyph range, so that we can have
+		// a bus warmed up by then. Negative speed means approaching.
+		float previous_distance;
+		bool has_previous_distance;
+		float radial_speed;
+		// Don't hammer the bus manager when the pool is empty.
+		uint64_t last_borrow_attempt_msec;
+
+		// Which path we're on. Buses are only touched when this changes.
+		PathState path_state;
+		// How much of the Anaglyph path we hear, 0 (fallback) to 1 (Anaglyph).
+		// Only in between when transitioning.
+		float anaglyph_mix;
+		// Where we're transitioning to.
+		bool transition_to_anaglyph;
+		float transition_time;
+		// The next path change should be instant. Starting to play shouldn't
+		// start with a crossfade.
+		bool snap_path;
+
+		// Points the children to the correct buses for `path_state`.
+		void apply_routing();
+		// Sets the children's volumes based on `anaglyph_mix`.
+		void apply_path_volumes();
+		// Moves towards the wanted path, crossfading if needed.
+		void update_path(bool use_anaglyph, float delta);
+		// Whether we'd like to hear the Anaglyph path at this position.
+		bool wants_anaglyph_path(const Vector3& polar) const;
+
+		// Only the audible child(ren) actually play, so that the other one
+		// doesn't decode the stream for nothing. These start a child where
+		// the other one currently is, and stop a child.
+		void start_path(bool anaglyph_path);
+		void stop_path(bool anaglyph_path);
+		// With polyphony, we can't hand over all voices, so then both keep
+		// running like they used to.
+		bool keeps_both_paths_running() const;
+		// Immediately go to the fallback. Needed when our bus is taken away.
+		void snap_to_fallback();
+
+		// Starts playing from scratch: picks a path, and starts that child.
+		void begin_playback(float from_position);
+
+		// When we're too quiet to hear, we stop both children and give back
+		// our bus, and only keep track of where we would have been. This is
+		// a "virtual voice". Once audible again, we continue from there.
+		bool is_virtual;
+		double virtual_position;
+		float virtual_threshold_db;
+		// Need to get this much louder than the threshold to come back, so
+		// we don't flip-flop right on it.
+		static const float virtual_hysteresis_db;
+		// How loud we'd roughly be at this position, from our volume, the
+		// fallback's attenuation settings, and our bus's volume.
+		float estimate_loudness_db(const Vector3& polar) const;
+		bool can_virtualize() const;
+		void virtualize();
+		void devirtualize();
+		// Advances the virtual clock. Returns false if the stream ended.
+		bool advance_virtual(float delta);
+		// Whether the stream loops, and if so, where it loops back to.
+		bool get_stream_loop(double& loop_start) const;
+
+		// Also synchronised, like `borrowed_bus` and `borrowed_effect`, but
+		// for the fallback. Empty when we don't have a mid-tier bus. Only
+		// one of the effects is set, depending on the kind of bus.
+		StringName mid_tier_bus;
+		Ref<AnaglyphPannerEffect> panner_effect;
+		Ref<AnaglyphAmbisonicEncoderEffect> ambisonic_effect;
+		// The fallback's own panning is turned off while it goes through a
+		// mid-tier bus. This is what the user had it set to.
+		float fallback_panning_strength;
+		uint64_t last_mid_tier_attempt_msec;
+
+		// Borrows or returns a mid-tier bus depending on where we are, and
+		// sends it our position. `delta` is as in `update_reservation()`.
+		void update_mid_tier(const Vector3& polar, float delta);
+		// These reroute the fallback themselves.
+		void borrow_mid_tier();
+		void return_mid_tier();
+		bool has_mid_tier() const;
+
 		void borrow_anaglyph();
 		void return_anaglyph();
+		// Whether we currently have an actual Anaglyph bus (and not just the
+		// fallback bus we get when the pool runs out).
+		bool has_anaglyph() const;
+
+		// Our slot in the AnaglyphPositionServer while we're in the tree.
+		int position_slot;
+
+		// Gets our polar position wrt the listener, with `unit_size` applied.
+		// Returns false if there's no listener.
+		bool get_polar_position(Vector3& polar) const;
+		// Whether the current settings allow Anaglyph at all.
+		bool anaglyph_allowed() const;
+		// Borrows a bus a bit before we need it, and returns it a bit after
+		// we stop needing it. `delta` is the time since the last update, or 0
+		// if this is not a regular update.
+		void update_reservation(const Vector3& polar, float delta);
+		// `update_reservation()` for when we don't have a position yet.
+		void reserve_anaglyph_if_needed();
 
 		// Some properties are shared between the two players, and to be set in
 		// this node. This copies that data over to the child nodes.
@@ -79,8 +235,34 @@ namespace godot {
 
 		void finish_signal();
 
+		// Remembers when the sound we're about to play ends.
+		void track_oneshot_voice();
+		// How many of our oneshot sounds are still going.
+		int count_oneshot_voices();
+		// Plays a oneshot as an extra voice on top of what we're playing.
+		// Oneshots start out with a single voice, so this switches us over
+		// to polyphony first.
+		void add_oneshot_voice(int polyphony);
+
+		// The node oneshots are added under, or nullptr (with an error) if
+		// oneshots can't be played right now.
+		static Node* get_oneshot_parent(const Ref<AudioStream>& stream);
+		// The part of `play_oneshot()` that has to happen for every sound.
+		// Returns the node it plays on, or nullptr if it doesn't need one (or
+		// got dropped).
+		static AudioStreamPlayerAnaglyph* start_oneshot(
+			Node* parent,
+			const Ref<AudioStream>& stream,
+			const Vector3& global_position,
+			float volume_db,
+			const Ref<AnaglyphEffectData>& anaglyph_settings,
+			const StringName& bus,
+			const AnaglyphRenderCache::Batch& cache_batch
+		);
+
 		bool try_add_children();
 		void enter_tree();
+		void exit_tree();
 		void ready();
 		void process();
 
@@ -132,6 +314,9 @@ namespace godot {
 		void set_autoplay(bool autoplay);
 		bool get_autoplay() const;
 
+		void set_max_polyphony(int voices);
+		int get_max_polyphony() const;
+
 		void set_bus(const StringName& bus);
 		StringName get_bus() const;
 
@@ -139,9 +324,29 @@ namespace godot {
 		void set_max_anaglyph_range(float meters);
 		float get_max_anaglyph_range() const;
 
+		void set_max_panner_range(float meters);
+		float get_max_panner_range() const;
+
+		void set_mid_tier(MidTier tier);
+		MidTier get_mid_tier() const;
+
+		void set_range_hysteresis(float meters);
+		float get_range_hysteresis() const;
+
+		void set_prewarm_time(float seconds);
+		float get_prewarm_time() const;
+		void set_transition_time(float seconds);
+		float get_transition_time() const;
+
+		void set_virtual_threshold_db(float volume);
+		float get_virtual_threshold_db() const;
+
 		void set_forcing(ForceStream forcing);
 		ForceStream get_forcing() const;
 
+		void set_bus_reuse(BusReuse reuse);
+		BusReuse get_bus_reuse() const;
+
 		void set_anaglyph_data(Ref<AnaglyphEffectData> anaglyph_data);
 		Ref<AnaglyphEffectData> get_anaglyph_data() const;
 
@@ -163,6 +368,62 @@ namespace godot {
 
 		static void prepare_anaglyph_buses(int count);
 
+		static void set_max_panner_buses(int count);
+		static int get_max_panner_buses();
+
+		static void set_max_ambisonic_buses(int count);
+		static int get_max_ambisonic_buses();
+		// The order of the shared ambisonic mix, 1 through 3. Higher is
+		// sharper, but every ambisonic source costs more.
+		static void set_ambisonic_order(int order);
+		static int get_ambisonic_order();
+		// Where the decoded ambisonic mix goes.
+		static void set_ambisonic_output_bus(const StringName& bus);
+		static StringName get_ambisonic_output_bus();
+
+		// Whether Anaglyph buses share one reverb per room (see
+		// `AnaglyphRoomEffect`), instead of each doing their own.
+		static void set_shared_reverb(bool shared);
+		static bool get_shared_reverb();
+		static void set_max_room_buses(int count);
+		static int get_max_room_buses();
+
+		// The angle within which sources share an Anaglyph bus, placed at
+		// their centroid. Zero disables this.
+		static void set_cluster_tolerance(float degrees);
+		static float get_cluster_tolerance();
+
+		// `play_oneshot()` reuses up to this many nodes.
+		static void set_oneshot_pool_size(int size);
+		static int get_oneshot_pool_size();
+		static void set_oneshot_overflow(OneshotOverflow overflow);
+		static OneshotOverflow get_oneshot_overflow();
+		// Oneshots this close to a playing one with the same stream, volume,
+		// settings, and bus become an extra voice of that one instead.
+		static void set_oneshot_merge_distance(float meters);
+		static float get_oneshot_merge_distance();
+		static void set_oneshot_polyphony(int voices);
+		static int get_oneshot_polyphony();
+		// Oneshots that `AnaglyphRenderCache` can handle are rendered once
+		// per position and settings, and played from memory after that.
+		// A size of 0 (the default) disables this.
+		static void set_oneshot_cache_size(int64_t bytes);
+		static int64_t get_oneshot_cache_size();
+		static int64_t get_oneshot_cache_usage();
+		static void set_oneshot_cache_angle_step(float degrees);
+		static float get_oneshot_cache_angle_step();
+		static void set_oneshot_cache_distance_step(float meters);
+		static float get_oneshot_cache_distance_step();
+		static void clear_oneshot_cache();
+
+		// Extrapolates positions forward by the audio latency, so that moving
+		// sounds line up with what's on screen. See AnaglyphPositionServer.
+		static void set_latency_compensation(bool enabled);
+		static bool get_latency_compensation();
+		static void set_extra_latency(float seconds);
+		static float get_extra_latency();
+		static float get_compensated_latency();
+
 		// Plays a stream once at a position by instantiating a node at the
 		// root of the active scene, and deleting it once it's done.
 		static void play_oneshot(
@@ -172,9 +433,22 @@ namespace godot {
 			Ref<AnaglyphEffectData> anaglyph_settings = nullptr,
 			StringName bus = "Master"
 		);
+		// The same as calling `play_oneshot()` for every position, but with
+		// the lookups only done once. `volumes_db` may be empty (all 0dB) or
+		// have a volume per position.
+		static void play_oneshots(
+			Ref<AudioStream> stream,
+			PackedVector3Array global_positions,
+			PackedFloat32Array volumes_db = PackedFloat32Array(),
+			Ref<AnaglyphEffectData> anaglyph_settings = nullptr,
+			StringName bus = "Master"
+		);
 	};
 }
 
 VARIANT_ENUM_CAST(AudioStreamPlayerAnaglyph::ForceStream);
+VARIANT_ENUM_CAST(AudioStreamPlayerAnaglyph::BusReuse);
+VARIANT_ENUM_CAST(AudioStreamPlayerAnaglyph::MidTier);
+VARIANT_ENUM_CAST(AudioStreamPlayerAnaglyph::OneshotOverflow);
 
 #endif //GDANAGLYPH_PLAYER
\ No newline at end of file
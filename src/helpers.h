@@ -31,23 +31,31 @@ namespace godot {
 		// Returns in the Vector3 the azimuth [x], elevation [y], and distance [z]
 		// so that their respective getters/setters can use them.
 		static Vector3 calculate_polar_position(Node3D* audio_source, Node3D* audio_listener) {
-			// World-space difference between the two sources
-			Vector3 global_delta
-				= audio_source->get_global_position()
-				- audio_listener->get_global_position();
-
 			// Rotate into camera... microphone?-space.
 			// "Basis" is the 3x3 rotation/scaling part of the transform.
 			// We only want to invert the rotational part, so grab the quaternion
-			// separately and apply the inverse ("xform_inv"...?) to our global.
+			// separately and apply the inverse to our global.
 			// The docs note the quaternion must be normalized, but surely it's
 			// normalized if the source is a transform?
+			Quaternion quat = audio_listener->get_global_basis().get_rotation_quaternion();
+			return calculate_polar_position(
+				audio_source->get_global_position(),
+				audio_listener->get_global_position(),
+				quat.inverse()
+			);
+		}
+
+		// Same as above, but with the listener already decomposed. When many
+		// sources share a listener, this saves recalculating its rotation
+		// for each of them.
+		static Vector3 calculate_polar_position(const Vector3& source_position, const Vector3& listener_position, const Quaternion& listener_inverse_rotation) {
+			// World-space difference between the two sources
+			Vector3 global_delta = source_position - listener_position;
 
 			// Note that we also need to take into account different handedness.
 			// This is effectively a flip in local space.
 			// (idk i didn't think too long about this it *sounds*/behaves correctly)
-			Quaternion quat = audio_listener->get_global_basis().get_rotation_quaternion();
-			Vector3 relative_pos = quat.xform_inv(global_delta);
+			Vector3 relative_pos = listener_inverse_rotation.xform(global_delta);
 			relative_pos.z *= -1;
 
 			// Now the usual "from cartesian to polar coords".
@@ -1,4 +1,14 @@
+#include "anaglyph_ambisonic_effect.h"
+#include "anaglyph_bus_manager.h"
 #include "anaglyph_export_plugin.h"
+#include "anaglyph_listener_registry.h"
+#include "anaglyph_offline_renderer.h"
+#include "anaglyph_oneshot_pool.h"
+#include "anaglyph_panner_effect.h"
+#include "anaglyph_position_server.h"
+#include "anaglyph_render_cache.h"
+#include "anaglyph_room_effect.h"
+#include "audio_stream_anaglyph.h"
 #include "audio_stream_player_anaglyph.h"
 #include "anaglyph_dll_bridge.h"
 #include "anaglyph_effect.h"
@@ -23,13 +33,33 @@ void initialize_gdanaglyph_module(ModuleInitializationLevel p_level) {
 		GDREGISTER_CLASS(AnaglyphEffectData);
 		GDREGISTER_CLASS(AnaglyphEffect);
 		GDREGISTER_CLASS(AnaglyphEffectInstance);
+		GDREGISTER_CLASS(AnaglyphPannerEffect);
+		GDREGISTER_CLASS(AnaglyphPannerEffectInstance);
+		GDREGISTER_CLASS(AnaglyphAmbisonicEncoderEffect);
+		GDREGISTER_CLASS(AnaglyphAmbisonicEncoderEffectInstance);
+		GDREGISTER_CLASS(AnaglyphAmbisonicDecoderEffect);
+		GDREGISTER_CLASS(AnaglyphAmbisonicDecoderEffectInstance);
+		GDREGISTER_CLASS(AnaglyphRoomEffect);
+		GDREGISTER_CLASS(AnaglyphRoomEffectInstance);
 		GDREGISTER_CLASS(AudioStreamPlayerAnaglyph);
+		GDREGISTER_CLASS(AnaglyphOfflineRenderer);
+		GDREGISTER_CLASS(AudioStreamAnaglyph);
+		GDREGISTER_CLASS(AudioStreamPlaybackAnaglyph);
 
 		// Might as well load the dll at the start.
 		// Note that we won't unload the dll at any point. Let it be cleaned up
 		// together with the entire program.
 		// TODO: Godot doesn't seem to print any debug data on load.
+		AnaglyphBridge::register_project_settings();
 		AnaglyphBridge::GetEffectData();
+
+		// Create the bus manager here on the main thread, instead of lazily
+		// from whatever (possibly threaded) node first needs it.
+		AnaglyphBusManager::get_singleton();
+		AnaglyphListenerRegistry::get_singleton();
+		AnaglyphPositionServer::get_singleton();
+		AnaglyphOneshotPool::get_singleton();
+		AnaglyphRenderCache::get_singleton();
 	}
 
 }
@@ -38,6 +68,11 @@ void uninitialize_gdanaglyph_module(ModuleInitializationLevel p_level) {
 	if (p_level != MODULE_INITIALIZATION_LEVEL_SCENE) {
 		return;
 	}
+	AnaglyphBusManager::free_singleton();
+	AnaglyphListenerRegistry::free_singleton();
+	AnaglyphPositionServer::free_singleton();
+	AnaglyphOneshotPool::free_singleton();
+	AnaglyphRenderCache::free_singleton();
 }
 
 extern "C" {
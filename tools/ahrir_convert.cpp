@@ -0,0 +1,141 @@
+// Converts HRTF datasets into the .ahrir files the native backend maps
+// (see `AnaglyphHRIRFile`). This is not part of the extension. Build with
+//   g++ -O2 -Isrc tools/ahrir_convert.cpp src/anaglyph_hrir.cpp src/anaglyph_hrir_file.cpp -o ahrir_convert
+// To also read .sofa files, have libmysofa installed and add
+//   -DGDANAGLYPH_MYSOFA -lmysofa
+// Usage:
+//   ahrir_convert [--rate=48000] [--partition=128] <input.sofa | --spherical> <output.ahrir>
+// Godot mixes at 44100 or 48000 depending on the project, so you probably
+// want a file for the rate your project uses. The backend only picks files
+// that match the mix rate.
+//
+// To convert the models that come with Anaglyph, e.g.
+//   for f in Anaglyph/anaglyph_plugin_data/*.sofa; do
+//       ahrir_convert --rate=48000 "$f" "Anaglyph/native_hrir/$(basename "$f" .sofa).ahrir"
+//   done
+
+#include "anaglyph_hrir.h"
+#include "anaglyph_hrir_file.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef GDANAGLYPH_MYSOFA
+#include <mysofa.h>
+#endif
+
+using namespace godot;
+
+#ifdef GDANAGLYPH_MYSOFA
+static const float RAD2DEG = 57.2957795f;
+
+// The native backend adds its own ITD, so measured IRs need theirs removed.
+// This shifts an IR so its onset (the first sample reaching 10% of the peak)
+// lands on sample `target`.
+static void align_onset(std::vector<float>& ir, int target) {
+	float peak = 0;
+	for (size_t i = 0; i < ir.size(); i++) {
+		peak = fmaxf(peak, fabsf(ir[i]));
+	}
+	int onset = 0;
+	while (onset < (int)ir.size() && fabsf(ir[onset]) < 0.1f * peak) {
+		onset++;
+	}
+	int shift = onset - target;
+	std::vector<float> shifted(ir.size(), 0);
+	for (int i = 0; i < (int)ir.size(); i++) {
+		int source = i + shift;
+		if (source >= 0 && source < (int)ir.size()) {
+			shifted[i] = ir[source];
+		}
+	}
+	ir = shifted;
+}
+
+static AnaglyphHRIRSet* load_sofa(const char* path, float rate) {
+	int filter_length = 0;
+	int err = 0;
+	// This also resamples to `rate` and normalizes loudness.
+	MYSOFA_EASY* easy = mysofa_open(path, rate, &filter_length, &err);
+	if (easy == nullptr) {
+		fprintf(stderr, "Could not read %s (libmysofa error %d).\n", path, err);
+		return nullptr;
+	}
+	MYSOFA_HRTF* hrtf = easy->hrtf;
+	int count = hrtf->M;
+	int length = hrtf->N;
+	AnaglyphHRIRSet* set = new AnaglyphHRIRSet();
+	set->init(rate, length, count);
+	std::vector<float> left(length);
+	std::vector<float> right(length);
+	for (int m = 0; m < count; m++) {
+		// mysofa_open converts positions to cartesian: x front, y left, z up.
+		const float* pos = hrtf->SourcePosition.values + m * 3;
+		float azimuth = atan2f(-pos[1], pos[0]) * RAD2DEG;
+		float elevation = atan2f(pos[2], sqrtf(pos[0] * pos[0] + pos[1] * pos[1])) * RAD2DEG;
+		const float* ir = hrtf->DataIR.values + (size_t)m * hrtf->R * length;
+		left.assign(ir, ir + length);
+		right.assign(ir + length, ir + 2 * length);
+		align_onset(left, 2);
+		align_onset(right, 2);
+		set->set_direction(m, azimuth, elevation, left.data(), right.data());
+	}
+	mysofa_close(easy);
+	return set;
+}
+#endif
+
+int main(int argc, char** argv) {
+	float rate = 48000;
+	int partition_size = 128;
+	bool spherical = false;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--rate=", 7) == 0) {
+			rate = (float)atof(argv[i] + 7);
+		}
+		else if (strncmp(argv[i], "--partition=", 12) == 0) {
+			partition_size = atoi(argv[i] + 12);
+		}
+		else if (strcmp(argv[i], "--spherical") == 0) {
+			spherical = true;
+		}
+		else {
+			files.push_back(argv[i]);
+		}
+	}
+	if (files.size() != (spherical ? 1u : 2u) || rate <= 0 || partition_size < 16 || (partition_size & (partition_size - 1)) != 0) {
+		fprintf(stderr, "Usage: %s [--rate=48000] [--partition=128] <input.sofa | --spherical> <output.ahrir>\n", argv[0]);
+		fprintf(stderr, "The partition size must be a power of two of at least 16.\n");
+		return 1;
+	}
+
+	AnaglyphHRIRSet* set = nullptr;
+	if (spherical) {
+		set = AnaglyphHRIRSet::generate_spherical_head(rate, 0.0875f);
+	}
+	else {
+#ifdef GDANAGLYPH_MYSOFA
+		set = load_sofa(files[0].c_str(), rate);
+#else
+		fprintf(stderr, "This build can't read .sofa files. Rebuild with -DGDANAGLYPH_MYSOFA -lmysofa.\n");
+#endif
+	}
+	if (set == nullptr) {
+		return 1;
+	}
+
+	std::string error;
+	if (!AnaglyphHRIRFile::save(*set, partition_size, files.back(), error)) {
+		fprintf(stderr, "Could not write %s: %s\n", files.back().c_str(), error.c_str());
+		delete set;
+		return 1;
+	}
+	printf("Wrote %s: %d directions, %d taps at %.0f Hz.\n", files.back().c_str(), set->get_direction_count(), set->get_ir_length(), rate);
+	delete set;
+	return 0;
+}